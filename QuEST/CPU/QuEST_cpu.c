@@ -17,6 +17,7 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <assert.h>
+# include <time.h>
 
 # ifdef _OPENMP
 # include <omp.h>
@@ -33,309 +34,398 @@ static int extractBit (const int locationOfBitFromRight, const long long int the
     return (theEncodedNumber & ( 1LL << locationOfBitFromRight )) >> locationOfBitFromRight;
 }
 
-void densmatr_oneQubitDephase(Qureg qureg, const int targetQubit, qreal dephase) {
-        qreal retain=1-dephase;
-    
-        const long long int numTasks = qureg.numAmpsPerChunk;
-        long long int innerMask = 1LL << targetQubit;
-        long long int outerMask = 1LL << (targetQubit + (qureg.numQubitsRepresented));
-    
-        long long int thisTask;
-        long long int thisPattern;
-        long long int totMask = innerMask|outerMask;
+/** The number of threads among which a kernel divides the local amplitudes of qureg: every
+ * available thread, up to the register's cap, such that each receives at least
+ * minAmpsPerThread amplitudes. A result of 1 runs the kernel without forking any threads.
+ */
+int getNumKernelThreads(Qureg qureg)
+{
+    int numThreads = 1;
+# ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+    if (qureg.policy.maxThreads > 0 && qureg.policy.maxThreads < numThreads)
+        numThreads = qureg.policy.maxThreads;
+    if (qureg.policy.minAmpsPerThread > 0 && qureg.numAmpsPerChunk / qureg.policy.minAmpsPerThread < numThreads)
+        numThreads = (int) (qureg.numAmpsPerChunk / qureg.policy.minAmpsPerThread);
+    if (numThreads < 1)
+        numThreads = 1;
+# endif
+    return numThreads;
+}
 
- # ifdef _OPENMP
+# ifdef _OPENMP
+/** The time to apply numSweeps Hadamard-like sweeps over the numAmps amplitudes (re, im), each
+ * sweep within its own parallel region of numThreads threads, as a kernel would run them.
+ */
+static double timeTuningSweeps(qreal* re, qreal* im, long long int numAmps, int numSweeps, int numThreads)
+{
+    long long int index;
+    qreal upRe, upIm, loRe, loIm;
+    qreal fac = 1/sqrt(2);
+
+    double start = omp_get_wtime();
+    for (int s=0; s < numSweeps; s++) {
 # pragma omp parallel \
+    num_threads (numThreads) \
     default  (none) \
-    shared   (innerMask,outerMask,totMask,qureg,retain) \
-    private  (thisTask,thisPattern) 
-# endif
-    {
-# ifdef _OPENMP
+    shared   (re,im, numAmps, fac) \
+    private  (index, upRe,upIm,loRe,loIm)
+        {
 # pragma omp for schedule (static)
+            for (index=0; index<numAmps; index+=2) {
+                upRe = re[index];   upIm = im[index];
+                loRe = re[index+1]; loIm = im[index+1];
+                re[index]   = fac*(upRe + loRe); im[index]   = fac*(upIm + loIm);
+                re[index+1] = fac*(upRe - loRe); im[index+1] = fac*(upIm - loIm);
+            }
+        }
+    }
+    return omp_get_wtime() - start;
+}
 # endif
-        for (thisTask=0; thisTask<numTasks; thisTask++){
-            thisPattern = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMask;
-            if ((thisPattern==innerMask) || (thisPattern==outerMask)){
-                // do dephase
-                // the lines below will degrade the off-diagonal terms |..0..><..1..| and |..1..><..0..|
-                qureg.stateVec.real[thisTask] = retain*qureg.stateVec.real[thisTask]; 
-                qureg.stateVec.imag[thisTask] = retain*qureg.stateVec.imag[thisTask]; 
-            } 
-        }  
+
+/** Finds the fewest amplitudes for which a Hadamard-like sweep is faster divided among every
+ * thread than upon one, doubling from 2^8, and gives each thread its share of that many. The
+ * result is clamped to [2^6, 2^20]; a machine on which threads never help (e.g. a single core)
+ * thus keeps all but the largest registers serial.
+ */
+static ExecPolicy getTunedExecPolicy(void)
+{
+    ExecPolicy policy;
+    policy.maxThreads = 0;
+    policy.minAmpsPerThread = 0;
+# ifdef _OPENMP
+    int numThreads = omp_get_max_threads();
+    if (numThreads == 1)
+        return policy;
+
+    const long long int maxAmps = 1LL << 20;
+    qreal *re = malloc(maxAmps * sizeof *re);
+    qreal *im = malloc(maxAmps * sizeof *im);
+    if (re == NULL || im == NULL) {
+        free(re);
+        free(im);
+        return policy;
+    }
+    for (long long int index=0; index<maxAmps; index++) {
+        re[index] = 1;
+        im[index] = 0;
+    }
+
+    // the first region creates the thread pool, so is not compared
+    timeTuningSweeps(re, im, maxAmps, 1, numThreads);
+
+    long long int numAmps;
+    for (numAmps = 1LL << 8; numAmps < maxAmps; numAmps <<= 1) {
+        int numSweeps = (int) ((1LL << 18) / numAmps) + 1;
+        double serialTime = timeTuningSweeps(re, im, numAmps, numSweeps, 1);
+        double parallelTime = timeTuningSweeps(re, im, numAmps, numSweeps, numThreads);
+        if (parallelTime < serialTime)
+            break;
     }
+    free(re);
+    free(im);
+
+    long long int minAmps = numAmps / numThreads;
+    if (numAmps == maxAmps)
+        minAmps = maxAmps;
+    policy.minAmpsPerThread = (minAmps < (1LL << 6))? (1LL << 6) : minAmps;
+# endif
+    return policy;
 }
 
-void densmatr_twoQubitDephase(Qureg qureg, const int qubit1, const int qubit2, qreal dephase) {
-    qreal retain=1-dephase;
+ExecPolicy getEnvExecPolicy(int isTuned)
+{
+    if (isTuned)
+        return getTunedExecPolicy();
 
-    const long long int numTasks = qureg.numAmpsPerChunk;
-    long long int innerMaskQubit1 = 1LL << qubit1;
-    long long int outerMaskQubit1 = 1LL << (qubit1 + (qureg.numQubitsRepresented));
-    long long int innerMaskQubit2 = 1LL << qubit2;
-    long long int outerMaskQubit2 = 1LL << (qubit2 + (qureg.numQubitsRepresented));
-    long long int totMaskQubit1 = innerMaskQubit1|outerMaskQubit1;
-    long long int totMaskQubit2 = innerMaskQubit2|outerMaskQubit2;
+    ExecPolicy policy;
+    policy.maxThreads = 0;
+    policy.minAmpsPerThread = DEFAULT_MIN_AMPS_PER_THREAD;
+    return policy;
+}
 
-    long long int thisTask;
-    long long int thisPatternQubit1, thisPatternQubit2;
+/** Measures the best of a few sweeps of the triad a[i] = a[i] + s*b[i] over numAmps amplitudes (two 
+ * arrays read, one written) by every thread, and returns the bytes moved per second. The arrays are 
+ * first touched by the same static schedule as the sweeps, as a register's are by initZeroState, so 
+ * each thread streams the pages it placed; with pinned threads this is the bandwidth kernels achieve.
+ * Returns 0 if the arrays cannot be allocated.
+ */
+double measureMemoryBandwidth(long long int numAmps)
+{
+    const int numSweeps = 4;
+    long long int index;
+    qreal fac = 0.5;
+    qreal *a = malloc(numAmps * sizeof *a);
+    qreal *b = malloc(numAmps * sizeof *b);
+    if (a == NULL || b == NULL) {
+        free(a);
+        free(b);
+        return 0;
+    }
 
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (innerMaskQubit1,outerMaskQubit1,totMaskQubit1,innerMaskQubit2,outerMaskQubit2, \
-                totMaskQubit2,qureg,retain) \
-    private  (thisTask,thisPatternQubit1,thisPatternQubit2) 
+    shared   (a,b, numAmps) \
+    private  (index)
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (thisTask=0; thisTask<numTasks; thisTask++){
-            thisPatternQubit1 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit1;
-            thisPatternQubit2 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit2;
-            
-            // any mismatch |...0...><...1...| etc
-            if ( (thisPatternQubit1==innerMaskQubit1) || (thisPatternQubit1==outerMaskQubit1) || 
-                    (thisPatternQubit2==innerMaskQubit2) || (thisPatternQubit2==outerMaskQubit2) ){ 
-                // do dephase
-                // the lines below will degrade the off-diagonal terms |..0..><..1..| and |..1..><..0..|
-                qureg.stateVec.real[thisTask] = retain*qureg.stateVec.real[thisTask]; 
-                qureg.stateVec.imag[thisTask] = retain*qureg.stateVec.imag[thisTask]; 
-            } 
-        }  
+        for (index=0; index<numAmps; index++) {
+            a[index] = 1;
+            b[index] = 1;
+        }
     }
-}
-
-void densmatr_oneQubitDepolariseLocal(Qureg qureg, const int targetQubit, qreal depolLevel) {
-    qreal retain=1-depolLevel;
 
-    const long long int numTasks = qureg.numAmpsPerChunk;
-    long long int innerMask = 1LL << targetQubit;
-    long long int outerMask = 1LL << (targetQubit + (qureg.numQubitsRepresented));
-    long long int totMask = innerMask|outerMask;
-
-    long long int thisTask;
-    long long int partner;
-    long long int thisPattern;
-
-    qreal realAv, imagAv;
-        
+    double bestTime = -1;
+    for (int s=0; s < numSweeps; s++) {
 # ifdef _OPENMP
+        double start = omp_get_wtime();
 # pragma omp parallel \
     default  (none) \
-    shared   (innerMask,outerMask,totMask,qureg,retain,depolLevel) \
-    private  (thisTask,partner,thisPattern,realAv,imagAv) 
+    shared   (a,b, numAmps, fac) \
+    private  (index)
+# else
+        clock_t start = clock();
 # endif
-    {
+        {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (thisTask=0; thisTask<numTasks; thisTask++){
-            thisPattern = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMask;
-            if ((thisPattern==innerMask) || (thisPattern==outerMask)){
-                // do dephase
-                // the lines below will degrade the off-diagonal terms |..0..><..1..| and |..1..><..0..|
-                qureg.stateVec.real[thisTask] = retain*qureg.stateVec.real[thisTask]; 
-                qureg.stateVec.imag[thisTask] = retain*qureg.stateVec.imag[thisTask]; 
-            } else {
-                if ((thisTask&totMask)==0){ //this element relates to targetQubit in state 0
-                    // do depolarise
-                    partner = thisTask | totMask;
-                    realAv =  (qureg.stateVec.real[thisTask] + qureg.stateVec.real[partner]) /2 ;
-                    imagAv =  (qureg.stateVec.imag[thisTask] + qureg.stateVec.imag[partner]) /2 ;
-                    
-                    qureg.stateVec.real[thisTask] = retain*qureg.stateVec.real[thisTask] + depolLevel*realAv;
-                    qureg.stateVec.imag[thisTask] = retain*qureg.stateVec.imag[thisTask] + depolLevel*imagAv;
-                    
-                    qureg.stateVec.real[partner] = retain*qureg.stateVec.real[partner] + depolLevel*realAv;
-                    qureg.stateVec.imag[partner] = retain*qureg.stateVec.imag[partner] + depolLevel*imagAv;
-                }
-            }
-        }  
+            for (index=0; index<numAmps; index++)
+                a[index] = a[index] + fac*b[index];
+        }
+# ifdef _OPENMP
+        double time = omp_get_wtime() - start;
+# else
+        double time = (clock() - start) / (double) CLOCKS_PER_SEC;
+# endif
+        if (bestTime < 0 || time < bestTime)
+            bestTime = time;
     }
-}
+    free(a);
+    free(b);
 
-void densmatr_oneQubitDepolariseDistributed(Qureg qureg, const int targetQubit, qreal depolLevel) {
-
-    // first do dephase part. 
-    // TODO -- this might be more efficient to do at the same time as the depolarise if we move to
-    // iterating over all elements in the state vector for the purpose of vectorisation
-    // TODO -- if we keep this split, move this function to densmatr_oneQubitDepolarise()
-    densmatr_oneQubitDephase(qureg, targetQubit, depolLevel);
-
-    long long int sizeInnerBlock, sizeInnerHalfBlock;
-    long long int sizeOuterColumn, sizeOuterHalfColumn;
-    long long int thisInnerBlock, // current block
-         thisOuterColumn, // current column in density matrix
-         thisIndex,    // current index in (density matrix representation) state vector
-         thisIndexInOuterColumn,
-         thisIndexInInnerBlock; 
-    int outerBit; 
+    if (bestTime <= 0)
+        return 0;
+    return 3 * numAmps * sizeof(qreal) / bestTime;
+}
 
-    long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+/** Classifies the amplitudes of this chunk by the row and column bits of the given qubits, so that
+ * noise kernels visit each affected class directly rather than testing every amplitude's pattern.
+ * The row and column bits which lie within the chunk are written (ascending) to localBits, and their
+ * number returned. Each task of a kernel then inserts zeros at localBits to find its base index.
+ * The offsets from that base of the amplitudes whose row and column differ in any of the qubits
+ * (the off-diagonal classes) are written to offOffsets, and of those which agree in every qubit
+ * (the diagonal classes) to diagOffsets. Bits beyond the chunk are fixed by its chunkId.
+ */
+static int getNoiseIndexClasses(Qureg qureg, int* qubits, const int numQubits, int* localBits,
+    long long int* offOffsets, int* numOff, long long int* diagOffsets, int* numDiag)
+{
+    int shift = qureg.numQubitsRepresented;
+    long long int chunkOffset = qureg.chunkId*qureg.numAmpsPerChunk;
+    int numLocal = 0;
+    
+    // gather and insertion-sort the local row and column bits
+    for (int q=0; q < numQubits; q++) {
+        int bits[2] = {qubits[q], qubits[q] + shift};
+        for (int b=0; b < 2; b++) {
+            if ((1LL << bits[b]) >= qureg.numAmpsPerChunk)
+                continue;
+            int i = numLocal++;
+            while (i > 0 && localBits[i-1] > bits[b]) {
+                localBits[i] = localBits[i-1];
+                i--;
+            }
+            localBits[i] = bits[b];
+        }
+    }
+    
+    *numOff = 0;
+    *numDiag = 0;
+    for (long long int combo=0; combo < (1LL << numLocal); combo++) {
+        long long int offset = 0;
+        for (int b=0; b < numLocal; b++)
+            if ((combo >> b) & 1)
+                offset |= 1LL << localBits[b];
+        
+        long long int globalInd = offset + chunkOffset;
+        int isDiag = 1;
+        for (int q=0; q < numQubits; q++)
+            if (extractBit(qubits[q], globalInd) != extractBit(qubits[q] + shift, globalInd))
+                isDiag = 0;
+        
+        if (isDiag)
+            diagOffsets[(*numDiag)++] = offset;
+        else
+            offOffsets[(*numOff)++] = offset;
+    }
+    return numLocal;
+}
 
-    // set dimensions
-    sizeInnerHalfBlock = 1LL << targetQubit;  
-    sizeInnerBlock = 2LL * sizeInnerHalfBlock; 
-    sizeOuterColumn = 1LL << qureg.numQubitsRepresented;
-    sizeOuterHalfColumn = sizeOuterColumn >> 1;
+/** Dephases the given qubits, scaling by retain every amplitude whose row and column differ in any of
+ * them, and when depolLevel is non-zero also depolarises them, mixing the amplitudes whose row and 
+ * column agree in every qubit toward their mean. This is done in a single pass which visits only the
+ * affected index classes: each task takes one block of amplitudes differing only in the local row and 
+ * column bits, as contiguous runs below the lowest of those bits, so the innermost loops are unit-stride. 
+ * Dephasing is valid for any chunk distribution, but depolarising requires all bits within this chunk.
+ */
+static void densmatr_mixQubits(Qureg qureg, int* qubits, const int numQubits, qreal retain, qreal depolLevel) {
+    
+    int localBits[4];
+    long long int offOffsets[16], diagOffsets[16];
+    int numOff, numDiag;
+    int numLocal = getNoiseIndexClasses(qureg, qubits, numQubits, localBits, 
+        offOffsets, &numOff, diagOffsets, &numDiag);
+    
+    int doDepol = (depolLevel != 0);
+    if (numOff == 0 && !doDepol)
+        return;
+    
+    long long int runLen = (numLocal > 0)? (1LL << localBits[0]) : qureg.numAmpsPerChunk;
+    long long int numTasks = (qureg.numAmpsPerChunk >> numLocal) / runLen;
+    qreal mixFac = depolLevel / numDiag;
+    
+    long long int thisTask, baseInd, ind;
+    long long int runInd;
+    int b, k;
+    qreal sumRe, sumIm;
+    
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeInnerBlock,sizeInnerHalfBlock,sizeOuterColumn,sizeOuterHalfColumn,qureg,depolLevel) \
-    private  (thisTask,thisInnerBlock,thisOuterColumn,thisIndex,thisIndexInOuterColumn, \
-                thisIndexInInnerBlock,outerBit) 
+    shared   (vecRe,vecIm, retain,mixFac,doDepol, localBits,numLocal, offOffsets,numOff, diagOffsets,numDiag, \
+                runLen,numTasks) \
+    private  (thisTask,baseInd,ind,runInd, b,k, sumRe,sumIm) 
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        // thisTask iterates over half the elements in this process' chunk of the density matrix
-        // treat this as iterating over all columns, then iterating over half the values
-        // within one column.
-        // If this function has been called, this process' chunk contains half an 
-        // outer block or less
         for (thisTask=0; thisTask<numTasks; thisTask++) {
-            // we want to process all columns in the density matrix,
-            // updating the values for half of each column (one half of each inner block)
-            thisOuterColumn = thisTask / sizeOuterHalfColumn;
-            thisIndexInOuterColumn = thisTask&(sizeOuterHalfColumn-1); // thisTask % sizeOuterHalfColumn
-            thisInnerBlock = thisIndexInOuterColumn/sizeInnerHalfBlock;
-            // get index in state vector corresponding to upper inner block
-            thisIndexInInnerBlock = thisTask&(sizeInnerHalfBlock-1); // thisTask % sizeInnerHalfBlock
-            thisIndex = thisOuterColumn*sizeOuterColumn + thisInnerBlock*sizeInnerBlock 
-                + thisIndexInInnerBlock;
-            // check if we are in the upper or lower half of an outer block
-            outerBit = extractBit(targetQubit, (thisIndex+qureg.numAmpsPerChunk*qureg.chunkId)>>qureg.numQubitsRepresented);
-            // if we are in the lower half of an outer block, shift to be in the lower half
-            // of the inner block as well (we want to dephase |0><0| and |1><1| only)
-            thisIndex += outerBit*(sizeInnerHalfBlock);
+            baseInd = thisTask * runLen;
+            for (b=0; b < numLocal; b++)
+                baseInd = ((baseInd >> localBits[b]) << (localBits[b]+1)) | (baseInd & ((1LL << localBits[b])-1));
+            
+            // degrade the off-diagonal terms |..0..><..1..| and |..1..><..0..|
+            for (k=0; k < numOff; k++) {
+                ind = baseInd + offOffsets[k];
+                for (runInd=0; runInd < runLen; runInd++) {
+                    vecRe[ind + runInd] *= retain;
+                    vecIm[ind + runInd] *= retain;
+                }
+            }
+            
+            // mix the diagonal terms toward their mean (diagOffsets[0] is always zero)
+            if (doDepol && numDiag == 2) {
+                for (runInd=0; runInd < runLen; runInd++) {
+                    ind = baseInd + runInd;
+                    sumRe = mixFac*(vecRe[ind] + vecRe[ind + diagOffsets[1]]);
+                    sumIm = mixFac*(vecIm[ind] + vecIm[ind + diagOffsets[1]]);
+                    vecRe[ind] = retain*vecRe[ind] + sumRe;
+                    vecIm[ind] = retain*vecIm[ind] + sumIm;
+                    vecRe[ind + diagOffsets[1]] = retain*vecRe[ind + diagOffsets[1]] + sumRe;
+                    vecIm[ind + diagOffsets[1]] = retain*vecIm[ind + diagOffsets[1]] + sumIm;
+                }
+            }
+            if (doDepol && numDiag == 4) {
+                for (runInd=0; runInd < runLen; runInd++) {
+                    ind = baseInd + runInd;
+                    sumRe = mixFac*(vecRe[ind] + vecRe[ind + diagOffsets[1]] 
+                        + vecRe[ind + diagOffsets[2]] + vecRe[ind + diagOffsets[3]]);
+                    sumIm = mixFac*(vecIm[ind] + vecIm[ind + diagOffsets[1]] 
+                        + vecIm[ind + diagOffsets[2]] + vecIm[ind + diagOffsets[3]]);
+                    for (k=0; k < 4; k++) {
+                        vecRe[ind + diagOffsets[k]] = retain*vecRe[ind + diagOffsets[k]] + sumRe;
+                        vecIm[ind + diagOffsets[k]] = retain*vecIm[ind + diagOffsets[k]] + sumIm;
+                    }
+                }
+            }
+        }
+    }
+}
 
-            // NOTE: at this point thisIndex should be the index of the element we want to 
-            // dephase in the chunk of the state vector on this process, in the 
-            // density matrix representation. 
-            // thisTask is the index of the pair element in pairStateVec
+void densmatr_oneQubitDephase(Qureg qureg, const int targetQubit, qreal dephase) {
+    
+    int qubits[1] = {targetQubit};
+    densmatr_mixQubits(qureg, qubits, 1, 1-dephase, 0);
+}
 
-           
-            // state[thisIndex] = (1-depolLevel)*state[thisIndex] + depolLevel*(state[thisIndex]
-            //      + pair[thisTask])/2
-            qureg.stateVec.real[thisIndex] = (1-depolLevel)*qureg.stateVec.real[thisIndex] +
-                    depolLevel*(qureg.stateVec.real[thisIndex] + qureg.pairStateVec.real[thisTask])/2;
-            
-            qureg.stateVec.imag[thisIndex] = (1-depolLevel)*qureg.stateVec.imag[thisIndex] +
-                    depolLevel*(qureg.stateVec.imag[thisIndex] + qureg.pairStateVec.imag[thisTask])/2;
-        } 
-    }    
+void densmatr_twoQubitDephase(Qureg qureg, const int qubit1, const int qubit2, qreal dephase) {
+    
+    int qubits[2] = {qubit1, qubit2};
+    densmatr_mixQubits(qureg, qubits, 2, 1-dephase, 0);
 }
 
-// @TODO
-void densmatr_twoQubitDepolariseLocal(Qureg qureg, int qubit1, int qubit2, qreal delta, qreal gamma) {
-    const long long int numTasks = qureg.numAmpsPerChunk;
-    long long int innerMaskQubit1 = 1LL << qubit1;
-    long long int outerMaskQubit1= 1LL << (qubit1 + qureg.numQubitsRepresented);
-    long long int totMaskQubit1 = innerMaskQubit1 | outerMaskQubit1;
-    long long int innerMaskQubit2 = 1LL << qubit2;
-    long long int outerMaskQubit2 = 1LL << (qubit2 + qureg.numQubitsRepresented);
-    long long int totMaskQubit2 = innerMaskQubit2 | outerMaskQubit2;
+void densmatr_oneQubitDepolariseLocal(Qureg qureg, const int targetQubit, qreal depolLevel) {
+    
+    int qubits[1] = {targetQubit};
+    densmatr_mixQubits(qureg, qubits, 1, 1-depolLevel, depolLevel);
+}
 
-    long long int thisTask;
-    long long int partner;
-    long long int thisPatternQubit1, thisPatternQubit2;
+/** Depolarises targetQubit when its column bit is within this chunk but its row bit is not. The row bit
+ * is then fixed for the chunk, so half the local amplitudes are off-diagonal and are dephased, while
+ * the other half are mixed with the diagonal amplitudes of the pair chunk, which have been compressed 
+ * into the front of pairStateVec. Both halves are updated in one pass.
+ */
+void densmatr_oneQubitDepolariseDistributed(Qureg qureg, const int targetQubit, qreal depolLevel) {
 
-    qreal real00, imag00;
+    long long int colBit = 1LL << targetQubit;
+    int rowBitIsOne = extractBit(targetQubit + qureg.numQubitsRepresented, qureg.chunkId*qureg.numAmpsPerChunk);
+    long long int diagOffset = rowBitIsOne? colBit : 0;
+    long long int offOffset = rowBitIsOne? 0 : colBit;
+    qreal retain = 1 - depolLevel;
+    qreal mixFac = depolLevel/2;
+
+    long long int thisTask, baseInd, diagInd;
+    long long int numTasks = qureg.numAmpsPerChunk >> 1;
+    
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
+    qreal *pairRe = qureg.pairStateVec.real;
+    qreal *pairIm = qureg.pairStateVec.imag;
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (totMaskQubit1,totMaskQubit2,qureg,delta,gamma) \
-    private  (thisTask,partner,thisPatternQubit1,thisPatternQubit2,real00,imag00) 
+    shared   (vecRe,vecIm,pairRe,pairIm, colBit,diagOffset,offOffset, retain,mixFac, numTasks) \
+    private  (thisTask,baseInd,diagInd) 
 # endif
     {
-
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        //--------------------------------------- STEP ONE ---------------------
-        for (thisTask=0; thisTask<numTasks; thisTask++){ 
-            thisPatternQubit1 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit1;
-            thisPatternQubit2 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit2;
-            if ((thisPatternQubit1==0) && ((thisPatternQubit2==0) 
-                        || (thisPatternQubit2==totMaskQubit2))){ 
-                //this element of form |...X...0...><...X...0...|  for X either 0 or 1.
-                partner = thisTask | totMaskQubit1;
-                real00 =  qureg.stateVec.real[thisTask];
-                imag00 =  qureg.stateVec.imag[thisTask];
-                    
-                qureg.stateVec.real[thisTask] = qureg.stateVec.real[thisTask] 
-                    + delta*qureg.stateVec.real[partner];
-                qureg.stateVec.imag[thisTask] = qureg.stateVec.imag[thisTask] 
-                    + delta*qureg.stateVec.imag[partner];
-                    
-                qureg.stateVec.real[partner] = qureg.stateVec.real[partner] + delta*real00;
-                qureg.stateVec.imag[partner] = qureg.stateVec.imag[partner] + delta*imag00;
-                                
-            }
-        }
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        //--------------------------------------- STEP TWO ---------------------
-        for (thisTask=0; thisTask<numTasks; thisTask++){ 
-            thisPatternQubit1 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit1;
-            thisPatternQubit2 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit2;
-            if ((thisPatternQubit2==0) && ((thisPatternQubit1==0) 
-                        || (thisPatternQubit1==totMaskQubit1))){ 
-                //this element of form |...0...X...><...0...X...|  for X either 0 or 1.
-                partner = thisTask | totMaskQubit2;
-                real00 =  qureg.stateVec.real[thisTask];
-                imag00 =  qureg.stateVec.imag[thisTask];
-                    
-                qureg.stateVec.real[thisTask] = qureg.stateVec.real[thisTask] 
-                    + delta*qureg.stateVec.real[partner];
-                qureg.stateVec.imag[thisTask] = qureg.stateVec.imag[thisTask] 
-                    + delta*qureg.stateVec.imag[partner];
-                    
-                qureg.stateVec.real[partner] = qureg.stateVec.real[partner] + delta*real00;
-                qureg.stateVec.imag[partner] = qureg.stateVec.imag[partner] + delta*imag00;
-
-            }
-        }
-
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        //--------------------------------------- STEP THREE ---------------------
-        for (thisTask=0; thisTask<numTasks; thisTask++){ 
-            thisPatternQubit1 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit1;
-            thisPatternQubit2 = (thisTask+qureg.numAmpsPerChunk*qureg.chunkId)&totMaskQubit2;
-            if ((thisPatternQubit2==0) && ((thisPatternQubit1==0) 
-                        || (thisPatternQubit1==totMaskQubit1))){ 
-                //this element of form |...0...X...><...0...X...|  for X either 0 or 1.
-                partner = thisTask | totMaskQubit2;
-                partner = partner ^ totMaskQubit1;
-                real00 =  qureg.stateVec.real[thisTask];
-                imag00 =  qureg.stateVec.imag[thisTask];
-
-                qureg.stateVec.real[thisTask] = gamma * (qureg.stateVec.real[thisTask] 
-                        + delta*qureg.stateVec.real[partner]);
-                qureg.stateVec.imag[thisTask] = gamma * (qureg.stateVec.imag[thisTask] 
-                        + delta*qureg.stateVec.imag[partner]);
-                    
-                qureg.stateVec.real[partner] = gamma * (qureg.stateVec.real[partner] 
-                        + delta*real00);
-                qureg.stateVec.imag[partner] = gamma * (qureg.stateVec.imag[partner] 
-                        + delta*imag00);
+        // thisTask is also the index of the pair element in pairStateVec
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            baseInd = ((thisTask & ~(colBit-1)) << 1) | (thisTask & (colBit-1));
+            diagInd = baseInd + diagOffset;
+            
+            vecRe[baseInd + offOffset] *= retain;
+            vecIm[baseInd + offOffset] *= retain;
+            
+            // state[diagInd] = (1-depolLevel)*state[diagInd] + depolLevel*(state[diagInd] + pair[thisTask])/2
+            vecRe[diagInd] = retain*vecRe[diagInd] + mixFac*(vecRe[diagInd] + pairRe[thisTask]);
+            vecIm[diagInd] = retain*vecIm[diagInd] + mixFac*(vecIm[diagInd] + pairIm[thisTask]);
+        } 
+    }    
+}
 
-            }
-        }
-    }
+void densmatr_twoQubitDepolariseLocal(Qureg qureg, int qubit1, int qubit2, qreal depolLevel) {
+    
+    int qubits[2] = {qubit1, qubit2};
+    densmatr_mixQubits(qureg, qubits, 2, 1-depolLevel, depolLevel);
 }
 
 void densmatr_twoQubitDepolariseLocalPart1(Qureg qureg, int qubit1, int qubit2, qreal delta) {
-    const long long int numTasks = qureg.numAmpsPerChunk;
+    long long int numTasks = qureg.numAmpsPerChunk;
     long long int innerMaskQubit1 = 1LL << qubit1;
     long long int outerMaskQubit1= 1LL << (qubit1 + qureg.numQubitsRepresented);
     long long int totMaskQubit1 = innerMaskQubit1 | outerMaskQubit1;
@@ -354,8 +444,9 @@ void densmatr_twoQubitDepolariseLocalPart1(Qureg qureg, int qubit1, int qubit2,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (totMaskQubit1,totMaskQubit2,qureg,delta) \
+    shared   (totMaskQubit1,totMaskQubit2,qureg,delta,numTasks) \
     private  (thisTask,partner,thisPatternQubit1,thisPatternQubit2,real00,imag00) 
 # endif
     {
@@ -387,8 +478,8 @@ void densmatr_twoQubitDepolariseLocalPart1(Qureg qureg, int qubit1, int qubit2,
     }
 }
 
-void densmatr_twoQubitDepolariseDistributed(Qureg qureg, const int targetQubit, 
-        const int qubit2, qreal delta, qreal gamma) {
+void densmatr_twoQubitDepolariseDistributed(Qureg qureg, int targetQubit, 
+        int qubit2, qreal delta, qreal gamma) {
 
     long long int sizeInnerBlockQ1, sizeInnerHalfBlockQ1;
     long long int sizeInnerBlockQ2, sizeInnerHalfBlockQ2, sizeInnerQuarterBlockQ2;
@@ -403,7 +494,7 @@ void densmatr_twoQubitDepolariseDistributed(Qureg qureg, const int targetQubit,
     int outerBitQ1, outerBitQ2; 
 
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>2;
+    long long int numTasks=qureg.numAmpsPerChunk>>2;
 
     // set dimensions
     sizeInnerHalfBlockQ1 = 1LL << targetQubit;  
@@ -416,9 +507,10 @@ void densmatr_twoQubitDepolariseDistributed(Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (sizeInnerBlockQ1,sizeInnerHalfBlockQ1,sizeInnerBlockQ2,sizeInnerHalfBlockQ2,sizeInnerQuarterBlockQ2,\
-                sizeOuterColumn,sizeOuterQuarterColumn,qureg,delta,gamma) \
+                sizeOuterColumn,sizeOuterQuarterColumn,qureg,delta,gamma,numTasks,targetQubit,qubit2) \
     private  (thisTask,thisInnerBlockQ2,thisInnerBlockQ1InInnerBlockQ2, \
                 thisOuterColumn,thisIndex,thisIndexInOuterColumn, \
                 thisIndexInInnerBlockQ1,thisIndexInInnerBlockQ2,outerBitQ1,outerBitQ2) 
@@ -478,8 +570,8 @@ void densmatr_twoQubitDepolariseDistributed(Qureg qureg, const int targetQubit,
     }    
 }
 
-void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, const int targetQubit, 
-        const int qubit2, qreal delta, qreal gamma) {
+void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, int targetQubit, 
+        int qubit2, qreal delta, qreal gamma) {
 
     long long int sizeInnerBlockQ1, sizeInnerHalfBlockQ1;
     long long int sizeInnerBlockQ2, sizeInnerHalfBlockQ2, sizeInnerQuarterBlockQ2;
@@ -495,7 +587,7 @@ void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, const int
     int outerBitQ1, outerBitQ2; 
 
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>2;
+    long long int numTasks=qureg.numAmpsPerChunk>>2;
 
     // set dimensions
     sizeInnerHalfBlockQ1 = 1LL << targetQubit;  
@@ -509,9 +601,10 @@ void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, const int
 //# if 0
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (sizeInnerBlockQ1,sizeInnerHalfBlockQ1,sizeInnerBlockQ2,sizeInnerHalfBlockQ2,sizeInnerQuarterBlockQ2,\
-                sizeOuterColumn,sizeOuterQuarterColumn,qureg,delta,gamma) \
+                sizeOuterColumn,sizeOuterQuarterColumn,qureg,delta,gamma,numTasks,targetQubit,qubit2) \
     private  (thisTask,thisInnerBlockQ2,thisInnerBlockQ1InInnerBlockQ2, \
                 thisOuterColumn,thisIndex,thisIndexInPairVector,thisIndexInOuterColumn, \
                 thisIndexInInnerBlockQ1,thisIndexInInnerBlockQ2,outerBitQ1,outerBitQ2) 
@@ -579,11 +672,317 @@ void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, const int
 }
 
 
+/** Multiplies the 2x2 matrix u onto the amplitude pair (up, lo), in place */
+static inline void multiplyMatrixOntoPair(ComplexMatrix2 u, qreal *reUp, qreal *imUp, qreal *reLo, qreal *imLo)
+{
+    qreal ru = *reUp, iu = *imUp;
+    qreal rl = *reLo, il = *imLo;
+    *reUp = u.r0c0.real*ru - u.r0c0.imag*iu + u.r0c1.real*rl - u.r0c1.imag*il;
+    *imUp = u.r0c0.real*iu + u.r0c0.imag*ru + u.r0c1.real*il + u.r0c1.imag*rl;
+    *reLo = u.r1c0.real*ru - u.r1c0.imag*iu + u.r1c1.real*rl - u.r1c1.imag*il;
+    *imLo = u.r1c0.real*iu + u.r1c0.imag*ru + u.r1c1.real*il + u.r1c1.imag*rl;
+}
+
+/** Applies U rho U^dagger for a multi-controlled single-target unitary U, as U (x) conj(U) upon the
+ * flattened density matrix, in a single pass. Each task loads the four amplitudes which differ only in
+ * the target bit (U) and the shifted target bit (conj(U)), and updates them in registers. The control
+ * masks are tested separately for each half of the index, since U and conj(U) are controlled by 
+ * different bits. Requires both target bits to lie within this chunk.
+ */
+void densmatr_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u)
+{
+    int shift = qureg.numQubitsRepresented;
+    long long int targetBit = 1LL << targetQubit;
+    long long int conjTargetBit = 1LL << (targetQubit + shift);
+    long long int conjCtrlMask = ctrlMask << shift;
+    long long int chunkOffset = qureg.chunkId*qureg.numAmpsPerChunk;
+    long long int numTasks = qureg.numAmpsPerChunk >> 2;
+    ComplexMatrix2 uConj = getConjugateMatrix(u);
+    
+    // amps 00, 01, 10, 11 have (conj target bit, target bit) set as labelled
+    long long int thisTask, ind00, ind01, ind10, ind11;
+    int ctrlsOn, conjCtrlsOn;
+    qreal re00,im00, re01,im01, re10,im10, re11,im11;
+    
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (vecRe,vecIm, u,uConj, targetBit,conjTargetBit, ctrlMask,conjCtrlMask, chunkOffset,numTasks) \
+    private  (thisTask, ind00,ind01,ind10,ind11, ctrlsOn,conjCtrlsOn, re00,im00,re01,im01,re10,im10,re11,im11)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            
+            // insert a zero at both target bits (lowest first)
+            ind00 = ((thisTask & ~(targetBit-1)) << 1) | (thisTask & (targetBit-1));
+            ind00 = ((ind00 & ~(conjTargetBit-1)) << 1) | (ind00 & (conjTargetBit-1));
+            
+            ctrlsOn = (ctrlMask == (ctrlMask & (ind00+chunkOffset)));
+            conjCtrlsOn = (conjCtrlMask == (conjCtrlMask & (ind00+chunkOffset)));
+            if (!ctrlsOn && !conjCtrlsOn)
+                continue;
+            
+            ind01 = ind00 | targetBit;
+            ind10 = ind00 | conjTargetBit;
+            ind11 = ind01 | conjTargetBit;
+            
+            re00 = vecRe[ind00]; im00 = vecIm[ind00];
+            re01 = vecRe[ind01]; im01 = vecIm[ind01];
+            re10 = vecRe[ind10]; im10 = vecIm[ind10];
+            re11 = vecRe[ind11]; im11 = vecIm[ind11];
+            
+            if (ctrlsOn) {
+                multiplyMatrixOntoPair(u, &re00,&im00, &re01,&im01);
+                multiplyMatrixOntoPair(u, &re10,&im10, &re11,&im11);
+            }
+            if (conjCtrlsOn) {
+                multiplyMatrixOntoPair(uConj, &re00,&im00, &re10,&im10);
+                multiplyMatrixOntoPair(uConj, &re01,&im01, &re11,&im11);
+            }
+            
+            vecRe[ind00] = re00; vecIm[ind00] = im00;
+            vecRe[ind01] = re01; vecIm[ind01] = im01;
+            vecRe[ind10] = re10; vecIm[ind10] = im10;
+            vecRe[ind11] = re11; vecIm[ind11] = im11;
+        }
+    }
+}
+
+/** As densmatr_multiControlledUnitaryLocal, when the target bit is within this chunk but the shifted
+ * (conj(U)) target bit is not. The chunk pair holding the other value of the shifted target bit has
+ * been exchanged, so that both U and conj(U) are applied in one pass.
+ * @param[in] stateVecUp the chunk in which the shifted target bit is 0
+ * @param[in] stateVecLo the chunk in which the shifted target bit is 1
+ * @param[in] updateUpper whether stateVecOut (this rank's chunk) is stateVecUp, else stateVecLo
+ */
+void densmatr_multiControlledUnitaryDistributed(Qureg qureg, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u,
+        ComplexArray stateVecUp,
+        ComplexArray stateVecLo,
+        ComplexArray stateVecOut,
+        int updateUpper)
+{
+    int shift = qureg.numQubitsRepresented;
+    long long int targetBit = 1LL << targetQubit;
+    long long int conjCtrlMask = ctrlMask << shift;
+    long long int chunkOffset = qureg.chunkId*qureg.numAmpsPerChunk;
+    long long int numTasks = qureg.numAmpsPerChunk >> 1;
+    ComplexMatrix2 uConj = getConjugateMatrix(u);
+    
+    long long int thisTask, ind0, ind1;
+    int ctrlsOn, conjCtrlsOn;
+    qreal re00,im00, re01,im01, re10,im10, re11,im11;
+    
+    qreal *upRe=stateVecUp.real, *upIm=stateVecUp.imag;
+    qreal *loRe=stateVecLo.real, *loIm=stateVecLo.imag;
+    qreal *outRe=stateVecOut.real, *outIm=stateVecOut.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (upRe,upIm,loRe,loIm,outRe,outIm, u,uConj, targetBit, ctrlMask,conjCtrlMask, chunkOffset,numTasks, updateUpper) \
+    private  (thisTask, ind0,ind1, ctrlsOn,conjCtrlsOn, re00,im00,re01,im01,re10,im10,re11,im11)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            
+            ind0 = ((thisTask & ~(targetBit-1)) << 1) | (thisTask & (targetBit-1));
+            ind1 = ind0 | targetBit;
+            
+            ctrlsOn = (ctrlMask == (ctrlMask & (ind0+chunkOffset)));
+            conjCtrlsOn = (conjCtrlMask == (conjCtrlMask & (ind0+chunkOffset)));
+            // stateVecOut is this rank's own chunk, so needs no update
+            if (!ctrlsOn && !conjCtrlsOn)
+                continue;
+            
+            re00 = upRe[ind0]; im00 = upIm[ind0];
+            re01 = upRe[ind1]; im01 = upIm[ind1];
+            re10 = loRe[ind0]; im10 = loIm[ind0];
+            re11 = loRe[ind1]; im11 = loIm[ind1];
+            
+            if (ctrlsOn) {
+                multiplyMatrixOntoPair(u, &re00,&im00, &re01,&im01);
+                multiplyMatrixOntoPair(u, &re10,&im10, &re11,&im11);
+            }
+            if (conjCtrlsOn) {
+                multiplyMatrixOntoPair(uConj, &re00,&im00, &re10,&im10);
+                multiplyMatrixOntoPair(uConj, &re01,&im01, &re11,&im11);
+            }
+            
+            if (updateUpper) {
+                outRe[ind0] = re00; outIm[ind0] = im00;
+                outRe[ind1] = re01; outIm[ind1] = im01;
+            } else {
+                outRe[ind0] = re10; outIm[ind0] = im10;
+                outRe[ind1] = re11; outIm[ind1] = im11;
+            }
+        }
+    }
+}
+
+
+/** Applies a superoperator to the flattened density matrix, upon each block of amplitudes which differ
+ * only in the bits superBits of the index, where superBits[b] is bit b of the superoperator's row and 
+ * column index. Each task takes one block of contiguous runs below the lowest local bit, so that every
+ * amplitude is read and written once. When pairBit is -1, every bit must lie within this chunk. Otherwise 
+ * superBits[pairBit] lies beyond it, with value pairBitValue for this chunk, and pairStateVec must hold
+ * the chunk in which that bit has the other value; only this chunk's amplitudes are then updated.
+ */
+static void densmatr_applySuperoperatorOnBits(Qureg qureg, int* superBits, const int numSuperBits, 
+    qreal* superRe, qreal* superIm, const int pairBit, const int pairBitValue)
+{
+    int superDim = 1 << numSuperBits;
+    int localBits[4];
+    int numLocal = 0;
+    
+    // insertion-sort the local bits
+    for (int b=0; b < numSuperBits; b++) {
+        if (b == pairBit)
+            continue;
+        int i = numLocal++;
+        while (i > 0 && localBits[i-1] > superBits[b]) {
+            localBits[i] = localBits[i-1];
+            i--;
+        }
+        localBits[i] = superBits[b];
+    }
+    
+    // the offset of each element of a block from its base, and whether it's held by the pair chunk
+    long long int offsets[16];
+    int fromPair[16], outInds[16];
+    int numOut = 0;
+    for (int p=0; p < superDim; p++) {
+        offsets[p] = 0;
+        for (int b=0; b < numSuperBits; b++)
+            if (b != pairBit && ((p >> b) & 1))
+                offsets[p] |= 1LL << superBits[b];
+        fromPair[p] = (pairBit >= 0 && ((p >> pairBit) & 1) != pairBitValue);
+        if (!fromPair[p])
+            outInds[numOut++] = p;
+    }
+    
+    long long int runLen = 1LL << localBits[0];
+    long long int numTasks = (qureg.numAmpsPerChunk >> numLocal) / runLen;
+    
+    long long int thisTask, baseInd, ind, runInd;
+    int b, p, q, o;
+    qreal inRe[16], inIm[16];
+    qreal outRe, outIm;
+    
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
+    qreal *pairRe = qureg.pairStateVec.real;
+    qreal *pairIm = qureg.pairStateVec.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (vecRe,vecIm,pairRe,pairIm, superRe,superIm,superDim, localBits,numLocal, \
+                offsets,fromPair,outInds,numOut, runLen,numTasks) \
+    private  (thisTask,baseInd,ind,runInd, b,p,q,o, inRe,inIm, outRe,outIm) 
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            baseInd = thisTask * runLen;
+            for (b=0; b < numLocal; b++)
+                baseInd = ((baseInd >> localBits[b]) << (localBits[b]+1)) | (baseInd & ((1LL << localBits[b])-1));
+            
+            for (runInd=0; runInd < runLen; runInd++) {
+                ind = baseInd + runInd;
+                
+                for (p=0; p < superDim; p++) {
+                    if (fromPair[p]) {
+                        inRe[p] = pairRe[ind + offsets[p]];
+                        inIm[p] = pairIm[ind + offsets[p]];
+                    } else {
+                        inRe[p] = vecRe[ind + offsets[p]];
+                        inIm[p] = vecIm[ind + offsets[p]];
+                    }
+                }
+                
+                for (o=0; o < numOut; o++) {
+                    p = outInds[o];
+                    outRe = 0;
+                    outIm = 0;
+                    for (q=0; q < superDim; q++) {
+                        outRe += superRe[p*superDim + q]*inRe[q] - superIm[p*superDim + q]*inIm[q];
+                        outIm += superRe[p*superDim + q]*inIm[q] + superIm[p*superDim + q]*inRe[q];
+                    }
+                    vecRe[ind + offsets[p]] = outRe;
+                    vecIm[ind + offsets[p]] = outIm;
+                }
+            }
+        }
+    }
+}
+
+void densmatr_applyKrausSuperoperatorLocal(Qureg qureg, int* superBits, const int numSuperBits, qreal* superRe, qreal* superIm) {
+    
+    densmatr_applySuperoperatorOnBits(qureg, superBits, numSuperBits, superRe, superIm, -1, 0);
+}
+
+void densmatr_applyKrausSuperoperatorDistributed(Qureg qureg, int* superBits, const int numSuperBits, 
+    qreal* superRe, qreal* superIm, const int pairBit, const int pairBitValue) 
+{
+    densmatr_applySuperoperatorOnBits(qureg, superBits, numSuperBits, superRe, superIm, pairBit, pairBitValue);
+}
+
+/** Completes swapping bit localBit of the index with a bit beyond this chunk (of value globalBitValue for 
+ * this chunk), after the chunk pair differing in that global bit has been exchanged into pairStateVec.
+ * Amplitudes whose local bit already equals globalBitValue stay, and the rest are taken from the pair.
+ */
+void densmatr_swapBitWithPairChunk(Qureg qureg, const int localBit, const int globalBitValue) {
+    
+    long long int localMask = 1LL << localBit;
+    long long int keepValue = globalBitValue? localMask : 0;
+    long long int numTasks = qureg.numAmpsPerChunk;
+    long long int thisTask;
+    
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
+    qreal *pairRe = qureg.pairStateVec.real;
+    qreal *pairIm = qureg.pairStateVec.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (vecRe,vecIm,pairRe,pairIm, localMask,keepValue, numTasks) \
+    private  (thisTask) 
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            if ((thisTask & localMask) != keepValue) {
+                vecRe[thisTask] = pairRe[thisTask ^ localMask];
+                vecIm[thisTask] = pairIm[thisTask ^ localMask];
+            }
+        }
+    }
+}
+
+
 /* Without nested parallelisation, only the outer most loops which call below are parallelised */
 void zeroSomeAmps(Qureg qureg, long long int startInd, long long int numAmps) {
     
 # ifdef _OPENMP
-# pragma omp parallel for schedule (static)
+# pragma omp parallel for schedule (static) num_threads (getNumKernelThreads(qureg))
 # endif
     for (long long int i=startInd; i < startInd+numAmps; i++) {
         qureg.stateVec.real[i] = 0;
@@ -593,7 +992,7 @@ void zeroSomeAmps(Qureg qureg, long long int startInd, long long int numAmps) {
 void normaliseSomeAmps(Qureg qureg, qreal norm, long long int startInd, long long int numAmps) {
     
 # ifdef _OPENMP
-# pragma omp parallel for schedule (static)
+# pragma omp parallel for schedule (static) num_threads (getNumKernelThreads(qureg))
 # endif
     for (long long int i=startInd; i < startInd+numAmps; i++) {
         qureg.stateVec.real[i] /= norm;
@@ -610,7 +1009,7 @@ void alternateNormZeroingSomeAmpBlocks(
     if (normFirst) {
         
 # ifdef _OPENMP
-# pragma omp parallel for schedule (static) private (blockStartInd)
+# pragma omp parallel for schedule (static) private (blockStartInd) num_threads (getNumKernelThreads(qureg))
 # endif 
         for (long long int dubBlockInd=0; dubBlockInd < numDubBlocks; dubBlockInd++) {
             blockStartInd = startAmpInd + dubBlockInd*2*blockSize;
@@ -620,7 +1019,7 @@ void alternateNormZeroingSomeAmpBlocks(
     } else {
         
 # ifdef _OPENMP
-# pragma omp parallel for schedule (static) private (blockStartInd)
+# pragma omp parallel for schedule (static) private (blockStartInd) num_threads (getNumKernelThreads(qureg))
 # endif 
         for (long long int dubBlockInd=0; dubBlockInd < numDubBlocks; dubBlockInd++) {
             blockStartInd = startAmpInd + dubBlockInd*2*blockSize;
@@ -719,6 +1118,7 @@ qreal densmatr_calcPurityLocal(Qureg qureg) {
     
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (vecRe, vecIm, numAmps) \
     private   (index) \
     reduction ( +:trace )
@@ -750,6 +1150,7 @@ void densmatr_addDensityMatrix(Qureg combineQureg, qreal otherProb, Qureg otherQ
     
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(combineQureg)) \
     default (none) \
     shared  (combineVecRe,combineVecIm,otherVecRe,otherVecIm, otherProb, numAmps) \
     private (index)
@@ -768,125 +1169,373 @@ void densmatr_addDensityMatrix(Qureg combineQureg, qreal otherProb, Qureg otherQ
     }
 }
 
-/** computes a few dens-columns-worth of (vec^*T) dens * vec */
-qreal densmatr_calcFidelityLocal(Qureg qureg, Qureg pureState) {
+/** The number of density matrix rows per block of densmatr_calcFidelityLocal. The block's pure state
+ * amplitudes (16 KiB in double precision) stay in L1 cache while every local column is swept.
+ */
+# define FIDELITY_ROWS_PER_BLOCK 1024
+
+qreal densmatr_calcFidelityLocal(Qureg qureg, Qureg pureState, ComplexArray rowAmps, long long int startRow, long long int numRows) {
         
-    /* Here, elements of pureState are not accessed (instead grabbed from qureg.pair).
-     * We only consult the attributes.
-     *
-     * qureg is a density matrix, and pureState is a statevector.
+    /* qureg is a density matrix, and pureState is a statevector.
      * Every node contains as many columns of qureg as amps by pureState.
      * Ergo, this node contains columns:
      * qureg.chunkID * pureState.numAmpsPerChunk  to
      * (qureg.chunkID + 1) * pureState.numAmpsPerChunk
+     * whose pure state amplitudes are exactly pureState's local amps.
+     *
+     * Only the rows [startRow, startRow + numRows) are summed, with their pure state amplitudes
+     * given by rowAmps, so that a distributed pure state may be consumed slice by slice.
      *
-     * The first pureState.numAmpsTotal elements of qureg.pairStateVec are the
-     * full pure state-vector
+     * The density matrix is column-major, so this computes 
+     * sum_col pureState[col] sum_row conj(pureState[row]) qureg[row][col] 
+     * with the row sums contiguous. Rows are blocked so that each block of pureState is
+     * reused from cache by every column, and the row sums use four independent accumulators
+     * which the compiler can vectorise.
      */
     
     // unpack everything for OPENMP
-    qreal* vecRe  = qureg.pairStateVec.real;
-    qreal* vecIm  = qureg.pairStateVec.imag;
+    qreal* vecRe  = rowAmps.real;
+    qreal* vecIm  = rowAmps.imag;
+    qreal* colRe  = pureState.stateVec.real;
+    qreal* colIm  = pureState.stateVec.imag;
     qreal* densRe = qureg.stateVec.real;
     qreal* densIm = qureg.stateVec.imag;
     
-    int row, col;
-    int dim = pureState.numAmpsTotal;
-    int colsPerNode = pureState.numAmpsPerChunk;
+    long long int dim = pureState.numAmpsTotal;
+    long long int colsPerNode = pureState.numAmpsPerChunk;
+    long long int rowsPerBlock = (numRows < FIDELITY_ROWS_PER_BLOCK)? numRows : FIDELITY_ROWS_PER_BLOCK;
+    long long int blockStart, blockEnd, row, col, colInd;
+    
+    qreal sumRe[4], sumIm[4];
+    qreal colSumRe, colSumIm;
+    int k;
+    
+    // quantity computed by this node
+    qreal globalSumRe = 0;   // imag-component is assumed zero
+    
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default   (none) \
+    shared    (vecRe,vecIm,colRe,colIm,densRe,densIm, dim,colsPerNode,rowsPerBlock,startRow,numRows) \
+    private   (blockStart,blockEnd,row,col,colInd, sumRe,sumIm, colSumRe,colSumIm, k) \
+    reduction ( +:globalSumRe )
+# endif 
+    {
+        for (blockStart=0; blockStart < numRows; blockStart += rowsPerBlock) {
+            blockEnd = blockStart + rowsPerBlock;
+            
+            // every block assigns each thread the same LOCAL columns
+# ifdef _OPENMP
+# pragma omp for schedule (static) nowait
+# endif
+            for (col=0; col < colsPerNode; col++) {
+                // the block's rows within this column, indexed from the slice start
+                colInd = col*dim + startRow;
+                
+                for (k=0; k < 4; k++)
+                    sumRe[k] = sumIm[k] = 0;
+                
+                // conj(pureState[row]) * qureg[row][col], four rows at a time
+                for (row=blockStart; row+4 <= blockEnd; row += 4) {
+                    for (k=0; k < 4; k++) {
+                        sumRe[k] += vecRe[row+k]*densRe[colInd+row+k] + vecIm[row+k]*densIm[colInd+row+k];
+                        sumIm[k] += vecRe[row+k]*densIm[colInd+row+k] - vecIm[row+k]*densRe[colInd+row+k];
+                    }
+                }
+                for (; row < blockEnd; row++) {
+                    sumRe[0] += vecRe[row]*densRe[colInd+row] + vecIm[row]*densIm[colInd+row];
+                    sumIm[0] += vecRe[row]*densIm[colInd+row] - vecIm[row]*densRe[colInd+row];
+                }
+                
+                colSumRe = (sumRe[0] + sumRe[1]) + (sumRe[2] + sumRe[3]);
+                colSumIm = (sumIm[0] + sumIm[1]) + (sumIm[2] + sumIm[3]);
+                
+                // multiply by the pureState element of this column
+                globalSumRe += colSumRe*colRe[col] - colSumIm*colIm[col];
+            }
+        }
+    }
+    
+    return globalSumRe;
+}
+
+Complex statevec_calcInnerProductLocal(Qureg bra, Qureg ket) {
+    
+    qreal innerProdReal = 0;
+    qreal innerProdImag = 0;
+    
+    long long int index;
+    long long int numAmps = bra.numAmpsPerChunk;
+    qreal *braVecReal = bra.stateVec.real;
+    qreal *braVecImag = bra.stateVec.imag;
+    qreal *ketVecReal = ket.stateVec.real;
+    qreal *ketVecImag = ket.stateVec.imag;
+    
+    qreal braRe, braIm, ketRe, ketIm;
+    
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(bra)) \
+    shared    (braVecReal, braVecImag, ketVecReal, ketVecImag, numAmps) \
+    private   (index, braRe, braIm, ketRe, ketIm) \
+    reduction ( +:innerProdReal, innerProdImag )
+# endif 
+    {
+# ifdef _OPENMP
+# pragma omp for schedule  (static)
+# endif
+        for (index=0; index < numAmps; index++) {
+            braRe = braVecReal[index];
+            braIm = braVecImag[index];
+            ketRe = ketVecReal[index];
+            ketIm = ketVecImag[index];
+            
+            // conj(bra_i) * ket_i
+            innerProdReal += braRe*ketRe + braIm*ketIm;
+            innerProdImag += braRe*ketIm - braIm*ketRe;
+        }
+    }
+    
+    Complex innerProd;
+    innerProd.real = innerProdReal;
+    innerProd.imag = innerProdImag;
+    return innerProd;
+}
+
+/** The number of amplitudes per block of statevec_calcInnerProductsLocal. Each block of the bra 
+ * (16 KiB in double precision) is read from memory once, then stays in L1 cache while the matching 
+ * block of every ket streams past it. Each ket's sum over the block is split into four lanes, so that 
+ * the products of neighbouring amplitudes are not each delayed by the previous addition.
+ */
+# define INNER_PRODUCTS_AMPS_PER_BLOCK 1024
+
+void statevec_calcInnerProductsLocal(Qureg bra, Qureg* kets, int numKets, qreal* prodsReal, qreal* prodsImag) {
+    
+    long long int numAmps = bra.numAmpsPerChunk;
+    long long int ampsPerBlock = (numAmps < INNER_PRODUCTS_AMPS_PER_BLOCK)? numAmps : INNER_PRODUCTS_AMPS_PER_BLOCK;
+    long long int numBlocks = numAmps / ampsPerBlock;
+    qreal *braVecReal = bra.stateVec.real;
+    qreal *braVecImag = bra.stateVec.imag;
+    
+    long long int thisBlock, index, blockStart, blockEnd;
+    int k, j;
+    qreal *ketVecReal, *ketVecImag;
+    qreal *threadProdsReal, *threadProdsImag;
+    qreal sumReal[4], sumImag[4];
+    
+    for (k=0; k < numKets; k++)
+        prodsReal[k] = prodsImag[k] = 0;
+    
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(bra)) \
+    default   (none) \
+    shared    (braVecReal,braVecImag, kets,numKets, ampsPerBlock,numBlocks, prodsReal,prodsImag) \
+    private   (thisBlock,index,blockStart,blockEnd, k,j, ketVecReal,ketVecImag, \
+                threadProdsReal,threadProdsImag, sumReal,sumImag)
+# endif 
+    {
+        threadProdsReal = calloc(numKets, sizeof *threadProdsReal);
+        threadProdsImag = calloc(numKets, sizeof *threadProdsImag);
+        
+# ifdef _OPENMP
+# pragma omp for schedule  (static)
+# endif
+        for (thisBlock=0; thisBlock < numBlocks; thisBlock++) {
+            blockStart = thisBlock*ampsPerBlock;
+            blockEnd = blockStart + ampsPerBlock;
+            
+            for (k=0; k < numKets; k++) {
+                ketVecReal = kets[k].stateVec.real;
+                ketVecImag = kets[k].stateVec.imag;
+                for (j=0; j < 4; j++)
+                    sumReal[j] = sumImag[j] = 0;
+                
+                // conj(bra_i) * ket_i, four amplitudes at a time
+                for (index=blockStart; index+4 <= blockEnd; index += 4) {
+                    for (j=0; j < 4; j++) {
+                        sumReal[j] += braVecReal[index+j]*ketVecReal[index+j] + braVecImag[index+j]*ketVecImag[index+j];
+                        sumImag[j] += braVecReal[index+j]*ketVecImag[index+j] - braVecImag[index+j]*ketVecReal[index+j];
+                    }
+                }
+                for (; index < blockEnd; index++) {
+                    sumReal[0] += braVecReal[index]*ketVecReal[index] + braVecImag[index]*ketVecImag[index];
+                    sumImag[0] += braVecReal[index]*ketVecImag[index] - braVecImag[index]*ketVecReal[index];
+                }
+                threadProdsReal[k] += (sumReal[0] + sumReal[1]) + (sumReal[2] + sumReal[3]);
+                threadProdsImag[k] += (sumImag[0] + sumImag[1]) + (sumImag[2] + sumImag[3]);
+            }
+        }
+        
+# ifdef _OPENMP
+# pragma omp critical (QuEST_innerProducts)
+# endif
+        for (k=0; k < numKets; k++) {
+            prodsReal[k] += threadProdsReal[k];
+            prodsImag[k] += threadProdsImag[k];
+        }
+        
+        free(threadProdsReal);
+        free(threadProdsImag);
+    }
+}
+
+/** The parity of the number of set bits of x */
+static inline int getBitMaskParity(long long int x) {
+# ifdef __GNUC__
+    return __builtin_parityll((unsigned long long int) x);
+# else
+    unsigned long long int bits = (unsigned long long int) x;
+    bits ^= bits >> 32;
+    bits ^= bits >> 16;
+    bits ^= bits >> 8;
+    bits ^= bits >> 4;
+    bits ^= bits >> 2;
+    bits ^= bits >> 1;
+    return (int) (bits & 1);
+# endif
+}
+
+/** Adds this chunk's contribution to the expected value of each of a group of Pauli products which share
+ * flipMask, i.e. Re( factor_t sum_j conj(psi[j ^ flipMask]) (-1)^|j & phaseMask_t| psi[j] ), to 
+ * expecs[sumInds[t]], the sum to which term t belongs.
+ * pairVec must hold the chunk containing amplitudes j ^ flipMask, at their local index; this is 
+ * qureg.stateVec itself when flipMask lies within the chunk. Neither is modified.
+ */
+void statevec_calcExpecPauliGroupLocal(Qureg qureg, ComplexArray pairVec, long long int flipMask, 
+    long long int* phaseMasks, qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs) 
+{
+    long long int numAmps = qureg.numAmpsPerChunk;
+    long long int localFlipMask = flipMask & (numAmps-1);
+    long long int chunkStart = qureg.chunkId * numAmps;
     
-    qreal densElemRe, densElemIm;
-    qreal prefacRe, prefacIm;
-    qreal rowSumRe, rowSumIm;
-    qreal vecElemRe, vecElemIm;
+    qreal *vecRe = qureg.stateVec.real;
+    qreal *vecIm = qureg.stateVec.imag;
+    qreal *pairRe = pairVec.real;
+    qreal *pairIm = pairVec.imag;
     
-    // starting GLOBAL column index of the qureg columns on this node
-    int startCol = qureg.chunkId * pureState.numAmpsPerChunk;
+    // the phase masks within this chunk; bits beyond it fix a sign for the whole chunk
+    long long int* localPhaseMasks = malloc(numTerms * sizeof *localPhaseMasks);
+    qreal* sumsRe = calloc(numTerms, sizeof *sumsRe);
+    qreal* sumsIm = calloc(numTerms, sizeof *sumsIm);
+    for (int t=0; t < numTerms; t++)
+        localPhaseMasks[t] = phaseMasks[t] & (numAmps-1);
     
-    // quantity computed by this node
-    qreal globalSumRe = 0;   // imag-component is assumed zero
+    long long int index, pairIndex;
+    int t;
+    qreal prodRe, prodIm, sign;
+    qreal *threadSumsRe, *threadSumsIm;
     
 # ifdef _OPENMP
 # pragma omp parallel \
-    shared    (vecRe,vecIm,densRe,densIm, dim,colsPerNode,startCol) \
-    private   (row,col, prefacRe,prefacIm, rowSumRe,rowSumIm, densElemRe,densElemIm, vecElemRe,vecElemIm) \
-    reduction ( +:globalSumRe )
-# endif 
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (vecRe,vecIm,pairRe,pairIm, numAmps,localFlipMask,localPhaseMasks,numTerms, sumsRe,sumsIm) \
+    private  (index,pairIndex, t, prodRe,prodIm,sign, threadSumsRe,threadSumsIm)
+# endif
     {
+        threadSumsRe = calloc(numTerms, sizeof *threadSumsRe);
+        threadSumsIm = calloc(numTerms, sizeof *threadSumsIm);
+        
 # ifdef _OPENMP
-# pragma omp for schedule  (static)
+# pragma omp for schedule (static)
 # endif
-        // indices of my GLOBAL row
-        for (row=0; row < dim; row++) {
-            
-            // single element of conj(pureState)
-            prefacRe =   vecRe[row];
-            prefacIm = - vecIm[row];
-                    
-            rowSumRe = 0;
-            rowSumIm = 0;
-            
-            // indices of my LOCAL column
-            for (col=0; col < colsPerNode; col++) {
-            
-                // my local density element
-                densElemRe = densRe[row + dim*col];
-                densElemIm = densIm[row + dim*col];
+        for (index=0; index < numAmps; index++) {
+            pairIndex = index ^ localFlipMask;
             
-                // state-vector element
-                vecElemRe = vecRe[startCol + col];
-                vecElemIm = vecIm[startCol + col];
+            // conj(psi[j ^ flipMask]) psi[j]
+            prodRe = pairRe[pairIndex]*vecRe[index] + pairIm[pairIndex]*vecIm[index];
+            prodIm = pairRe[pairIndex]*vecIm[index] - pairIm[pairIndex]*vecRe[index];
             
-                rowSumRe += densElemRe*vecElemRe - densElemIm*vecElemIm;
-                rowSumIm += densElemRe*vecElemIm + densElemIm*vecElemRe;
+            // branchless, since the parities are unpredictable
+            for (t=0; t < numTerms; t++) {
+                sign = 1 - 2*getBitMaskParity(index & localPhaseMasks[t]);
+                threadSumsRe[t] += sign*prodRe;
+                threadSumsIm[t] += sign*prodIm;
             }
+        }
         
-            globalSumRe += rowSumRe*prefacRe + rowSumIm*prefacIm;   
+# ifdef _OPENMP
+# pragma omp critical (QuEST_pauliSums)
+# endif
+        for (t=0; t < numTerms; t++) {
+            sumsRe[t] += threadSumsRe[t];
+            sumsIm[t] += threadSumsIm[t];
         }
+        
+        free(threadSumsRe);
+        free(threadSumsIm);
     }
     
-    return globalSumRe;
+    for (t=0; t < numTerms; t++) {
+        qreal sign = getBitMaskParity(chunkStart & phaseMasks[t])? -1 : 1;
+        expecs[sumInds[t]] += sign * (factorsRe[t]*sumsRe[t] - factorsIm[t]*sumsIm[t]);
+    }
+    
+    free(localPhaseMasks);
+    free(sumsRe);
+    free(sumsIm);
 }
 
-Complex statevec_calcInnerProductLocal(Qureg bra, Qureg ket) {
+/** Adds this chunk's contribution to Tr(P_t rho) to expecs[sumInds[t]], for every term t. Only the 
+ * elements rho[c][c ^ flipMask] contribute, with phase factor_t (-1)^|c & phaseMask_t|, so each term 
+ * visits one element per column.
+ */
+void densmatr_calcExpecPauliMasksLocal(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs) 
+{
+    long long int dim = 1LL << qureg.numQubitsRepresented;
+    long long int chunkStart = qureg.chunkId * qureg.numAmpsPerChunk;
+    long long int chunkEnd = chunkStart + qureg.numAmpsPerChunk;
     
-    qreal innerProdReal = 0;
-    qreal innerProdImag = 0;
+    // the columns overlapping this chunk
+    long long int startCol = chunkStart / dim;
+    long long int endCol = (chunkEnd + dim - 1) / dim;
     
-    long long int index;
-    long long int numAmps = bra.numAmpsPerChunk;
-    qreal *braVecReal = bra.stateVec.real;
-    qreal *braVecImag = bra.stateVec.imag;
-    qreal *ketVecReal = ket.stateVec.real;
-    qreal *ketVecImag = ket.stateVec.imag;
+    qreal *densRe = qureg.stateVec.real;
+    qreal *densIm = qureg.stateVec.imag;
     
-    qreal braRe, braIm, ketRe, ketIm;
+    long long int col, row, index, flipMask, phaseMask;
+    qreal factorRe, factorIm, sign, termExpec;
+    int t;
     
 # ifdef _OPENMP
 # pragma omp parallel \
-    shared    (braVecReal, braVecImag, ketVecReal, ketVecImag, numAmps) \
-    private   (index, braRe, braIm, ketRe, ketIm) \
-    reduction ( +:innerProdReal, innerProdImag )
-# endif 
+    num_threads (getNumKernelThreads(qureg)) \
+    default   (none) \
+    shared    (densRe,densIm, dim,chunkStart,chunkEnd,startCol,endCol, \
+                flipMasks,phaseMasks,factorsRe,factorsIm,sumInds,numTerms, expecs) \
+    private   (col,row,index,flipMask,phaseMask, factorRe,factorIm,sign,termExpec, t)
+# endif
     {
+        for (t=0; t < numTerms; t++) {
+            flipMask = flipMasks[t];
+            phaseMask = phaseMasks[t];
+            factorRe = factorsRe[t];
+            factorIm = factorsIm[t];
+            termExpec = 0;
+            
 # ifdef _OPENMP
-# pragma omp for schedule  (static)
+# pragma omp for schedule (static) nowait
 # endif
-        for (index=0; index < numAmps; index++) {
-            braRe = braVecReal[index];
-            braIm = braVecImag[index];
-            ketRe = ketVecReal[index];
-            ketIm = ketVecImag[index];
+            for (col=startCol; col < endCol; col++) {
+                row = col ^ flipMask;
+                index = row + col*dim;
+                if (index < chunkStart || index >= chunkEnd)
+                    continue;
+                index -= chunkStart;
+                
+                sign = getBitMaskParity(row & phaseMask)? -1 : 1;
+                termExpec += sign * (factorRe*densRe[index] - factorIm*densIm[index]);
+            }
             
-            // conj(bra_i) * ket_i
-            innerProdReal += braRe*ketRe + braIm*ketIm;
-            innerProdImag += braRe*ketIm - braIm*ketRe;
+# ifdef _OPENMP
+# pragma omp atomic
+# endif
+            expecs[sumInds[t]] += termExpec;
         }
     }
-    
-    Complex innerProd;
-    innerProd.real = innerProdReal;
-    innerProd.imag = innerProdImag;
-    return innerProd;
 }
 
 
@@ -904,6 +1553,7 @@ void densmatr_initClassicalState (Qureg qureg, long long int stateInd)
     long long int index;
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (densityNumElems, densityReal, densityImag) \
     private  (index) 
@@ -945,6 +1595,7 @@ void densmatr_initPlusState (Qureg qureg)
     // initialise the state to |+++..+++> = 1/normFactor {1, 1, 1, ...}
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (chunkSize, densityReal, densityImag, probFactor) \
     private  (index) 
@@ -960,20 +1611,22 @@ void densmatr_initPlusState (Qureg qureg)
     }
 }
 
-void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg) {
+void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg, ComplexArray rowAmps, long long int startRow, long long int numRows) {
     
-    /* copyQureg amps aren't explicitly used - they're accessed through targetQureg.pair,
-     * which contains the full pure statevector.
-     * targetQureg has as many columns on node as copyQureg has amps
+    /* targetQureg has as many columns on node as copyQureg has amps, and their pure state
+     * amplitudes are exactly copyQureg's local amps. Only rows [startRow, startRow + numRows)
+     * are set, from the pure state amplitudes rowAmps, so that a distributed pure state may 
+     * be consumed slice by slice.
      */
     
-    long long int colOffset = targetQureg.chunkId * copyQureg.numAmpsPerChunk;
     long long int colsPerNode = copyQureg.numAmpsPerChunk;
-    long long int rowsPerNode = copyQureg.numAmpsTotal;
+    long long int dim = copyQureg.numAmpsTotal;
     
     // unpack vars for OpenMP
-    qreal* vecRe = targetQureg.pairStateVec.real;
-    qreal* vecIm = targetQureg.pairStateVec.imag;
+    qreal* vecRe = rowAmps.real;
+    qreal* vecIm = rowAmps.imag;
+    qreal* colRe = copyQureg.stateVec.real;
+    qreal* colIm = copyQureg.stateVec.imag;
     qreal* densRe = targetQureg.stateVec.real;
     qreal* densIm = targetQureg.stateVec.imag;
     
@@ -984,8 +1637,9 @@ void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg) {
     
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(targetQureg)) \
     default  (none) \
-    shared   (colOffset, colsPerNode,rowsPerNode, vecRe,vecIm,densRe,densIm) \
+    shared   (colsPerNode,dim,startRow,numRows, vecRe,vecIm,colRe,colIm,densRe,densIm) \
     private  (col,row, ketRe,ketIm,braRe,braIm, index) 
 # endif
     {
@@ -994,20 +1648,20 @@ void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg) {
 # endif
         // local column
         for (col=0; col < colsPerNode; col++) {
+            braRe = colRe[col];
+            braIm = colIm[col];
         
-            // global row
-            for (row=0; row < rowsPerNode; row++) {
+            // row within the slice
+            for (row=0; row < numRows; row++) {
             
                 // get pure state amps
                 ketRe = vecRe[row];
                 ketIm = vecIm[row];
-                braRe = vecRe[col + colOffset];
-                braIm = vecIm[col + colOffset];
             
                 // update density matrix
-                index = row + col*rowsPerNode; // local ind
-                densRe[index] = ketRe*braRe - ketIm*braIm;
-                densIm[index] = ketRe*braIm - ketIm*braRe;
+                index = startRow + row + col*dim; // local ind
+                densRe[index] = ketRe*braRe + ketIm*braIm;
+                densIm[index] = ketIm*braRe - ketRe*braIm;
             }
         }
     }
@@ -1039,6 +1693,7 @@ void statevec_setAmps(Qureg qureg, long long int startInd, qreal* reals, qreal*
     
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (localStartInd,localEndInd, vecRe,vecIm, reals,imags, offset) \
     private  (index) 
@@ -1055,16 +1710,26 @@ void statevec_setAmps(Qureg qureg, long long int startInd, qreal* reals, qreal*
     }
 }
 
+/** The fewest amplitudes a bounded pairStateVec holds, which is room for the two halves (sent and
+ * received) of a packed slice of at least one amplitude, twice over to keep two slices in flight */
+# define MIN_EXCHANGE_BUFFER_AMPS 4
+
 void statevec_createQureg(Qureg *qureg, int numQubits, QuESTEnv env)
 {
     long long int numAmps = 1L << numQubits;
     long long int numAmpsPerRank = numAmps/env.numRanks;
 
+    // the exchange buffer is a power of 2 amplitudes, and at least a few, so that slices tile it
+    long long int numPairAmps = numAmpsPerRank;
+    long long int maxPairAmps = env.maxExchangeBufferBytes / (2 * sizeof(qreal));
+    while (env.maxExchangeBufferBytes > 0 && numPairAmps > maxPairAmps && numPairAmps > MIN_EXCHANGE_BUFFER_AMPS)
+        numPairAmps >>= 1;
+
     qureg->stateVec.real = malloc(numAmpsPerRank * sizeof(*(qureg->stateVec.real)));
     qureg->stateVec.imag = malloc(numAmpsPerRank * sizeof(*(qureg->stateVec.imag)));
     if (env.numRanks>1){
-        qureg->pairStateVec.real = malloc(numAmpsPerRank * sizeof(*(qureg->pairStateVec.real)));
-        qureg->pairStateVec.imag = malloc(numAmpsPerRank * sizeof(*(qureg->pairStateVec.imag)));
+        qureg->pairStateVec.real = malloc(numPairAmps * sizeof(*(qureg->pairStateVec.real)));
+        qureg->pairStateVec.imag = malloc(numPairAmps * sizeof(*(qureg->pairStateVec.imag)));
     }
 
     if ( (!(qureg->stateVec.real) || !(qureg->stateVec.imag))
@@ -1082,9 +1747,36 @@ void statevec_createQureg(Qureg *qureg, int numQubits, QuESTEnv env)
     qureg->numQubitsInStateVec = numQubits;
     qureg->numAmpsTotal = numAmps;
     qureg->numAmpsPerChunk = numAmpsPerRank;
+    qureg->numPairAmps = (env.numRanks>1)? numPairAmps : 0;
+    qureg->compressExchanges = (env.numRanks>1)? env.compressExchanges : 0;
     qureg->chunkId = env.rank;
     qureg->numChunks = env.numRanks;
     qureg->isDensityMatrix = 0;
+    qureg->policy = env.policy;
+
+    // the exchange buffer is otherwise first touched by MPI on the master thread, placing every page 
+    // on its NUMA node; touching it by the kernels' static schedule spreads it as the kernels read it
+    if (env.numRanks>1) {
+        long long int index;
+        qreal *pairReal = qureg->pairStateVec.real;
+        qreal *pairImag = qureg->pairStateVec.imag;
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(*qureg)) \
+    default  (none) \
+    shared   (numPairAmps, pairReal, pairImag) \
+    private  (index)
+# endif
+        {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+            for (index=0; index<numPairAmps; index++) {
+                pairReal[index] = 0;
+                pairImag[index] = 0;
+            }
+        }
+    }
 }
 
 void statevec_destroyQureg(Qureg qureg, QuESTEnv env){
@@ -1144,6 +1836,7 @@ void statevec_initZeroState (Qureg qureg)
     // initialise the state-vector to all-zeroes
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (stateVecSize, stateVecReal, stateVecImag) \
     private  (index) 
@@ -1182,6 +1875,7 @@ void statevec_initPlusState (Qureg qureg)
     // initialise the state to |+++..+++> = 1/normFactor {1, 1, 1, ...}
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (chunkSize, stateVecReal, stateVecImag, normFactor) \
     private  (index) 
@@ -1209,59 +1903,406 @@ void statevec_initClassicalState (Qureg qureg, long long int stateInd)
     qreal *stateVecReal = qureg.stateVec.real;
     qreal *stateVecImag = qureg.stateVec.imag;
 
-    // initialise the state to vector to all zeros
+    // initialise the state to vector to all zeros
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (stateVecSize, stateVecReal, stateVecImag) \
+    private  (index) 
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (index=0; index<stateVecSize; index++) {
+            stateVecReal[index] = 0.0;
+            stateVecImag[index] = 0.0;
+        }
+    }
+
+    // give the specified classical state prob 1
+    if (qureg.chunkId == stateInd/stateVecSize){
+        stateVecReal[stateInd % stateVecSize] = 1.0;
+        stateVecImag[stateInd % stateVecSize] = 0.0;
+    }
+}
+
+void statevec_cloneQureg(Qureg targetQureg, Qureg copyQureg) {
+    
+    // registers are equal sized, so nodes hold the same state-vector partitions
+    long long int stateVecSize;
+    long long int index;
+
+    // dimension of the state vector
+    stateVecSize = targetQureg.numAmpsPerChunk;
+
+    // Can't use qureg->stateVec as a private OMP var
+    qreal *targetStateVecReal = targetQureg.stateVec.real;
+    qreal *targetStateVecImag = targetQureg.stateVec.imag;
+    qreal *copyStateVecReal = copyQureg.stateVec.real;
+    qreal *copyStateVecImag = copyQureg.stateVec.imag;
+
+    // initialise the state to |0000..0000>
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(targetQureg)) \
+    default  (none) \
+    shared   (stateVecSize, targetStateVecReal, targetStateVecImag, copyStateVecReal, copyStateVecImag) \
+    private  (index) 
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (index=0; index<stateVecSize; index++) {
+            targetStateVecReal[index] = copyStateVecReal[index];
+            targetStateVecImag[index] = copyStateVecImag[index];
+        }
+    }
+}
+
+/** Sets out = facOut*out + fac1*qureg1 + fac2*qureg2, amplitude-wise. Since the registers have
+ * the same dimensions, each node updates only its own chunk. out may alias qureg1 or qureg2.
+ */
+void statevec_setWeightedQureg(Complex fac1, Qureg qureg1, Complex fac2, Qureg qureg2, Complex facOut, Qureg out) {
+
+    long long int numAmps = out.numAmpsPerChunk;
+    long long int index;
+
+    qreal *vecRe1 = qureg1.stateVec.real;
+    qreal *vecIm1 = qureg1.stateVec.imag;
+    qreal *vecRe2 = qureg2.stateVec.real;
+    qreal *vecIm2 = qureg2.stateVec.imag;
+    qreal *vecReOut = out.stateVec.real;
+    qreal *vecImOut = out.stateVec.imag;
+
+    qreal fac1Re = fac1.real, fac1Im = fac1.imag;
+    qreal fac2Re = fac2.real, fac2Im = fac2.imag;
+    qreal facOutRe = facOut.real, facOutIm = facOut.imag;
+    qreal re1, im1, re2, im2, reOut, imOut;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg1)) \
+    default  (none) \
+    shared   (numAmps, vecRe1,vecIm1, vecRe2,vecIm2, vecReOut,vecImOut, \
+              fac1Re,fac1Im, fac2Re,fac2Im, facOutRe,facOutIm) \
+    private  (index, re1,im1, re2,im2, reOut,imOut)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (index=0; index<numAmps; index++) {
+            re1 = vecRe1[index]; im1 = vecIm1[index];
+            re2 = vecRe2[index]; im2 = vecIm2[index];
+            reOut = vecReOut[index]; imOut = vecImOut[index];
+
+            vecReOut[index] = (facOutRe*reOut - facOutIm*imOut) + (fac1Re*re1 - fac1Im*im1) + (fac2Re*re2 - fac2Im*im2);
+            vecImOut[index] = (facOutRe*imOut + facOutIm*reOut) + (fac1Re*im1 + fac1Im*re1) + (fac2Re*im2 + fac2Im*re2);
+        }
+    }
+}
+
+/** Multiplies every amplitude by a factor looked up from the bits of its index at the set bits
+ * of qubitMask: the k-th lowest qubit of the mask gives bit k of the table index. This applies
+ * any product of diagonal gates upon those qubits in a single pass.
+ */
+void statevec_applyDiagonalTable(Qureg qureg, long long int qubitMask, qreal* factorsRe, qreal* factorsIm) {
+
+    long long int numAmps = qureg.numAmpsPerChunk;
+    long long int chunkOffset = qureg.chunkId * numAmps;
+    long long int index, globalInd;
+    int tableInd, k;
+
+    int numBits = 0;
+    int bits[64];
+    for (int b=0; b < 64; b++)
+        if ((qubitMask >> b) & 1)
+            bits[numBits++] = b;
+
+    qreal *stateVecReal = qureg.stateVec.real;
+    qreal *stateVecImag = qureg.stateVec.imag;
+    qreal re, im, facRe, facIm;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (numAmps, chunkOffset, numBits, bits, stateVecReal,stateVecImag, factorsRe,factorsIm) \
+    private  (index, globalInd, tableInd, k, re,im, facRe,facIm)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (index=0; index<numAmps; index++) {
+            globalInd = chunkOffset + index;
+            tableInd = 0;
+            for (k=0; k < numBits; k++)
+                tableInd |= (int) ((globalInd >> bits[k]) & 1) << k;
+
+            re = stateVecReal[index];
+            im = stateVecImag[index];
+            facRe = factorsRe[tableInd];
+            facIm = factorsIm[tableInd];
+            stateVecReal[index] = re*facRe - im*facIm;
+            stateVecImag[index] = re*facIm + im*facRe;
+        }
+    }
+}
+
+/** Applies a sequence of (multi-)controlled unitaries and diagonal tables to the local
+ * amplitudes, opening one parallel region for the whole sequence rather than one per gate.
+ * The threads share out each step with a worksharing loop, whose closing barrier keeps the
+ * steps in order. Every target must be a local qubit.
+ */
+void statevec_applyGateSequenceLocal(Qureg qureg, GateSequenceStep* steps, const int numSteps)
+{
+    long long int numAmps = qureg.numAmpsPerChunk;
+    long long int numTasks = numAmps >> 1;
+    long long int chunkOffset = qureg.chunkId * numAmps;
+    long long int sizeBlock, sizeHalfBlock, mask;
+    long long int thisTask, indexUp, indexLo, index, globalInd;
+    qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
+    qreal re, im, facRe, facIm;
+    ComplexMatrix2 u;
+    int s, tableInd, numBits, b, k;
+    int bits[64];
+
+    qreal *stateVecReal = qureg.stateVec.real;
+    qreal *stateVecImag = qureg.stateVec.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (steps,numSteps, numAmps,numTasks,chunkOffset, stateVecReal,stateVecImag) \
+    private  (s, sizeBlock,sizeHalfBlock,mask,u, thisTask,indexUp,indexLo,index,globalInd, \
+                stateRealUp,stateImagUp,stateRealLo,stateImagLo, re,im,facRe,facIm, tableInd,numBits,b,k,bits)
+# endif
+    {
+        for (s=0; s < numSteps; s++) {
+
+            if (steps[s].targetQubit >= 0) {
+                sizeHalfBlock = 1LL << steps[s].targetQubit;
+                sizeBlock     = 2LL * sizeHalfBlock;
+                mask = steps[s].ctrlMask;
+                u = steps[s].u;
+
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+                for (thisTask=0; thisTask<numTasks; thisTask++) {
+                    indexUp = (thisTask / sizeHalfBlock)*sizeBlock + thisTask%sizeHalfBlock;
+                    indexLo = indexUp + sizeHalfBlock;
+
+                    if (mask == (mask & (indexUp + chunkOffset))) {
+                        stateRealUp = stateVecReal[indexUp];
+                        stateImagUp = stateVecImag[indexUp];
+                        stateRealLo = stateVecReal[indexLo];
+                        stateImagLo = stateVecImag[indexLo];
+
+                        stateVecReal[indexUp] = u.r0c0.real*stateRealUp - u.r0c0.imag*stateImagUp 
+                            + u.r0c1.real*stateRealLo - u.r0c1.imag*stateImagLo;
+                        stateVecImag[indexUp] = u.r0c0.real*stateImagUp + u.r0c0.imag*stateRealUp 
+                            + u.r0c1.real*stateImagLo + u.r0c1.imag*stateRealLo;
+
+                        stateVecReal[indexLo] = u.r1c0.real*stateRealUp  - u.r1c0.imag*stateImagUp 
+                            + u.r1c1.real*stateRealLo  -  u.r1c1.imag*stateImagLo;
+                        stateVecImag[indexLo] = u.r1c0.real*stateImagUp + u.r1c0.imag*stateRealUp 
+                            + u.r1c1.real*stateImagLo + u.r1c1.imag*stateRealLo;
+                    }
+                }
+            }
+            else {
+                numBits = 0;
+                for (b=0; b < 64; b++)
+                    if ((steps[s].tableMask >> b) & 1)
+                        bits[numBits++] = b;
+
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+                for (index=0; index<numAmps; index++) {
+                    globalInd = chunkOffset + index;
+                    tableInd = 0;
+                    for (k=0; k < numBits; k++)
+                        tableInd |= (int) ((globalInd >> bits[k]) & 1) << k;
+
+                    re = stateVecReal[index];
+                    im = stateVecImag[index];
+                    facRe = steps[s].factorsRe[tableInd];
+                    facIm = steps[s].factorsIm[tableInd];
+                    stateVecReal[index] = re*facRe - im*facIm;
+                    stateVecImag[index] = re*facIm + im*facRe;
+                }
+            }
+        }
+    }
+}
+
+/** Copies numPacked amplitudes of this chunk whose index has the bits of localMask equal to those of
+ * value, in order from the startInd-th such amplitude, into packed (or, if isUnpack, copies them back
+ * from packed). Only those amplitudes then need be exchanged, for example by a controlled gate upon a 
+ * non-local target, whose local control bits are all set.
+ */
+void statevec_packAmps(Qureg qureg, long long int localMask, long long int value, ComplexArray packed, 
+    long long int startInd, long long int numPacked, int isUnpack)
+{
+    int numBits = 0;
+    int bits[64];
+    for (int b=0; b < 64; b++)
+        if ((localMask >> b) & 1)
+            bits[numBits++] = b;
+
+    long long int thisTask, index, lowBits;
+    int k;
+
+    qreal *stateVecReal = qureg.stateVec.real;
+    qreal *stateVecImag = qureg.stateVec.imag;
+    qreal *packedReal = packed.real;
+    qreal *packedImag = packed.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (numBits,bits,value,startInd,numPacked, stateVecReal,stateVecImag,packedReal,packedImag, isUnpack) \
+    private  (thisTask,index,lowBits,k)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (thisTask=0; thisTask<numPacked; thisTask++) {
+            // insert the bit of value at each masked bit (lowest first)
+            index = startInd + thisTask;
+            for (k=0; k < numBits; k++) {
+                lowBits = index & ((1LL << bits[k]) - 1);
+                index = ((index ^ lowBits) << 1) | (value & (1LL << bits[k])) | lowBits;
+            }
+
+            if (isUnpack) {
+                stateVecReal[index] = packedReal[thisTask];
+                stateVecImag[index] = packedImag[thisTask];
+            } else {
+                packedReal[thisTask] = stateVecReal[index];
+                packedImag[thisTask] = stateVecImag[index];
+            }
+        }
+    }
+}
+
+/** The number of the numAmps amplitudes of amps (e.g. a slice about to be exchanged) which are nonzero */
+long long int statevec_countNonZeroAmps(Qureg qureg, ComplexArray amps, long long int numAmps)
+{
+    long long int index;
+    long long int numNonZero = 0;
+    qreal *ampsReal = amps.real;
+    qreal *ampsImag = amps.imag;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
+    default  (none) \
+    shared   (ampsReal,ampsImag, numAmps) \
+    private  (index) \
+    reduction ( +:numNonZero )
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (index=0; index<numAmps; index++)
+            numNonZero += (ampsReal[index] != 0 || ampsImag[index] != 0);
+    }
+    return numNonZero;
+}
+
+/** Copies the amplitudes of this chunk from in to out, with each qubit q of the chunk moved to
+ * qubit newPositions[q], so that bit q of an amplitude's index in becomes bit newPositions[q] of
+ * its index in out. in and out must not overlap.
+ */
+void statevec_permuteChunkQubits(Qureg qureg, int* newPositions, ComplexArray in, ComplexArray out)
+{
+    int numQubits = 0;
+    while ((1LL << numQubits) < qureg.numAmpsPerChunk)
+        numQubits++;
+
+    long long int numTasks = qureg.numAmpsPerChunk;
+    long long int thisTask, index;
+    int q;
+
+    qreal *inReal = in.real;
+    qreal *inImag = in.imag;
+    qreal *outReal = out.real;
+    qreal *outImag = out.imag;
+
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (stateVecSize, stateVecReal, stateVecImag) \
-    private  (index) 
+    shared   (numQubits,newPositions,numTasks, inReal,inImag,outReal,outImag) \
+    private  (thisTask,index,q)
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (index=0; index<stateVecSize; index++) {
-            stateVecReal[index] = 0.0;
-            stateVecImag[index] = 0.0;
-        }
-    }
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            index = 0;
+            for (q=0; q < numQubits; q++)
+                index |= ((thisTask >> q) & 1) << newPositions[q];
 
-    // give the specified classical state prob 1
-    if (qureg.chunkId == stateInd/stateVecSize){
-        stateVecReal[stateInd % stateVecSize] = 1.0;
-        stateVecImag[stateInd % stateVecSize] = 0.0;
+            outReal[index] = inReal[thisTask];
+            outImag[index] = inImag[thisTask];
+        }
     }
 }
 
-void statevec_cloneQureg(Qureg targetQureg, Qureg copyQureg) {
-    
-    // registers are equal sized, so nodes hold the same state-vector partitions
-    long long int stateVecSize;
-    long long int index;
-
-    // dimension of the state vector
-    stateVecSize = targetQureg.numAmpsPerChunk;
+/** Swaps qubits qb1 and qb2 of the chunk in place, exchanging each amplitude whose index has bit qb1
+ * set and bit qb2 clear with the one whose index has them the other way around
+ */
+void statevec_swapChunkQubits(Qureg qureg, int qb1, int qb2)
+{
+    int lowBit = (qb1 < qb2)? qb1 : qb2;
+    int highBit = (qb1 < qb2)? qb2 : qb1;
+    long long int numTasks = qureg.numAmpsPerChunk >> 2;
+    long long int thisTask, index, pairIndex, lowBits;
+    qreal tmpRe, tmpIm;
 
-    // Can't use qureg->stateVec as a private OMP var
-    qreal *targetStateVecReal = targetQureg.stateVec.real;
-    qreal *targetStateVecImag = targetQureg.stateVec.imag;
-    qreal *copyStateVecReal = copyQureg.stateVec.real;
-    qreal *copyStateVecImag = copyQureg.stateVec.imag;
+    qreal *stateVecReal = qureg.stateVec.real;
+    qreal *stateVecImag = qureg.stateVec.imag;
 
-    // initialise the state to |0000..0000>
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (stateVecSize, targetStateVecReal, targetStateVecImag, copyStateVecReal, copyStateVecImag) \
-    private  (index) 
+    shared   (lowBit,highBit,numTasks, stateVecReal,stateVecImag) \
+    private  (thisTask,index,pairIndex,lowBits, tmpRe,tmpIm)
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (index=0; index<stateVecSize; index++) {
-            targetStateVecReal[index] = copyStateVecReal[index];
-            targetStateVecImag[index] = copyStateVecImag[index];
+        for (thisTask=0; thisTask<numTasks; thisTask++) {
+            // insert a zero at each swapped bit (lowest first), then set the high one
+            index = thisTask;
+            lowBits = index & ((1LL << lowBit) - 1);
+            index = ((index ^ lowBits) << 1) | lowBits;
+            lowBits = index & ((1LL << highBit) - 1);
+            index = ((index ^ lowBits) << 1) | lowBits;
+            index |= 1LL << highBit;
+            pairIndex = index ^ (1LL << highBit) ^ (1LL << lowBit);
+
+            tmpRe = stateVecReal[index];
+            tmpIm = stateVecImag[index];
+            stateVecReal[index] = stateVecReal[pairIndex];
+            stateVecImag[index] = stateVecImag[pairIndex];
+            stateVecReal[pairIndex] = tmpRe;
+            stateVecImag[pairIndex] = tmpIm;
         }
     }
 }
@@ -1277,7 +2318,7 @@ void statevec_initStateOfSingleQubit(Qureg *qureg, int qubitId, int outcome)
     long long int chunkSize, stateVecSize;
     long long int index;
     int bit;
-    const long long int chunkId=qureg->chunkId;
+    long long int chunkId=qureg->chunkId;
 
     // dimension of the state vector
     chunkSize = qureg->numAmpsPerChunk;
@@ -1291,8 +2332,9 @@ void statevec_initStateOfSingleQubit(Qureg *qureg, int qubitId, int outcome)
     // initialise the state to |0000..0000>
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(*qureg)) \
     default  (none) \
-    shared   (chunkSize, stateVecReal, stateVecImag, normFactor, qubitId, outcome) \
+    shared   (chunkSize, stateVecReal, stateVecImag, normFactor, qubitId, outcome,chunkId) \
     private  (index, bit) 
 # endif
     {
@@ -1336,6 +2378,7 @@ void statevec_initStateDebug (Qureg qureg)
     // initialise the state to |0000..0000>
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (chunkSize, stateVecReal, stateVecImag, indexOffset) \
     private  (index) 
@@ -1402,6 +2445,14 @@ int statevec_initStateFromSingleFile(Qureg *qureg, char filename[200], QuESTEnv
     return 1;
 }
 
+int statevec_writeCheckpoint(Qureg qureg, char* prefix) {
+    return writeCheckpointChunk(qureg, prefix);
+}
+
+int statevec_initStateFromCheckpoint(Qureg qureg, char* prefix, int numSavedChunks) {
+    return readCheckpointChunk(qureg, prefix, numSavedChunks);
+}
+
 int statevec_compareStates(Qureg mq1, Qureg mq2, qreal precision){
     qreal diff;
     int chunkSize = mq1.numAmpsPerChunk;
@@ -1423,7 +2474,7 @@ void statevec_compactUnitaryLocal (Qureg qureg, const int targetQubit, Complex a
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -1437,8 +2488,9 @@ void statevec_compactUnitaryLocal (Qureg qureg, const int targetQubit, Complex a
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, alphaReal,alphaImag, betaReal,betaImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, alphaReal,alphaImag, betaReal,betaImag,numTasks) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo) 
 # endif
     {
@@ -1482,7 +2534,7 @@ void statevec_unitaryLocal(Qureg qureg, const int targetQubit, ComplexMatrix2 u)
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -1494,8 +2546,9 @@ void statevec_unitaryLocal(Qureg qureg, const int targetQubit, ComplexMatrix2 u)
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u,numTasks) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo) 
 # endif
     {
@@ -1553,7 +2606,7 @@ void statevec_compactUnitaryDistributed (Qureg qureg, const int targetQubit,
 
     qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
+    long long int numTasks=qureg.numAmpsPerChunk;
 
     qreal rot1Real=rot1.real, rot1Imag=rot1.imag;
     qreal rot2Real=rot2.real, rot2Imag=rot2.imag;
@@ -1563,9 +2616,10 @@ void statevec_compactUnitaryDistributed (Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            rot1Real,rot1Imag, rot2Real,rot2Imag) \
+            rot1Real,rot1Imag, rot2Real,rot2Imag,numTasks) \
     private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo)
 # endif
     {
@@ -1609,7 +2663,7 @@ void statevec_unitaryDistributed (Qureg qureg, const int targetQubit,
 
     qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
+    long long int numTasks=qureg.numAmpsPerChunk;
 
     qreal rot1Real=rot1.real, rot1Imag=rot1.imag;
     qreal rot2Real=rot2.real, rot2Imag=rot2.imag;
@@ -1620,9 +2674,10 @@ void statevec_unitaryDistributed (Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            rot1Real, rot1Imag, rot2Real, rot2Imag) \
+            rot1Real, rot1Imag, rot2Real, rot2Imag,numTasks) \
     private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo)
 # endif
     {
@@ -1645,7 +2700,7 @@ void statevec_unitaryDistributed (Qureg qureg, const int targetQubit,
     }
 }
 
-void statevec_controlledCompactUnitaryLocal (Qureg qureg, const int controlQubit, const int targetQubit, 
+void statevec_controlledCompactUnitaryLocal (Qureg qureg, int controlQubit, const int targetQubit, 
         Complex alpha, Complex beta)
 {
     long long int sizeBlock, sizeHalfBlock;
@@ -1654,9 +2709,9 @@ void statevec_controlledCompactUnitaryLocal (Qureg qureg, const int controlQubit
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     int controlBit;
 
@@ -1672,8 +2727,9 @@ void statevec_controlledCompactUnitaryLocal (Qureg qureg, const int controlQubit
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, alphaReal,alphaImag, betaReal,betaImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, alphaReal,alphaImag, betaReal,betaImag,numTasks,chunkId,chunkSize,controlQubit) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo,controlBit) 
 # endif
     {
@@ -1721,9 +2777,9 @@ void statevec_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit,
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -1735,8 +2791,9 @@ void statevec_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u, mask) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u, mask,numTasks,chunkId,chunkSize) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo) 
 # endif
     {
@@ -1775,7 +2832,7 @@ void statevec_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit,
 
 }
 
-void statevec_controlledUnitaryLocal(Qureg qureg, const int controlQubit, const int targetQubit, 
+void statevec_controlledUnitaryLocal(Qureg qureg, int controlQubit, const int targetQubit, 
         ComplexMatrix2 u)
 {
     long long int sizeBlock, sizeHalfBlock;
@@ -1784,9 +2841,9 @@ void statevec_controlledUnitaryLocal(Qureg qureg, const int controlQubit, const
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     int controlBit;
 
@@ -1800,8 +2857,9 @@ void statevec_controlledUnitaryLocal(Qureg qureg, const int controlQubit, const
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, u,numTasks,chunkId,chunkSize,controlQubit) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo,controlBit) 
 # endif
     {
@@ -1841,196 +2899,6 @@ void statevec_controlledUnitaryLocal(Qureg qureg, const int controlQubit, const
 
 }
 
-/** Rotate a single qubit in the state vector of probability amplitudes, given two complex 
- * numbers alpha and beta and a subset of the state vector with upper and lower block values 
- * stored seperately. Only perform the rotation where the control qubit is one.
- *                                               
- *  @param[in,out] qureg object representing the set of qubits
- *  @param[in] targetQubit qubit to rotate
- *  @param[in] controlQubit qubit to determine whether or not to perform a rotation 
- *  @param[in] rot1 rotation angle
- *  @param[in] rot2 rotation angle
- *  @param[in] stateVecUp probability amplitudes in upper half of a block
- *  @param[in] stateVecLo probability amplitudes in lower half of a block
- *  @param[out] stateVecOut array section to update (will correspond to either the lower or upper half of a block)
- */
-void statevec_controlledCompactUnitaryDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut)
-{
-
-    qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
-    long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
-
-    int controlBit;
-
-    qreal rot1Real=rot1.real, rot1Imag=rot1.imag;
-    qreal rot2Real=rot2.real, rot2Imag=rot2.imag;
-    qreal *stateVecRealUp=stateVecUp.real, *stateVecImagUp=stateVecUp.imag;
-    qreal *stateVecRealLo=stateVecLo.real, *stateVecImagLo=stateVecLo.imag;
-    qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
-
-# ifdef _OPENMP
-# pragma omp parallel \
-    default  (none) \
-    shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            rot1Real,rot1Imag, rot2Real,rot2Imag) \
-    private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo,controlBit)
-# endif
-    {
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        for (thisTask=0; thisTask<numTasks; thisTask++) {
-            controlBit = extractBit (controlQubit, thisTask+chunkId*chunkSize);
-            if (controlBit){
-                // store current state vector values in temp variables
-                stateRealUp = stateVecRealUp[thisTask];
-                stateImagUp = stateVecImagUp[thisTask];
-
-                stateRealLo = stateVecRealLo[thisTask];
-                stateImagLo = stateVecImagLo[thisTask];
-
-                // state[indexUp] = alpha * state[indexUp] - conj(beta)  * state[indexLo]
-                stateVecRealOut[thisTask] = rot1Real*stateRealUp - rot1Imag*stateImagUp + rot2Real*stateRealLo + rot2Imag*stateImagLo;
-                stateVecImagOut[thisTask] = rot1Real*stateImagUp + rot1Imag*stateRealUp + rot2Real*stateImagLo - rot2Imag*stateRealLo;
-            }
-        }
-    }
-}
-
-/** Rotate a single qubit in the state vector of probability amplitudes, given two complex 
- *  numbers alpha and beta and a subset of the state vector with upper and lower block values 
- *  stored seperately. Only perform the rotation where the control qubit is one.
- *                                                 
- *  @param[in,out] qureg object representing the set of qubits
- *  @param[in] targetQubit qubit to rotate
- *  @param[in] controlQubit qubit to determine whether or not to perform a rotation 
- *  @param[in] rot1 rotation angle
- *  @param[in] rot2 rotation angle
- *  @param[in] stateVecUp probability amplitudes in upper half of a block
- *  @param[in] stateVecLo probability amplitudes in lower half of a block
- *  @param[out] stateVecOut array section to update (will correspond to either the lower or upper half of a block)
- */
-void statevec_controlledUnitaryDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut)
-{
-
-    qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
-    long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
-
-    int controlBit;
-
-    qreal rot1Real=rot1.real, rot1Imag=rot1.imag;
-    qreal rot2Real=rot2.real, rot2Imag=rot2.imag;
-    qreal *stateVecRealUp=stateVecUp.real, *stateVecImagUp=stateVecUp.imag;
-    qreal *stateVecRealLo=stateVecLo.real, *stateVecImagLo=stateVecLo.imag;
-    qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
-
-# ifdef _OPENMP
-# pragma omp parallel \
-    default  (none) \
-    shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            rot1Real,rot1Imag, rot2Real,rot2Imag) \
-    private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo,controlBit)
-# endif
-    {
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        for (thisTask=0; thisTask<numTasks; thisTask++) {
-            controlBit = extractBit (controlQubit, thisTask+chunkId*chunkSize);
-            if (controlBit){
-                // store current state vector values in temp variables
-                stateRealUp = stateVecRealUp[thisTask];
-                stateImagUp = stateVecImagUp[thisTask];
-
-                stateRealLo = stateVecRealLo[thisTask];
-                stateImagLo = stateVecImagLo[thisTask];
-
-                stateVecRealOut[thisTask] = rot1Real*stateRealUp - rot1Imag*stateImagUp 
-                    + rot2Real*stateRealLo - rot2Imag*stateImagLo;
-                stateVecImagOut[thisTask] = rot1Real*stateImagUp + rot1Imag*stateRealUp 
-                    + rot2Real*stateImagLo + rot2Imag*stateRealLo;
-            }
-        }
-    }
-}
-
-/** Apply a unitary operation to a single qubit in the state vector of probability amplitudes, given
- *  a subset of the state vector with upper and lower block values 
- stored seperately. Only perform the rotation where all the control qubits are 1.
- *                                                 
- *  @param[in,out] qureg object representing the set of qubits
- *  @param[in] targetQubit qubit to rotate
- *  @param[in] controlQubit qubit to determine whether or not to perform a rotation 
- *  @param[in] rot1 rotation angle
- *  @param[in] rot2 rotation angle
- *  @param[in] stateVecUp probability amplitudes in upper half of a block
- *  @param[in] stateVecLo probability amplitudes in lower half of a block
- *  @param[out] stateVecOut array section to update (will correspond to either the lower or upper half of a block)
- */
-void statevec_multiControlledUnitaryDistributed (Qureg qureg, 
-        const int targetQubit, 
-        long long int mask,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut)
-{
-
-    qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
-    long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
-
-    qreal rot1Real=rot1.real, rot1Imag=rot1.imag;
-    qreal rot2Real=rot2.real, rot2Imag=rot2.imag;
-    qreal *stateVecRealUp=stateVecUp.real, *stateVecImagUp=stateVecUp.imag;
-    qreal *stateVecRealLo=stateVecLo.real, *stateVecImagLo=stateVecLo.imag;
-    qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
-
-# ifdef _OPENMP
-# pragma omp parallel \
-    default  (none) \
-    shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            rot1Real,rot1Imag, rot2Real,rot2Imag, mask) \
-    private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo)
-# endif
-    {
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        for (thisTask=0; thisTask<numTasks; thisTask++) {
-            if (mask == (mask & (thisTask+chunkId*chunkSize)) ){
-                // store current state vector values in temp variables
-                stateRealUp = stateVecRealUp[thisTask];
-                stateImagUp = stateVecImagUp[thisTask];
-
-                stateRealLo = stateVecRealLo[thisTask];
-                stateImagLo = stateVecImagLo[thisTask];
-
-                stateVecRealOut[thisTask] = rot1Real*stateRealUp - rot1Imag*stateImagUp 
-                    + rot2Real*stateRealLo - rot2Imag*stateImagLo;
-                stateVecImagOut[thisTask] = rot1Real*stateImagUp + rot1Imag*stateRealUp 
-                    + rot2Real*stateImagLo + rot2Imag*stateRealLo;
-            }
-        }
-    }
-}
-
 void statevec_pauliXLocal(Qureg qureg, const int targetQubit)
 {
     long long int sizeBlock, sizeHalfBlock;
@@ -2039,7 +2907,7 @@ void statevec_pauliXLocal(Qureg qureg, const int targetQubit)
 
     qreal stateRealUp,stateImagUp;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -2051,8 +2919,9 @@ void statevec_pauliXLocal(Qureg qureg, const int targetQubit)
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag,numTasks) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp) 
 # endif
     {
@@ -2096,15 +2965,16 @@ void statevec_pauliXDistributed (Qureg qureg, const int targetQubit,
 {
 
     long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
+    long long int numTasks=qureg.numAmpsPerChunk;
 
     qreal *stateVecRealIn=stateVecIn.real, *stateVecImagIn=stateVecIn.imag;
     qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut) \
+    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut,numTasks) \
     private  (thisTask)
 # endif
     {
@@ -2118,7 +2988,7 @@ void statevec_pauliXDistributed (Qureg qureg, const int targetQubit,
     }
 } 
 
-void statevec_controlledNotLocal(Qureg qureg, const int controlQubit, const int targetQubit)
+void statevec_controlledNotLocal(Qureg qureg, int controlQubit, const int targetQubit)
 {
     long long int sizeBlock, sizeHalfBlock;
     long long int thisBlock, // current block
@@ -2126,9 +2996,9 @@ void statevec_controlledNotLocal(Qureg qureg, const int controlQubit, const int
 
     qreal stateRealUp,stateImagUp;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     int controlBit;
 
@@ -2142,8 +3012,9 @@ void statevec_controlledNotLocal(Qureg qureg, const int controlQubit, const int
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag,numTasks,chunkId,chunkSize,controlQubit) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,controlBit) 
 # endif
     {
@@ -2170,53 +3041,7 @@ void statevec_controlledNotLocal(Qureg qureg, const int controlQubit, const int
     }
 }
 
-/** Rotate a single qubit by {{0,1},{1,0}.
- *  Operate on a subset of the state vector with upper and lower block values 
- *  stored seperately. This rotation is just swapping upper and lower values, and
- *  stateVecIn must already be the correct section for this chunk. Only perform the rotation
- *  for elements where controlQubit is one.
- *                                          
- *  @param[in,out] qureg object representing the set of qubits
- *  @param[in] targetQubit qubit to rotate
- *  @param[in] stateVecIn probability amplitudes in lower or upper half of a block depending on chunkId
- *  @param[out] stateVecOut array section to update (will correspond to either the lower or upper half of a block)
- */
-void statevec_controlledNotDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        ComplexArray stateVecIn,
-        ComplexArray stateVecOut)
-{
-
-    long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
-
-    int controlBit;
-
-    qreal *stateVecRealIn=stateVecIn.real, *stateVecImagIn=stateVecIn.imag;
-    qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
-
-# ifdef _OPENMP
-# pragma omp parallel \
-    default  (none) \
-    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut) \
-    private  (thisTask,controlBit)
-# endif
-    {
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        for (thisTask=0; thisTask<numTasks; thisTask++) {
-            controlBit = extractBit (controlQubit, thisTask+chunkId*chunkSize);
-            if (controlBit){
-                stateVecRealOut[thisTask] = stateVecRealIn[thisTask];
-                stateVecImagOut[thisTask] = stateVecImagIn[thisTask];
-            }
-        }
-    }
-} 
-
-void statevec_pauliYLocal(Qureg qureg, const int targetQubit, const int conjFac)
+void statevec_pauliYLocal(Qureg qureg, const int targetQubit, int conjFac)
 {
     long long int sizeBlock, sizeHalfBlock;
     long long int thisBlock, // current block
@@ -2224,7 +3049,7 @@ void statevec_pauliYLocal(Qureg qureg, const int targetQubit, const int conjFac)
 
     qreal stateRealUp,stateImagUp;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -2236,8 +3061,9 @@ void statevec_pauliYLocal(Qureg qureg, const int targetQubit, const int conjFac)
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag,numTasks,conjFac) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp) 
 # endif
     {
@@ -2277,11 +3103,11 @@ void statevec_pauliYLocal(Qureg qureg, const int targetQubit, const int conjFac)
 void statevec_pauliYDistributed(Qureg qureg, const int targetQubit,
         ComplexArray stateVecIn,
         ComplexArray stateVecOut, 
-        int updateUpper, const int conjFac)
+        int updateUpper, int conjFac)
 {
 
     long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
+    long long int numTasks=qureg.numAmpsPerChunk;
 
     qreal *stateVecRealIn=stateVecIn.real, *stateVecImagIn=stateVecIn.imag;
     qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
@@ -2292,8 +3118,9 @@ void statevec_pauliYDistributed(Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut,realSign,imagSign) \
+    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut,realSign,imagSign,numTasks,conjFac) \
     private  (thisTask)
 # endif
     {
@@ -2310,7 +3137,7 @@ void statevec_pauliYDistributed(Qureg qureg, const int targetQubit,
 
 
 
-void statevec_controlledPauliYLocal(Qureg qureg, const int controlQubit, const int targetQubit, const int conjFac)
+void statevec_controlledPauliYLocal(Qureg qureg, int controlQubit, const int targetQubit, int conjFac)
 {
     long long int sizeBlock, sizeHalfBlock;
     long long int thisBlock, // current block
@@ -2318,9 +3145,9 @@ void statevec_controlledPauliYLocal(Qureg qureg, const int controlQubit, const i
 
     qreal stateRealUp,stateImagUp;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     int controlBit;
 
@@ -2334,8 +3161,9 @@ void statevec_controlledPauliYLocal(Qureg qureg, const int controlQubit, const i
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag,numTasks,chunkId,chunkSize,controlQubit,conjFac) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,controlBit) 
 # endif
     {
@@ -2363,47 +3191,6 @@ void statevec_controlledPauliYLocal(Qureg qureg, const int controlQubit, const i
 }
 
 
-void statevec_controlledPauliYDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        ComplexArray stateVecIn,
-        ComplexArray stateVecOut, const int conjFac)
-{
-
-    long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
-
-    int controlBit;
-
-    qreal *stateVecRealIn=stateVecIn.real, *stateVecImagIn=stateVecIn.imag;
-    qreal *stateVecRealOut=stateVecOut.real, *stateVecImagOut=stateVecOut.imag;
-
-# ifdef _OPENMP
-# pragma omp parallel \
-    default  (none) \
-    shared   (stateVecRealIn,stateVecImagIn,stateVecRealOut,stateVecImagOut) \
-    private  (thisTask,controlBit)
-# endif
-    {
-# ifdef _OPENMP
-# pragma omp for schedule (static)
-# endif
-        for (thisTask=0; thisTask<numTasks; thisTask++) {
-            controlBit = extractBit (controlQubit, thisTask+chunkId*chunkSize);
-            if (controlBit){
-                stateVecRealOut[thisTask] = conjFac * stateVecRealIn[thisTask];
-                stateVecImagOut[thisTask] = conjFac * stateVecImagIn[thisTask];
-            }
-        }
-    }
-} 
-
-
-
-
-
-
-
 void statevec_hadamardLocal(Qureg qureg, const int targetQubit)
 {
     long long int sizeBlock, sizeHalfBlock;
@@ -2412,7 +3199,7 @@ void statevec_hadamardLocal(Qureg qureg, const int targetQubit)
 
     qreal stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;         
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeHalfBlock = 1LL << targetQubit;  
@@ -2426,8 +3213,9 @@ void statevec_hadamardLocal(Qureg qureg, const int targetQubit)
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, recRoot2) \
+    shared   (sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag, recRoot2,numTasks) \
     private  (thisTask,thisBlock ,indexUp,indexLo, stateRealUp,stateImagUp,stateRealLo,stateImagLo) 
 # endif
     {
@@ -2474,7 +3262,7 @@ void statevec_hadamardDistributed(Qureg qureg, const int targetQubit,
 
     qreal   stateRealUp,stateRealLo,stateImagUp,stateImagLo;
     long long int thisTask;  
-    const long long int numTasks=qureg.numAmpsPerChunk;
+    long long int numTasks=qureg.numAmpsPerChunk;
 
     int sign;
     if (updateUpper) sign=1;
@@ -2488,9 +3276,10 @@ void statevec_hadamardDistributed(Qureg qureg, const int targetQubit,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (stateVecRealUp,stateVecImagUp,stateVecRealLo,stateVecImagLo,stateVecRealOut,stateVecImagOut, \
-            recRoot2, sign) \
+            recRoot2, sign,numTasks) \
     private  (thisTask,stateRealUp,stateImagUp,stateRealLo,stateImagLo)
 # endif
     {
@@ -2511,14 +3300,14 @@ void statevec_hadamardDistributed(Qureg qureg, const int targetQubit,
     }
 }
 
-void statevec_phaseShiftByTerm (Qureg qureg, const int targetQubit, Complex term)
+void statevec_phaseShiftByTerm (Qureg qureg, int targetQubit, Complex term)
 {       
     long long int index;
     long long int stateVecSize;
     int targetBit;
     
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     // dimension of the state vector
     stateVecSize = qureg.numAmpsPerChunk;
@@ -2526,13 +3315,14 @@ void statevec_phaseShiftByTerm (Qureg qureg, const int targetQubit, Complex term
     qreal *stateVecImag = qureg.stateVec.imag;
     
     qreal stateRealLo, stateImagLo;
-    const qreal cosAngle = term.real;
-    const qreal sinAngle = term.imag;
+    qreal cosAngle = term.real;
+    qreal sinAngle = term.imag;
 
 # ifdef _OPENMP
 # pragma omp parallel for \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none)              \
-    shared   (stateVecSize, stateVecReal,stateVecImag ) \
+    shared   (stateVecSize, stateVecReal,stateVecImag ,chunkId,chunkSize,targetQubit,cosAngle,sinAngle) \
     private  (index,targetBit,stateRealLo,stateImagLo)             \
     schedule (static)
 # endif
@@ -2551,14 +3341,14 @@ void statevec_phaseShiftByTerm (Qureg qureg, const int targetQubit, Complex term
     }
 }
 
-void statevec_controlledPhaseShift (Qureg qureg, const int idQubit1, const int idQubit2, qreal angle)
+void statevec_controlledPhaseShift (Qureg qureg, int idQubit1, int idQubit2, qreal angle)
 {
     long long int index;
     long long int stateVecSize;
     int bit1, bit2;
     
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     // dimension of the state vector
     stateVecSize = qureg.numAmpsPerChunk;
@@ -2566,13 +3356,14 @@ void statevec_controlledPhaseShift (Qureg qureg, const int idQubit1, const int i
     qreal *stateVecImag = qureg.stateVec.imag;
     
     qreal stateRealLo, stateImagLo;
-    const qreal cosAngle = cos(angle);
-    const qreal sinAngle = sin(angle);
+    qreal cosAngle = cos(angle);
+    qreal sinAngle = sin(angle);
 
 # ifdef _OPENMP
 # pragma omp parallel for \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none)              \
-    shared   (stateVecSize, stateVecReal,stateVecImag ) \
+    shared   (stateVecSize, stateVecReal,stateVecImag ,chunkId,chunkSize,idQubit1,idQubit2,cosAngle,sinAngle) \
     private  (index,bit1,bit2,stateRealLo,stateImagLo)             \
     schedule (static)
 # endif
@@ -2595,8 +3386,8 @@ void statevec_multiControlledPhaseShift(Qureg qureg, int *controlQubits, int num
     long long int index;
     long long int stateVecSize;
 
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     long long int mask=0;
     for (int i=0; i<numControlQubits; i++) 
@@ -2607,13 +3398,14 @@ void statevec_multiControlledPhaseShift(Qureg qureg, int *controlQubits, int num
     qreal *stateVecImag = qureg.stateVec.imag;
     
     qreal stateRealLo, stateImagLo;
-    const qreal cosAngle = cos(angle);
-    const qreal sinAngle = sin(angle);
+    qreal cosAngle = cos(angle);
+    qreal sinAngle = sin(angle);
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none)              \
-    shared   (stateVecSize, stateVecReal, stateVecImag, mask) \
+    shared   (stateVecSize, stateVecReal, stateVecImag, mask,chunkId,chunkSize,cosAngle,sinAngle) \
     private  (index, stateRealLo, stateImagLo)
 # endif
     {
@@ -2659,6 +3451,7 @@ qreal densmatr_findProbabilityOfZeroLocal(Qureg qureg, const int measureQubit) {
     
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (localIndNextDiag, numPrevDiags, diagSpacing, stateVecReal, numDiagsInThisChunk) \
     private   (visitedDiags, basisStateInd, index) \
     reduction ( +:zeroProb )
@@ -2719,6 +3512,7 @@ qreal statevec_findProbabilityOfZeroLocal (Qureg qureg,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (numTasks,sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag) \
     private   (thisTask,thisBlock,index) \
     reduction ( +:totalProbability )
@@ -2767,6 +3561,7 @@ qreal statevec_findProbabilityOfZeroDistributed (Qureg qureg,
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (numTasks,stateVecReal,stateVecImag) \
     private   (thisTask) \
     reduction ( +:totalProbability )
@@ -2786,14 +3581,14 @@ qreal statevec_findProbabilityOfZeroDistributed (Qureg qureg,
 
 
 
-void statevec_controlledPhaseFlip (Qureg qureg, const int idQubit1, const int idQubit2)
+void statevec_controlledPhaseFlip (Qureg qureg, int idQubit1, int idQubit2)
 {
     long long int index;
     long long int stateVecSize;
     int bit1, bit2;
 
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
     
     // dimension of the state vector
     stateVecSize = qureg.numAmpsPerChunk;
@@ -2802,8 +3597,9 @@ void statevec_controlledPhaseFlip (Qureg qureg, const int idQubit1, const int id
 
 # ifdef _OPENMP
 # pragma omp parallel for \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none)              \
-    shared   (stateVecSize, stateVecReal,stateVecImag ) \
+    shared   (stateVecSize, stateVecReal,stateVecImag ,chunkId,chunkSize,idQubit1,idQubit2) \
     private  (index,bit1,bit2)             \
     schedule (static)
 # endif
@@ -2822,8 +3618,8 @@ void statevec_multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numC
     long long int index;
     long long int stateVecSize;
 
-    const long long int chunkSize=qureg.numAmpsPerChunk;
-    const long long int chunkId=qureg.chunkId;
+    long long int chunkSize=qureg.numAmpsPerChunk;
+    long long int chunkId=qureg.chunkId;
 
     long long int mask=0;
     for (int i=0; i<numControlQubits; i++)
@@ -2835,8 +3631,9 @@ void statevec_multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numC
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none)              \
-    shared   (stateVecSize, stateVecReal,stateVecImag, mask ) \
+    shared   (stateVecSize, stateVecReal,stateVecImag, mask ,chunkId,chunkSize) \
     private  (index)
 # endif
     {
@@ -2897,6 +3694,7 @@ void statevec_collapseToKnownProbOutcomeLocal(Qureg qureg, int measureQubit, int
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default (none) \
     shared    (numTasks,sizeBlock,sizeHalfBlock, stateVecReal,stateVecImag,renorm,outcome) \
     private   (thisTask,thisBlock,index)
@@ -2963,6 +3761,7 @@ void statevec_collapseToKnownProbOutcomeDistributedRenorm (Qureg qureg, const in
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (numTasks,stateVecReal,stateVecImag) \
     private   (thisTask)
 # endif
@@ -3004,6 +3803,7 @@ void statevec_collapseToOutcomeDistributedSetZero(Qureg qureg)
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     shared    (numTasks,stateVecReal,stateVecImag) \
     private   (thisTask)
 # endif
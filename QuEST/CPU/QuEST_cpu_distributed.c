@@ -2,9 +2,14 @@
 
 /** @file
  * An implementation of the backend in ../QuEST_ops.h for an MPI environment.
- * Mostly pure-state wrappers for the local/distributed functions implemented in QuEST_cpu
+ * Mostly pure-state wrappers for the local/distributed functions implemented in QuEST_cpu.
+ * Built with QuEST_SHARED_MEMORY, the ranks are instead processes on one machine, communicating
+ * through the MPI subset of QuEST_cpu_shm.h
  */
 
+// for the CPU affinity of threads
+# define _GNU_SOURCE
+
 # include "../QuEST.h"
 # include "../QuEST_internal.h"
 # include "../QuEST_precision.h"
@@ -14,18 +19,37 @@
 
 #define _BSD_SOURCE
 # include <unistd.h>
+# ifdef QuEST_SHARED_MEMORY
+# include "QuEST_cpu_shm.h"
+# else
 # include <mpi.h>
+# endif
 # include <stdlib.h>
 # include <stdio.h>
 # include <string.h>    // for memcpy
 # include <math.h>
 # include <time.h>
 # include <sys/types.h>
+# ifdef __linux__
+# include <sched.h>
+# endif
 
 # ifdef _OPENMP
 # include <omp.h>
 # endif
 
+/** the number of slices into which a gate's chunk exchange is divided, so that the first slices
+ * are updated while the rest are in flight */
+# define EXCHANGE_NUM_SLICES 8
+/** the fewest amplitudes in a slice, so that a small chunk is not split into latency-bound messages */
+# define EXCHANGE_MIN_SLICE_AMPS (1LL << 12)
+/** the default bound upon each state-vector's exchange buffer, overridden by QUEST_EXCHANGE_BUFFER_MB */
+# define DEFAULT_EXCHANGE_BUFFER_MB 256
+/** the amplitudes of a slice sampled to decide whether it is too dense to be worth compressing */
+# define EXCHANGE_COMPRESSION_SAMPLES 64
+/** the most CPUs of a node whose topology is read */
+# define MAX_NODE_CPUS 1024
+
 /** Get the value of the bit at a particular index in a number.
   SCB edit: new definition of extractBit is much faster ***
  * @param[in] locationOfBitFromRight location of bit in theEncodedNumber
@@ -38,24 +62,66 @@ static int extractBit (const int locationOfBitFromRight, const long long int the
     return (theEncodedNumber & ( 1LL << locationOfBitFromRight )) >> locationOfBitFromRight;
 }
 
+/** Scalars to be summed over every chunk, such as the probabilities of many qubits or the expected 
+ * values of many observables. Each is deferred into the batch as soon as this chunk's contribution is 
+ * known, and the whole batch is resolved by a single reduction, so that k scalars cost one collective 
+ * rather than k. The sums are held in storage given by the caller.
+ */
+typedef struct {
+    qreal* sums;
+    int numSums;
+} ReductionBatch;
+
+static void beginReductionBatch(ReductionBatch* batch, qreal* sums) {
+    batch->sums = sums;
+    batch->numSums = 0;
+}
+
+/** Defers this chunk's contribution to a sum, returning its index within the batch */
+static int deferReduction(ReductionBatch* batch, qreal localSum) {
+    batch->sums[batch->numSums] = localSum;
+    return batch->numSums++;
+}
+
+/** Replaces every deferred contribution with its sum over all chunks of qureg */
+static void resolveReductionBatch(ReductionBatch* batch, Qureg qureg) {
+    if (qureg.numChunks > 1 && batch->numSums > 0)
+        MPI_Allreduce(MPI_IN_PLACE, batch->sums, batch->numSums, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
+}
+
 Complex statevec_calcInnerProduct(Qureg bra, Qureg ket) {
     
     Complex localInnerProd = statevec_calcInnerProductLocal(bra, ket);
-    if (bra.numChunks == 1)
-        return localInnerProd;
     
-    qreal localReal = localInnerProd.real;
-    qreal localImag = localInnerProd.imag;
-    qreal globalReal, globalImag;
-    MPI_Allreduce(&localReal, &globalReal, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(&localImag, &globalImag, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
+    qreal sums[2];
+    ReductionBatch batch;
+    beginReductionBatch(&batch, sums);
+    int realInd = deferReduction(&batch, localInnerProd.real);
+    int imagInd = deferReduction(&batch, localInnerProd.imag);
+    resolveReductionBatch(&batch, bra);
     
     Complex globalInnerProd;
-    globalInnerProd.real = globalReal;
-    globalInnerProd.imag = globalImag;
+    globalInnerProd.real = sums[realInd];
+    globalInnerProd.imag = sums[imagInd];
     return globalInnerProd;
 }
 
+void statevec_calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds) {
+    
+    // the real components followed by the imaginary, deferred together into one batch
+    qreal* prods = malloc(2 * numKets * sizeof *prods);
+    statevec_calcInnerProductsLocal(bra, kets, numKets, prods, &prods[numKets]);
+    
+    ReductionBatch batch = {prods, 2*numKets};
+    resolveReductionBatch(&batch, bra);
+    
+    for (int k=0; k < numKets; k++) {
+        innerProds[k].real = prods[k];
+        innerProds[k].imag = prods[numKets + k];
+    }
+    free(prods);
+}
+
 qreal densmatr_calcTotalProb(Qureg qureg) {
 	
 	// computes the trace by summing every element ("diag") with global index (2^n + 1)i for i in [0, 2^n-1]
@@ -132,6 +198,245 @@ static int getChunkOuterBlockPairId(int chunkIsUpper, int chunkId, long long int
 static int halfMatrixBlockFitsInChunk(long long int chunkSize, int targetQubit);
 static int getChunkIdFromIndex(Qureg qureg, long long int index);
 
+/** The CPUs of a node, as read from /sys: the socket (physical package), core and NUMA node of each 
+ * online CPU, indexed by its id, and the online CPUs ordered by NUMA node, socket, core then id, so that 
+ * a contiguous run of them shares the most memory and cache.
+ */
+typedef struct NodeTopology
+{
+    int numCpus;
+    int numCores;
+    int numSockets;
+    int numNumaNodes;
+    int cpus[MAX_NODE_CPUS];
+    int socket[MAX_NODE_CPUS];
+    int core[MAX_NODE_CPUS];
+    int numaNode[MAX_NODE_CPUS];
+} NodeTopology;
+
+/** Marks in isListed the ids of a /sys list such as "0-3,8-11", returning how many, or 0 if the file 
+ * cannot be read */
+static int readSysList(char* filename, int* isListed) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+        return 0;
+    
+    int numListed = 0;
+    int first, last;
+    char sep;
+    while (fscanf(file, "%d", &first) == 1) {
+        last = first;
+        sep = (char) fgetc(file);
+        if (sep == '-') {
+            if (fscanf(file, "%d", &last) != 1)
+                break;
+            sep = (char) fgetc(file);
+        }
+        for (int id=first; id <= last && id < MAX_NODE_CPUS; id++)
+            if (id >= 0 && !isListed[id]) {
+                isListed[id] = 1;
+                numListed++;
+            }
+        if (sep != ',')
+            break;
+    }
+    fclose(file);
+    return numListed;
+}
+
+/** The single integer in a /sys file, or defaultValue if it cannot be read */
+static int readSysInt(char* filename, int defaultValue) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+        return defaultValue;
+    int value;
+    if (fscanf(file, "%d", &value) != 1)
+        value = defaultValue;
+    fclose(file);
+    return value;
+}
+
+/** Whether online CPU a precedes b in a NodeTopology's order */
+static int precedesCpu(NodeTopology* topo, int a, int b) {
+    if (topo->numaNode[a] != topo->numaNode[b])
+        return topo->numaNode[a] < topo->numaNode[b];
+    if (topo->socket[a] != topo->socket[b])
+        return topo->socket[a] < topo->socket[b];
+    if (topo->core[a] != topo->core[b])
+        return topo->core[a] < topo->core[b];
+    return a < b;
+}
+
+/** Reads the topology of this node from /sys. Without /sys (or off Linux), the online CPUs are taken 
+ * to be separate cores of one socket and one NUMA node.
+ */
+static void getNodeTopology(NodeTopology* topo) {
+    char filename[128];
+    int isOnline[MAX_NODE_CPUS] = {0};
+    int isListed[MAX_NODE_CPUS];
+    
+    if (readSysList("/sys/devices/system/cpu/online", isOnline) == 0) {
+        long numOnline = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int c=0; c < numOnline && c < MAX_NODE_CPUS; c++)
+            isOnline[c] = 1;
+    }
+    
+    topo->numCpus = 0;
+    for (int c=0; c < MAX_NODE_CPUS; c++) {
+        if (!isOnline[c])
+            continue;
+        sprintf(filename, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+        topo->socket[c] = readSysInt(filename, 0);
+        sprintf(filename, "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+        topo->core[c] = readSysInt(filename, c);
+        topo->numaNode[c] = 0;
+        topo->cpus[topo->numCpus++] = c;
+    }
+    
+    // every CPU not listed by a NUMA node stays in node 0
+    int isNode[MAX_NODE_CPUS] = {0};
+    readSysList("/sys/devices/system/node/online", isNode);
+    for (int n=0; n < MAX_NODE_CPUS; n++) {
+        if (!isNode[n])
+            continue;
+        memset(isListed, 0, sizeof isListed);
+        sprintf(filename, "/sys/devices/system/node/node%d/cpulist", n);
+        readSysList(filename, isListed);
+        for (int c=0; c < MAX_NODE_CPUS; c++)
+            if (isListed[c] && isOnline[c])
+                topo->numaNode[c] = n;
+    }
+    
+    // order the online CPUs, then count the distinct sockets, cores and NUMA nodes between neighbours
+    for (int i=1; i < topo->numCpus; i++) {
+        int cpu = topo->cpus[i];
+        int j = i;
+        for (; j > 0 && precedesCpu(topo, cpu, topo->cpus[j-1]); j--)
+            topo->cpus[j] = topo->cpus[j-1];
+        topo->cpus[j] = cpu;
+    }
+    topo->numCores = topo->numNumaNodes = 0;
+    for (int i=0; i < topo->numCpus; i++) {
+        int cpu = topo->cpus[i];
+        int prev = (i > 0)? topo->cpus[i-1] : -1;
+        int isNewNuma = (prev < 0 || topo->numaNode[cpu] != topo->numaNode[prev]);
+        int isNewCore = (isNewNuma || topo->socket[cpu] != topo->socket[prev] || topo->core[cpu] != topo->core[prev]);
+        topo->numNumaNodes += isNewNuma;
+        topo->numCores += isNewCore;
+    }
+    
+    // a socket may span several NUMA nodes, so is not counted between neighbours
+    int isSocket[MAX_NODE_CPUS] = {0};
+    topo->numSockets = 0;
+    for (int i=0; i < topo->numCpus; i++) {
+        int socket = topo->socket[topo->cpus[i]];
+        if (socket >= 0 && socket < MAX_NODE_CPUS && !isSocket[socket]) {
+            isSocket[socket] = 1;
+            topo->numSockets++;
+        }
+    }
+}
+
+/** Finds this rank's index among the ranks sharing its node, and their number, by comparing the 
+ * hashes of every rank's hostname */
+static void findNodeRanks(QuESTEnv* env) {
+    char hostName[256];
+    gethostname(hostName, 255);
+    hostName[255] = '\0';
+    
+    unsigned long int* hashes = calloc(env->numRanks, sizeof *hashes);
+    hashes[env->rank] = hashString(hostName);
+    MPI_Allreduce(MPI_IN_PLACE, hashes, env->numRanks, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    
+    env->nodeRank = 0;
+    env->numNodeRanks = 0;
+    for (int r=0; r < env->numRanks; r++)
+        if (hashes[r] == hashes[env->rank]) {
+            env->nodeRank += (r < env->rank);
+            env->numNodeRanks++;
+        }
+    free(hashes);
+}
+
+/** Pins each OpenMP thread of this rank to one CPU of a block, and returns the block's size (or 0 if 
+ * the threads are left unpinned). A rank already bound by its launcher (e.g. mpirun --bind-to) takes 
+ * the CPUs it was bound to; otherwise the ranks sharing a node divide its CPUs, in topological order, 
+ * into contiguous blocks, so that each rank's threads share the fewest sockets and NUMA nodes. Unless 
+ * OMP_NUM_THREADS says otherwise, a rank then runs one thread per CPU of its block; if OMP_NUM_THREADS 
+ * asks for more threads than the block has CPUs, none are pinned. Kernels divide 
+ * amplitudes among threads by a static schedule, so the thread which first touches an amplitude in 
+ * initZeroState is the one which later updates it, and pinned, stays beside the memory holding it.
+ * 
+ * Pinning is skipped if QUEST_PIN_THREADS is 0, or if the OpenMP runtime was told to bind threads 
+ * itself (by OMP_PROC_BIND, OMP_PLACES, GOMP_CPU_AFFINITY or KMP_AFFINITY).
+ */
+static int pinThreads(QuESTEnv env, NodeTopology* topo) {
+    char* pinVar = getenv("QUEST_PIN_THREADS");
+    if (pinVar != NULL && atoi(pinVar) == 0)
+        return 0;
+    if (getenv("OMP_PROC_BIND") || getenv("OMP_PLACES") || getenv("GOMP_CPU_AFFINITY") || getenv("KMP_AFFINITY"))
+        return 0;
+# ifdef __linux__
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof mask, &mask) != 0)
+        return 0;
+    
+    int block[MAX_NODE_CPUS];
+    int numBlockCpus = 0;
+    for (int i=0; i < topo->numCpus; i++)
+        if (CPU_ISSET(topo->cpus[i], &mask))
+            block[numBlockCpus++] = topo->cpus[i];
+    
+    if (numBlockCpus == topo->numCpus) {
+        numBlockCpus = 0;
+        if (env.numNodeRanks <= topo->numCpus) {
+            int start = (int) ((long long int) env.nodeRank * topo->numCpus / env.numNodeRanks);
+            int end = (int) ((long long int) (env.nodeRank+1) * topo->numCpus / env.numNodeRanks);
+            for (int i=start; i < end; i++)
+                block[numBlockCpus++] = topo->cpus[i];
+        } else
+            block[numBlockCpus++] = topo->cpus[env.nodeRank % topo->numCpus];
+    }
+    if (numBlockCpus == 0)
+        return 0;
+    
+# ifdef _OPENMP
+    // threads outnumbering the block (e.g. by OMP_NUM_THREADS) would share CPUs, so are left to the OS
+    if (getenv("OMP_NUM_THREADS") != NULL && omp_get_max_threads() > numBlockCpus)
+        return 0;
+# endif
+    
+    // threads yet to be created inherit the whole block, before each is narrowed to its own CPU
+    CPU_ZERO(&mask);
+    for (int i=0; i < numBlockCpus; i++)
+        CPU_SET(block[i], &mask);
+    if (sched_setaffinity(0, sizeof mask, &mask) != 0)
+        return 0;
+    
+# ifdef _OPENMP
+    if (getenv("OMP_NUM_THREADS") == NULL)
+        omp_set_num_threads(numBlockCpus);
+    
+# pragma omp parallel \
+    default  (none) \
+    shared   (block, numBlockCpus)
+# endif
+    {
+        int thread = 0;
+# ifdef _OPENMP
+        thread = omp_get_thread_num();
+# endif
+        cpu_set_t threadMask;
+        CPU_ZERO(&threadMask);
+        CPU_SET(block[thread % numBlockCpus], &threadMask);
+        sched_setaffinity(0, sizeof threadMask, &threadMask);
+    }
+    return numBlockCpus;
+# else
+    return 0;
+# endif
+}
+
 QuESTEnv createQuESTEnv(void) {
     
     QuESTEnv env;
@@ -158,7 +463,35 @@ QuESTEnv createQuESTEnv(void) {
         env.numRanks=numRanks;
 	}
     
-	seedQuESTDefault();
+	seedQuESTDefault(&env);
+    
+    // threads are pinned before any tuning of the policy, so that it is tuned to the threads kernels will use
+    NodeTopology topo;
+    getNodeTopology(&topo);
+    findNodeRanks(&env);
+    env.numPinnedCpus = pinThreads(env, &topo);
+    
+    // a fixed policy keeps identical runs bitwise reproducible, so tuning it is optional; when tuned, 
+    // every rank takes the largest tuned grain, so all ranks divide their chunks alike
+    char* tuneVar = getenv("QUEST_TUNE_EXEC_POLICY");
+    int isTuned = (tuneVar != NULL && atoi(tuneVar) != 0);
+    MPI_Bcast(&isTuned, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    env.policy = getEnvExecPolicy(isTuned);
+    MPI_Allreduce(MPI_IN_PLACE, &env.policy.minAmpsPerThread, 1, MPI_LONG_LONG_INT, MPI_MAX, MPI_COMM_WORLD);
+    
+    // state-vectors exchange chunks through a buffer of at most this size (0 meaning a whole chunk),
+    // which every rank must agree upon so that their slices match
+    long long int bufferMB = DEFAULT_EXCHANGE_BUFFER_MB;
+    char* bufferVar = getenv("QUEST_EXCHANGE_BUFFER_MB");
+    if (bufferVar != NULL && atoll(bufferVar) >= 0)
+        bufferMB = atoll(bufferVar);
+    MPI_Bcast(&bufferMB, 1, MPI_LONG_LONG_INT, 0, MPI_COMM_WORLD);
+    env.maxExchangeBufferBytes = bufferMB << 20;
+    
+    // compressing exchanges pays when the network is slow and states are sparse, so is optional
+    char* compressVar = getenv("QUEST_EXCHANGE_COMPRESSION");
+    env.compressExchanges = (compressVar != NULL && atoi(compressVar) != 0);
+    MPI_Bcast(&env.compressExchanges, 1, MPI_INT, 0, MPI_COMM_WORLD);
     
     return env;
 }
@@ -180,6 +513,87 @@ void destroyQuESTEnv(QuESTEnv env){
     else printf("ERROR: Trying to close QuESTEnv multiple times. Ignoring\n");
 }
 
+/** Reports the exchange buffer, and the largest state-vector 64 ranks like this one could hold with 
+ * it, rather than with a buffer of a whole chunk. A power of 2 amplitudes fit the node's memory either 
+ * way, so a bounded buffer buys at most one qubit.
+ */
+static void reportExchangeBuffer(QuESTEnv env) {
+    int numReportedRanks = 64;
+    long long int memBytes = (long long int) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    long long int ampBytes = 2 * sizeof(qreal);
+    
+    if (env.maxExchangeBufferBytes == 0) {
+        printf("Exchange buffer holds a whole chunk\n");
+        return;
+    }
+    
+    long long int wholeChunkAmps = 1;
+    while (2 * (2*wholeChunkAmps) * ampBytes <= memBytes)
+        wholeChunkAmps *= 2;
+    long long int boundedChunkAmps = 1;
+    for (;;) {
+        long long int chunkBytes = (2*boundedChunkAmps) * ampBytes;
+        long long int bufferBytes = (env.maxExchangeBufferBytes < chunkBytes)? env.maxExchangeBufferBytes : chunkBytes;
+        if (chunkBytes + bufferBytes > memBytes)
+            break;
+        boundedChunkAmps *= 2;
+    }
+    
+    int wholeChunkQubits = 0, boundedQubits = 0;
+    while ((1LL << wholeChunkQubits) < wholeChunkAmps * numReportedRanks)
+        wholeChunkQubits++;
+    while ((1LL << boundedQubits) < boundedChunkAmps * numReportedRanks)
+        boundedQubits++;
+    printf("Exchange buffer is at most %lld MiB, so %d ranks of %lld MiB fit %d qubits, rather than %d with a whole-chunk buffer\n",
+        env.maxExchangeBufferBytes >> 20, numReportedRanks, memBytes >> 20, boundedQubits, wholeChunkQubits);
+}
+
+/** Reports the topology of rank 0's node, whether threads are pinned, and the layout of ranks and 
+ * threads which would suit the node: one rank per NUMA node (or socket), whose memory its pinned 
+ * threads then share, with a thread per core. The ranks per node are a power of 2, as QuEST requires 
+ * of the ranks in all.
+ */
+static void reportNodeTopology(QuESTEnv env) {
+    NodeTopology topo;
+    getNodeTopology(&topo);
+    printf("Node of rank 0 has %d CPUs in %d cores, %d sockets and %d NUMA nodes, shared by %d ranks\n",
+        topo.numCpus, topo.numCores, topo.numSockets, topo.numNumaNodes, env.numNodeRanks);
+    if (env.numPinnedCpus > 0)
+        printf("Threads of rank 0 are pinned, each to its own CPU of a block of %d\n", env.numPinnedCpus);
+    else
+        printf("Threads are not pinned by QuEST\n");
+    
+    int numDomains = (topo.numNumaNodes > 1)? topo.numNumaNodes : topo.numSockets;
+    int numRanksPerNode = 1;
+    while (2*numRanksPerNode <= numDomains)
+        numRanksPerNode *= 2;
+    int numThreadsPerRank = topo.numCores / numRanksPerNode;
+    if (numThreadsPerRank < 1)
+        numThreadsPerRank = 1;
+    printf("Recommended layout is %d ranks per node (one per %s), each of %d threads (one per core)\n",
+        numRanksPerNode, (topo.numNumaNodes > 1)? "NUMA node" : "socket", numThreadsPerRank);
+}
+
+/** Reports the memory bandwidth each rank achieved while all streamed at once, and the imbalance 
+ * between them; a rank far slower than the rest shares its memory with too many others, or runs 
+ * threads far from it.
+ */
+static void reportBandwidths(QuESTEnv env, double* bandwidths) {
+    double minBandwidth = bandwidths[0];
+    double maxBandwidth = bandwidths[0];
+    printf("Memory bandwidth achieved by each rank streaming %lld MiB at once:\n", 
+        (3 * BANDWIDTH_NUM_AMPS * (long long int) sizeof(qreal)) >> 20);
+    for (int r=0; r < env.numRanks; r++) {
+        printf("  rank %d: %.2f GB/s\n", r, bandwidths[r] / 1e9);
+        if (bandwidths[r] < minBandwidth)
+            minBandwidth = bandwidths[r];
+        if (bandwidths[r] > maxBandwidth)
+            maxBandwidth = bandwidths[r];
+    }
+    if (maxBandwidth > 0)
+        printf("Slowest rank achieved %.0f%% of the fastest's bandwidth\n", 100 * minBandwidth / maxBandwidth);
+}
+
 void reportQuESTEnv(QuESTEnv env){
     if (env.rank==0){
         printf("EXECUTION ENVIRONMENT:\n"); 
@@ -188,19 +602,46 @@ void reportQuESTEnv(QuESTEnv env){
 # ifdef _OPENMP
         printf("OpenMP enabled\n");
         printf("Number of threads available is %d\n", omp_get_max_threads());
+        printf("Kernels give each thread at least %lld amplitudes\n", env.policy.minAmpsPerThread);
 # else
         printf("OpenMP disabled\n");
 # endif 
         printf("Precision: size of qreal is %ld bytes\n", sizeof(qreal) );
+        reportExchangeBuffer(env);
+        if (env.compressExchanges)
+            printf("Exchanges send only the nonzero amplitudes of mostly zero slices\n");
+        reportNodeTopology(env);
     }
 }
 
+void reportMemoryBandwidth(QuESTEnv env){
+    
+    // every rank measures its bandwidth while the others do
+    double* bandwidths = calloc(env.numRanks, sizeof *bandwidths);
+    bandwidths[env.rank] = measureMemoryBandwidth(BANDWIDTH_NUM_AMPS);
+    MPI_Allreduce(MPI_IN_PLACE, bandwidths, env.numRanks, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    if (env.rank==0)
+        reportBandwidths(env, bandwidths);
+    free(bandwidths);
+}
+
 void reportNodeList(QuESTEnv env){
     char hostName[256];
     gethostname(hostName, 255);
     printf("hostname on rank %d: %s\n", env.rank, hostName);
 }
 
+void statevec_calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages) 
+{
+    // every trajectory is distributed over all ranks, which agree on each sampled error and 
+    // observable, so trajectories run in turn and need no final reduction
+    sumTrajectories(env, numQubits, 0, numTrajectories, circuit, observe, args, numObservables, averages);
+    for (int o=0; o < numObservables; o++)
+        averages[o] /= numTrajectories;
+}
+
 int getChunkIdFromIndex(Qureg qureg, long long int index){
     return index/qureg.numAmpsPerChunk; // this is numAmpsPerChunk
 }
@@ -376,84 +817,122 @@ static int densityMatrixBlockFitsInChunk(long long int chunkSize, int numQubits,
     else return 0;
 }
 
-void copyVecIntoMatrixPairState(Qureg matr, Qureg vec) {
+/** A distributed pure state streamed around the ring of ranks, so that every rank sees every amplitude
+ * while holding only two slices of it at once. Each chunk is divided into slices, as for a PairExchange, 
+ * and every rank receives each slice of its lower neighbour's chunks from it, and forwards it to its
+ * upper neighbour while consuming it. Slices are passed in order of their index within the chunk, so 
+ * a rank forwards a slice on the very step after receiving it, and the received slices alternate 
+ * between two buffers at the start of the density matrix's pairStateVec. This replaces a broadcast of
+ * the whole pure state into every pairStateVec, so memory is independent of the number of ranks.
+ */
+typedef struct PureStateRing
+{
+    Qureg vec;
+    ComplexArray buffers[2];
+    long long int sliceSize;
+    int numSlices;
+    //! the step about to be consumed, which is slice (step / numChunks) of the chunk (step % numChunks) ranks below
+    int step;
+    //! the receive then sends of the real then imaginary amplitudes in flight
+    MPI_Request requests[4];
+    int numRequests;
+} PureStateRing;
+
+static void beginPureStateRing(PureStateRing* ring, Qureg matr, Qureg vec) {
+    long long int sliceSize = vec.numAmpsPerChunk / EXCHANGE_NUM_SLICES;
+    if (sliceSize < EXCHANGE_MIN_SLICE_AMPS)
+        sliceSize = EXCHANGE_MIN_SLICE_AMPS;
+    if (sliceSize > MPI_MAX_AMPS_IN_MSG)
+        sliceSize = MPI_MAX_AMPS_IN_MSG;
+    if (sliceSize > vec.numAmpsPerChunk)
+        sliceSize = vec.numAmpsPerChunk;
     
-    // copy this state's pure state section into this qureg's pairState
-    long long int numLocalAmps = vec.numAmpsPerChunk;
-    long long int myOffset = vec.chunkId * numLocalAmps;
-    memcpy(&matr.pairStateVec.real[myOffset], vec.stateVec.real, numLocalAmps * sizeof(qreal) );
-    memcpy(&matr.pairStateVec.imag[myOffset], vec.stateVec.imag, numLocalAmps * sizeof(qreal) );
+    // the density matrix chunk holds as many columns as the vector chunk holds amplitudes, so its 
+    // pairStateVec fits two slices
+    ring->vec = vec;
+    ring->sliceSize = sliceSize;
+    ring->numSlices = vec.numAmpsPerChunk / sliceSize;
+    for (int b=0; b < 2; b++) {
+        ring->buffers[b].real = &matr.pairStateVec.real[b*sliceSize];
+        ring->buffers[b].imag = &matr.pairStateVec.imag[b*sliceSize];
+    }
+    ring->step = 0;
+    ring->numRequests = 0;
+}
 
-    // work out how many messages needed to send vec chunks (2GB limit)
-    long long int maxMsgSize = MPI_MAX_AMPS_IN_MSG;
-    if (numLocalAmps < maxMsgSize) 
-        maxMsgSize = numLocalAmps;
-    // safely assume MPI_MAX... = 2^n, so division always exact:
-    int numMsgs = numLocalAmps / maxMsgSize;
+/** Waits for the previous step's messages, then posts those of the next step and gives the slice to
+ * consume meanwhile, as its amplitudes and the global index of the first. Returns 0 once every slice 
+ * of every chunk has been given.
+ */
+static int awaitPureStateSlice(PureStateRing* ring, ComplexArray* amps, long long int* startInd) {
+    int TAG=100;
+    Qureg vec = ring->vec;
+    int numSteps = vec.numChunks * ring->numSlices;
     
-    // every node gets a turn at being the broadcaster
-    for (int broadcaster=0; broadcaster < vec.numChunks; broadcaster++) {
-        
-        long long int otherOffset = broadcaster * numLocalAmps;
-    
-        // every node sends a slice of qureg's pairState to every other
-        for (int i=0; i< numMsgs; i++) {
-    
-            // by sending that slice in further slices (due to bandwidth limit)
-            MPI_Bcast(
-                &matr.pairStateVec.real[otherOffset + i*maxMsgSize], 
-                maxMsgSize,  MPI_QuEST_REAL, broadcaster, MPI_COMM_WORLD);
-            MPI_Bcast(
-                &matr.pairStateVec.imag[otherOffset + i*maxMsgSize], 
-                maxMsgSize,  MPI_QuEST_REAL, broadcaster, MPI_COMM_WORLD);
-        }
+    MPI_Waitall(ring->numRequests, ring->requests, MPI_STATUSES_IGNORE);
+    ring->numRequests = 0;
+    if (ring->step == numSteps)
+        return 0;
+    
+    // a slice of this rank's own chunk is read in place, and the rest from the buffer received into
+    int hops = ring->step % vec.numChunks;
+    int slice = ring->step / vec.numChunks;
+    int owner = (vec.chunkId - hops + vec.numChunks) % vec.numChunks;
+    long long int offset = slice * ring->sliceSize;
+    if (hops == 0) {
+        amps->real = &vec.stateVec.real[offset];
+        amps->imag = &vec.stateVec.imag[offset];
+    } else
+        *amps = ring->buffers[ring->step % 2];
+    *startInd = owner * vec.numAmpsPerChunk + offset;
+    
+    // the slice is forwarded until it reaches the rank below its owner, which receives it last
+    if (hops < vec.numChunks - 1) {
+        int lowerRank = (vec.chunkId - 1 + vec.numChunks) % vec.numChunks;
+        int upperRank = (vec.chunkId + 1) % vec.numChunks;
+        ComplexArray next = ring->buffers[(ring->step + 1) % 2];
+        MPI_Irecv(next.real, ring->sliceSize, MPI_QuEST_REAL, lowerRank, TAG, MPI_COMM_WORLD, &ring->requests[0]);
+        MPI_Irecv(next.imag, ring->sliceSize, MPI_QuEST_REAL, lowerRank, TAG, MPI_COMM_WORLD, &ring->requests[1]);
+        MPI_Isend(amps->real, ring->sliceSize, MPI_QuEST_REAL, upperRank, TAG, MPI_COMM_WORLD, &ring->requests[2]);
+        MPI_Isend(amps->imag, ring->sliceSize, MPI_QuEST_REAL, upperRank, TAG, MPI_COMM_WORLD, &ring->requests[3]);
+        ring->numRequests = 4;
     }
+    
+    ring->step++;
+    return 1;
 }
 
 qreal densmatr_calcFidelity(Qureg qureg, Qureg pureState) {
     
-    // set qureg's pairState is to be the full pureState (on every node)
-    copyVecIntoMatrixPairState(qureg, pureState);
- 
-    // collect calcFidelityLocal by every machine
-    qreal localSum = densmatr_calcFidelityLocal(qureg, pureState);
+    // each rank sums over its columns, one slice of rows at a time
+    qreal localSum = 0;
+    ComplexArray amps;
+    long long int startRow;
+    PureStateRing ring;
+    beginPureStateRing(&ring, qureg, pureState);
+    while (awaitPureStateSlice(&ring, &amps, &startRow))
+        localSum += densmatr_calcFidelityLocal(qureg, pureState, amps, startRow, ring.sliceSize);
     
-    // sum each localSum
     qreal globalSum;
-    MPI_Allreduce(&localSum, &globalSum, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
+    ReductionBatch batch;
+    beginReductionBatch(&batch, &globalSum);
+    deferReduction(&batch, localSum);
+    resolveReductionBatch(&batch, qureg);
     
     return globalSum;
 }
 
 void densmatr_initPureState(Qureg targetQureg, Qureg copyQureg) {
-
-    if (targetQureg.numChunks==1){
-        // local version
-        // save pointers to qureg's pair state
-        qreal* quregPairRePtr = targetQureg.pairStateVec.real;
-        qreal* quregPairImPtr = targetQureg.pairStateVec.imag;
-
-        // populate qureg pair state with pure state (by repointing)
-        targetQureg.pairStateVec.real = copyQureg.stateVec.real;
-        targetQureg.pairStateVec.imag = copyQureg.stateVec.imag;
-
-        // populate density matrix via it's pairState
-        densmatr_initPureStateLocal(targetQureg, copyQureg);
-
-        // restore pointers
-        targetQureg.pairStateVec.real = quregPairRePtr;
-        targetQureg.pairStateVec.imag = quregPairImPtr;
-    } else {
-        // set qureg's pairState is to be the full pure state (on every node)
-        copyVecIntoMatrixPairState(targetQureg, copyQureg);
-        
-        // update every density matrix chunk using pairState
-        densmatr_initPureStateLocal(targetQureg, copyQureg);
-    }
+    
+    // each rank sets its columns, one slice of rows at a time
+    ComplexArray amps;
+    long long int startRow;
+    PureStateRing ring;
+    beginPureStateRing(&ring, targetQureg, copyQureg);
+    while (awaitPureStateSlice(&ring, &amps, &startRow))
+        densmatr_initPureStateLocal(targetQureg, copyQureg, amps, startRow, ring.sliceSize);
 }
 
-
-
 void exchangeStateVectors(Qureg qureg, int pairRank){
     // MPI send/receive vars
     int TAG=100;
@@ -484,6 +963,276 @@ void exchangeStateVectors(Qureg qureg, int pairRank){
     }
 }
 
+/** A chunk exchange in progress, divided into slices which are sent and received without
+ * blocking, so that a gate updates each slice of stateVec as soon as its pair slice arrives
+ * while later slices are still in flight. The slices pass through numSlots slots of pairStateVec,
+ * which may be smaller than the chunk: slice j is posted into slot j % numSlots once slice 
+ * j - numSlots has been updated. A controlled exchange sends only the amplitudes with every local
+ * control bit set, gathered (and afterward scattered back) slice by slice through its slot.
+ * A compressed exchange sends only the nonzero amplitudes of a slice, with a mask of which they are,
+ * compacted through its slot likewise.
+ */
+typedef struct PairExchange
+{
+    Qureg qureg;
+    int pairRank;
+    //! the control bits within the chunk, whose amplitudes are packed, or 0 to exchange every amplitude
+    long long int localCtrlMask;
+    //! whether slices are zero-run encoded, unless too few of their amplitudes are zero
+    int isCompressed;
+    long long int sliceSize;
+    int numSlices;
+    int numSlots;
+    //! the receives then sends of the real then imaginary amplitudes (then the masks, if compressed) of each slot
+    MPI_Request* requests;
+    //! if compressed, the masks received then sent for each slot, of EXCHANGE_MASK_WORDS(sliceSize) words
+    long long int* masks;
+} PairExchange;
+
+/** the words of a compressed slice's mask: the number of amplitudes sent (or -1 if every one is, 
+ * uncompressed), then a bit per amplitude, set if it is nonzero */
+# define EXCHANGE_MASK_WORDS(sliceSize) (1 + ((sliceSize) + 63) / 64)
+
+/** Returns 0 if a control bit of ctrlMask beyond the chunk is off, in which case neither this chunk 
+ * nor its pair (which differs only in the target bit) is changed by the controlled gate, and no 
+ * exchange is needed
+ */
+static int globalControlsAreSet(Qureg qureg, long long int ctrlMask) {
+    long long int globalMask = ctrlMask & ~(qureg.numAmpsPerChunk - 1);
+    return ((qureg.chunkId * qureg.numAmpsPerChunk) & globalMask) == globalMask;
+}
+
+/** Whether slices are staged in the first half of their slot before being sent */
+static int isPairExchangeStaged(PairExchange* exchange) {
+    return exchange->localCtrlMask != 0 || exchange->isCompressed;
+}
+
+/** The amplitudes of slice j which are updated in place, the half of its slot they are staged in 
+ * (if they are), and the half into which its pair slice is received */
+static void getPairExchangeBuffers(PairExchange* exchange, int j, 
+    ComplexArray* amps, ComplexArray* staged, ComplexArray* received) 
+{
+    Qureg qureg = exchange->qureg;
+    long long int sliceSize = exchange->sliceSize;
+    long long int slotStart = (j % exchange->numSlots) * sliceSize;
+    
+    amps->real = &qureg.stateVec.real[j*sliceSize];
+    amps->imag = &qureg.stateVec.imag[j*sliceSize];
+    if (isPairExchangeStaged(exchange)) {
+        slotStart *= 2;
+        staged->real = &qureg.pairStateVec.real[slotStart];
+        staged->imag = &qureg.pairStateVec.imag[slotStart];
+        slotStart += sliceSize;
+        
+        // packed amplitudes are updated where they are staged
+        if (exchange->localCtrlMask != 0)
+            *amps = *staged;
+    }
+    received->real = &qureg.pairStateVec.real[slotStart];
+    received->imag = &qureg.pairStateVec.imag[slotStart];
+}
+
+/** Compacts the nonzero amplitudes of in into the front of out (which may be in itself), recording 
+ * them in mask, unless more than half are nonzero, when the slice is worth sending as it is. Returns 
+ * the number of amplitudes to send. A slice whose evenly spaced samples are mostly nonzero is sent as 
+ * it is without being counted, so that dense states pay only for the samples; the count of any other 
+ * is shared among the register's threads, leaving only the compaction serial.
+ */
+static long long int compressExchangeSlice(Qureg qureg, ComplexArray in, ComplexArray out, long long int sliceSize, 
+    long long int* mask) 
+{
+    long long int sampleStride = (sliceSize > EXCHANGE_COMPRESSION_SAMPLES)? sliceSize / EXCHANGE_COMPRESSION_SAMPLES : 1;
+    long long int numSamples = 0, numNonZeroSamples = 0;
+    for (long long int i=0; i < sliceSize; i += sampleStride) {
+        numSamples++;
+        numNonZeroSamples += (in.real[i] != 0 || in.imag[i] != 0);
+    }
+    long long int numNonZero = sliceSize;
+    if (2*numNonZeroSamples <= numSamples)
+        numNonZero = statevec_countNonZeroAmps(qureg, in, sliceSize);
+    if (2*numNonZero > sliceSize) {
+        mask[0] = -1;
+        return sliceSize;
+    }
+    
+    // output never overtakes input, so may overwrite it
+    long long int k = 0;
+    mask[0] = numNonZero;
+    for (long long int w=1; w < EXCHANGE_MASK_WORDS(sliceSize); w++)
+        mask[w] = 0;
+    for (long long int i=0; i < sliceSize; i++) {
+        if (in.real[i] != 0 || in.imag[i] != 0) {
+            mask[1 + i/64] |= 1LL << (i%64);
+            out.real[k] = in.real[i];
+            out.imag[k] = in.imag[i];
+            k++;
+        }
+    }
+    return numNonZero;
+}
+
+/** Expands a slice compacted by compressExchangeSlice in place, restoring its zeros */
+static void decompressExchangeSlice(ComplexArray amps, long long int sliceSize, long long int* mask) {
+    if (mask[0] < 0)
+        return;
+    
+    // from the back, so that no compacted amplitude is overwritten before it is moved
+    long long int k = mask[0];
+    for (long long int i=sliceSize-1; i >= 0; i--) {
+        if ((mask[1 + i/64] >> (i%64)) & 1) {
+            k--;
+            amps.real[i] = amps.real[k];
+            amps.imag[i] = amps.imag[k];
+        } else {
+            amps.real[i] = 0;
+            amps.imag[i] = 0;
+        }
+    }
+}
+
+/** Posts the receive and send of slice j into its slot, gathering and compressing it first as needed */
+static void postPairExchangeSlice(PairExchange* exchange, int j) {
+    int TAG=100;
+    long long int sliceSize = exchange->sliceSize;
+    int slot = j % exchange->numSlots;
+    ComplexArray amps, staged, received;
+    getPairExchangeBuffers(exchange, j, &amps, &staged, &received);
+    
+    if (exchange->localCtrlMask != 0)
+        statevec_packAmps(exchange->qureg, exchange->localCtrlMask, exchange->localCtrlMask, staged, 
+            j*sliceSize, sliceSize, 0);
+    
+    // an uncompressed slice is sent from where it is updated
+    ComplexArray sent = amps;
+    long long int numSent = sliceSize;
+    long long int numMaskWords = EXCHANGE_MASK_WORDS(sliceSize);
+    long long int* receivedMask = &exchange->masks[2*slot*numMaskWords];
+    long long int* sentMask = &receivedMask[numMaskWords];
+    if (exchange->isCompressed) {
+        numSent = compressExchangeSlice(exchange->qureg, amps, staged, sliceSize, sentMask);
+        if (sentMask[0] >= 0)
+            sent = staged;
+    }
+    
+    // receives are posted before sends, and slices are matched in order. Compressed messages may be 
+    // shorter than their receives
+    MPI_Request* requests = &exchange->requests[6*slot];
+    MPI_Irecv(received.real, sliceSize, MPI_QuEST_REAL, exchange->pairRank, TAG, MPI_COMM_WORLD, &requests[0]);
+    MPI_Irecv(received.imag, sliceSize, MPI_QuEST_REAL, exchange->pairRank, TAG, MPI_COMM_WORLD, &requests[1]);
+    if (exchange->isCompressed)
+        MPI_Irecv(receivedMask, numMaskWords, MPI_LONG_LONG_INT, exchange->pairRank, TAG, MPI_COMM_WORLD, &requests[4]);
+    MPI_Isend(sent.real, numSent, MPI_QuEST_REAL, exchange->pairRank, TAG, MPI_COMM_WORLD, &requests[2]);
+    MPI_Isend(sent.imag, numSent, MPI_QuEST_REAL, exchange->pairRank, TAG, MPI_COMM_WORLD, &requests[3]);
+    if (exchange->isCompressed)
+        MPI_Isend(sentMask, (sentMask[0] < 0)? 1 : numMaskWords, MPI_LONG_LONG_INT, exchange->pairRank, TAG, 
+            MPI_COMM_WORLD, &requests[5]);
+}
+
+/** Scatters slice j back into stateVec if packed, then frees its slot for the slice numSlots later */
+static void finishPairExchangeSlice(PairExchange* exchange, int j) {
+    if (exchange->localCtrlMask != 0) {
+        ComplexArray amps, staged, received;
+        getPairExchangeBuffers(exchange, j, &amps, &staged, &received);
+        statevec_packAmps(exchange->qureg, exchange->localCtrlMask, exchange->localCtrlMask, staged, 
+            j*exchange->sliceSize, exchange->sliceSize, 1);
+    }
+    if (j + exchange->numSlots < exchange->numSlices)
+        postPairExchangeSlice(exchange, j + exchange->numSlots);
+}
+
+/** Begins the exchange of this chunk with pairRank's, slice by slice, posting as many slices as 
+ * pairStateVec has slots for. Only the amplitudes with every bit of ctrlMask within the chunk set 
+ * are exchanged (so 2^k times fewer for k local controls), and those beyond the chunk must be set,
+ * as checked by globalControlsAreSet. Slices are a fraction EXCHANGE_NUM_SLICES of the exchanged 
+ * amplitudes, but no smaller than EXCHANGE_MIN_SLICE_AMPS or minSliceSize (for kernels pairing 
+ * amplitudes within the chunk), nor larger than one message. If pairStateVec cannot hold every 
+ * slice, they are shrunk so that it holds at least two, one being updated while the next arrives.
+ * Slices are compressed if the register compresses its exchanges, unless staging them would
+ * shrink them below minSliceSize.
+ */
+static void beginPairExchange(PairExchange* exchange, Qureg qureg, int pairRank, long long int ctrlMask, 
+    long long int minSliceSize) 
+{
+    exchange->localCtrlMask = ctrlMask & (qureg.numAmpsPerChunk - 1);
+    exchange->isCompressed = qureg.compressExchanges && (minSliceSize <= qureg.numPairAmps / 4);
+    
+    long long int numExchanged = qureg.numAmpsPerChunk >> __builtin_popcountll(exchange->localCtrlMask);
+    long long int sliceSize = numExchanged / EXCHANGE_NUM_SLICES;
+    if (sliceSize < EXCHANGE_MIN_SLICE_AMPS)
+        sliceSize = EXCHANGE_MIN_SLICE_AMPS;
+    if (sliceSize < minSliceSize)
+        sliceSize = minSliceSize;
+    if (sliceSize > MPI_MAX_AMPS_IN_MSG)
+        sliceSize = MPI_MAX_AMPS_IN_MSG;
+    if (sliceSize > numExchanged)
+        sliceSize = numExchanged;
+    
+    // a staged slot holds both the staged and received amplitudes. Kernels needing a minimum slice
+    // (those of density matrices) always have a whole chunk of pairStateVec
+    long long int slotCapacity = (isPairExchangeStaged(exchange))? qureg.numPairAmps / 2 : qureg.numPairAmps;
+    if (numExchanged > slotCapacity && sliceSize > slotCapacity / 2)
+        sliceSize = slotCapacity / 2;
+    
+    // all sizes are powers of 2, so slices tile the exchanged amplitudes and slots tile pairStateVec
+    exchange->qureg = qureg;
+    exchange->pairRank = pairRank;
+    exchange->sliceSize = sliceSize;
+    exchange->numSlices = numExchanged / sliceSize;
+    exchange->numSlots = slotCapacity / sliceSize;
+    if (exchange->numSlots > exchange->numSlices)
+        exchange->numSlots = exchange->numSlices;
+    exchange->requests = malloc(6 * exchange->numSlots * sizeof *exchange->requests);
+    exchange->masks = NULL;
+    if (exchange->isCompressed)
+        exchange->masks = malloc(2 * exchange->numSlots * EXCHANGE_MASK_WORDS(sliceSize) * sizeof *exchange->masks);
+    if (exchange->requests == NULL || (exchange->isCompressed && exchange->masks == NULL)) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    for (int j=0; j < exchange->numSlots; j++)
+        postPairExchangeSlice(exchange, j);
+}
+
+/** Finishes slice i-1, then waits until slice i has been both received and sent, so that it may be
+ * overwritten, and returns it (decompressed) as a register of its own: since slices tile the exchanged 
+ * amplitudes evenly, slice i is chunk (chunkId*numSlices + i) of the same register divided into 
+ * numSlices times as many chunks, so the distributed kernels find the global indices of its amplitudes 
+ * unchanged (except of a packed slice, whose kernels are uncontrolled and index-free). Slices must be 
+ * awaited in order, and the view is valid only until the next is awaited.
+ */
+static Qureg awaitPairExchangeSlice(PairExchange* exchange, int i) {
+    if (i > 0)
+        finishPairExchangeSlice(exchange, i-1);
+    
+    int slot = i % exchange->numSlots;
+    MPI_Waitall((exchange->isCompressed)? 6 : 4, &exchange->requests[6*slot], MPI_STATUSES_IGNORE);
+    
+    Qureg slice = exchange->qureg;
+    ComplexArray staged;
+    slice.numAmpsPerChunk = exchange->sliceSize;
+    slice.chunkId = exchange->qureg.chunkId * exchange->numSlices + i;
+    slice.numChunks = exchange->qureg.numChunks * exchange->numSlices;
+    getPairExchangeBuffers(exchange, i, &slice.stateVec, &staged, &slice.pairStateVec);
+    
+    // packed amplitudes were compacted where they are updated, so are restored too
+    if (exchange->isCompressed) {
+        long long int numMaskWords = EXCHANGE_MASK_WORDS(exchange->sliceSize);
+        long long int* receivedMask = &exchange->masks[2*slot*numMaskWords];
+        decompressExchangeSlice(slice.pairStateVec, exchange->sliceSize, receivedMask);
+        if (exchange->localCtrlMask != 0)
+            decompressExchangeSlice(slice.stateVec, exchange->sliceSize, &receivedMask[numMaskWords]);
+    }
+    return slice;
+}
+
+/** Finishes the last slice of an exchange whose every slice has been awaited, and frees it */
+static void endPairExchange(PairExchange* exchange) {
+    finishPairExchangeSlice(exchange, exchange->numSlices - 1);
+    free(exchange->requests);
+    free(exchange->masks);
+}
+
 void exchangePairStateVectorHalves(Qureg qureg, int pairRank){
     // MPI send/receive vars
     int TAG=100;
@@ -518,7 +1267,7 @@ void exchangePairStateVectorHalves(Qureg qureg, int pairRank){
 }
 
 //TODO -- decide where this function should go. It is a preparation for MPI data transfer function
-void compressPairVectorForSingleQubitDepolarise(Qureg qureg, const int targetQubit){
+void compressPairVectorForSingleQubitDepolarise(Qureg qureg, int targetQubit){
     long long int sizeInnerBlock, sizeInnerHalfBlock;
     long long int sizeOuterColumn, sizeOuterHalfColumn;
     long long int thisInnerBlock, // current block
@@ -530,7 +1279,7 @@ void compressPairVectorForSingleQubitDepolarise(Qureg qureg, const int targetQub
     int outerBit;
 
     long long int thisTask;
-    const long long int numTasks=qureg.numAmpsPerChunk>>1;
+    long long int numTasks=qureg.numAmpsPerChunk>>1;
 
     // set dimensions
     sizeInnerHalfBlock = 1LL << targetQubit;
@@ -540,8 +1289,9 @@ void compressPairVectorForSingleQubitDepolarise(Qureg qureg, const int targetQub
 
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
-    shared   (sizeInnerBlock,sizeInnerHalfBlock,sizeOuterColumn,sizeOuterHalfColumn,qureg) \
+    shared   (sizeInnerBlock,sizeInnerHalfBlock,sizeOuterColumn,sizeOuterHalfColumn,qureg,numTasks,targetQubit) \
     private  (thisTask,thisInnerBlock,thisOuterColumn,thisIndex,thisIndexInOuterColumn, \
                 thisIndexInInnerBlock,outerBit) 
 # endif
@@ -584,8 +1334,8 @@ void compressPairVectorForSingleQubitDepolarise(Qureg qureg, const int targetQub
     }
 }
 
-void compressPairVectorForTwoQubitDepolarise(Qureg qureg, const int targetQubit,
-        const int qubit2) {
+void compressPairVectorForTwoQubitDepolarise(Qureg qureg, int targetQubit,
+        int qubit2) {
 
     long long int sizeInnerBlockQ1, sizeInnerHalfBlockQ1;
     long long int sizeInnerBlockQ2, sizeInnerHalfBlockQ2, sizeInnerQuarterBlockQ2;
@@ -601,7 +1351,7 @@ void compressPairVectorForTwoQubitDepolarise(Qureg qureg, const int targetQubit,
     int outerBitQ1, outerBitQ2;
 
     long long int thisTask;
-    const long long int numTasks=qureg.numAmpsPerChunk>>2;
+    long long int numTasks=qureg.numAmpsPerChunk>>2;
 
     // set dimensions
     sizeInnerHalfBlockQ1 = 1LL << targetQubit;
@@ -614,10 +1364,11 @@ void compressPairVectorForTwoQubitDepolarise(Qureg qureg, const int targetQubit,
  
 # ifdef _OPENMP
 # pragma omp parallel \
+    num_threads (getNumKernelThreads(qureg)) \
     default  (none) \
     shared   (sizeInnerBlockQ1,sizeInnerHalfBlockQ1,sizeInnerQuarterBlockQ2,sizeInnerHalfBlockQ2,sizeInnerBlockQ2, \
                 sizeOuterColumn, \
-                sizeOuterQuarterColumn,qureg) \
+                sizeOuterQuarterColumn,qureg,numTasks,targetQubit,qubit2) \
     private  (thisTask,thisInnerBlockQ2,thisOuterColumn,thisIndex,thisIndexInOuterColumn, \
                 thisIndexInInnerBlockQ1,thisIndexInInnerBlockQ2,thisInnerBlockQ1InInnerBlockQ2,outerBitQ1,outerBitQ2) 
 # endif
@@ -707,8 +1458,6 @@ void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depo
     int pairRank; // rank of corresponding chunk
     int biggerQubit, smallerQubit;
 
-    densmatr_twoQubitDephase(qureg, qubit1, qubit2, depolLevel);
-    
     qreal eta = 2/depolLevel;
     qreal delta = eta - 1 - sqrt( (eta-1)*(eta-1) - 1 ); 
     qreal gamma = 1+delta;
@@ -729,9 +1478,11 @@ void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depo
     useLocalDataOnlyBigQubit = densityMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, 
         qureg.numQubitsRepresented, biggerQubit);
     if (useLocalDataOnlyBigQubit){
-        // does parts 1, 2 and 3 locally in one go
-        densmatr_twoQubitDepolariseLocal(qureg, qubit1, qubit2, delta, gamma);
+        // dephases and depolarises in a single local pass
+        densmatr_twoQubitDepolariseLocal(qureg, qubit1, qubit2, depolLevel);
     } else {
+        densmatr_twoQubitDephase(qureg, qubit1, qubit2, depolLevel);
+        
         useLocalDataOnlySmallQubit = densityMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, 
             qureg.numQubitsRepresented, smallerQubit);
         if (useLocalDataOnlySmallQubit){
@@ -810,22 +1561,27 @@ void statevec_compactUnitary(Qureg qureg, const int targetQubit, Complex alpha,
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         getRotAngle(rankIsUpper, &rot1, &rot2, alpha, beta);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-
-        // this rank's values are either in the upper of lower half of the block. 
-        // send values to compactUnitaryDistributed in the correct order
-        if (rankIsUpper){
-            statevec_compactUnitaryDistributed(qureg,targetQubit,rot1,rot2,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec); //output
-        } else {
-            statevec_compactUnitaryDistributed(qureg,targetQubit,rot1,rot2,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec); //output
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+
+            // this rank's values are either in the upper of lower half of the block. 
+            // send values to compactUnitaryDistributed in the correct order
+            if (rankIsUpper){
+                statevec_compactUnitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec); //output
+            } else {
+                statevec_compactUnitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec); //output
+            }
         }
+        endPairExchange(&exchange);
     }
 }
 
@@ -847,22 +1603,27 @@ void statevec_unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u)
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         getRotAngleFromUnitaryMatrix(rankIsUpper, &rot1, &rot2, u);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-
-        // this rank's values are either in the upper of lower half of the block. 
-        // send values to compactUnitaryDistributed in the correct order
-        if (rankIsUpper){
-            statevec_unitaryDistributed(qureg,targetQubit,rot1,rot2,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec); //output
-        } else {
-            statevec_unitaryDistributed(qureg,targetQubit,rot1,rot2,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec); //output
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+
+            // this rank's values are either in the upper of lower half of the block. 
+            // send values to compactUnitaryDistributed in the correct order
+            if (rankIsUpper){
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec); //output
+            } else {
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec); //output
+            }
         }
+        endPairExchange(&exchange);
     }
 
 
@@ -870,6 +1631,8 @@ void statevec_unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u)
 
 void statevec_controlledCompactUnitary(Qureg qureg, const int controlQubit, const int targetQubit, Complex alpha, Complex beta)
 {
+    long long int mask = 1LL << controlQubit;
+
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
     int useLocalDataOnly = halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, targetQubit);
     Complex rot1, rot2;
@@ -882,33 +1645,41 @@ void statevec_controlledCompactUnitary(Qureg qureg, const int controlQubit, cons
         // all values required to update state vector lie in this rank
         statevec_controlledCompactUnitaryLocal(qureg, controlQubit, targetQubit, alpha, beta);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         getRotAngle(rankIsUpper, &rot1, &rot2, alpha, beta);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        //printf("%d rank has pair rank: %d\n", qureg.rank, pairRank);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-
-        // this rank's values are either in the upper of lower half of the block. send values to controlledCompactUnitaryDistributed
-        // in the correct order
-        if (rankIsUpper){
-            statevec_controlledCompactUnitaryDistributed(qureg,controlQubit,targetQubit,rot1,rot2,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec); //output
-        } else {
-            statevec_controlledCompactUnitaryDistributed(qureg,controlQubit,targetQubit,rot1,rot2,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec); //output
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+
+            // this rank's values are either in the upper of lower half of the block. the packed amplitudes
+            // are all controlled, so are updated by the uncontrolled compactUnitaryDistributed
+            if (rankIsUpper){
+                statevec_compactUnitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec); //output
+            } else {
+                statevec_compactUnitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec); //output
+            }
         }
+        endPairExchange(&exchange);
     }
 }
 
 void statevec_controlledUnitary(Qureg qureg, const int controlQubit, const int targetQubit, 
         ComplexMatrix2 u)
 {
+    long long int mask = 1LL << controlQubit;
+
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
     int useLocalDataOnly = halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, targetQubit);
     Complex rot1, rot2;
@@ -921,30 +1692,42 @@ void statevec_controlledUnitary(Qureg qureg, const int controlQubit, const int t
         // all values required to update state vector lie in this rank
         statevec_controlledUnitaryLocal(qureg, controlQubit, targetQubit, u);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         getRotAngleFromUnitaryMatrix(rankIsUpper, &rot1, &rot2, u);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        //printf("%d rank has pair rank: %d\n", qureg.rank, pairRank);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-
-        // this rank's values are either in the upper of lower half of the block. send values to controlledUnitaryDistributed
-        // in the correct order
-        if (rankIsUpper){
-            statevec_controlledUnitaryDistributed(qureg,controlQubit,targetQubit,rot1,rot2,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec); //output
-        } else {
-            statevec_controlledUnitaryDistributed(qureg,controlQubit,targetQubit,rot1,rot2,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec); //output
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+
+            // this rank's values are either in the upper of lower half of the block. the packed amplitudes
+            // are all controlled, so are updated by the uncontrolled unitaryDistributed
+            if (rankIsUpper){
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec); //output
+            } else {
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec); //output
+            }
         }
+        endPairExchange(&exchange);
     }
 }
 
+void statevec_applyGateSequence(Qureg qureg, GateSequenceStep* steps, int numSteps)
+{
+    // every target is local, so each rank updates its own chunk without communicating
+    statevec_applyGateSequenceLocal(qureg, steps, numSteps);
+}
+
 void statevec_multiControlledUnitary(Qureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u)
 {
     long long int mask=0;
@@ -962,29 +1745,101 @@ void statevec_multiControlledUnitary(Qureg qureg, int* controlQubits, const int
         // all values required to update state vector lie in this rank
         statevec_multiControlledUnitaryLocal(qureg, targetQubit, mask, u);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         getRotAngleFromUnitaryMatrix(rankIsUpper, &rot1, &rot2, u);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        //printf("%d rank has pair rank: %d\n", qureg.rank, pairRank);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+
+            // this rank's values are either in the upper of lower half of the block. the packed amplitudes
+            // are all controlled, so are updated by the uncontrolled unitaryDistributed
+            if (rankIsUpper){
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec); //output
+            } else {
+                statevec_unitaryDistributed(slice,targetQubit,rot1,rot2,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec); //output
+            }
+        }
+        endPairExchange(&exchange);
+    }
+}
+void densmatr_multiControlledUnitary(Qureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u)
+{
+    int shift = qureg.numQubitsRepresented;
+    long long int mask=0;
+    for (int i=0; i<numControlQubits; i++) mask = mask | (1LL<<controlQubits[i]);
 
-        // this rank's values are either in the upper of lower half of the block. send values to multiControlledUnitaryDistributed
-        // in the correct order
-        if (rankIsUpper){
-            statevec_multiControlledUnitaryDistributed(qureg,targetQubit,mask,rot1,rot2,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec); //output
-        } else {
-            statevec_multiControlledUnitaryDistributed(qureg,targetQubit,mask,rot1,rot2,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec); //output
+    // the shifted (conj) target bit is the more significant, so if it's local then so is the target bit
+    if (halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, targetQubit + shift)) {
+        densmatr_multiControlledUnitaryLocal(qureg, targetQubit, mask, u);
+        return;
+    }
+    
+    if (halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, targetQubit)) {
+        // exchange with the rank differing in the shifted target bit, then apply U and conj(U) in one pass
+        int rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit + shift);
+        int pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit + shift);
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 2LL << targetQubit);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+        
+            if (rankIsUpper){
+                densmatr_multiControlledUnitaryDistributed(slice,targetQubit,mask,u,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec, //output
+                        rankIsUpper);
+            } else {
+                densmatr_multiControlledUnitaryDistributed(slice,targetQubit,mask,u,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec, //output
+                        rankIsUpper);
+            }
         }
+        endPairExchange(&exchange);
+        return;
+    }
+    
+    // both target bits are global, so each of U and conj(U) needs its own exchange
+    statevec_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit, u);
+    shiftIndices(controlQubits, numControlQubits, shift);
+    statevec_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit + shift, getConjugateMatrix(u));
+    shiftIndices(controlQubits, numControlQubits, -shift);
+}
+
+/** Replaces numAmps amplitudes of amps with those of pairRank, in place and without a receive
+ * buffer, as pauliX upon a qubit beyond the chunk does to the whole chunk
+ */
+static void swapAmpsWithPair(ComplexArray amps, long long int numAmps, int pairRank) {
+    int TAG=100;
+    MPI_Status status;
+
+    // as in exchangeStateVectors, messages are limited to MPI_MAX_AMPS_IN_MSG amplitudes
+    long long int maxMessageCount = MPI_MAX_AMPS_IN_MSG;
+    if (numAmps < maxMessageCount)
+        maxMessageCount = numAmps;
+
+    for (long long int offset=0; offset < numAmps; offset += maxMessageCount) {
+        MPI_Sendrecv_replace(&amps.real[offset], maxMessageCount, MPI_QuEST_REAL,
+                pairRank, TAG, pairRank, TAG, MPI_COMM_WORLD, &status);
+        MPI_Sendrecv_replace(&amps.imag[offset], maxMessageCount, MPI_QuEST_REAL,
+                pairRank, TAG, pairRank, TAG, MPI_COMM_WORLD, &status);
     }
 }
+
 void statevec_pauliX(Qureg qureg, const int targetQubit)
 {
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
@@ -998,22 +1853,88 @@ void statevec_pauliX(Qureg qureg, const int targetQubit)
         // all values required to update state vector lie in this rank
         statevec_pauliXLocal(qureg, targetQubit);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // pauliX just replaces this rank's values with its pair's, so swap them in place
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        //printf("%d rank has pair rank: %d\n", qureg.rank, pairRank);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block. pauliX just replaces
-        // this rank's values with pair values
-        statevec_pauliXDistributed(qureg, targetQubit,
-                qureg.pairStateVec, // in
-                qureg.stateVec); // out
+        swapAmpsWithPair(qureg.stateVec, qureg.numAmpsPerChunk, pairRank);
+    }
+}
+
+void statevec_swapGlobalQubits(Qureg qureg, int* globalQubits, int* localQubits, int numPairs)
+{
+    int numLocalQubits = 0;
+    while ((1LL << numLocalQubits) < qureg.numAmpsPerChunk)
+        numLocalQubits++;
+
+    long long int localMask = 0;
+    for (int k=0; k < numPairs; k++)
+        localMask |= 1LL << localQubits[k];
+
+    // the amplitudes whose local qubits have value v (localQubits[k] as bit k) are owed to the chunk
+    // whose global qubits have value v, which owes us those of its own whose local qubits have our 
+    // value, in the same order. Pairing chunks by value xor step lets each step be a pairwise swap, 
+    // gathered through pairStateVec as many amplitudes at a time as it holds
+    int myValue = 0;
+    for (int k=0; k < numPairs; k++)
+        myValue |= ((qureg.chunkId >> (globalQubits[k] - numLocalQubits)) & 1) << k;
+
+    long long int numSwapped = qureg.numAmpsPerChunk >> numPairs;
+    long long int numPerPass = (numSwapped < qureg.numPairAmps)? numSwapped : qureg.numPairAmps;
+    for (int step=1; step < (1 << numPairs); step++) {
+        int pairValue = myValue ^ step;
+        int pairRank = qureg.chunkId;
+        long long int localValue = 0;
+        for (int k=0; k < numPairs; k++) {
+            int bit = 1 << (globalQubits[k] - numLocalQubits);
+            pairRank = ((pairValue >> k) & 1)? (pairRank | bit) : (pairRank & ~bit);
+            localValue |= (long long int) ((pairValue >> k) & 1) << localQubits[k];
+        }
+        for (long long int start=0; start < numSwapped; start += numPerPass) {
+            statevec_packAmps(qureg, localMask, localValue, qureg.pairStateVec, start, numPerPass, 0);
+            swapAmpsWithPair(qureg.pairStateVec, numPerPass, pairRank);
+            statevec_packAmps(qureg, localMask, localValue, qureg.pairStateVec, start, numPerPass, 1);
+        }
+    }
+}
+
+void statevec_permuteLocalQubits(Qureg qureg, int* newPositions)
+{
+    if (qureg.numPairAmps >= qureg.numAmpsPerChunk) {
+        statevec_permuteChunkQubits(qureg, newPositions, qureg.stateVec, qureg.pairStateVec);
+
+        long long int numBytes = qureg.numAmpsPerChunk * sizeof(qreal);
+        memcpy(qureg.stateVec.real, qureg.pairStateVec.real, numBytes);
+        memcpy(qureg.stateVec.imag, qureg.pairStateVec.imag, numBytes);
+        return;
+    }
+
+    // pairStateVec cannot hold the chunk, so permute in place by one transposition per misplaced qubit,
+    // tracking the current position of each qubit, and the qubit at each position
+    int numLocalQubits = 0;
+    while ((1LL << numLocalQubits) < qureg.numAmpsPerChunk)
+        numLocalQubits++;
+
+    int position[64], qubitAt[64];
+    for (int q=0; q < numLocalQubits; q++)
+        position[q] = qubitAt[q] = q;
+    for (int q=0; q < numLocalQubits; q++) {
+        int from = position[q];
+        int to = newPositions[q];
+        if (from == to)
+            continue;
+        statevec_swapChunkQubits(qureg, from, to);
+        int displaced = qubitAt[to];
+        qubitAt[from] = displaced;
+        position[displaced] = from;
+        qubitAt[to] = q;
+        position[q] = to;
     }
 }
 
 void statevec_controlledNot(Qureg qureg, const int controlQubit, const int targetQubit)
 {
+    long long int mask = 1LL << controlQubit;
+
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
     int useLocalDataOnly = halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, targetQubit);
     int rankIsUpper; 	// rank's chunk is in upper half of block 
@@ -1023,21 +1944,22 @@ void statevec_controlledNot(Qureg qureg, const int controlQubit, const int targe
         // all values required to update state vector lie in this rank
         statevec_controlledNotLocal(qureg, controlQubit, targetQubit);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block
-        if (rankIsUpper){
-            statevec_controlledNotDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec); //out
-        } else {
-            statevec_controlledNotDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec); //out
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block
+            statevec_pauliXDistributed(slice,targetQubit,
+                    slice.pairStateVec, //in
+                    slice.stateVec); //out
         }
+        endPairExchange(&exchange);
     }
 }
 
@@ -1056,13 +1978,18 @@ void statevec_pauliY(Qureg qureg, const int targetQubit)
         // need to get corresponding chunk of state vector from other rank
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block
-        statevec_pauliYDistributed(qureg,targetQubit,
-                qureg.pairStateVec, // in
-                qureg.stateVec, // out
-                rankIsUpper, conjFac);
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block
+            statevec_pauliYDistributed(slice,targetQubit,
+                    slice.pairStateVec, // in
+                    slice.stateVec, // out
+                    rankIsUpper, conjFac);
+        }
+        endPairExchange(&exchange);
     }
 }
 
@@ -1081,18 +2008,25 @@ void statevec_pauliYConj(Qureg qureg, const int targetQubit)
         // need to get corresponding chunk of state vector from other rank
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block
-        statevec_pauliYDistributed(qureg,targetQubit,
-                qureg.pairStateVec, // in
-                qureg.stateVec, // out
-                rankIsUpper, conjFac);
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block
+            statevec_pauliYDistributed(slice,targetQubit,
+                    slice.pairStateVec, // in
+                    slice.stateVec, // out
+                    rankIsUpper, conjFac);
+        }
+        endPairExchange(&exchange);
     }
 }
 
 void statevec_controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit)
 {
+    long long int mask = 1LL << controlQubit;
+
 	int conjFac = 1;
 
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
@@ -1104,28 +2038,30 @@ void statevec_controlledPauliY(Qureg qureg, const int controlQubit, const int ta
         // all values required to update state vector lie in this rank
         statevec_controlledPauliYLocal(qureg, controlQubit, targetQubit, conjFac);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block
-        if (rankIsUpper){
-            statevec_controlledPauliYDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec,
-					conjFac); //out
-        } else {
-            statevec_controlledPauliYDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec,
-					conjFac); //out
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block
+            statevec_pauliYDistributed(slice,targetQubit,
+                    slice.pairStateVec, // in
+                    slice.stateVec, // out
+                    rankIsUpper, conjFac);
         }
+        endPairExchange(&exchange);
     }
 }
 
 void statevec_controlledPauliYConj(Qureg qureg, const int controlQubit, const int targetQubit)
 {
+    long long int mask = 1LL << controlQubit;
+
 	int conjFac = -1;
 
     // flag to require memory exchange. 1: an entire block fits on one rank, 0: at most half a block fits on one rank
@@ -1137,23 +2073,23 @@ void statevec_controlledPauliYConj(Qureg qureg, const int controlQubit, const in
         // all values required to update state vector lie in this rank
         statevec_controlledPauliYLocal(qureg, controlQubit, targetQubit, conjFac);
     } else {
-        // need to get corresponding chunk of state vector from other rank
+        // only amplitudes with every control bit set need my pair's values
+        if (!globalControlsAreSet(qureg, mask))
+            return;
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block
-        if (rankIsUpper){
-            statevec_controlledPauliYDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec,
-					conjFac); //out
-        } else {
-            statevec_controlledPauliYDistributed(qureg,controlQubit,targetQubit,
-                    qureg.pairStateVec, //in
-                    qureg.stateVec,
-					conjFac); //out
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, mask, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block
+            statevec_pauliYDistributed(slice,targetQubit,
+                    slice.pairStateVec, // in
+                    slice.stateVec, // out
+                    rankIsUpper, conjFac);
         }
+        endPairExchange(&exchange);
     }
 }
 
@@ -1174,21 +2110,26 @@ void statevec_hadamard(Qureg qureg, const int targetQubit)
         rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, targetQubit);
         //printf("%d rank has pair rank: %d\n", qureg.rank, pairRank);
-        // get corresponding values from my pair
-        exchangeStateVectors(qureg, pairRank);
-        // this rank's values are either in the upper of lower half of the block. send values to hadamardDistributed
-        // in the correct order
-        if (rankIsUpper){
-            statevec_hadamardDistributed(qureg,targetQubit,
-                    qureg.stateVec, //upper
-                    qureg.pairStateVec, //lower
-                    qureg.stateVec, rankIsUpper); //output
-        } else {
-            statevec_hadamardDistributed(qureg,targetQubit,
-                    qureg.pairStateVec, //upper
-                    qureg.stateVec, //lower
-                    qureg.stateVec, rankIsUpper); //output
+        // get corresponding values from my pair, updating each slice as it arrives
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            // this rank's values are either in the upper of lower half of the block. send values to hadamardDistributed
+            // in the correct order
+            if (rankIsUpper){
+                statevec_hadamardDistributed(slice,targetQubit,
+                        slice.stateVec, //upper
+                        slice.pairStateVec, //lower
+                        slice.stateVec, rankIsUpper); //output
+            } else {
+                statevec_hadamardDistributed(slice,targetQubit,
+                        slice.pairStateVec, //upper
+                        slice.stateVec, //lower
+                        slice.stateVec, rankIsUpper); //output
+            }
         }
+        endPairExchange(&exchange);
     }
 }
 
@@ -1212,40 +2153,190 @@ static int isChunkToSkipInFindPZero(int chunkId, long long int chunkSize, int me
     return bitToCheck;
 }
 
-qreal statevec_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome)
+/** This chunk's contribution to the probability of measureQubit being 0 */
+static qreal findProbabilityOfZeroInChunk(Qureg qureg, const int measureQubit)
 {
-    qreal stateProb=0, totalStateProb=0;
     int skipValuesWithinRank = halfMatrixBlockFitsInChunk(qureg.numAmpsPerChunk, measureQubit);
-    if (skipValuesWithinRank) {
-        stateProb = statevec_findProbabilityOfZeroLocal(qureg, measureQubit);
-    } else {
-        if (!isChunkToSkipInFindPZero(qureg.chunkId, qureg.numAmpsPerChunk, measureQubit)){
-            stateProb = statevec_findProbabilityOfZeroDistributed(qureg, measureQubit);
-        } else stateProb = 0;
-    }
-    MPI_Allreduce(&stateProb, &totalStateProb, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
-    if (outcome==1) totalStateProb = 1.0 - totalStateProb;
+    if (skipValuesWithinRank)
+        return statevec_findProbabilityOfZeroLocal(qureg, measureQubit);
+    if (!isChunkToSkipInFindPZero(qureg.chunkId, qureg.numAmpsPerChunk, measureQubit))
+        return statevec_findProbabilityOfZeroDistributed(qureg, measureQubit);
+    return 0;
+}
+
+qreal statevec_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome)
+{
+    int qubit = measureQubit;
+    qreal totalStateProb;
+    statevec_calcProbsOfOutcomes(qureg, &qubit, &outcome, 1, &totalStateProb);
     return totalStateProb;
 }
 
 qreal densmatr_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome) {
-	
-	qreal zeroProb = densmatr_findProbabilityOfZeroLocal(qureg, measureQubit);
-	
-	qreal outcomeProb;
-	MPI_Allreduce(&zeroProb, &outcomeProb, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
-	if (outcome == 1)
-		outcomeProb = 1.0 - outcomeProb;
-	
-	return outcomeProb;
+    
+    int qubit = measureQubit;
+    qreal outcomeProb;
+    densmatr_calcProbsOfOutcomes(qureg, &qubit, &outcome, 1, &outcomeProb);
+    return outcomeProb;
 }
 
-qreal densmatr_calcPurity(Qureg qureg) {
+/** Resolves the probabilities of zero deferred for each measurement, into those of the given outcomes */
+static void resolveProbsOfOutcomes(ReductionBatch* batch, Qureg qureg, int* outcomes, int numMeasures) {
+    
+    resolveReductionBatch(batch, qureg);
+    for (int m=0; m < numMeasures; m++)
+        if (outcomes[m] == 1)
+            batch->sums[m] = 1.0 - batch->sums[m];
+}
+
+void statevec_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs) {
     
-    qreal localPurity = densmatr_calcPurityLocal(qureg);
+    ReductionBatch batch;
+    beginReductionBatch(&batch, outcomeProbs);
+    for (int m=0; m < numMeasures; m++)
+        deferReduction(&batch, findProbabilityOfZeroInChunk(qureg, measureQubits[m]));
+    resolveProbsOfOutcomes(&batch, qureg, outcomes, numMeasures);
+}
+
+void densmatr_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs) {
+    
+    ReductionBatch batch;
+    beginReductionBatch(&batch, outcomeProbs);
+    for (int m=0; m < numMeasures; m++)
+        deferReduction(&batch, densmatr_findProbabilityOfZeroLocal(qureg, measureQubits[m]));
+    resolveProbsOfOutcomes(&batch, qureg, outcomes, numMeasures);
+}
+
+/** Swaps bit localBit of every index with bit globalBit (beyond the chunk), by exchanging this chunk with
+ * the one differing in globalBit. Applying it twice restores the original layout.
+ */
+static void swapLocalAndGlobalBit(Qureg qureg, int localBit, int globalBit) {
+    
+    int rankIsUpper = chunkIsUpper(qureg.chunkId, qureg.numAmpsPerChunk, globalBit);
+    int pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, qureg.numAmpsPerChunk, globalBit);
+    
+    exchangeStateVectors(qureg, pairRank);
+    densmatr_swapBitWithPairChunk(qureg, localBit, !rankIsUpper);
+}
+
+void densmatr_applyKrausSuperoperator(Qureg qureg, int* targets, const int numTargets, qreal* superRe, qreal* superIm) {
+    
+    // the row bits of the targets are the least significant bits of the superoperator index
+    int numSuperBits = 2*numTargets;
+    int superBits[4];
+    for (int t=0; t < numTargets; t++) {
+        superBits[t] = targets[t];
+        superBits[t + numTargets] = targets[t] + qureg.numQubitsRepresented;
+    }
+    
+    // all but one bit beyond this chunk are first swapped with a free local bit, so that a 
+    // single exchange with the pair chunk suffices. Validation ensures free local bits exist.
+    long long int chunkSize = qureg.numAmpsPerChunk;
+    int swapLocal[4], swapGlobal[4];
+    int numSwaps = 0;
+    int globalInd = -1;
+    for (int b=0; b < numSuperBits; b++) {
+        if ((1LL << superBits[b]) < chunkSize)
+            continue;
+        if (globalInd == -1) {
+            globalInd = b;
+            continue;
+        }
+        
+        // the lowest local bit outside the group
+        int freeBit = 0;
+        for (int c=0; c < numSuperBits; c++)
+            if (superBits[c] == freeBit) {
+                freeBit++;
+                c = -1;
+            }
         
+        swapLocalAndGlobalBit(qureg, freeBit, superBits[b]);
+        swapLocal[numSwaps] = freeBit;
+        swapGlobal[numSwaps] = superBits[b];
+        numSwaps++;
+        superBits[b] = freeBit;
+    }
+    
+    if (globalInd == -1)
+        densmatr_applyKrausSuperoperatorLocal(qureg, superBits, numSuperBits, superRe, superIm);
+    else {
+        int rankIsUpper = chunkIsUpper(qureg.chunkId, chunkSize, superBits[globalInd]);
+        int pairRank = getChunkPairId(rankIsUpper, qureg.chunkId, chunkSize, superBits[globalInd]);
+        
+        exchangeStateVectors(qureg, pairRank);
+        densmatr_applyKrausSuperoperatorDistributed(qureg, superBits, numSuperBits, superRe, superIm, 
+            globalInd, !rankIsUpper);
+    }
+    
+    // restore the original layout
+    for (int s=numSwaps-1; s >= 0; s--)
+        swapLocalAndGlobalBit(qureg, swapLocal[s], swapGlobal[s]);
+}
+
+void statevec_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    ReductionBatch batch;
+    beginReductionBatch(&batch, expecs);
+    for (int s=0; s < numSums; s++)
+        deferReduction(&batch, 0);
+    
+    // terms with equal flip masks are adjacent, whichever sum they belong to, and share a single pass 
+    // and at most one exchange
+    int start, end;
+    for (start=0; start < numTerms; start=end) {
+        for (end=start+1; end < numTerms && flipMasks[end] == flipMasks[start]; end++)
+            ;
+        
+        // flipped bits beyond the chunk pair it with the chunk whose id differs in those bits
+        int pairRank = qureg.chunkId ^ (int) (flipMasks[start] / qureg.numAmpsPerChunk);
+        if (pairRank == qureg.chunkId) {
+            statevec_calcExpecPauliGroupLocal(qureg, qureg.stateVec, flipMasks[start], 
+                &phaseMasks[start], &factorsRe[start], &factorsIm[start], &sumInds[start], end-start, batch.sums);
+            continue;
+        }
+        
+        // else the pair's slice i arrives, which holds the flipped amplitudes of my slice i ^ sliceFlips, 
+        // where sliceFlips are the flipped bits above a slice but within the chunk
+        PairExchange exchange;
+        beginPairExchange(&exchange, qureg, pairRank, 0, 1);
+        long long int sliceSize = exchange.sliceSize;
+        int sliceFlips = (int) ((flipMasks[start] & (qureg.numAmpsPerChunk - 1)) / sliceSize);
+        for (int i=0; i < exchange.numSlices; i++) {
+            Qureg slice = awaitPairExchangeSlice(&exchange, i);
+            int mySlice = i ^ sliceFlips;
+            slice.chunkId = qureg.chunkId * exchange.numSlices + mySlice;
+            slice.stateVec.real = &qureg.stateVec.real[mySlice * sliceSize];
+            slice.stateVec.imag = &qureg.stateVec.imag[mySlice * sliceSize];
+            statevec_calcExpecPauliGroupLocal(slice, slice.pairStateVec, flipMasks[start], 
+                &phaseMasks[start], &factorsRe[start], &factorsIm[start], &sumInds[start], end-start, batch.sums);
+        }
+        endPairExchange(&exchange);
+    }
+    
+    resolveReductionBatch(&batch, qureg);
+}
+
+void densmatr_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    ReductionBatch batch;
+    beginReductionBatch(&batch, expecs);
+    for (int s=0; s < numSums; s++)
+        deferReduction(&batch, 0);
+    
+    densmatr_calcExpecPauliMasksLocal(qureg, flipMasks, phaseMasks, factorsRe, factorsIm, sumInds, numTerms, batch.sums);
+    resolveReductionBatch(&batch, qureg);
+}
+
+qreal densmatr_calcPurity(Qureg qureg) {
+    
     qreal globalPurity;
-    MPI_Allreduce(&localPurity, &globalPurity, 1, MPI_QuEST_REAL, MPI_SUM, MPI_COMM_WORLD);
+    ReductionBatch batch;
+    beginReductionBatch(&batch, &globalPurity);
+    deferReduction(&batch, densmatr_calcPurityLocal(qureg));
+    resolveReductionBatch(&batch, qureg);
     
     return globalPurity;
 }
@@ -1270,15 +2361,13 @@ void statevec_collapseToKnownProbOutcome(Qureg qureg, const int measureQubit, in
     }
 }
 
-void seedQuESTDefault(){
-    // init MT random number generator with three keys -- time, pid and a hash of hostname 
-    // for the MPI version, it is ok that all procs will get the same seed as random numbers will only be 
-    // used by the master process
+void seedQuESTDefault(QuESTEnv *env){
+    // seed MT random number generators with three keys -- time, pid and a hash of hostname 
 
     unsigned long int key[3];
     getQuESTDefaultSeedKey(key);
     // this seed will be used to generate the same random number on all procs,
     // therefore we want to make sure all procs receive the same key
     MPI_Bcast(key, 3, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
-    init_by_array(key, 3);
+    seedQuEST(env, key, 3);
 }
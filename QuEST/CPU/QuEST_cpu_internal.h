@@ -11,11 +11,24 @@
 
 # include "../QuEST_precision.h"
 
+/** the number of threads with which a kernel upon qureg opens its parallel region, as set by its policy */
+int getNumKernelThreads(Qureg qureg);
+
+/** the policy of a new environment, with minAmpsPerThread fixed at DEFAULT_MIN_AMPS_PER_THREAD, or 
+ * if isTuned, tuned to the cost of a parallel region */
+ExecPolicy getEnvExecPolicy(int isTuned);
+
+/** the amplitudes over which reportMemoryBandwidth streams, well beyond any cache */
+# define BANDWIDTH_NUM_AMPS (1LL << 22)
+
+/** the bytes per second this process's threads stream through memory, measured over numAmps amplitudes */
+double measureMemoryBandwidth(long long int numAmps);
+
 qreal densmatr_calcPurityLocal(Qureg qureg);
 
-void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg);
+void densmatr_initPureStateLocal(Qureg targetQureg, Qureg copyQureg, ComplexArray rowAmps, long long int startRow, long long int numRows);
 
-qreal densmatr_calcFidelityLocal(Qureg qureg, Qureg pureState);
+qreal densmatr_calcFidelityLocal(Qureg qureg, Qureg pureState, ComplexArray rowAmps, long long int startRow, long long int numRows);
 
 qreal densmatr_findProbabilityOfZeroLocal(Qureg qureg, const int measureQubit);
 
@@ -23,7 +36,7 @@ void densmatr_oneQubitDepolariseLocal(Qureg qureg, const int targetQubit, qreal
 
 void densmatr_oneQubitDepolariseDistributed(Qureg qureg, const int targetQubit, qreal depolLevel);
 
-void densmatr_twoQubitDepolariseLocal(Qureg qureg, int qubit1, int qubit2, qreal delta, qreal gamma);
+void densmatr_twoQubitDepolariseLocal(Qureg qureg, int qubit1, int qubit2, qreal depolLevel);
 
 void densmatr_twoQubitDepolariseLocalPart1(Qureg qureg, int qubit1, int qubit2, qreal delta);
 
@@ -33,8 +46,31 @@ void densmatr_twoQubitDepolariseDistributed(Qureg qureg, const int targetQubit,
 void densmatr_twoQubitDepolariseQ1LocalQ2DistributedPart3(Qureg qureg, const int targetQubit,
                 const int qubit2, qreal delta, qreal gamma);
 
+void densmatr_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u);
+
+void densmatr_multiControlledUnitaryDistributed(Qureg qureg, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u,
+        ComplexArray stateVecUp,
+        ComplexArray stateVecLo,
+        ComplexArray stateVecOut,
+        int updateUpper);
+
+void densmatr_applyKrausSuperoperatorLocal(Qureg qureg, int* superBits, const int numSuperBits, qreal* superRe, qreal* superIm);
+
+void densmatr_applyKrausSuperoperatorDistributed(Qureg qureg, int* superBits, const int numSuperBits, 
+    qreal* superRe, qreal* superIm, const int pairBit, const int pairBitValue);
+
+void densmatr_swapBitWithPairChunk(Qureg qureg, const int localBit, const int globalBitValue);
+
 Complex statevec_calcInnerProductLocal(Qureg bra, Qureg ket);
 
+void statevec_calcInnerProductsLocal(Qureg bra, Qureg* kets, int numKets, qreal* prodsReal, qreal* prodsImag);
+
+void statevec_calcExpecPauliGroupLocal(Qureg qureg, ComplexArray pairVec, long long int flipMask, 
+    long long int* phaseMasks, qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs);
+
+void densmatr_calcExpecPauliMasksLocal(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs);
+
 void statevec_compactUnitaryLocal (Qureg qureg, const int targetQubit, Complex alpha, Complex beta);
 
 void statevec_compactUnitaryDistributed (Qureg qureg, const int targetQubit,
@@ -54,31 +90,11 @@ void statevec_unitaryDistributed (Qureg qureg, const int targetQubit,
 void statevec_controlledCompactUnitaryLocal (Qureg qureg, const int controlQubit, const int targetQubit,
         Complex alpha, Complex beta);
 
-void statevec_controlledCompactUnitaryDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut);
-
 void statevec_controlledUnitaryLocal(Qureg qureg, const int controlQubit, const int targetQubit, ComplexMatrix2 u);
 
-void statevec_controlledUnitaryDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut);
-
 void statevec_multiControlledUnitaryLocal(Qureg qureg, const int targetQubit,
         long long int mask, ComplexMatrix2 u);
 
-void statevec_multiControlledUnitaryDistributed (Qureg qureg,
-        const int targetQubit,
-        long long int mask,
-        Complex rot1, Complex rot2,
-        ComplexArray stateVecUp,
-        ComplexArray stateVecLo,
-        ComplexArray stateVecOut);
-
 void statevec_pauliXLocal(Qureg qureg, const int targetQubit);
 
 void statevec_pauliXDistributed (Qureg qureg, const int targetQubit,
@@ -94,10 +110,6 @@ void statevec_pauliYDistributed(Qureg qureg, const int targetQubit,
 
 void statevec_controlledPauliYLocal(Qureg qureg, const int controlQubit, const int targetQubit, const int conjFactor);
 
-void statevec_controlledPauliYDistributed(Qureg qureg, const int controlQubit, const int targetQubit,
-        ComplexArray stateVecIn,
-        ComplexArray stateVecOut, const int conjFactor);
-        
 void statevec_hadamardLocal (Qureg qureg, const int targetQubit);
 
 void statevec_hadamardDistributed (Qureg qureg, const int targetQubit,
@@ -107,10 +119,6 @@ void statevec_hadamardDistributed (Qureg qureg, const int targetQubit,
 
 void statevec_controlledNotLocal(Qureg qureg, const int controlQubit, const int targetQubit);
 
-void statevec_controlledNotDistributed (Qureg qureg, const int controlQubit, const int targetQubit,
-        ComplexArray stateVecIn,
-        ComplexArray stateVecOut);
-
 qreal statevec_findProbabilityOfZeroLocal (Qureg qureg, const int measureQubit);
 
 qreal statevec_findProbabilityOfZeroDistributed (Qureg qureg, const int measureQubit);
@@ -121,6 +129,17 @@ void statevec_collapseToKnownProbOutcomeDistributedRenorm (Qureg qureg, const in
 
 void statevec_collapseToOutcomeDistributedSetZero(Qureg qureg);
 
+void statevec_packAmps(Qureg qureg, long long int localMask, long long int value, ComplexArray packed, 
+    long long int startInd, long long int numPacked, int isUnpack);
+
+long long int statevec_countNonZeroAmps(Qureg qureg, ComplexArray amps, long long int numAmps);
+
+void statevec_permuteChunkQubits(Qureg qureg, int* newPositions, ComplexArray in, ComplexArray out);
+
+void statevec_swapChunkQubits(Qureg qureg, int qb1, int qb2);
+
+void statevec_applyGateSequenceLocal(Qureg qureg, GateSequenceStep* steps, const int numSteps);
+
 
 
 
@@ -33,61 +33,71 @@ void densmatr_oneQubitDepolarise(Qureg qureg, const int targetQubit, qreal depol
 void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depolLevel){
     if (depolLevel == 0)
         return;
-    qreal eta = 2/depolLevel;
-    qreal delta = eta - 1 - sqrt( (eta-1)*(eta-1) - 1 );
-    qreal gamma = 1+delta;
-    // TODO -- test delta too small
 
-    gamma = 1/(gamma*gamma*gamma);
-    densmatr_twoQubitDephase(qureg, qubit1, qubit2, depolLevel);
-    densmatr_twoQubitDepolariseLocal(qureg, qubit1, qubit2, delta, gamma);
+    densmatr_twoQubitDepolariseLocal(qureg, qubit1, qubit2, depolLevel);
 }
 
 
+void densmatr_applyKrausSuperoperator(Qureg qureg, int* targets, const int numTargets, qreal* superRe, qreal* superIm) {
+    
+    // the row bits of the targets are the least significant bits of the superoperator index
+    int superBits[4];
+    for (int t=0; t < numTargets; t++) {
+        superBits[t] = targets[t];
+        superBits[t + numTargets] = targets[t] + qureg.numQubitsRepresented;
+    }
+    densmatr_applyKrausSuperoperatorLocal(qureg, superBits, 2*numTargets, superRe, superIm);
+}
+
 qreal densmatr_calcPurity(Qureg qureg) {
     return densmatr_calcPurityLocal(qureg);
 }
 
 qreal densmatr_calcFidelity(Qureg qureg, Qureg pureState) {
-    
-    // save pointers to qureg's pair state
-    qreal* quregPairRePtr = qureg.pairStateVec.real;
-    qreal* quregPairImPtr = qureg.pairStateVec.imag;
-    
-    // populate qureg pair state with pure state (by repointing)
-    qureg.pairStateVec.real = pureState.stateVec.real;
-    qureg.pairStateVec.imag = pureState.stateVec.imag;
-    
-    // calculate fidelity using pairState
-    qreal fid = densmatr_calcFidelityLocal(qureg, pureState);
-    
-    // restore pointers
-    qureg.pairStateVec.real = quregPairRePtr;
-    qureg.pairStateVec.imag = quregPairImPtr;
-    
-    return fid;
+    return densmatr_calcFidelityLocal(qureg, pureState, pureState.stateVec, 0, pureState.numAmpsTotal);
 }
 
 void densmatr_initPureState(Qureg qureg, Qureg pureState) {
+    densmatr_initPureStateLocal(qureg, pureState, pureState.stateVec, 0, pureState.numAmpsTotal);
+}
+
+Complex statevec_calcInnerProduct(Qureg bra, Qureg ket) {
+    return statevec_calcInnerProductLocal(bra, ket);
+}
+
+void statevec_calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds) {
     
-    // save pointers to qureg's pair state
-    qreal* quregPairRePtr = qureg.pairStateVec.real;
-    qreal* quregPairImPtr = qureg.pairStateVec.imag;
-    
-    // populate qureg pair state with pure state (by repointing)
-    qureg.pairStateVec.real = pureState.stateVec.real;
-    qureg.pairStateVec.imag = pureState.stateVec.imag;
+    qreal* prods = malloc(2 * numKets * sizeof *prods);
+    statevec_calcInnerProductsLocal(bra, kets, numKets, prods, &prods[numKets]);
+    for (int k=0; k < numKets; k++) {
+        innerProds[k].real = prods[k];
+        innerProds[k].imag = prods[numKets + k];
+    }
+    free(prods);
+}
 
-    // populate density matrix via it's pairState
-    densmatr_initPureStateLocal(qureg, pureState);
+void statevec_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    for (int s=0; s < numSums; s++)
+        expecs[s] = 0;
     
-    // restore pointers
-    qureg.pairStateVec.real = quregPairRePtr;
-    qureg.pairStateVec.imag = quregPairImPtr;
+    // terms with equal flip masks are adjacent, and share a single pass
+    int start, end;
+    for (start=0; start < numTerms; start=end) {
+        for (end=start+1; end < numTerms && flipMasks[end] == flipMasks[start]; end++)
+            ;
+        statevec_calcExpecPauliGroupLocal(qureg, qureg.stateVec, flipMasks[start], 
+            &phaseMasks[start], &factorsRe[start], &factorsIm[start], &sumInds[start], end-start, expecs);
+    }
 }
 
-Complex statevec_calcInnerProduct(Qureg bra, Qureg ket) {
-    return statevec_calcInnerProductLocal(bra, ket);
+void densmatr_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    for (int s=0; s < numSums; s++)
+        expecs[s] = 0;
+    densmatr_calcExpecPauliMasksLocal(qureg, flipMasks, phaseMasks, factorsRe, factorsIm, sumInds, numTerms, expecs);
 }
 
 qreal densmatr_calcTotalProb(Qureg qureg) {
@@ -151,7 +161,20 @@ QuESTEnv createQuESTEnv(void) {
     env.rank=0;
     env.numRanks=1;
     
-    seedQuESTDefault();
+    seedQuESTDefault(&env);
+    
+    // a fixed policy keeps identical runs bitwise reproducible, so tuning it is optional
+    char* tuneVar = getenv("QUEST_TUNE_EXEC_POLICY");
+    env.policy = getEnvExecPolicy(tuneVar != NULL && atoi(tuneVar) != 0);
+    
+    // a single rank exchanges nothing
+    env.maxExchangeBufferBytes = 0;
+    env.compressExchanges = 0;
+    
+    // nor shares its node with other ranks, so leaves its threads to the OS
+    env.nodeRank = 0;
+    env.numNodeRanks = 1;
+    env.numPinnedCpus = 0;
     
     return env;
 }
@@ -175,16 +198,63 @@ void reportQuESTEnv(QuESTEnv env){
 # ifdef _OPENMP
     printf("OpenMP enabled\n");
     printf("Number of threads available is %d\n", omp_get_max_threads());
+    printf("Kernels give each thread at least %lld amplitudes\n", env.policy.minAmpsPerThread);
 # else
     printf("OpenMP disabled\n");
 # endif
     printf("Precision: size of qreal is %ld bytes\n", sizeof(qreal));
 }
 
+void reportMemoryBandwidth(QuESTEnv env){
+    double bandwidth = measureMemoryBandwidth(BANDWIDTH_NUM_AMPS);
+    printf("Memory bandwidth achieved streaming %lld MiB: %.2f GB/s\n",
+        (3 * BANDWIDTH_NUM_AMPS * (long long int) sizeof(qreal)) >> 20, bandwidth / 1e9);
+}
+
 void reportNodeList(QuESTEnv env){
     printf("Hostname unknown: running locally\n");
 }
 
+void statevec_calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages) 
+{
+    int maxThreads = 1;
+# ifdef _OPENMP
+    maxThreads = omp_get_max_threads();
+# endif
+    qreal* threadSums = calloc(maxThreads * (size_t) numObservables, sizeof *threadSums);
+    
+    // each thread simulates a contiguous share of the trajectories upon its own register, 
+    // so the gate kernels within are not further parallelised
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (env, numQubits, numTrajectories, circuit, observe, args, numObservables, threadSums) 
+# endif
+    {
+        int thread=0, numThreads=1;
+# ifdef _OPENMP
+        thread = omp_get_thread_num();
+        numThreads = omp_get_num_threads();
+# endif
+        int first = (int) ((numTrajectories * (long long int) thread) / numThreads);
+        int last = (int) ((numTrajectories * (long long int) (thread+1)) / numThreads);
+        
+        sumTrajectories(env, numQubits, first, last-first, circuit, observe, args, numObservables, 
+            &threadSums[thread * (size_t) numObservables]);
+    }
+    
+    // the threads' sums are combined in a fixed order, so that repeated calls agree exactly
+    for (int o=0; o < numObservables; o++) {
+        averages[o] = 0;
+        for (int t=0; t < maxThreads; t++)
+            averages[o] += threadSums[t * (size_t) numObservables + o];
+        averages[o] /= numTrajectories;
+    }
+    free(threadSums);
+}
+
 qreal statevec_getRealAmp(Qureg qureg, long long int index){
     return qureg.stateVec.real[index];
 }
@@ -222,6 +292,30 @@ void statevec_multiControlledUnitary(Qureg qureg, int* controlQubits, const int
     statevec_multiControlledUnitaryLocal(qureg, targetQubit, mask, u);
 }
 
+void statevec_applyGateSequence(Qureg qureg, GateSequenceStep* steps, int numSteps)
+{
+    statevec_applyGateSequenceLocal(qureg, steps, numSteps);
+}
+
+void statevec_swapGlobalQubits(Qureg qureg, int* globalQubits, int* localQubits, int numPairs)
+{
+    // a register held by one process has no qubits beyond its chunk, so this is never called
+}
+
+void statevec_permuteLocalQubits(Qureg qureg, int* newPositions)
+{
+    // only the qubits of distributed registers are relabelled, so this is never called
+}
+
+void densmatr_multiControlledUnitary(Qureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u) 
+{
+    long long int mask=0; 
+    for (int i=0; i<numControlQubits; i++)
+        mask = mask | (1LL<<controlQubits[i]);
+
+    densmatr_multiControlledUnitaryLocal(qureg, targetQubit, mask, u);
+}
+
 void statevec_pauliX(Qureg qureg, const int targetQubit) 
 {
     statevec_pauliXLocal(qureg, targetQubit);
@@ -277,17 +371,25 @@ qreal densmatr_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcom
     return outcomeProb;
 }
 
+void statevec_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs) {
+    for (int m=0; m < numMeasures; m++)
+        outcomeProbs[m] = statevec_calcProbOfOutcome(qureg, measureQubits[m], outcomes[m]);
+}
+
+void densmatr_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs) {
+    for (int m=0; m < numMeasures; m++)
+        outcomeProbs[m] = densmatr_calcProbOfOutcome(qureg, measureQubits[m], outcomes[m]);
+}
+
 void statevec_collapseToKnownProbOutcome(Qureg qureg, const int measureQubit, int outcome, qreal stateProb)
 {
     statevec_collapseToKnownProbOutcomeLocal(qureg, measureQubit, outcome, stateProb);
 }
 
-void seedQuESTDefault(){
-    // init MT random number generator with three keys -- time, pid and a hash of hostname 
-    // for the MPI version, it is ok that all procs will get the same seed as random numbers will only be 
-    // used by the master process
+void seedQuESTDefault(QuESTEnv *env){
+    // seed MT random number generators with three keys -- time, pid and a hash of hostname 
 
     unsigned long int key[3];
     getQuESTDefaultSeedKey(key);
-    init_by_array(key, 3);
+    seedQuEST(env, key, 3);
 }
@@ -0,0 +1,490 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * Shared-memory ranks, implementing the MPI subset declared in QuEST_cpu_shm.h.
+ *
+ * The ranks are processes forked by MPI_Init, which share one anonymous mapping holding a ring
+ * buffer for each ordered pair of ranks. A ring has a single writer and a single reader, so is
+ * advanced without locks. Each message is written as a header (its size and tag) then its bytes.
+ * Sends and receives are only queued when posted, and are advanced, in the order posted on
+ * each ring, by whichever wait the rank is blocked in, so that nonblocking exchanges between
+ * two ranks never deadlock whatever their size. A rank which finds no progress yields its core,
+ * and gives up if any other rank has died.
+ */
+
+# define _DEFAULT_SOURCE
+
+# include "QuEST_cpu_shm.h"
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <sched.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+
+# ifndef MAP_ANONYMOUS
+# define MAP_ANONYMOUS MAP_ANON
+# endif
+
+//! the bytes buffered between each ordered pair of ranks
+# define SHM_RING_BYTES (1LL << 20)
+
+//! how many fruitless passes over the pending requests are made between checks that every rank lives
+# define SHM_IDLE_PASSES_PER_CHECK 4096
+
+typedef struct ShmRing
+{
+    //! advanced only by the writer, and read by the reader
+    long long int numWritten;
+    char writerPadding[56];
+    //! advanced only by the reader, and read by the writer
+    long long int numRead;
+    char readerPadding[56];
+    char bytes[SHM_RING_BYTES];
+} ShmRing;
+
+typedef struct ShmMessageHeader
+{
+    long long int numBytes;
+    int tag;
+    int padding;
+} ShmMessageHeader;
+
+typedef struct ShmSegment
+{
+    int isAborted;
+    int numRanks;
+    char padding[56];
+    //! the ring from rank s to rank d is rings[s*numRanks + d]
+    ShmRing rings[];
+} ShmSegment;
+
+typedef struct ShmRequest
+{
+    int isActive;
+    int isSend;
+    int peer;
+    long long int postOrder;
+    char* buf;
+    long long int numBytes;
+    //! the bytes of the header, then of buf, sent or received so far
+    long long int numDone;
+    //! the header sent, or of the message being received
+    ShmMessageHeader header;
+    //! for the receive of MPI_Sendrecv_replace, the send of the same buffer which it must not overtake, else -1
+    int limitingSend;
+} ShmRequest;
+
+static ShmSegment* segment = NULL;
+static size_t segmentBytes = 0;
+static int shmRank = 0;
+static int shmNumRanks = 1;
+static int isInitialised = 0;
+static int isFinalised = 0;
+static pid_t parentPid;
+static pid_t* childPids = NULL;
+
+static ShmRequest* requests = NULL;
+static int numRequestSlots = 0;
+static long long int numPosted = 0;
+static long long int numIdlePasses = 0;
+
+static void exitWithShmError(const char* msg) {
+    fprintf(stderr, "ERROR (shared-memory rank %d): %s\n", shmRank, msg);
+    if (segment != NULL)
+        __atomic_store_n(&segment->isAborted, 1, __ATOMIC_RELEASE);
+    exit(EXIT_FAILURE);
+}
+
+static size_t getTypeSize(MPI_Datatype type) {
+    switch (type) {
+        case MPI_FLOAT:         return sizeof(float);
+        case MPI_DOUBLE:        return sizeof(double);
+        case MPI_LONG_DOUBLE:   return sizeof(long double);
+        case MPI_INT:           return sizeof(int);
+        case MPI_LONG_LONG_INT: return sizeof(long long int);
+        case MPI_UNSIGNED_LONG: return sizeof(unsigned long);
+    }
+    exitWithShmError("unknown datatype");
+    return 0;
+}
+
+static ShmRing* getRing(int source, int dest) {
+    return &segment->rings[(size_t) source * shmNumRanks + dest];
+}
+
+/** copies up to numBytes of src into ring, as space allows, returning how many */
+static long long int writeRing(ShmRing* ring, const char* src, long long int numBytes) {
+    long long int numWritten = ring->numWritten;
+    long long int numRead = __atomic_load_n(&ring->numRead, __ATOMIC_ACQUIRE);
+    long long int space = SHM_RING_BYTES - (numWritten - numRead);
+    if (numBytes > space)
+        numBytes = space;
+
+    long long int start = numWritten % SHM_RING_BYTES;
+    long long int first = (numBytes < SHM_RING_BYTES - start)? numBytes : SHM_RING_BYTES - start;
+    memcpy(&ring->bytes[start], src, first);
+    memcpy(ring->bytes, &src[first], numBytes - first);
+    __atomic_store_n(&ring->numWritten, numWritten + numBytes, __ATOMIC_RELEASE);
+    return numBytes;
+}
+
+/** copies up to numBytes from ring into dest, as have arrived, returning how many */
+static long long int readRing(ShmRing* ring, char* dest, long long int numBytes) {
+    long long int numRead = ring->numRead;
+    long long int numWritten = __atomic_load_n(&ring->numWritten, __ATOMIC_ACQUIRE);
+    if (numBytes > numWritten - numRead)
+        numBytes = numWritten - numRead;
+
+    long long int start = numRead % SHM_RING_BYTES;
+    long long int first = (numBytes < SHM_RING_BYTES - start)? numBytes : SHM_RING_BYTES - start;
+    memcpy(dest, &ring->bytes[start], first);
+    memcpy(&dest[first], ring->bytes, numBytes - first);
+    __atomic_store_n(&ring->numRead, numRead + numBytes, __ATOMIC_RELEASE);
+    return numBytes;
+}
+
+static int postRequest(int isSend, int peer, int tag, const void* buf, long long int numBytes) {
+    if (!isInitialised || isFinalised)
+        exitWithShmError("communication outside of MPI_Init and MPI_Finalize");
+    if (peer < 0 || peer >= shmNumRanks)
+        exitWithShmError("no such rank");
+
+    int r = 0;
+    while (r < numRequestSlots && requests[r].isActive)
+        r++;
+    if (r == numRequestSlots) {
+        numRequestSlots = (numRequestSlots == 0)? 16 : 2*numRequestSlots;
+        requests = realloc(requests, numRequestSlots * sizeof *requests);
+        if (requests == NULL)
+            exitWithShmError("could not allocate requests");
+        for (int s=r; s < numRequestSlots; s++)
+            requests[s].isActive = 0;
+    }
+
+    ShmRequest* req = &requests[r];
+    req->isActive = 1;
+    req->isSend = isSend;
+    req->peer = peer;
+    req->postOrder = numPosted++;
+    req->buf = (char*) buf;
+    req->numBytes = numBytes;
+    req->numDone = 0;
+    req->header.numBytes = numBytes;
+    req->header.tag = tag;
+    req->header.padding = 0;
+    req->limitingSend = -1;
+    return r;
+}
+
+static int isComplete(ShmRequest* req) {
+    return req->numDone == (long long int) sizeof req->header + req->numBytes;
+}
+
+/** whether req is the earliest posted incomplete request upon its ring */
+static int isFirstOnRing(int r) {
+    ShmRequest* req = &requests[r];
+    for (int s=0; s < numRequestSlots; s++) {
+        ShmRequest* other = &requests[s];
+        if (other->isActive && !isComplete(other) && other->isSend == req->isSend
+            && other->peer == req->peer && other->postOrder < req->postOrder)
+            return 0;
+    }
+    return 1;
+}
+
+/** gives up if this rank waits upon one which has died */
+static void checkRanksLive(void) {
+    if (__atomic_load_n(&segment->isAborted, __ATOMIC_ACQUIRE))
+        exitWithShmError("another rank failed");
+    if (shmRank != 0) {
+        if (getppid() != parentPid)
+            exitWithShmError("rank 0 exited");
+        return;
+    }
+    int status;
+    for (int r=1; r < shmNumRanks; r++)
+        if (childPids[r] > 0 && waitpid(childPids[r], &status, WNOHANG) == childPids[r]) {
+            childPids[r] = -1;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                exitWithShmError("another rank failed");
+        }
+}
+
+/** moves as many bytes of the pending requests as the rings allow */
+static void progressRequests(void) {
+    int isMoved = 0;
+    long long int headerBytes = sizeof(ShmMessageHeader);
+
+    for (int r=0; r < numRequestSlots; r++) {
+        ShmRequest* req = &requests[r];
+        if (!req->isActive || isComplete(req) || !isFirstOnRing(r))
+            continue;
+
+        long long int total = headerBytes + req->numBytes;
+        while (req->numDone < total) {
+            int isHeader = req->numDone < headerBytes;
+            char* bytes = (isHeader)? &((char*) &req->header)[req->numDone] : &req->buf[req->numDone - headerBytes];
+            long long int numBytes = (isHeader)? headerBytes - req->numDone : total - req->numDone;
+
+            long long int numMoved;
+            if (req->isSend)
+                numMoved = writeRing(getRing(shmRank, req->peer), bytes, numBytes);
+            else {
+                // a buffer sent and received in place is only overwritten where already sent
+                if (!isHeader && req->limitingSend >= 0) {
+                    long long int numSent = requests[req->limitingSend].numDone - headerBytes;
+                    long long int numAllowed = numSent - (req->numDone - headerBytes);
+                    if (numBytes > numAllowed)
+                        numBytes = numAllowed;
+                }
+                numMoved = readRing(getRing(req->peer, shmRank), bytes, numBytes);
+                
+                // as in MPI, a message may be shorter than its receive, which then completes early
+                if (isHeader && req->numDone + numMoved == headerBytes) {
+                    if (req->header.numBytes > req->numBytes)
+                        exitWithShmError("a message is longer than its receive");
+                    req->numBytes = req->header.numBytes;
+                    total = headerBytes + req->numBytes;
+                }
+            }
+            if (numMoved == 0)
+                break;
+            req->numDone += numMoved;
+            isMoved = 1;
+        }
+    }
+
+    if (isMoved) {
+        numIdlePasses = 0;
+        return;
+    }
+    if (++numIdlePasses % SHM_IDLE_PASSES_PER_CHECK == 0)
+        checkRanksLive();
+    sched_yield();
+}
+
+static void waitForRequest(int r) {
+    while (!isComplete(&requests[r]))
+        progressRequests();
+    requests[r].isActive = 0;
+}
+
+static void sendBytes(const void* buf, long long int numBytes, int dest) {
+    waitForRequest(postRequest(1, dest, 0, buf, numBytes));
+}
+
+static void recvBytes(void* buf, long long int numBytes, int source) {
+    waitForRequest(postRequest(0, source, 0, buf, numBytes));
+}
+
+# define COMBINE_ELEMS(TYPE) { \
+    TYPE* a = (TYPE*) acc; \
+    const TYPE* b = (const TYPE*) in; \
+    for (long long int i=0; i < count; i++) { \
+        switch (op) { \
+            case MPI_SUM:  a[i] = a[i] + b[i]; break; \
+            case MPI_MAX:  a[i] = (b[i] > a[i])? b[i] : a[i]; break; \
+            case MPI_MIN:  a[i] = (b[i] < a[i])? b[i] : a[i]; break; \
+            case MPI_LAND: a[i] = a[i] && b[i]; break; \
+        } \
+    } \
+    break; \
+}
+
+/** combines count elements of in into acc, by op */
+static void combineElems(void* acc, const void* in, long long int count, MPI_Datatype type, MPI_Op op) {
+    switch (type) {
+        case MPI_FLOAT:         COMBINE_ELEMS(float)
+        case MPI_DOUBLE:        COMBINE_ELEMS(double)
+        case MPI_LONG_DOUBLE:   COMBINE_ELEMS(long double)
+        case MPI_INT:           COMBINE_ELEMS(int)
+        case MPI_LONG_LONG_INT: COMBINE_ELEMS(long long int)
+        case MPI_UNSIGNED_LONG: COMBINE_ELEMS(unsigned long)
+    }
+}
+
+
+/*
+ * MPI subset
+ */
+
+int MPI_Init(int* argc, char*** argv) {
+    char* numRanksStr = getenv("QUEST_SHM_RANKS");
+    shmNumRanks = (numRanksStr == NULL)? 1 : atoi(numRanksStr);
+    if (shmNumRanks < 1)
+        exitWithShmError("QUEST_SHM_RANKS must be a positive number of ranks");
+
+    segmentBytes = sizeof(ShmSegment) + (size_t) shmNumRanks * shmNumRanks * sizeof(ShmRing);
+    segment = mmap(NULL, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED) {
+        segment = NULL;
+        exitWithShmError("could not map the memory shared between ranks");
+    }
+    segment->isAborted = 0;
+    segment->numRanks = shmNumRanks;
+
+    // the other ranks are copies of this process from here on, so nothing buffered may be printed twice
+    fflush(stdout);
+    fflush(stderr);
+    parentPid = getpid();
+    childPids = calloc(shmNumRanks, sizeof *childPids);
+    for (int r=1; r < shmNumRanks; r++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            exitWithShmError("could not fork the ranks");
+        if (pid == 0) {
+            shmRank = r;
+            break;
+        }
+        childPids[r] = pid;
+    }
+
+    isInitialised = 1;
+    return MPI_SUCCESS;
+}
+
+int MPI_Initialized(int* flag) {
+    *flag = isInitialised;
+    return MPI_SUCCESS;
+}
+
+int MPI_Finalize(void) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    isFinalised = 1;
+
+    // rank 0 is the original process, which outlives the others
+    if (shmRank == 0)
+        for (int r=1; r < shmNumRanks; r++)
+            if (childPids[r] > 0)
+                waitpid(childPids[r], NULL, 0);
+
+    munmap(segment, segmentBytes);
+    segment = NULL;
+    free(childPids);
+    free(requests);
+    requests = NULL;
+    numRequestSlots = 0;
+    return MPI_SUCCESS;
+}
+
+int MPI_Finalized(int* flag) {
+    *flag = isFinalised;
+    return MPI_SUCCESS;
+}
+
+int MPI_Comm_size(MPI_Comm comm, int* size) {
+    *size = shmNumRanks;
+    return MPI_SUCCESS;
+}
+
+int MPI_Comm_rank(MPI_Comm comm, int* rank) {
+    *rank = shmRank;
+    return MPI_SUCCESS;
+}
+
+int MPI_Isend(const void* buf, long long int count, MPI_Datatype type, int dest, int tag,
+    MPI_Comm comm, MPI_Request* request
+) {
+    *request = postRequest(1, dest, tag, buf, count * getTypeSize(type));
+    return MPI_SUCCESS;
+}
+
+int MPI_Irecv(void* buf, long long int count, MPI_Datatype type, int source, int tag,
+    MPI_Comm comm, MPI_Request* request
+) {
+    *request = postRequest(0, source, tag, buf, count * getTypeSize(type));
+    return MPI_SUCCESS;
+}
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status) {
+    waitForRequest(*request);
+    if (status != MPI_STATUS_IGNORE) {
+        status->MPI_SOURCE = requests[*request].peer;
+        status->MPI_TAG = requests[*request].header.tag;
+    }
+    return MPI_SUCCESS;
+}
+
+int MPI_Waitall(int count, MPI_Request* requestArray, MPI_Status* statuses) {
+    for (int i=0; i < count; i++)
+        MPI_Wait(&requestArray[i], (statuses == MPI_STATUSES_IGNORE)? MPI_STATUS_IGNORE : &statuses[i]);
+    return MPI_SUCCESS;
+}
+
+int MPI_Sendrecv(const void* sendbuf, long long int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+    void* recvbuf, long long int recvcount, MPI_Datatype recvtype, int source, int recvtag,
+    MPI_Comm comm, MPI_Status* status
+) {
+    MPI_Request reqs[2];
+    MPI_Irecv(recvbuf, recvcount, recvtype, source, recvtag, comm, &reqs[0]);
+    MPI_Isend(sendbuf, sendcount, sendtype, dest, sendtag, comm, &reqs[1]);
+    MPI_Wait(&reqs[0], status);
+    MPI_Wait(&reqs[1], MPI_STATUS_IGNORE);
+    return MPI_SUCCESS;
+}
+
+int MPI_Sendrecv_replace(void* buf, long long int count, MPI_Datatype type, int dest, int sendtag,
+    int source, int recvtag, MPI_Comm comm, MPI_Status* status
+) {
+    MPI_Request reqs[2];
+    MPI_Isend(buf, count, type, dest, sendtag, comm, &reqs[1]);
+    MPI_Irecv(buf, count, type, source, recvtag, comm, &reqs[0]);
+    requests[reqs[0]].limitingSend = reqs[1];
+
+    // the send must outlive the receive which it limits
+    while (!isComplete(&requests[reqs[0]]))
+        progressRequests();
+    MPI_Wait(&reqs[1], MPI_STATUS_IGNORE);
+    MPI_Wait(&reqs[0], status);
+    return MPI_SUCCESS;
+}
+
+int MPI_Bcast(void* buf, long long int count, MPI_Datatype type, int root, MPI_Comm comm) {
+    long long int numBytes = count * getTypeSize(type);
+    if (shmRank != root) {
+        recvBytes(buf, numBytes, root);
+        return MPI_SUCCESS;
+    }
+
+    MPI_Request* reqs = malloc(shmNumRanks * sizeof *reqs);
+    for (int r=0; r < shmNumRanks; r++)
+        if (r != root)
+            reqs[r] = postRequest(1, r, 0, buf, numBytes);
+    for (int r=0; r < shmNumRanks; r++)
+        if (r != root)
+            waitForRequest(reqs[r]);
+    free(reqs);
+    return MPI_SUCCESS;
+}
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, long long int count, MPI_Datatype type, MPI_Op op,
+    MPI_Comm comm
+) {
+    long long int numBytes = count * getTypeSize(type);
+    if (sendbuf != MPI_IN_PLACE)
+        memmove(recvbuf, sendbuf, numBytes);
+
+    // rank 0 combines the contributions in rank order, so every rank receives the same result
+    if (shmRank == 0) {
+        void* contribution = malloc(numBytes);
+        if (contribution == NULL && numBytes > 0)
+            exitWithShmError("could not allocate a reduction");
+        for (int r=1; r < shmNumRanks; r++) {
+            recvBytes(contribution, numBytes, r);
+            combineElems(recvbuf, contribution, count, type, op);
+        }
+        free(contribution);
+    } else
+        sendBytes(recvbuf, numBytes, 0);
+
+    return MPI_Bcast(recvbuf, count, type, 0, comm);
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+    int token = 0;
+    return MPI_Allreduce(MPI_IN_PLACE, &token, 1, MPI_INT, MPI_SUM, comm);
+}
@@ -0,0 +1,82 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * The subset of MPI used by the distributed backend, implemented over shared memory between
+ * processes on one machine, so that the chunked algorithms of QuEST_cpu_distributed.c run
+ * unchanged without an MPI installation or mpirun. Built in place of MPI with DISTRIBUTED=1
+ * and SHARED_MEMORY=1.
+ *
+ * MPI_Init forks the process into QUEST_SHM_RANKS ranks (default 1), which then each continue
+ * from where it was called, exactly as ranks started by mpirun would. Every ordered pair of
+ * ranks shares a ring buffer, through which messages stream in the order they were posted,
+ * whatever their tags; the distributed backend always posts its sends and receives between
+ * two ranks in the same order on both, as this requires. As in MPI, a message may be shorter
+ * than the receive it fills. Collectives are made of point-to-point messages through rank 0.
+ * Only MPI_COMM_WORLD exists.
+ */
+
+# ifndef QUEST_CPU_SHM_H
+# define QUEST_CPU_SHM_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+typedef int MPI_Comm;
+typedef int MPI_Request;
+typedef enum {MPI_FLOAT, MPI_DOUBLE, MPI_LONG_DOUBLE, MPI_INT, MPI_LONG_LONG_INT, MPI_UNSIGNED_LONG} MPI_Datatype;
+typedef enum {MPI_SUM, MPI_MAX, MPI_MIN, MPI_LAND} MPI_Op;
+
+typedef struct MPI_Status
+{
+    int MPI_SOURCE;
+    int MPI_TAG;
+} MPI_Status;
+
+# define MPI_COMM_WORLD 0
+# define MPI_IN_PLACE ((void*) 1)
+# define MPI_STATUS_IGNORE ((MPI_Status*) NULL)
+# define MPI_STATUSES_IGNORE ((MPI_Status*) NULL)
+# define MPI_SUCCESS 0
+
+int MPI_Init(int* argc, char*** argv);
+
+int MPI_Initialized(int* flag);
+
+int MPI_Finalize(void);
+
+int MPI_Finalized(int* flag);
+
+int MPI_Comm_size(MPI_Comm comm, int* size);
+
+int MPI_Comm_rank(MPI_Comm comm, int* rank);
+
+int MPI_Isend(const void* buf, long long int count, MPI_Datatype type, int dest, int tag,
+    MPI_Comm comm, MPI_Request* request);
+
+int MPI_Irecv(void* buf, long long int count, MPI_Datatype type, int source, int tag,
+    MPI_Comm comm, MPI_Request* request);
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status);
+
+int MPI_Waitall(int count, MPI_Request* requests, MPI_Status* statuses);
+
+int MPI_Sendrecv(const void* sendbuf, long long int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+    void* recvbuf, long long int recvcount, MPI_Datatype recvtype, int source, int recvtag,
+    MPI_Comm comm, MPI_Status* status);
+
+int MPI_Sendrecv_replace(void* buf, long long int count, MPI_Datatype type, int dest, int sendtag,
+    int source, int recvtag, MPI_Comm comm, MPI_Status* status);
+
+int MPI_Bcast(void* buf, long long int count, MPI_Datatype type, int root, MPI_Comm comm);
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, long long int count, MPI_Datatype type, MPI_Op op,
+    MPI_Comm comm);
+
+int MPI_Barrier(MPI_Comm comm);
+
+# ifdef __cplusplus
+}
+# endif
+
+# endif // QUEST_CPU_SHM_H
@@ -64,6 +64,63 @@ void statevec_cloneQureg(Qureg targetQureg, Qureg copyQureg) {
         cudaMemcpyDeviceToDevice);
 }
 
+__global__ void statevec_setWeightedQuregKernel(Complex fac1, Qureg qureg1, Complex fac2, Qureg qureg2, Complex facOut, Qureg out) {
+
+    long long int index = blockIdx.x*blockDim.x + threadIdx.x;
+    if (index>=out.numAmpsPerChunk) return;
+
+    qreal re1 = qureg1.deviceStateVec.real[index], im1 = qureg1.deviceStateVec.imag[index];
+    qreal re2 = qureg2.deviceStateVec.real[index], im2 = qureg2.deviceStateVec.imag[index];
+    qreal reOut = out.deviceStateVec.real[index], imOut = out.deviceStateVec.imag[index];
+
+    out.deviceStateVec.real[index] = (facOut.real*reOut - facOut.imag*imOut) + (fac1.real*re1 - fac1.imag*im1) + (fac2.real*re2 - fac2.imag*im2);
+    out.deviceStateVec.imag[index] = (facOut.real*imOut + facOut.imag*reOut) + (fac1.real*im1 + fac1.imag*re1) + (fac2.real*im2 + fac2.imag*re2);
+}
+
+void statevec_setWeightedQureg(Complex fac1, Qureg qureg1, Complex fac2, Qureg qureg2, Complex facOut, Qureg out) {
+
+    int threadsPerCUDABlock, CUDABlocks;
+    threadsPerCUDABlock = 128;
+    CUDABlocks = ceil((qreal)(out.numAmpsPerChunk)/threadsPerCUDABlock);
+    statevec_setWeightedQuregKernel<<<CUDABlocks, threadsPerCUDABlock>>>(fac1, qureg1, fac2, qureg2, facOut, out);
+}
+
+__global__ void statevec_applyDiagonalTableKernel(Qureg qureg, long long int qubitMask, qreal* factorsRe, qreal* factorsIm) {
+
+    long long int index = blockIdx.x*blockDim.x + threadIdx.x;
+    if (index>=qureg.numAmpsPerChunk) return;
+
+    // gather the bits of the global index at the mask's qubits, lowest first
+    long long int globalInd = qureg.chunkId*qureg.numAmpsPerChunk + index;
+    int tableInd = 0;
+    int k = 0;
+    for (long long int mask=qubitMask; mask != 0; mask &= mask-1, k++)
+        tableInd |= (int) ((globalInd >> (__ffsll(mask)-1)) & 1) << k;
+
+    qreal re = qureg.deviceStateVec.real[index];
+    qreal im = qureg.deviceStateVec.imag[index];
+    qureg.deviceStateVec.real[index] = re*factorsRe[tableInd] - im*factorsIm[tableInd];
+    qureg.deviceStateVec.imag[index] = re*factorsIm[tableInd] + im*factorsRe[tableInd];
+}
+
+void statevec_applyDiagonalTable(Qureg qureg, long long int qubitMask, qreal* factorsRe, qreal* factorsIm) {
+
+    int tableLen = 1 << __builtin_popcountll(qubitMask);
+    qreal *deviceFactorsRe, *deviceFactorsIm;
+    cudaMalloc(&deviceFactorsRe, tableLen * sizeof *deviceFactorsRe);
+    cudaMalloc(&deviceFactorsIm, tableLen * sizeof *deviceFactorsIm);
+    cudaMemcpy(deviceFactorsRe, factorsRe, tableLen * sizeof *deviceFactorsRe, cudaMemcpyHostToDevice);
+    cudaMemcpy(deviceFactorsIm, factorsIm, tableLen * sizeof *deviceFactorsIm, cudaMemcpyHostToDevice);
+
+    int threadsPerCUDABlock, CUDABlocks;
+    threadsPerCUDABlock = 128;
+    CUDABlocks = ceil((qreal)(qureg.numAmpsPerChunk)/threadsPerCUDABlock);
+    statevec_applyDiagonalTableKernel<<<CUDABlocks, threadsPerCUDABlock>>>(qureg, qubitMask, deviceFactorsRe, deviceFactorsIm);
+
+    cudaFree(deviceFactorsRe);
+    cudaFree(deviceFactorsIm);
+}
+
 __global__ void densmatr_initPureStateKernel(
     long long int numPureAmps,
     qreal *targetVecReal, qreal *targetVecImag, 
@@ -242,7 +299,20 @@ QuESTEnv createQuESTEnv(void) {
     env.rank=0;
     env.numRanks=1;
     
-    seedQuESTDefault();
+    seedQuESTDefault(&env);
+    
+    // the GPU kernels take no threads from OpenMP, so the policy merely records the default
+    env.policy.maxThreads = 0;
+    env.policy.minAmpsPerThread = DEFAULT_MIN_AMPS_PER_THREAD;
+    
+    // a single GPU exchanges nothing
+    env.maxExchangeBufferBytes = 0;
+    env.compressExchanges = 0;
+    
+    // nor shares its node with other ranks, so leaves its threads to the OS
+    env.nodeRank = 0;
+    env.numNodeRanks = 1;
+    env.numPinnedCpus = 0;
     
     return env;
 }
@@ -271,6 +341,20 @@ void reportQuESTEnv(QuESTEnv env){
 # endif
 }
 
+void reportMemoryBandwidth(QuESTEnv env){
+    printf("Memory bandwidth is not measured with GPU acceleration\n");
+}
+
+void statevec_calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages) 
+{
+    // trajectories share the device, so run in turn upon a single register
+    sumTrajectories(env, numQubits, 0, numTrajectories, circuit, observe, args, numObservables, averages);
+    for (int o=0; o < numObservables; o++)
+        averages[o] /= numTrajectories;
+}
+
 void getEnvironmentString(QuESTEnv env, Qureg qureg, char str[200]){
     sprintf(str, "%dqubits_GPU_noMpi_noOMP", qureg.numQubitsInStateVec);    
 }
@@ -510,6 +594,18 @@ int statevec_initStateFromSingleFile(Qureg *qureg, char filename[200], QuESTEnv
     return 1;
 }
 
+int statevec_writeCheckpoint(Qureg qureg, char* prefix) {
+    copyStateFromGPU(qureg);
+    return writeCheckpointChunk(qureg, prefix);
+}
+
+int statevec_initStateFromCheckpoint(Qureg qureg, char* prefix, int numSavedChunks) {
+    int success = readCheckpointChunk(qureg, prefix, numSavedChunks);
+    if (success)
+        copyStateToGPU(qureg);
+    return success;
+}
+
 int statevec_compareStates(Qureg mq1, Qureg mq2, qreal precision){
     qreal diff;
     int chunkSize = mq1.numAmpsPerChunk;
@@ -851,6 +947,103 @@ void statevec_multiControlledUnitary(Qureg qureg, int *controlQubits, int numCon
     statevec_multiControlledUnitaryKernel<<<CUDABlocks, threadsPerCUDABlock>>>(qureg, mask, targetQubit, u);
 }
 
+void statevec_applyGateSequence(Qureg qureg, GateSequenceStep* steps, int numSteps)
+{
+    // kernel launches are queued without synchronising, so the steps are simply launched in turn
+    int threadsPerCUDABlock, CUDABlocks;
+    threadsPerCUDABlock = 128;
+    CUDABlocks = ceil((qreal)(qureg.numAmpsPerChunk>>1)/threadsPerCUDABlock);
+    for (int s=0; s < numSteps; s++) {
+        if (steps[s].targetQubit < 0)
+            statevec_applyDiagonalTable(qureg, steps[s].tableMask, steps[s].factorsRe, steps[s].factorsIm);
+        else
+            statevec_multiControlledUnitaryKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
+                qureg, steps[s].ctrlMask, steps[s].targetQubit, steps[s].u);
+    }
+}
+
+void statevec_swapGlobalQubits(Qureg qureg, int* globalQubits, int* localQubits, int numPairs)
+{
+    // a GPU register is held by one process, so has no qubits beyond its chunk; this is never called
+}
+
+void statevec_permuteLocalQubits(Qureg qureg, int* newPositions)
+{
+    // only the qubits of distributed registers are relabelled, so this is never called
+}
+
+/** multiplies u onto the amplitude pair (up, lo), in place */
+__device__ __forceinline__ void multiplyMatrixOntoPair(ComplexMatrix2 u, qreal *reUp, qreal *imUp, qreal *reLo, qreal *imLo) {
+    qreal ru = *reUp, iu = *imUp;
+    qreal rl = *reLo, il = *imLo;
+    *reUp = u.r0c0.real*ru - u.r0c0.imag*iu + u.r0c1.real*rl - u.r0c1.imag*il;
+    *imUp = u.r0c0.real*iu + u.r0c0.imag*ru + u.r0c1.real*il + u.r0c1.imag*rl;
+    *reLo = u.r1c0.real*ru - u.r1c0.imag*iu + u.r1c1.real*rl - u.r1c1.imag*il;
+    *imLo = u.r1c0.real*iu + u.r1c0.imag*ru + u.r1c1.real*il + u.r1c1.imag*rl;
+}
+
+/** applies u (x) conj(u) to the flattened density matrix in a single pass, each thread updating 
+ * the four amplitudes which differ in the target bit and the shifted target bit 
+ */
+__global__ void densmatr_multiControlledUnitaryKernel(
+    Qureg qureg, long long int ctrlMask, const int targetQubit, ComplexMatrix2 u, ComplexMatrix2 uConj
+) {
+    long long int thisTask = blockIdx.x*blockDim.x + threadIdx.x;
+    long long int numTasks = qureg.numAmpsPerChunk >> 2;
+    if (thisTask>=numTasks) return;
+    
+    int shift = qureg.numQubitsRepresented;
+    long long int colBit = 1LL << targetQubit;
+    long long int rowBit = 1LL << (targetQubit + shift);
+    long long int conjCtrlMask = ctrlMask << shift;
+    
+    // insert a zero at both target bits (lowest first)
+    long long int ind00 = ((thisTask & ~(colBit-1)) << 1) | (thisTask & (colBit-1));
+    ind00 = ((ind00 & ~(rowBit-1)) << 1) | (ind00 & (rowBit-1));
+    
+    int ctrlsOn = (ctrlMask == (ctrlMask & ind00));
+    int conjCtrlsOn = (conjCtrlMask == (conjCtrlMask & ind00));
+    if (!ctrlsOn && !conjCtrlsOn)
+        return;
+    
+    long long int ind01 = ind00 | colBit;
+    long long int ind10 = ind00 | rowBit;
+    long long int ind11 = ind01 | rowBit;
+    
+    qreal *vecRe = qureg.deviceStateVec.real;
+    qreal *vecIm = qureg.deviceStateVec.imag;
+    
+    qreal re00 = vecRe[ind00], im00 = vecIm[ind00];
+    qreal re01 = vecRe[ind01], im01 = vecIm[ind01];
+    qreal re10 = vecRe[ind10], im10 = vecIm[ind10];
+    qreal re11 = vecRe[ind11], im11 = vecIm[ind11];
+    
+    if (ctrlsOn) {
+        multiplyMatrixOntoPair(u, &re00,&im00, &re01,&im01);
+        multiplyMatrixOntoPair(u, &re10,&im10, &re11,&im11);
+    }
+    if (conjCtrlsOn) {
+        multiplyMatrixOntoPair(uConj, &re00,&im00, &re10,&im10);
+        multiplyMatrixOntoPair(uConj, &re01,&im01, &re11,&im11);
+    }
+    
+    vecRe[ind00] = re00; vecIm[ind00] = im00;
+    vecRe[ind01] = re01; vecIm[ind01] = im01;
+    vecRe[ind10] = re10; vecIm[ind10] = im10;
+    vecRe[ind11] = re11; vecIm[ind11] = im11;
+}
+
+void densmatr_multiControlledUnitary(Qureg qureg, int *controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u)
+{
+    int threadsPerCUDABlock, CUDABlocks;
+    long long int mask=0;
+    for (int i=0; i<numControlQubits; i++) mask = mask | (1LL<<controlQubits[i]);
+    threadsPerCUDABlock = 128;
+    CUDABlocks = ceil((qreal)(qureg.numAmpsPerChunk>>2)/threadsPerCUDABlock);
+    densmatr_multiControlledUnitaryKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
+        qureg, mask, targetQubit, u, getConjugateMatrix(u));
+}
+
 __global__ void statevec_pauliXKernel(Qureg qureg, const int targetQubit){
     // ----- sizes
     long long int sizeBlock,                                           // size of blocks
@@ -1566,6 +1759,18 @@ qreal densmatr_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcom
     return outcomeProb;
 }
 
+void statevec_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs)
+{
+    for (int m=0; m < numMeasures; m++)
+        outcomeProbs[m] = statevec_calcProbOfOutcome(qureg, measureQubits[m], outcomes[m]);
+}
+
+void densmatr_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs)
+{
+    for (int m=0; m < numMeasures; m++)
+        outcomeProbs[m] = densmatr_calcProbOfOutcome(qureg, measureQubits[m], outcomes[m]);
+}
+
 
 /** computes either a real or imag term in the inner product */
 __global__ void statevec_calcInnerProductKernel(
@@ -1685,6 +1890,13 @@ Complex statevec_calcInnerProduct(Qureg bra, Qureg ket) {
     return innerProd;
 }
 
+void statevec_calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds) {
+    
+    // each reduction already streams bra from device memory only once per ket
+    for (int k=0; k < numKets; k++)
+        innerProds[k] = statevec_calcInnerProduct(bra, kets[k]);
+}
+
 /** computes one term of (vec^*T) dens * vec */
 __global__ void densmatr_calcFidelityKernel(Qureg dens, Qureg vec, long long int dim, qreal* reducedArray) {
 
@@ -1776,6 +1988,119 @@ qreal densmatr_calcFidelity(Qureg qureg, Qureg pureState) {
 }
 
 
+/** computes one term of sum_j Re( factor conj(psi[j ^ flipMask]) (-1)^|j & phaseMask| psi[j] ) */
+__global__ void statevec_calcExpecPauliProdKernel(
+    qreal* vecReal, qreal* vecImag, long long int numAmps, 
+    long long int flipMask, long long int phaseMask, qreal factorRe, qreal factorIm, qreal* reducedArray
+) {
+    long long int index = blockIdx.x*blockDim.x + threadIdx.x;
+    if (index >= numAmps) return;
+    
+    long long int pairIndex = index ^ flipMask;
+    qreal prodRe = vecReal[pairIndex]*vecReal[index] + vecImag[pairIndex]*vecImag[index];
+    qreal prodIm = vecReal[pairIndex]*vecImag[index] - vecImag[pairIndex]*vecReal[index];
+    qreal sign = (__popcll(index & phaseMask) & 1)? -1 : 1;
+    
+    extern __shared__ qreal tempReductionArray[];
+    tempReductionArray[threadIdx.x] = sign * (factorRe*prodRe - factorIm*prodIm);
+    __syncthreads();
+    
+    // every second thread reduces
+    if (threadIdx.x<blockDim.x/2)
+        reduceBlock(tempReductionArray, reducedArray, blockDim.x);
+}
+
+/** computes one term of Tr(P rho), from the element rho[col ^ flipMask][col] */
+__global__ void densmatr_calcExpecPauliProdKernel(
+    qreal* vecReal, qreal* vecImag, long long int dim, 
+    long long int flipMask, long long int phaseMask, qreal factorRe, qreal factorIm, qreal* reducedArray
+) {
+    long long int col = blockIdx.x*blockDim.x + threadIdx.x;
+    if (col >= dim) return;
+    
+    long long int row = col ^ flipMask;
+    long long int index = row + col*dim;
+    qreal sign = (__popcll(row & phaseMask) & 1)? -1 : 1;
+    
+    extern __shared__ qreal tempReductionArray[];
+    tempReductionArray[threadIdx.x] = sign * (factorRe*vecReal[index] - factorIm*vecImag[index]);
+    __syncthreads();
+    
+    // every second thread reduces
+    if (threadIdx.x<blockDim.x/2)
+        reduceBlock(tempReductionArray, reducedArray, blockDim.x);
+}
+
+/** reduces a single Pauli product, one value per amplitude of a state-vector or column of a density matrix */
+static qreal calcExpecPauliProdMasks(Qureg qureg, long long int flipMask, long long int phaseMask, qreal factorRe, qreal factorIm) {
+    
+    long long int numValuesToReduce = (qureg.isDensityMatrix)? 
+        (1LL << qureg.numQubitsRepresented) : qureg.numAmpsPerChunk;
+    long long int numValues = numValuesToReduce;
+    
+    int valuesPerCUDABlock, numCUDABlocks, sharedMemSize;
+    int maxReducedPerLevel = REDUCE_SHARED_SIZE;
+    int firstTime = 1;
+    
+    while (numValuesToReduce > 1) {
+        
+        // need less than one CUDA-BLOCK to reduce
+        if (numValuesToReduce < maxReducedPerLevel) {
+            valuesPerCUDABlock = numValuesToReduce;
+            numCUDABlocks = 1;
+        }
+        // otherwise use only full CUDA-BLOCKS
+        else {
+            valuesPerCUDABlock = maxReducedPerLevel; // constrained by shared memory
+            numCUDABlocks = ceil((qreal)numValuesToReduce/valuesPerCUDABlock);
+        }
+        sharedMemSize = valuesPerCUDABlock*sizeof(qreal);
+        
+        if (firstTime) {
+            if (qureg.isDensityMatrix)
+                densmatr_calcExpecPauliProdKernel<<<numCUDABlocks, valuesPerCUDABlock, sharedMemSize>>>(
+                    qureg.deviceStateVec.real, qureg.deviceStateVec.imag, numValues,
+                    flipMask, phaseMask, factorRe, factorIm, qureg.firstLevelReduction);
+            else
+                statevec_calcExpecPauliProdKernel<<<numCUDABlocks, valuesPerCUDABlock, sharedMemSize>>>(
+                    qureg.deviceStateVec.real, qureg.deviceStateVec.imag, numValues,
+                    flipMask, phaseMask, factorRe, factorIm, qureg.firstLevelReduction);
+            firstTime = 0;
+        } else {
+            cudaDeviceSynchronize();    
+            copySharedReduceBlock<<<numCUDABlocks, valuesPerCUDABlock/2, sharedMemSize>>>(
+                    qureg.firstLevelReduction, 
+                    qureg.secondLevelReduction, valuesPerCUDABlock); 
+            cudaDeviceSynchronize();    
+            swapDouble(&(qureg.firstLevelReduction), &(qureg.secondLevelReduction));
+        }
+        numValuesToReduce = numValuesToReduce/maxReducedPerLevel;
+    }
+    
+    qreal expec;
+    cudaMemcpy(&expec, qureg.firstLevelReduction, sizeof(qreal), cudaMemcpyDeviceToHost);
+    return expec;
+}
+
+void statevec_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    for (int s=0; s < numSums; s++)
+        expecs[s] = 0;
+    for (int t=0; t < numTerms; t++)
+        expecs[sumInds[t]] += calcExpecPauliProdMasks(qureg, flipMasks[t], phaseMasks[t], factorsRe[t], factorsIm[t]);
+}
+
+void densmatr_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums) 
+{
+    for (int s=0; s < numSums; s++)
+        expecs[s] = 0;
+    for (int t=0; t < numTerms; t++)
+        expecs[sumInds[t]] += calcExpecPauliProdMasks(qureg, flipMasks[t], phaseMasks[t], factorsRe[t], factorsIm[t]);
+}
+
+
 __global__ void densmatr_calcPurityKernel(qreal* vecReal, qreal* vecImag, long long int numAmpsToSum, qreal *reducedArray) {
     
     // figure out which density matrix term this thread is assigned
@@ -2099,25 +2424,32 @@ void densmatr_twoQubitDephase(Qureg qureg, int qubit1, int qubit2, qreal dephase
         part1, part2, part3, part4, part5, colBit1, rowBit1, colBit2, rowBit2);
 }
 
-/** Works like oneQubitDephase but modifies every other element, and elements are averaged in pairs */
+/** Visits the four amplitudes of each |..x..><..y..| block, dephasing the two off-diagonal ones
+ * and averaging the two diagonal ones in pairs, so the channel takes a single pass */
 __global__ void densmatr_oneQubitDepolariseKernel(
     qreal depolLevel, qreal* vecReal, qreal *vecImag, long long int numAmpsToVisit,
     long long int part1, long long int part2, long long int part3, 
-    long long int bothBits)
+    long long int colBit, long long int rowBit)
 {
     long long int scanInd = blockIdx.x*blockDim.x + threadIdx.x;
     if (scanInd >= numAmpsToVisit) return;
     
     long long int baseInd = (scanInd&part1) + ((scanInd&part2)<<1) + ((scanInd&part3)<<2);
-    long long int targetInd = baseInd + bothBits;
+    long long int targetInd = baseInd + colBit + rowBit;
+    qreal retain = 1 - depolLevel;
+    
+    vecReal[baseInd + colBit] *= retain;
+    vecImag[baseInd + colBit] *= retain;
+    vecReal[baseInd + rowBit] *= retain;
+    vecImag[baseInd + rowBit] *= retain;
     
     qreal realAvDepol = depolLevel * 0.5 * (vecReal[baseInd] + vecReal[targetInd]);
     qreal imagAvDepol = depolLevel * 0.5 * (vecImag[baseInd] + vecImag[targetInd]);
     
-    vecReal[baseInd]   *= 1 - depolLevel;
-    vecImag[baseInd]   *= 1 - depolLevel;
-    vecReal[targetInd] *= 1 - depolLevel;
-    vecImag[targetInd] *= 1 - depolLevel;
+    vecReal[baseInd]   *= retain;
+    vecImag[baseInd]   *= retain;
+    vecReal[targetInd] *= retain;
+    vecImag[targetInd] *= retain;
     
     vecReal[baseInd]   += realAvDepol;
     vecImag[baseInd]   += imagAvDepol;
@@ -2130,14 +2462,11 @@ void densmatr_oneQubitDepolarise(Qureg qureg, const int targetQubit, qreal depol
     if (depolLevel == 0)
         return;
     
-    densmatr_oneQubitDephase(qureg, targetQubit, depolLevel);
-    
     long long int numAmpsToVisit = qureg.numAmpsPerChunk/4;
     int rowQubit = targetQubit + qureg.numQubitsRepresented;
     
     long long int colBit = 1LL << targetQubit;
     long long int rowBit = 1LL << rowQubit;
-    long long int bothBits = colBit | rowBit;
     
     long long int part1 = colBit - 1;
     long long int part2 = (rowBit >> 1) - colBit;
@@ -2148,21 +2477,36 @@ void densmatr_oneQubitDepolarise(Qureg qureg, const int targetQubit, qreal depol
     CUDABlocks = ceil(numAmpsToVisit / (qreal) threadsPerCUDABlock);
     densmatr_oneQubitDepolariseKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
         depolLevel, qureg.deviceStateVec.real, qureg.deviceStateVec.imag, numAmpsToVisit,
-        part1, part2, part3, bothBits);
+        part1, part2, part3, colBit, rowBit);
 }
 
-/** Called once for every 16 amplitudes */
+/** Called once for every 16 amplitudes, dephasing the 12 whose row and column differ in either
+ * qubit and depolarising the other 4, so the channel takes a single pass */
 __global__ void densmatr_twoQubitDepolariseKernel(
     qreal depolLevel, qreal* vecReal, qreal *vecImag, long long int numAmpsToVisit,
     long long int part1, long long int part2, long long int part3, 
     long long int part4, long long int part5,
-    long long int rowCol1, long long int rowCol2)
+    long long int colBit1, long long int rowBit1, long long int colBit2, long long int rowBit2)
 {
     long long int scanInd = blockIdx.x*blockDim.x + threadIdx.x;
     if (scanInd >= numAmpsToVisit) return;
     
+    long long int rowCol1 = colBit1 | rowBit1;
+    long long int rowCol2 = colBit2 | rowBit2;
+    
     // index of |..0..0..><..0..0|
     long long int ind00 = (scanInd&part1) + ((scanInd&part2)<<1) + ((scanInd&part3)<<2) + ((scanInd&part4)<<3) + ((scanInd&part5)<<4);
+    
+    // dephase the bit strings DCBA for |..D..C..><..B..A| in 1...14 excluding 5, 10
+    for (int meta=1; meta < 15; meta++) {
+        if (meta == 5 || meta == 10)
+            continue;
+        long long int offInd = ind00 + 
+            rowBit2*((meta>>3)%2) + rowBit1*((meta>>2)%2) + colBit2*((meta>>1)%2) + colBit1*(meta%2);
+        vecReal[offInd] *= 1 - depolLevel;
+        vecImag[offInd] *= 1 - depolLevel;
+    }
+    
     long long int ind01 = ind00 + rowCol1;
     long long int ind10 = ind00 + rowCol2;
     long long int ind11 = ind00 + rowCol1 + rowCol2;
@@ -2191,8 +2535,6 @@ void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depo
     
     // assumes qubit2 > qubit1
     
-    densmatr_twoQubitDephase(qureg, qubit1, qubit2, depolLevel);
-    
     int rowQubit1 = qubit1 + qureg.numQubitsRepresented;
     int rowQubit2 = qubit2 + qureg.numQubitsRepresented;
     
@@ -2201,9 +2543,6 @@ void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depo
     long long int colBit2 = 1LL << qubit2;
     long long int rowBit2 = 1LL << rowQubit2;
     
-    long long int rowCol1 = colBit1 | rowBit1;
-    long long int rowCol2 = colBit2 | rowBit2;
-    
     long long int numAmpsToVisit = qureg.numAmpsPerChunk/16;
     long long int part1 = colBit1 - 1;
     long long int part2 = (colBit2 >> 1) - colBit1;
@@ -2216,17 +2555,96 @@ void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depo
     CUDABlocks = ceil(numAmpsToVisit / (qreal) threadsPerCUDABlock);
     densmatr_twoQubitDepolariseKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
         depolLevel, qureg.deviceStateVec.real, qureg.deviceStateVec.imag, numAmpsToVisit,
-        part1, part2, part3, part4, part5, rowCol1, rowCol2);
+        part1, part2, part3, part4, part5, colBit1, rowBit1, colBit2, rowBit2);
+}
+
+__global__ void densmatr_applyKrausSuperoperatorKernel(
+    qreal* vecReal, qreal* vecImag, long long int numGroups, int numSuperBits, 
+    int bit0, int bit1, int bit2, int bit3, int sorted0, int sorted1, int sorted2, int sorted3,
+    qreal* superRe, qreal* superIm
+) {
+    long long int thisTask = blockIdx.x*blockDim.x + threadIdx.x;
+    if (thisTask >= numGroups) return;
+    
+    int bits[4] = {bit0, bit1, bit2, bit3};
+    int sorted[4] = {sorted0, sorted1, sorted2, sorted3};
+    int superDim = 1 << numSuperBits;
+    
+    // insert a zero at each group bit, lowest first
+    long long int baseInd = thisTask;
+    for (int b=0; b < numSuperBits; b++)
+        baseInd = ((baseInd >> sorted[b]) << (sorted[b]+1)) | (baseInd & ((1LL << sorted[b])-1));
+    
+    long long int inds[16];
+    qreal inRe[16], inIm[16];
+    for (int p=0; p < superDim; p++) {
+        inds[p] = baseInd;
+        for (int b=0; b < numSuperBits; b++)
+            if ((p >> b) & 1)
+                inds[p] |= 1LL << bits[b];
+        inRe[p] = vecReal[inds[p]];
+        inIm[p] = vecImag[inds[p]];
+    }
+    
+    for (int p=0; p < superDim; p++) {
+        qreal outRe = 0;
+        qreal outIm = 0;
+        for (int q=0; q < superDim; q++) {
+            outRe += superRe[p*superDim + q]*inRe[q] - superIm[p*superDim + q]*inIm[q];
+            outIm += superRe[p*superDim + q]*inIm[q] + superIm[p*superDim + q]*inRe[q];
+        }
+        vecReal[inds[p]] = outRe;
+        vecImag[inds[p]] = outIm;
+    }
+}
+
+void densmatr_applyKrausSuperoperator(Qureg qureg, int* targets, const int numTargets, qreal* superRe, qreal* superIm) {
+    
+    // the row bits of the targets are the least significant bits of the superoperator index
+    int numSuperBits = 2*numTargets;
+    int bits[4] = {0, 0, 0, 0};
+    for (int t=0; t < numTargets; t++) {
+        bits[t] = targets[t];
+        bits[t + numTargets] = targets[t] + qureg.numQubitsRepresented;
+    }
+    
+    int sorted[4] = {0, 0, 0, 0};
+    for (int b=0; b < numSuperBits; b++) {
+        int i = b;
+        while (i > 0 && sorted[i-1] > bits[b]) {
+            sorted[i] = sorted[i-1];
+            i--;
+        }
+        sorted[i] = bits[b];
+    }
+    
+    // the superoperator is too large for kernel arguments, so is copied to the device
+    int superLen = (1 << numSuperBits) * (1 << numSuperBits);
+    qreal *deviceSuperRe, *deviceSuperIm;
+    cudaMalloc(&deviceSuperRe, superLen * sizeof *deviceSuperRe);
+    cudaMalloc(&deviceSuperIm, superLen * sizeof *deviceSuperIm);
+    cudaMemcpy(deviceSuperRe, superRe, superLen * sizeof *deviceSuperRe, cudaMemcpyHostToDevice);
+    cudaMemcpy(deviceSuperIm, superIm, superLen * sizeof *deviceSuperIm, cudaMemcpyHostToDevice);
+    
+    long long int numGroups = qureg.numAmpsPerChunk >> numSuperBits;
+    int threadsPerCUDABlock, CUDABlocks;
+    threadsPerCUDABlock = 128;
+    CUDABlocks = ceil(numGroups / (qreal) threadsPerCUDABlock);
+    densmatr_applyKrausSuperoperatorKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
+        qureg.deviceStateVec.real, qureg.deviceStateVec.imag, numGroups, numSuperBits, 
+        bits[0], bits[1], bits[2], bits[3], sorted[0], sorted[1], sorted[2], sorted[3],
+        deviceSuperRe, deviceSuperIm);
+    
+    cudaFree(deviceSuperRe);
+    cudaFree(deviceSuperIm);
 }
 
-void seedQuESTDefault(){
-    // init MT random number generator with three keys -- time, pid and a hash of hostname 
-    // for the MPI version, it is ok that all procs will get the same seed as random numbers will only be 
-    // used by the master process
+void seedQuESTDefault(QuESTEnv *env){
+    // seed MT random number generators with three keys -- time, pid and a hash of hostname 
 
     unsigned long int key[3];
     getQuESTDefaultSeedKey(key); 
-    init_by_array(key, 3); 
+    seedQuEST(env, key, 3); 
 }  
 
 
@@ -6,8 +6,9 @@
  * and should never call eachother.
  *
  * Density matrices rho of N qubits are flattened to appear as state-vectors |s> of 2N qubits.
- * Operations U rho U^dag are implemented as U^* U |s> and make use of the pure state backend,
- * and often don't need to explicitly compute U^*.
+ * Unitary gates U rho U^dag are implemented as (U^* (x) U) |s> by the densmatr_ backend, which
+ * applies U and U^* together in a single pass over the amplitudes. Other operations, like
+ * initialisation, make use of the pure state backend directly.
  */
 
 # include "QuEST.h"
@@ -15,6 +16,7 @@
 # include "QuEST_internal.h"
 # include "QuEST_validation.h"
 # include "QuEST_qasm.h"
+# include "mt19937ar.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +37,8 @@ Qureg createQureg(int numQubits, QuESTEnv env) {
     qureg.numQubitsInStateVec = numQubits;
     
     qasm_setup(&qureg);
+    qureg.rng = createRandomGenerator(env);
+    qureg.policy = env.policy;
     initZeroState(qureg);
     return qureg;
 }
@@ -42,13 +46,17 @@ Qureg createQureg(int numQubits, QuESTEnv env) {
 Qureg createDensityQureg(int numQubits, QuESTEnv env) {
     validateCreateNumQubits(numQubits, __func__);
     
+    // density matrices exchange and rearrange whole chunks, so hold a whole chunk in pairStateVec
     Qureg qureg;
+    env.maxExchangeBufferBytes = 0;
     statevec_createQureg(&qureg, 2*numQubits, env);
     qureg.isDensityMatrix = 1;
     qureg.numQubitsRepresented = numQubits;
     qureg.numQubitsInStateVec = 2*numQubits;
     
     qasm_setup(&qureg);
+    qureg.rng = createRandomGenerator(env);
+    qureg.policy = env.policy;
     initZeroState(qureg);
     return qureg;
 }
@@ -56,6 +64,19 @@ Qureg createDensityQureg(int numQubits, QuESTEnv env) {
 void destroyQureg(Qureg qureg, QuESTEnv env) {
     statevec_destroyQureg(qureg, env);
     qasm_free(qureg);
+    destroyRandomGenerator(qureg.rng);
+}
+
+void seedQureg(Qureg qureg, unsigned long int *seedArray, int numSeeds) {
+    validateNumSeeds(numSeeds, __func__);
+    
+    init_by_array(qureg.rng, seedArray, numSeeds);
+}
+
+void setQuregExecPolicy(Qureg *qureg, ExecPolicy policy) {
+    validateExecPolicy(policy, __func__);
+    
+    qureg->policy = policy;
 }
 
 
@@ -85,6 +106,37 @@ void writeRecordedQASMToFile(Qureg qureg, char* filename) {
 }
 
 
+/*
+ * checkpointing
+ */
+
+void writeQuregCheckpoint(Qureg qureg, char* prefix) {
+    // any earlier manifest is gone before a chunk is overwritten, so never describes a partial checkpoint
+    if (qureg.chunkId == 0)
+        removeCheckpointManifest(prefix);
+    syncQuESTSuccess(1);
+    
+    // every rank writes its chunk concurrently, after which the first writes the manifest
+    int success = syncQuESTSuccess(statevec_writeCheckpoint(qureg, prefix));
+    if (success && qureg.chunkId == 0)
+        success = writeCheckpointManifest(qureg, prefix);
+    success = syncQuESTSuccess(success);
+    validateFileOpened(success, __func__);
+}
+
+void initStateFromCheckpoint(Qureg qureg, char* prefix) {
+    CheckpointManifest manifest;
+    int success = syncQuESTSuccess(readCheckpointManifest(prefix, &manifest));
+    validateFileOpened(success, __func__);
+    validateCheckpointManifest(qureg, manifest.numQubitsRepresented, manifest.isDensityMatrix, 
+        manifest.numChunks, manifest.qrealBytes, __func__);
+    
+    success = syncQuESTSuccess(statevec_initStateFromCheckpoint(qureg, prefix, manifest.numChunks));
+    validateFileOpened(success, __func__);
+    qasm_recordComment(qureg, "Here, the register was loaded from a checkpoint.");
+}
+
+
 /*
  * state initialisation
  */
@@ -160,10 +212,10 @@ void cloneQureg(Qureg targetQureg, Qureg copyQureg) {
 void hadamard(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_hadamard(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_hadamard(qureg, targetQubit+qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_hadamard(qureg, targetQubit);
+    else
+        statevec_hadamard(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_HADAMARD, targetQubit);
 }
@@ -171,10 +223,10 @@ void hadamard(Qureg qureg, const int targetQubit) {
 void rotateX(Qureg qureg, const int targetQubit, qreal angle) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_rotateX(qureg, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        statevec_rotateX(qureg, targetQubit+qureg.numQubitsRepresented, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_rotateX(qureg, targetQubit, angle);
+    else
+        statevec_rotateX(qureg, targetQubit, angle);
     
     qasm_recordParamGate(qureg, GATE_ROTATE_X, targetQubit, angle);
 }
@@ -182,10 +234,10 @@ void rotateX(Qureg qureg, const int targetQubit, qreal angle) {
 void rotateY(Qureg qureg, const int targetQubit, qreal angle) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_rotateY(qureg, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        statevec_rotateY(qureg, targetQubit+qureg.numQubitsRepresented, angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_rotateY(qureg, targetQubit, angle);
+    else
+        statevec_rotateY(qureg, targetQubit, angle);
     
     qasm_recordParamGate(qureg, GATE_ROTATE_Y, targetQubit, angle);
 }
@@ -193,10 +245,10 @@ void rotateY(Qureg qureg, const int targetQubit, qreal angle) {
 void rotateZ(Qureg qureg, const int targetQubit, qreal angle) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_rotateZ(qureg, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        statevec_rotateZ(qureg, targetQubit+qureg.numQubitsRepresented, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_rotateZ(qureg, targetQubit, angle);
+    else
+        statevec_rotateZ(qureg, targetQubit, angle);
     
     qasm_recordParamGate(qureg, GATE_ROTATE_Z, targetQubit, angle);
 }
@@ -204,11 +256,10 @@ void rotateZ(Qureg qureg, const int targetQubit, qreal angle) {
 void controlledRotateX(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     
-    statevec_controlledRotateX(qureg, controlQubit, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledRotateX(qureg, controlQubit+shift, targetQubit+shift, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledRotateX(qureg, controlQubit, targetQubit, angle);
+    else
+        statevec_controlledRotateX(qureg, controlQubit, targetQubit, angle);
     
     qasm_recordControlledParamGate(qureg, GATE_ROTATE_X, controlQubit, targetQubit, angle);
 }
@@ -216,11 +267,10 @@ void controlledRotateX(Qureg qureg, const int controlQubit, const int targetQubi
 void controlledRotateY(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     
-    statevec_controlledRotateY(qureg, controlQubit, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledRotateY(qureg, controlQubit+shift, targetQubit+shift, angle); // rotateY is real
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledRotateY(qureg, controlQubit, targetQubit, angle);
+    else
+        statevec_controlledRotateY(qureg, controlQubit, targetQubit, angle);
 
     qasm_recordControlledParamGate(qureg, GATE_ROTATE_Y, controlQubit, targetQubit, angle);
 }
@@ -228,11 +278,10 @@ void controlledRotateY(Qureg qureg, const int controlQubit, const int targetQubi
 void controlledRotateZ(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     
-    statevec_controlledRotateZ(qureg, controlQubit, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledRotateZ(qureg, controlQubit+shift, targetQubit+shift, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledRotateZ(qureg, controlQubit, targetQubit, angle);
+    else
+        statevec_controlledRotateZ(qureg, controlQubit, targetQubit, angle);
     
     qasm_recordControlledParamGate(qureg, GATE_ROTATE_Z, controlQubit, targetQubit, angle);
 }
@@ -241,10 +290,10 @@ void unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u) {
     validateTarget(qureg, targetQubit, __func__);
     validateUnitaryMatrix(u, __func__);
     
-    statevec_unitary(qureg, targetQubit, u);
-    if (qureg.isDensityMatrix) {
-        statevec_unitary(qureg, targetQubit+qureg.numQubitsRepresented, getConjugateMatrix(u));
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_unitary(qureg, targetQubit, u);
+    else
+        statevec_unitary(qureg, targetQubit, u);
     
     qasm_recordUnitary(qureg, u, targetQubit);
 }
@@ -253,11 +302,10 @@ void controlledUnitary(Qureg qureg, const int controlQubit, const int targetQubi
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     validateUnitaryMatrix(u, __func__);
     
-    statevec_controlledUnitary(qureg, controlQubit, targetQubit, u);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledUnitary(qureg, controlQubit+shift, targetQubit+shift, getConjugateMatrix(u));
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledUnitary(qureg, controlQubit, targetQubit, u);
+    else
+        statevec_controlledUnitary(qureg, controlQubit, targetQubit, u);
     
     qasm_recordControlledUnitary(qureg, u, controlQubit, targetQubit);
 }
@@ -266,13 +314,10 @@ void multiControlledUnitary(Qureg qureg, int* controlQubits, const int numContro
     validateMultiControlsTarget(qureg, controlQubits, numControlQubits, targetQubit, __func__);
     validateUnitaryMatrix(u, __func__);
     
-    statevec_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit, u);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        shiftIndices(controlQubits, numControlQubits, shift);
-        statevec_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit+shift, getConjugateMatrix(u));
-        shiftIndices(controlQubits, numControlQubits, -shift);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit, u);
+    else
+        statevec_multiControlledUnitary(qureg, controlQubits, numControlQubits, targetQubit, u);
     
     qasm_recordMultiControlledUnitary(qureg, u, controlQubits, numControlQubits, targetQubit);
 }
@@ -281,11 +326,10 @@ void compactUnitary(Qureg qureg, const int targetQubit, Complex alpha, Complex b
     validateTarget(qureg, targetQubit, __func__);
     validateUnitaryComplexPair(alpha, beta, __func__);
     
-    statevec_compactUnitary(qureg, targetQubit, alpha, beta);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_compactUnitary(qureg, targetQubit+shift, getConjugateScalar(alpha), getConjugateScalar(beta));
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_compactUnitary(qureg, targetQubit, alpha, beta);
+    else
+        statevec_compactUnitary(qureg, targetQubit, alpha, beta);
 
     qasm_recordCompactUnitary(qureg, alpha, beta, targetQubit);
 }
@@ -294,13 +338,10 @@ void controlledCompactUnitary(Qureg qureg, const int controlQubit, const int tar
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     validateUnitaryComplexPair(alpha, beta, __func__);
     
-    statevec_controlledCompactUnitary(qureg, controlQubit, targetQubit, alpha, beta);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledCompactUnitary(qureg, 
-            controlQubit+shift, targetQubit+shift, 
-            getConjugateScalar(alpha), getConjugateScalar(beta));
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledCompactUnitary(qureg, controlQubit, targetQubit, alpha, beta);
+    else
+        statevec_controlledCompactUnitary(qureg, controlQubit, targetQubit, alpha, beta);
     
     qasm_recordControlledCompactUnitary(qureg, alpha, beta, controlQubit, targetQubit);
 }
@@ -308,10 +349,10 @@ void controlledCompactUnitary(Qureg qureg, const int controlQubit, const int tar
 void pauliX(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_pauliX(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_pauliX(qureg, targetQubit+qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_pauliX(qureg, targetQubit);
+    else
+        statevec_pauliX(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_SIGMA_X, targetQubit);
 }
@@ -319,10 +360,10 @@ void pauliX(Qureg qureg, const int targetQubit) {
 void pauliY(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_pauliY(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_pauliYConj(qureg, targetQubit + qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_pauliY(qureg, targetQubit);
+    else
+        statevec_pauliY(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_SIGMA_Y, targetQubit);
 }
@@ -330,10 +371,10 @@ void pauliY(Qureg qureg, const int targetQubit) {
 void pauliZ(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_pauliZ(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_pauliZ(qureg, targetQubit+qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_pauliZ(qureg, targetQubit);
+    else
+        statevec_pauliZ(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_SIGMA_Z, targetQubit);
 }
@@ -341,10 +382,10 @@ void pauliZ(Qureg qureg, const int targetQubit) {
 void sGate(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_sGate(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_sGateConj(qureg, targetQubit+qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_sGate(qureg, targetQubit);
+    else
+        statevec_sGate(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_S, targetQubit);
 }
@@ -352,10 +393,10 @@ void sGate(Qureg qureg, const int targetQubit) {
 void tGate(Qureg qureg, const int targetQubit) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_tGate(qureg, targetQubit);
-    if (qureg.isDensityMatrix) {
-        statevec_tGateConj(qureg, targetQubit+qureg.numQubitsRepresented);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_tGate(qureg, targetQubit);
+    else
+        statevec_tGate(qureg, targetQubit);
     
     qasm_recordGate(qureg, GATE_T, targetQubit);
 }
@@ -363,10 +404,10 @@ void tGate(Qureg qureg, const int targetQubit) {
 void phaseShift(Qureg qureg, const int targetQubit, qreal angle) {
     validateTarget(qureg, targetQubit, __func__);
     
-    statevec_phaseShift(qureg, targetQubit, angle);
-    if (qureg.isDensityMatrix) {
-        statevec_phaseShift(qureg, targetQubit+qureg.numQubitsRepresented, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_phaseShift(qureg, targetQubit, angle);
+    else
+        statevec_phaseShift(qureg, targetQubit, angle);
     
     qasm_recordParamGate(qureg, GATE_PHASE_SHIFT, targetQubit, angle);
 }
@@ -374,11 +415,10 @@ void phaseShift(Qureg qureg, const int targetQubit, qreal angle) {
 void controlledPhaseShift(Qureg qureg, const int idQubit1, const int idQubit2, qreal angle) {
     validateControlTarget(qureg, idQubit1, idQubit2, __func__);
     
-    statevec_controlledPhaseShift(qureg, idQubit1, idQubit2, angle);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledPhaseShift(qureg, idQubit1+shift, idQubit2+shift, -angle);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledPhaseShift(qureg, idQubit1, idQubit2, angle);
+    else
+        statevec_controlledPhaseShift(qureg, idQubit1, idQubit2, angle);
     
     qasm_recordControlledParamGate(qureg, GATE_PHASE_SHIFT, idQubit1, idQubit2, angle);
 }
@@ -386,13 +426,10 @@ void controlledPhaseShift(Qureg qureg, const int idQubit1, const int idQubit2, q
 void multiControlledPhaseShift(Qureg qureg, int *controlQubits, int numControlQubits, qreal angle) {
     validateMultiControls(qureg, controlQubits, numControlQubits, __func__);
     
-    statevec_multiControlledPhaseShift(qureg, controlQubits, numControlQubits, angle);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        shiftIndices(controlQubits, numControlQubits, shift);
+    if (qureg.isDensityMatrix)
+        densmatr_multiControlledPhaseShift(qureg, controlQubits, numControlQubits, angle);
+    else
         statevec_multiControlledPhaseShift(qureg, controlQubits, numControlQubits, angle);
-        shiftIndices(controlQubits, numControlQubits, -shift);
-    }
     
     qasm_recordMultiControlledParamGate(qureg, GATE_PHASE_SHIFT, controlQubits, numControlQubits-1, controlQubits[numControlQubits-1], angle);
 }
@@ -400,11 +437,10 @@ void multiControlledPhaseShift(Qureg qureg, int *controlQubits, int numControlQu
 void controlledNot(Qureg qureg, const int controlQubit, const int targetQubit) {
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     
-    statevec_controlledNot(qureg, controlQubit, targetQubit);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledNot(qureg, controlQubit+shift, targetQubit+shift);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledNot(qureg, controlQubit, targetQubit);
+    else
+        statevec_controlledNot(qureg, controlQubit, targetQubit);
     
     qasm_recordControlledGate(qureg, GATE_SIGMA_X, controlQubit, targetQubit);
 }
@@ -412,11 +448,10 @@ void controlledNot(Qureg qureg, const int controlQubit, const int targetQubit) {
 void controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit) {
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     
-    statevec_controlledPauliY(qureg, controlQubit, targetQubit);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledPauliYConj(qureg, controlQubit+shift, targetQubit+shift);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledPauliY(qureg, controlQubit, targetQubit);
+    else
+        statevec_controlledPauliY(qureg, controlQubit, targetQubit);
     
     qasm_recordControlledGate(qureg, GATE_SIGMA_Y, controlQubit, targetQubit);
 }
@@ -424,11 +459,10 @@ void controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit
 void controlledPhaseFlip(Qureg qureg, const int idQubit1, const int idQubit2) {
     validateControlTarget(qureg, idQubit1, idQubit2, __func__);
     
-    statevec_controlledPhaseFlip(qureg, idQubit1, idQubit2);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledPhaseFlip(qureg, idQubit1+shift, idQubit2+shift);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledPhaseFlip(qureg, idQubit1, idQubit2);
+    else
+        statevec_controlledPhaseFlip(qureg, idQubit1, idQubit2);
     
     qasm_recordControlledGate(qureg, GATE_SIGMA_Z, idQubit1, idQubit2);
 }
@@ -436,13 +470,10 @@ void controlledPhaseFlip(Qureg qureg, const int idQubit1, const int idQubit2) {
 void multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numControlQubits) {
     validateMultiControls(qureg, controlQubits, numControlQubits, __func__);
     
-    statevec_multiControlledPhaseFlip(qureg, controlQubits, numControlQubits);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        shiftIndices(controlQubits, numControlQubits, shift);
+    if (qureg.isDensityMatrix)
+        densmatr_multiControlledPhaseFlip(qureg, controlQubits, numControlQubits);
+    else
         statevec_multiControlledPhaseFlip(qureg, controlQubits, numControlQubits);
-        shiftIndices(controlQubits, numControlQubits, -shift);
-    }
     
     qasm_recordMultiControlledGate(qureg, GATE_SIGMA_Z, controlQubits, numControlQubits-1, controlQubits[numControlQubits-1]);
 }
@@ -451,11 +482,10 @@ void rotateAroundAxis(Qureg qureg, const int rotQubit, qreal angle, Vector axis)
     validateTarget(qureg, rotQubit, __func__);
     validateVector(axis, __func__);
     
-    statevec_rotateAroundAxis(qureg, rotQubit, angle, axis);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_rotateAroundAxisConj(qureg, rotQubit+shift, angle, axis);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_rotateAroundAxis(qureg, rotQubit, angle, axis);
+    else
+        statevec_rotateAroundAxis(qureg, rotQubit, angle, axis);
     
     qasm_recordAxisRotation(qureg, angle, axis, rotQubit);
 }
@@ -464,11 +494,10 @@ void controlledRotateAroundAxis(Qureg qureg, const int controlQubit, const int t
     validateControlTarget(qureg, controlQubit, targetQubit, __func__);
     validateVector(axis, __func__);
     
-    statevec_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, axis);
-    if (qureg.isDensityMatrix) {
-        int shift = qureg.numQubitsRepresented;
-        statevec_controlledRotateAroundAxisConj(qureg, controlQubit+shift, targetQubit+shift, angle, axis);
-    }
+    if (qureg.isDensityMatrix)
+        densmatr_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, axis);
+    else
+        statevec_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, axis);
     
     qasm_recordControlledAxisRotation(qureg, angle, axis, controlQubit, targetQubit);
 }
@@ -611,6 +640,56 @@ Complex calcInnerProduct(Qureg bra, Qureg ket) {
     return statevec_calcInnerProduct(bra, ket);
 }
 
+void calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds) {
+    validateNumQuregs(numKets, __func__);
+    validateStateVecQureg(bra, __func__);
+    for (int k=0; k < numKets; k++) {
+        validateStateVecQureg(kets[k], __func__);
+        validateMatchingQuregDims(bra, kets[k], __func__);
+    }
+    
+    statevec_calcInnerProducts(bra, kets, numKets, innerProds);
+}
+
+qreal calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets) {
+    validateMultiTargets(qureg, targetQubits, numTargets, __func__);
+    validatePauliCodes(pauliCodes, numTargets, __func__);
+    
+    if (qureg.isDensityMatrix)
+        return densmatr_calcExpecPauliProd(qureg, targetQubits, pauliCodes, numTargets);
+    else
+        return statevec_calcExpecPauliProd(qureg, targetQubits, pauliCodes, numTargets);
+}
+
+qreal calcExpecPauliSum(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, int numSumTerms) {
+    validateNumSumTerms(numSumTerms, __func__);
+    validatePauliCodes(allPauliCodes, numSumTerms*qureg.numQubitsRepresented, __func__);
+    
+    qreal expec;
+    if (qureg.isDensityMatrix)
+        densmatr_calcExpecPauliSums(qureg, allPauliCodes, termCoeffs, &numSumTerms, 1, &expec);
+    else
+        statevec_calcExpecPauliSums(qureg, allPauliCodes, termCoeffs, &numSumTerms, 1, &expec);
+    return expec;
+}
+
+void calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs) 
+{
+    validateNumObservables(numSums, __func__);
+    int numTerms = 0;
+    for (int s=0; s < numSums; s++) {
+        validateNumSumTerms(numSumTerms[s], __func__);
+        numTerms += numSumTerms[s];
+    }
+    validatePauliCodes(allPauliCodes, numTerms*qureg.numQubitsRepresented, __func__);
+    
+    if (qureg.isDensityMatrix)
+        densmatr_calcExpecPauliSums(qureg, allPauliCodes, termCoeffs, numSumTerms, numSums, expecs);
+    else
+        statevec_calcExpecPauliSums(qureg, allPauliCodes, termCoeffs, numSumTerms, numSums, expecs);
+}
+
 qreal calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome) {
     validateTarget(qureg, measureQubit, __func__);
     validateOutcome(outcome, __func__);
@@ -621,6 +700,19 @@ qreal calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome) {
         return statevec_calcProbOfOutcome(qureg, measureQubit, outcome);
 }
 
+void calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs) {
+    validateNumMeasurements(numMeasures, __func__);
+    for (int m=0; m < numMeasures; m++) {
+        validateTarget(qureg, measureQubits[m], __func__);
+        validateOutcome(outcomes[m], __func__);
+    }
+    
+    if (qureg.isDensityMatrix)
+        densmatr_calcProbsOfOutcomes(qureg, measureQubits, outcomes, numMeasures, outcomeProbs);
+    else
+        statevec_calcProbsOfOutcomes(qureg, measureQubits, outcomes, numMeasures, outcomeProbs);
+}
+
 qreal calcPurity(Qureg qureg) {
     validateDensityMatrQureg(qureg, __func__);
     
@@ -643,37 +735,65 @@ qreal calcFidelity(Qureg qureg, Qureg pureState) {
  */
 
 void applyOneQubitDephaseError(Qureg qureg, const int targetQubit, qreal prob) {
-    validateDensityMatrQureg(qureg, __func__);
     validateTarget(qureg, targetQubit, __func__);
     validateOneQubitDephaseProb(prob, __func__);
     
-    densmatr_oneQubitDephase(qureg, targetQubit, 2*prob);
+    if (qureg.isDensityMatrix)
+        densmatr_oneQubitDephase(qureg, targetQubit, 2*prob);
+    else
+        statevec_oneQubitDephaseTrajectory(qureg, targetQubit, prob);
 }
 
 void applyTwoQubitDephaseError(Qureg qureg, int qubit1, int qubit2, qreal prob) {
-    validateDensityMatrQureg(qureg, __func__);
     validateUniqueTargets(qureg, qubit1, qubit2, __func__);
     validateTwoQubitDephaseProb(prob, __func__);
 
     ensureIndsIncrease(&qubit1, &qubit2);
-    densmatr_twoQubitDephase(qureg, qubit1, qubit2, (4*prob)/3.0);
+    if (qureg.isDensityMatrix)
+        densmatr_twoQubitDephase(qureg, qubit1, qubit2, (4*prob)/3.0);
+    else
+        statevec_twoQubitDephaseTrajectory(qureg, qubit1, qubit2, prob);
 }
 
 void applyOneQubitDepolariseError(Qureg qureg, const int targetQubit, qreal prob) {
-    validateDensityMatrQureg(qureg, __func__);
     validateTarget(qureg, targetQubit, __func__);
     validateOneQubitDepolProb(prob, __func__);
     
-    densmatr_oneQubitDepolarise(qureg, targetQubit, (4*prob)/3.0);
+    if (qureg.isDensityMatrix)
+        densmatr_oneQubitDepolarise(qureg, targetQubit, (4*prob)/3.0);
+    else
+        statevec_oneQubitDepolariseTrajectory(qureg, targetQubit, prob);
 }
 
 void applyTwoQubitDepolariseError(Qureg qureg, int qubit1, int qubit2, qreal prob) {
-    validateDensityMatrQureg(qureg, __func__);
     validateUniqueTargets(qureg, qubit1, qubit2, __func__);
     validateTwoQubitDepolProb(prob, __func__);
     
     ensureIndsIncrease(&qubit1, &qubit2);
-    densmatr_twoQubitDepolarise(qureg, qubit1, qubit2, (16*prob)/15.0);
+    if (qureg.isDensityMatrix)
+        densmatr_twoQubitDepolarise(qureg, qubit1, qubit2, (16*prob)/15.0);
+    else
+        statevec_twoQubitDepolariseTrajectory(qureg, qubit1, qubit2, prob);
+}
+
+void calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages) 
+{
+    validateCreateNumQubits(numQubits, __func__);
+    validateNumTrajectories(numTrajectories, __func__);
+    validateNumObservables(numObservables, __func__);
+    
+    statevec_calcTrajectoryAverages(env, numQubits, numTrajectories, 
+        circuit, observe, args, numObservables, averages);
+}
+
+void applyKrausMap(Qureg qureg, int* targets, const int numTargets, Complex* ops, const int numOps) {
+    validateDensityMatrQureg(qureg, __func__);
+    validateKrausTargets(qureg, targets, numTargets, __func__);
+    validateKrausOps(numTargets, ops, numOps, __func__);
+    
+    densmatr_applyKrausMap(qureg, targets, numTargets, ops, numOps);
 }
 
 
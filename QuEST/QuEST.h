@@ -35,6 +35,12 @@ typedef struct {
     
 } QASMLogger;
 
+/** The state of a Mersenne Twister, defined in mt19937ar.h */
+struct MTState;
+
+/** The most keys with which a random number generator may be seeded */
+# define MAX_NUM_SEEDS 64
+
 /** Represents an array of complex numbers grouped into an array of 
  * real components and an array of coressponding complex components.
  */
@@ -60,6 +66,10 @@ typedef struct Complex
     qreal imag;
 } Complex;
 
+/** Codes for specifying Pauli operators
+ */
+enum pauliOpType {PAULI_I=0, PAULI_X=1, PAULI_Y=2, PAULI_Z=3};
+
 /** Represents a 2x2 matrix of complex numbers
  */
 typedef struct ComplexMatrix2
@@ -75,6 +85,26 @@ typedef struct Vector
     qreal x, y, z;
 } Vector;
 
+/** The fewest amplitudes each thread is given by the policy of a new environment, unless tuned */
+# define DEFAULT_MIN_AMPS_PER_THREAD (1LL << 13)
+
+/** How the CPU kernels acting upon a register share its amplitudes among OpenMP threads.
+ * A kernel gives each thread at least minAmpsPerThread of the register's local amplitudes, so a
+ * register with fewer than twice that many is processed by a single thread without opening a
+ * parallel region. createQuESTEnv sets minAmpsPerThread to DEFAULT_MIN_AMPS_PER_THREAD, so that
+ * identical runs divide their sums alike and agree bitwise. Setting the environment variable
+ * QUEST_TUNE_EXEC_POLICY=1 (of rank 0) instead tunes it to the measured cost of a parallel region
+ * on the machine, which costs a little at startup and may differ between runs. Every register
+ * starts with the policy of the environment.
+ */
+typedef struct ExecPolicy
+{
+    //! The most threads a kernel upon the register may use, or 0 for every available thread
+    int maxThreads;
+    //! The fewest amplitudes each thread is given; 0 divides every register among all threads
+    long long int minAmpsPerThread;
+} ExecPolicy;
+
 /** Represents a system of qubits.
  * Qubits are zero-based
  */
@@ -98,8 +128,14 @@ typedef struct Qureg
     
     //! Computational state amplitudes - a subset thereof in the MPI version
     ComplexArray stateVec; 
-    //! Temporary storage for a chunk of the state vector received from another process in the MPI version
+    //! Temporary storage for amplitudes received from another process in the MPI version
     ComplexArray pairStateVec;
+    //! Number of amplitudes pairStateVec holds: the whole chunk for a density matrix, else at most
+    //! the exchange buffer of the environment, through which chunks are exchanged slice by slice
+    long long int numPairAmps;
+    //! Whether the nonzero amplitudes alone (with a mask of where they lie) of each exchanged slice 
+    //! are sent, when at most half are nonzero
+    int compressExchanges;
     
     //! Storage for wavefunction amplitudes in the GPU version
     ComplexArray deviceStateVec;
@@ -109,15 +145,36 @@ typedef struct Qureg
     //! Storage for generated QASM output
     QASMLogger* qasmLog;
     
+    //! This register's own random number generator, drawn upon by measurement and trajectory noise
+    struct MTState* rng;
+    
+    //! How kernels upon this register are divided among threads
+    ExecPolicy policy;
+    
 } Qureg;
 
 /** Information about the environment the program is running in.
-In practice, this holds info about MPI ranks and helps to hide MPI initialization code
+In practice, this holds info about MPI ranks and helps to hide MPI initialization code, 
+the keys with which the random number generator of each new register is seeded, 
+and the execution policy each new register is given
 */
 typedef struct QuESTEnv
 {
     int rank;
     int numRanks;
+    unsigned long int seeds[MAX_NUM_SEEDS];
+    int numSeeds;
+    ExecPolicy policy;
+    //! The most bytes of pairStateVec each distributed state-vector allocates, or 0 for a whole chunk
+    long long int maxExchangeBufferBytes;
+    //! Whether distributed registers compress the runs of zero amplitudes in the slices they exchange
+    int compressExchanges;
+    //! The index of this rank among those sharing its node
+    int nodeRank;
+    //! The number of ranks sharing this rank's node
+    int numNodeRanks;
+    //! The number of CPUs to which this rank's threads are pinned, or 0 if they are left to the OS
+    int numPinnedCpus;
 } QuESTEnv;
 
 
@@ -128,7 +185,10 @@ typedef struct QuESTEnv
 
 /** Create a Qureg object representing a set of qubits which will remain in a pure state.
  * Allocate space for state vector of probability amplitudes, including space for temporary values to be copied from
- * one other chunk if running the distributed version. Define properties related to the size of the set of qubits.
+ * one other chunk if running the distributed version. That space is at most \p env.maxExchangeBufferBytes 
+ * (256 MiB, unless overridden by the environment variable QUEST_EXCHANGE_BUFFER_MB), through which a chunk is 
+ * exchanged slice by slice, so that memory per rank is dominated by the state itself. 
+ * Define properties related to the size of the set of qubits.
  * The qubits are initialised in the zero state (i.e. initZeroState is automatically called)
  *
  * @returns an object representing the set of qubits
@@ -182,6 +242,33 @@ real, imag
  */
 void reportState(Qureg qureg);
 
+/** Save the amplitudes of \p qureg (a state-vector or density matrix) to a checkpoint, from which
+ * initStateFromCheckpoint can later restore them. 
+ * Each rank writes its own chunk concurrently to the binary file '[prefix]_chunk_[rank].bin' (its real,
+ * then its imaginary amplitudes, at full precision), after which the first rank writes a short text 
+ * manifest '[prefix].manifest' recording the number of qubits, the type of register, the number of 
+ * chunk files and the precision. Any existing checkpoint of the same prefix is overwritten, its 
+ * manifest being removed before any chunk is, and the new manifest is written last (by renaming a 
+ * temporary file), so that its presence marks a complete checkpoint even if a write is interrupted.
+ *
+ * @param[in] qureg object representing the set of qubits to save
+ * @param[in] prefix the path and name of the checkpoint files, without extension
+ * @throws exitWithError if any file cannot be written
+ */
+void writeQuregCheckpoint(Qureg qureg, char* prefix);
+
+/** Restore the amplitudes of \p qureg from a checkpoint written by writeQuregCheckpoint, which may
+ * have been written by a different number of ranks. Each rank reads only the parts of the chunk files
+ * which overlap its own chunk, concurrently with the others, so the amplitudes are redistributed 
+ * without communication, and loading takes as long as reading one chunk.
+ *
+ * @param[in,out] qureg object representing the set of qubits to restore
+ * @param[in] prefix the path and name of the checkpoint files, without extension
+ * @throws exitWithError if the checkpoint cannot be read, or was written from a register of a 
+ *      different number of qubits, type or precision
+ */
+void initStateFromCheckpoint(Qureg qureg, char* prefix);
+
 /** Print the current state vector of probability amplitudes for a set of qubits to standard out. 
  * For debugging purposes. Each rank should print output serially. 
  * Only print output for systems <= 5 qubits
@@ -567,6 +654,16 @@ int syncQuESTSuccess(int successCode);
  */
 void reportQuESTEnv(QuESTEnv env);
 
+/** Measure and report the memory bandwidth each rank achieves when its threads stream through 
+ * memory (96 MiB in double precision), every rank at once, and the imbalance between them. A rank 
+ * far slower than the rest shares its memory with too many others, or runs threads far from it. 
+ * Unlike reportQuESTEnv, this must be called by every rank, since each measures its own bandwidth. 
+ * A GPU-accelerated environment measures nothing.
+ *
+ * @param[in] env object representing the execution environment. A single instance is used for each program
+ */
+void reportMemoryBandwidth(QuESTEnv env);
+
 void getEnvironmentString(QuESTEnv env, Qureg qureg, char str[200]);
 
 /** Getthe complex amplitude at a given index in the state vector.
@@ -1290,6 +1387,23 @@ void controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit
  */
 qreal calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome);
 
+/** Gives the probability of each of \p numMeasures qubits being measured in the given outcome,
+ * writing calcProbOfOutcome(\p qureg, \p measureQubits[m], \p outcomes[m]) to \p outcomeProbs[m].
+ * Like calcProbOfOutcome, this performs no measurement and does not change the state. 
+ * Distributed registers combine every probability in a single reduction, rather than one per qubit.
+ *
+ * @param[in] qureg object representing the set of all qubits
+ * @param[in] measureQubits the qubits to study
+ * @param[in] outcomes the outcome (0 or 1) of each of \p measureQubits
+ * @param[in] numMeasures the number of qubits in \p measureQubits
+ * @param[out] outcomeProbs the \p numMeasures probabilities
+ * @throws exitWithError
+ *      if \p numMeasures <= 0,
+ *      or if any of \p measureQubits are outside [0, \p qureg.numQubitsRepresented),
+ *      or if any of \p outcomes are not in {0, 1}.
+ */
+void calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs);
+
 /** Updates the state vector to be consistent with measuring the measure qubit in the given outcome (0 or 1), and returns the probability of such a measurement outcome. 
  * This is effectively performing a measurement and forcing the outcome.
  * This is an irreversible change to the state vector, whereby incompatible states
@@ -1337,31 +1451,140 @@ int measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb);
 /** Computes <bra|ket> */
 Complex calcInnerProduct(Qureg bra, Qureg ket);
 
-/** Seed the Mersenne Twister used for random number generation in the QuEST environment with an example
- * defualt seed.
- * This default seeding function uses the mt19937 init_by_array function with three keys -- 
- * time, pid and hostname. Subsequent calls to mt19937 genrand functions will use this seeding. 
- * For a multi process code, the same seed is given to all process, therefore this seeding is only
- * appropriate to use for functions such as measure where all processes require the same random value.
+/** Computes <bra|ket_k> for each of \p numKets kets, writing them to \p innerProds[k].
+ * This is equivalent to calling calcInnerProduct for every ket, but \p bra is read once in 
+ * cache-sized blocks which are reused by every ket, and distributed registers combine all
+ * products in a single reduction.
+ *
+ * @param[in] bra a state-vector
+ * @param[in] kets state-vectors with the same number of qubits as \p bra
+ * @param[in] numKets the number of registers in \p kets
+ * @param[out] innerProds the \p numKets inner products
+ * @throws exitWithError
+ *      if \p numKets <= 0,
+ *      or if \p bra or any of \p kets is a density matrix,
+ *      or if the dimensions of \p bra and any of \p kets differ
+ */
+void calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds);
+
+/** Computes the expected value of a product of Pauli operators.
+ * For a state-vector \p qureg = \f$|\psi\rangle\f$ this is \f$\langle\psi| P |\psi\rangle\f$,
+ * and for a density matrix \p qureg = \f$\rho\f$ it is \f$\text{Tr}(P \rho)\f$, where 
+ * \f$P\f$ applies \p pauliCodes[i] to \p targetQubits[i].
+ *
+ * The product is never applied to \p qureg, which is unchanged. Instead each amplitude is paired
+ * with the one whose index differs in the X and Y targets, and signed by the parity of its 
+ * Y and Z target bits, in a single read-only pass. State-vectors in distributed mode exchange
+ * their chunk with at most one other node, when an X or Y target lies beyond the chunk.
+ *
+ * @param[in] qureg a state-vector or density matrix
+ * @param[in] targetQubits the qubits upon which the Pauli operators act
+ * @param[in] pauliCodes the Pauli operator upon each target, one of PAULI_I, PAULI_X, PAULI_Y, PAULI_Z
+ * @param[in] numTargets the number of qubits in \p targetQubits
+ * @return the real expected value of the Pauli product
+ * @throws exitWithError
+ *      if \p numTargets is outside [1, \p qureg.numQubitsRepresented],
+ *      or if any of \p targetQubits are outside [0, \p qureg.numQubitsRepresented) or are not unique,
+ *      or if any of \p pauliCodes are not valid Pauli codes
+ */
+qreal calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets);
+
+/** Computes the expected value of a weighted sum of Pauli products, such as a Hamiltonian.
+ * Term t is \p termCoeffs[t] times the product of \p allPauliCodes[t*n + q] upon each qubit q,
+ * where n = \p qureg.numQubitsRepresented.
+ *
+ * Terms which flip the same qubits (for example, every product of only Z and I) are evaluated
+ * together in one read-only pass over \p qureg, and distributed registers combine every term
+ * in a single reduction.
+ *
+ * @param[in] qureg a state-vector or density matrix
+ * @param[in] allPauliCodes the \p numSumTerms * n Pauli codes of every term
+ * @param[in] termCoeffs the real coefficient of each term
+ * @param[in] numSumTerms the number of terms in the sum
+ * @return the real expected value of the sum
+ * @throws exitWithError
+ *      if \p numSumTerms <= 0,
+ *      or if any of \p allPauliCodes are not valid Pauli codes
+ */
+qreal calcExpecPauliSum(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, int numSumTerms);
+
+/** Computes the expected values of \p numSums weighted sums of Pauli products, such as several 
+ * observables of one state, writing them to \p expecs. The terms of every sum are listed one sum
+ * after another in \p allPauliCodes and \p termCoeffs, as in calcExpecPauliSum, with \p numSumTerms[s]
+ * terms in sum s.
+ *
+ * This is equivalent to calling calcExpecPauliSum for every sum, but terms which flip the same qubits
+ * share one pass over \p qureg even when they belong to different sums, and distributed registers 
+ * combine every sum in a single reduction.
+ *
+ * @param[in] qureg a state-vector or density matrix
+ * @param[in] allPauliCodes the n Pauli codes of every term of every sum, where n = \p qureg.numQubitsRepresented
+ * @param[in] termCoeffs the real coefficient of every term of every sum
+ * @param[in] numSumTerms the number of terms in each sum
+ * @param[in] numSums the number of sums
+ * @param[out] expecs the \p numSums real expected values
+ * @throws exitWithError
+ *      if \p numSums <= 0,
+ *      or if any of \p numSumTerms are <= 0,
+ *      or if any of \p allPauliCodes are not valid Pauli codes
+ */
+void calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs);
+
+/** Set the keys of the QuEST environment to an example default seed.
+ * Every register holds its own Mersenne Twister, which createQureg and createDensityQureg seed 
+ * with the mt19937 init_by_array function from the keys of the environment. This default seeding 
+ * uses three keys -- time, pid and hostname -- and is applied by createQuESTEnv. 
+ * For a multi process code, the same seed is given to all process, so that every process draws the 
+ * same random values, as required by functions such as measure.
  *
  * For more information about the MT, see http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/MT2002/emt19937ar.html
+ *
+ * @param[in,out] env the environment whose keys to set
  **/
-void seedQuESTDefault(void);
+void seedQuESTDefault(QuESTEnv *env);
 
-/** Seed the Mersenne Twister used for random number generation in the QuEST environment with
- * a user defined seed.
- * This function uses the mt19937 init_by_array function with numSeeds keys supplied by the user.
- * Subsequent calls to mt19937 genrand functions will use this seeding. 
- * For a multi process code, the same seed is given to all process, therefore this seeding is only
- * appropriate to use for functions such as measure where all processes require the same random value.
+/** Set the keys of the QuEST environment to a user defined seed.
+ * Registers created after this call have their Mersenne Twister seeded with the mt19937 init_by_array 
+ * function from these numSeeds keys; registers created beforehand are unaffected (see seedQureg).
+ * Every register created from the same keys draws the same sequence of random numbers.
+ * For a multi process code, the same seed must be given to all process, so that every process draws 
+ * the same random values, as required by functions such as measure.
  *
+ * @param[in,out] env the environment whose keys to set
  * @param[in] seedArray Array of integers to use as seed. This allows the MT to be initialised with more 
  * than a 32-bit integer if required
  * @param[in] numSeeds Length of seedArray
+ * @throws exitWithError if \p numSeeds <= 0 or \p numSeeds > MAX_NUM_SEEDS
  *
  * For more information about the MT, see http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/MT2002/emt19937ar.html
  **/
-void seedQuEST(unsigned long int *seedArray, int numSeeds);
+void seedQuEST(QuESTEnv *env, unsigned long int *seedArray, int numSeeds);
+
+/** Reseed the Mersenne Twister of a single register with the mt19937 init_by_array function.
+ * Each register owns its generator, so registers used concurrently by different threads never 
+ * share random state, and seeding each from its own keys makes their outcomes reproducible 
+ * regardless of how the threads are scheduled.
+ *
+ * @param[in,out] qureg the register whose generator to reseed
+ * @param[in] seedArray Array of integers to use as seed
+ * @param[in] numSeeds Length of seedArray
+ * @throws exitWithError if \p numSeeds <= 0 or \p numSeeds > MAX_NUM_SEEDS
+ **/
+void seedQureg(Qureg qureg, unsigned long int *seedArray, int numSeeds);
+
+/** Set how the CPU kernels acting upon a register are divided among OpenMP threads.
+ * Capping the threads of each register lets several registers be simulated concurrently without 
+ * oversubscribing the cores, and a large \p policy.minAmpsPerThread keeps small registers serial. 
+ * Results may differ in their last bits between policies, since sums are split differently among 
+ * threads. The policy has no effect on the GPU, nor without OpenMP. Registers created afterwards 
+ * take the policy of the environment, which may be assigned directly.
+ *
+ * @param[in,out] qureg the register whose policy to set
+ * @param[in] policy the thread cap (0 for none) and fewest amplitudes per thread
+ * @throws exitWithError if \p policy.maxThreads < 0 or \p policy.minAmpsPerThread < 0
+ **/
+void setQuregExecPolicy(Qureg *qureg, ExecPolicy policy);
 
 /** Enable QASM recording. Gates applied to qureg will here-after be added to growing QASM instructions,
  * progressively consuming more memory until stopped
@@ -1394,12 +1617,16 @@ void writeRecordedQASMToFile(Qureg qureg, char* filename);
  * where q = \p targetQubit.
  * \p prob cannot exceed 1/2, which maximally mixes \p targetQubit.
  *
- * @param[in,out] qureg a density matrix
+ * If \p qureg is instead a state-vector, one quantum trajectory of the channel is sampled:
+ * Pauli Z is applied to \p targetQubit with probability \p prob, else nothing is.
+ * Observables averaged over many such trajectories (see calcTrajectoryAverages) converge to 
+ * their value under the mixed state, while each trajectory needs only 2^n amplitudes.
+ *
+ * @param[in,out] qureg a density matrix, or a state-vector upon which to sample the error
  * @param[in] targetQubit qubit upon which to induce dephasing noise
  * @param[in] prob the probability of the phase error occuring
  * @throws exitWithError
- *      if \p qureg is not a density matrix,
- *      or if \p targetQubit is outside [0, \p qureg.numQubitsRepresented),
+ *      if \p targetQubit is outside [0, \p qureg.numQubitsRepresented),
  *      or if \p prob is not in [0, 1/2]
  */
 void applyOneQubitDephaseError(Qureg qureg, const int targetQubit, qreal prob);
@@ -1418,13 +1645,15 @@ void applyOneQubitDephaseError(Qureg qureg, const int targetQubit, qreal prob);
  * where a = \p qubit1, b = \p qubit2.
  * \p prob cannot exceed 3/4, at which maximal mixing occurs.
  *
- * @param[in,out] qureg a density matrix
+ * If \p qureg is a state-vector, a trajectory is sampled: with probability \p prob, one of
+ * \f$Z_a\f$, \f$Z_b\f$ and \f$Z_a Z_b\f$ is chosen uniformly and applied.
+ *
+ * @param[in,out] qureg a density matrix, or a state-vector upon which to sample the error
  * @param[in] qubit1 qubit upon which to induce dephasing noise
  * @param[in] qubit2 qubit upon which to induce dephasing noise
  * @param[in] prob the probability of the phase error occuring
  * @throws exitWithError
- *      if \p qureg is not a density matrix,
- *      or if either \p qubit1 or \p qubit2 is outside [0, \p qureg.numQubitsRepresented),
+ *      if either \p qubit1 or \p qubit2 is outside [0, \p qureg.numQubitsRepresented),
  *      or if \p qubit1 = \p qubit2,
  *      or if \p prob is not in [0, 3/4]
  */
@@ -1444,12 +1673,14 @@ void applyTwoQubitDephaseError(Qureg qureg, const int qubit1, const int qubit2,
  * where q = \p targetQubit.
  * \p prob cannot exceed 3/4, at which maximal mixing occurs.
  *
- * @param[in,out] qureg a density matrix
+ * If \p qureg is a state-vector, a trajectory is sampled: with probability \p prob, one of
+ * X, Y and Z is chosen uniformly and applied to \p targetQubit.
+ *
+ * @param[in,out] qureg a density matrix, or a state-vector upon which to sample the error
  * @param[in] targetQubit qubit upon which to induce depolarising noise
  * @param[in] prob the probability of the depolarising error occuring
  * @throws exitWithError
- *      if \p qureg is not a density matrix,
- *      or if \p targetQubit is outside [0, \p qureg.numQubitsRepresented),
+ *      if \p targetQubit is outside [0, \p qureg.numQubitsRepresented),
  *      or if \p prob is not in [0, 3/4]
  */
 void applyOneQubitDepolariseError(Qureg qureg, const int targetQubit, qreal prob);
@@ -1491,18 +1722,83 @@ void applyOneQubitDepolariseError(Qureg qureg, const int targetQubit, qreal prob
  * where a = \p qubit1, b = \p qubit2.
  * \p prob cannot exceed 15/16, at which maximal mixing occurs.
  *
- * @param[in,out] qureg a density matrix
+ * If \p qureg is a state-vector, a trajectory is sampled: with probability \p prob, one of
+ * the 15 two-qubit Pauli gates above is chosen uniformly and applied.
+ *
+ * @param[in,out] qureg a density matrix, or a state-vector upon which to sample the error
  * @param[in] qubit1 qubit upon which to induce depolarising noise
  * @param[in] qubit2 qubit upon which to induce depolarising noise
  * @param[in] prob the probability of the depolarising error occuring
  * @throws exitWithError
- *      if \p qureg is not a density matrix,
- *      or if either \p qubit1 or \p qubit2 is outside [0, \p qureg.numQubitsRepresented),
+ *      if either \p qubit1 or \p qubit2 is outside [0, \p qureg.numQubitsRepresented),
  *      or if \p qubit1 = \p qubit2,
  *      or if \p prob is not in [0, 15/16]
  */
 void applyTwoQubitDepolariseError(Qureg qureg, const int qubit1, const int qubit2, qreal prob);
 
+/** Estimates observables of a noisy circuit by averaging them over quantum trajectories.
+ * Each of \p numTrajectories trajectories prepares a state-vector of \p numQubits qubits in 
+ * the zero state, passes it to \p circuit, which may apply the noise functions above to sample
+ * errors, and then to \p observe, which writes \p numObservables real values (for example
+ * probabilities from calcProbOfOutcome). Their means are written to \p averages.
+ *
+ * This reproduces the observables of the equivalent density matrix simulation to within a
+ * statistical error which falls as 1/sqrt(\p numTrajectories), in 2^n rather than 4^n memory.
+ * In multithreaded builds, trajectories run concurrently with one register per thread, so 
+ * \p circuit and \p observe must only modify the given register and their own local state.
+ * In distributed builds, each register is spread over every node and trajectories run in turn.
+ * Trajectory t draws its random numbers from a generator seeded with the keys of \p env followed 
+ * by t, so it samples the same errors whichever thread simulates it, and repeated calls with the 
+ * same keys and number of threads give identical averages.
+ *
+ * @param[in] env object representing the execution environment
+ * @param[in] numQubits the number of qubits in each trajectory's register
+ * @param[in] numTrajectories the number of trajectories to sample
+ * @param[in] circuit applies the noisy circuit to a register
+ * @param[in] observe writes the observables of a register to its third argument
+ * @param[in] args passed unchanged to \p circuit and \p observe
+ * @param[in] numObservables the number of values written by \p observe
+ * @param[out] averages the mean of each observable over all trajectories
+ * @throws exitWithError
+ *      if \p numQubits <= 0,
+ *      or if \p numTrajectories <= 0,
+ *      or if \p numObservables <= 0
+ */
+void calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages);
+
+/** Applies a general one- or two-qubit noise channel, given by its Kraus operators, to a density matrix.
+ * This transforms \p qureg = \f$\rho\f$ into the mixed state
+ * \f[
+ * \sum \limits_{i=0}^{\text{numOps}-1} K_i \, \rho \, K_i^\dagger
+ * \f]
+ * where the Kraus operators \f$K_i\f$ act upon \p targets, and must satisfy 
+ * \f$\sum_i K_i^\dagger K_i = I\f$ so that the channel preserves the trace.
+ * This can describe amplitude damping, or calibrated device noise, without mixing cloned registers.
+ *
+ * The operators are given as a flat array of \p numOps row-major \f$2^k \times 2^k\f$ matrices,
+ * so that element (r, c) of operator i is \p ops[i*4^k + r*2^k + c], where k = \p numTargets.
+ * \p targets[0] is the least significant qubit of the matrix row and column indices.
+ *
+ * The superoperator \f$\sum_i K_i^* \otimes K_i\f$ is computed once, and applied in a single
+ * pass over the density matrix.
+ *
+ * @param[in,out] qureg a density matrix
+ * @param[in] targets the qubits upon which the Kraus operators act
+ * @param[in] numTargets the number of qubits in \p targets, either 1 or 2
+ * @param[in] ops the \p numOps Kraus operators, each a row-major \f$2^k \times 2^k\f$ matrix
+ * @param[in] numOps the number of Kraus operators, in [1, 4^k]
+ * @throws exitWithError
+ *      if \p qureg is not a density matrix,
+ *      or if \p numTargets is not 1 or 2,
+ *      or if any of \p targets are outside [0, \p qureg.numQubitsRepresented) or are not unique,
+ *      or if \p numOps is not in [1, 4^k],
+ *      or if the Kraus operators do not satisfy \f$\sum_i K_i^\dagger K_i = I\f$,
+ *      or if (in distributed mode) a node holds fewer than 4^k amplitudes
+ */
+void applyKrausMap(Qureg qureg, int* targets, const int numTargets, Complex* ops, const int numOps);
+
 /** Modifies combineQureg to become (1-prob)combineProb + prob otherQureg.
  * Both registers must be equal-dimension density matrices, and prob must be in [0, 1].
  *
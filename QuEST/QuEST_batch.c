@@ -0,0 +1,563 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * A backend for batches of small pure states, implementing QuEST_batch.h.
+ *
+ * The amplitudes of a batch of B instances form a 2^N by B array, stored row-major so that
+ * the B values of one amplitude index are adjacent. Every gate is reduced to one of two
+ * kernels: a (possibly controlled) 2x2 matrix applied to amplitude pairs, or a phase
+ * applied to the amplitudes whose masked bits are all 1. Both loop over amplitude indices
+ * outside and over instances inside, reading the gate's coefficients from per-instance
+ * arrays, so the inner loop has unit stride, no branches and no aliasing, and is vectorised.
+ * Inactive instances are given the identity matrix or a unit phase, so masking costs nothing
+ * beyond the arithmetic already being performed.
+ */
+
+# include "QuEST.h"
+# include "QuEST_batch.h"
+# include "QuEST_internal.h"
+# include "QuEST_precision.h"
+# include "QuEST_validation.h"
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <math.h>
+
+# ifdef _OPENMP
+# include <omp.h>
+# endif
+
+# ifndef M_PI
+# define M_PI 3.14159265358979323846
+# endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the number of coefficient arrays in the workspace; a 2x2 complex matrix needs all of them
+# define BATCH_NUM_COEFF_ARRAYS 8
+
+// lanes are processed in groups of this many, so that inner loops have a fixed trip count
+// and are vectorised even at -O2; this fills an AVX-512 register of doubles
+# define BATCH_LANE_WIDTH 8
+
+// kernels with fewer amplitudes than this in total are not worth distributing between threads
+# define BATCH_MIN_PARALLEL_AMPS (1LL<<14)
+
+
+/*
+ * kernels
+ */
+
+/* Applies to one group of lanes of an amplitude pair the per-lane matrices whose elements
+ * (r0c0, r0c1, r1c0, r1c1) have their real and imaginary parts in consecutive arrays, each
+ * coeffStride apart
+ */
+static inline void applyMatrixToLanes(
+    qreal* restrict upRe, qreal* restrict upIm, qreal* restrict loRe, qreal* restrict loIm,
+    const qreal* restrict coeffs, long long int coeffStride
+) {
+    const qreal* restrict aRe = coeffs;
+    const qreal* restrict aIm = coeffs + coeffStride;
+    const qreal* restrict bRe = coeffs + 2*coeffStride;
+    const qreal* restrict bIm = coeffs + 3*coeffStride;
+    const qreal* restrict cRe = coeffs + 4*coeffStride;
+    const qreal* restrict cIm = coeffs + 5*coeffStride;
+    const qreal* restrict dRe = coeffs + 6*coeffStride;
+    const qreal* restrict dIm = coeffs + 7*coeffStride;
+
+    for (int k=0; k<BATCH_LANE_WIDTH; k++) {
+        qreal ur = upRe[k], ui = upIm[k];
+        qreal lr = loRe[k], li = loIm[k];
+        upRe[k] = aRe[k]*ur - aIm[k]*ui + bRe[k]*lr - bIm[k]*li;
+        upIm[k] = aRe[k]*ui + aIm[k]*ur + bRe[k]*li + bIm[k]*lr;
+        loRe[k] = cRe[k]*ur - cIm[k]*ui + dRe[k]*lr - dIm[k]*li;
+        loIm[k] = cRe[k]*ui + cIm[k]*ur + dRe[k]*li + dIm[k]*lr;
+    }
+}
+
+/* Multiplies one group of lanes of an amplitude by the per-lane factors */
+static inline void applyPhaseToLanes(
+    qreal* restrict ampRe, qreal* restrict ampIm,
+    const qreal* restrict fRe, const qreal* restrict fIm
+) {
+    for (int k=0; k<BATCH_LANE_WIDTH; k++) {
+        qreal r = ampRe[k], i = ampIm[k];
+        ampRe[k] = fRe[k]*r - fIm[k]*i;
+        ampIm[k] = fRe[k]*i + fIm[k]*r;
+    }
+}
+
+/* Adds to one group of lane sums the squared norms of one group of lanes of an amplitude */
+static inline void addProbsOfLanes(
+    qreal* restrict sums, const qreal* restrict ampRe, const qreal* restrict ampIm
+) {
+    for (int k=0; k<BATCH_LANE_WIDTH; k++)
+        sums[k] += ampRe[k]*ampRe[k] + ampIm[k]*ampIm[k];
+}
+
+/* Applies to each lane b the matrix held in the b-th elements of the eight coefficient
+ * arrays, upon every amplitude pair of targetQubit for which all qubits in ctrlMask are 1
+ */
+static void applyMatrices(QuregBatch batch, const int targetQubit, long long int ctrlMask) {
+
+    long long int numLanes = batch.numLanes;
+    long long int numTasks = batch.numAmpsPerInstance >> 1;
+    long long int sizeHalfBlock = 1LL << targetQubit;
+    long long int sizeBlock = 2 * sizeHalfBlock;
+    long long int mask = ctrlMask;
+# ifdef _OPENMP
+    int isParallel = (batch.numAmpsPerInstance * numLanes >= BATCH_MIN_PARALLEL_AMPS);
+# endif
+
+    qreal* vecRe = batch.stateVec.real;
+    qreal* vecIm = batch.stateVec.imag;
+    qreal* coeffs = batch.laneCoeffs;
+
+    long long int thisTask, indUp, indLo, lane;
+
+# ifdef _OPENMP
+# pragma omp parallel for if(isParallel) \
+    default  (none) \
+    shared   (numTasks,numLanes,sizeHalfBlock,sizeBlock,mask, vecRe,vecIm,coeffs) \
+    private  (thisTask,indUp,indLo,lane) \
+    schedule (static)
+# endif
+    for (thisTask=0; thisTask<numTasks; thisTask++) {
+
+        indUp = (thisTask / sizeHalfBlock)*sizeBlock + thisTask%sizeHalfBlock;
+        indLo = indUp + sizeHalfBlock;
+        if ((indUp & mask) != mask)
+            continue;
+
+        for (lane=0; lane<numLanes; lane+=BATCH_LANE_WIDTH)
+            applyMatrixToLanes(
+                vecRe + indUp*numLanes + lane, vecIm + indUp*numLanes + lane,
+                vecRe + indLo*numLanes + lane, vecIm + indLo*numLanes + lane,
+                coeffs + lane, numLanes);
+    }
+}
+
+/* Multiplies every amplitude of lane b for which all qubits in phaseMask are 1 by the
+ * b-th elements of the first two coefficient arrays (the real then imaginary part)
+ */
+static void applyPhases(QuregBatch batch, long long int phaseMask) {
+
+    long long int numLanes = batch.numLanes;
+    long long int numAmps = batch.numAmpsPerInstance;
+    long long int mask = phaseMask;
+# ifdef _OPENMP
+    int isParallel = (numAmps * numLanes >= BATCH_MIN_PARALLEL_AMPS);
+# endif
+
+    qreal* vecRe = batch.stateVec.real;
+    qreal* vecIm = batch.stateVec.imag;
+    qreal* coeffs = batch.laneCoeffs;
+
+    long long int index, lane;
+
+# ifdef _OPENMP
+# pragma omp parallel for if(isParallel) \
+    default  (none) \
+    shared   (numAmps,numLanes,mask, vecRe,vecIm,coeffs) \
+    private  (index,lane) \
+    schedule (static)
+# endif
+    for (index=0; index<numAmps; index++) {
+
+        if ((index & mask) != mask)
+            continue;
+
+        for (lane=0; lane<numLanes; lane+=BATCH_LANE_WIDTH)
+            applyPhaseToLanes(
+                vecRe + index*numLanes + lane, vecIm + index*numLanes + lane,
+                coeffs + lane, coeffs + numLanes + lane);
+    }
+}
+
+
+/*
+ * per-instance coefficients
+ */
+
+static void setLaneMatrix(QuregBatch batch, int b, ComplexMatrix2 u) {
+    if (! batch.isActive[b]) {
+        u.r0c0.real = 1; u.r0c0.imag = 0;
+        u.r0c1.real = 0; u.r0c1.imag = 0;
+        u.r1c0.real = 0; u.r1c0.imag = 0;
+        u.r1c1.real = 1; u.r1c1.imag = 0;
+    }
+    qreal* coeffs = batch.laneCoeffs;
+    int n = batch.numLanes;
+    coeffs[0*n + b] = u.r0c0.real;
+    coeffs[1*n + b] = u.r0c0.imag;
+    coeffs[2*n + b] = u.r0c1.real;
+    coeffs[3*n + b] = u.r0c1.imag;
+    coeffs[4*n + b] = u.r1c0.real;
+    coeffs[5*n + b] = u.r1c0.imag;
+    coeffs[6*n + b] = u.r1c1.real;
+    coeffs[7*n + b] = u.r1c1.imag;
+}
+
+static void setLanePhase(QuregBatch batch, int b, Complex factor) {
+    if (! batch.isActive[b]) {
+        factor.real = 1;
+        factor.imag = 0;
+    }
+    batch.laneCoeffs[b] = factor.real;
+    batch.laneCoeffs[batch.numLanes + b] = factor.imag;
+}
+
+static void applyUniformMatrix(QuregBatch batch, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u) {
+    for (int b=0; b < batch.numLanes; b++)
+        setLaneMatrix(batch, b, u);
+    applyMatrices(batch, targetQubit, ctrlMask);
+}
+
+static void applyUniformPhase(QuregBatch batch, long long int phaseMask, qreal factorRe, qreal factorIm) {
+    Complex factor = {.real = factorRe, .imag = factorIm};
+    for (int b=0; b < batch.numLanes; b++)
+        setLanePhase(batch, b, factor);
+    applyPhases(batch, phaseMask);
+}
+
+static void applyRotations(QuregBatch batch, const int targetQubit, long long int ctrlMask, qreal* angles, Vector axis) {
+    for (int b=0; b < batch.numLanes; b++) {
+        Complex alpha, beta;
+        getComplexPairFromRotation((b < batch.numInstances)? angles[b] : 0, axis, &alpha, &beta);
+        setLaneMatrix(batch, b, getMatrixFromComplexPair(alpha, beta));
+    }
+    applyMatrices(batch, targetQubit, ctrlMask);
+}
+
+static void applyPhaseShifts(QuregBatch batch, long long int phaseMask, qreal* angles) {
+    for (int b=0; b < batch.numLanes; b++) {
+        qreal angle = (b < batch.numInstances)? angles[b] : 0;
+        Complex factor = {.real = cos(angle), .imag = sin(angle)};
+        setLanePhase(batch, b, factor);
+    }
+    applyPhases(batch, phaseMask);
+}
+
+static ComplexMatrix2 getRealMatrix(qreal r0c0, qreal r0c1, qreal r1c0, qreal r1c1) {
+    ComplexMatrix2 u = {
+        .r0c0 = {.real = r0c0, .imag = 0}, .r0c1 = {.real = r0c1, .imag = 0},
+        .r1c0 = {.real = r1c0, .imag = 0}, .r1c1 = {.real = r1c1, .imag = 0}};
+    return u;
+}
+
+static long long int getControlMask(int* controlQubits, const int numControlQubits) {
+    long long int mask = 0;
+    for (int i=0; i < numControlQubits; i++)
+        mask |= 1LL << controlQubits[i];
+    return mask;
+}
+
+
+/*
+ * batch management
+ */
+
+static Qureg getValidationShape(QuregBatch batch) {
+    Qureg shape = {
+        .isDensityMatrix = 0,
+        .numQubitsRepresented = batch.numQubits,
+        .numQubitsInStateVec = batch.numQubits,
+        .numAmpsTotal = batch.numAmpsPerInstance};
+    return shape;
+}
+
+static void* allocOrExit(size_t numBytes) {
+    void* mem = malloc(numBytes);
+    if (mem == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+QuregBatch createQuregBatch(int numQubits, int numInstances, QuESTEnv env) {
+    validateCreateNumQubits(numQubits, __func__);
+    validateNumInstances(numInstances, __func__);
+
+    QuregBatch batch;
+    batch.numQubits = numQubits;
+    batch.numInstances = numInstances;
+    batch.numAmpsPerInstance = 1LL << numQubits;
+    batch.numLanes = BATCH_LANE_WIDTH * ((numInstances + BATCH_LANE_WIDTH - 1) / BATCH_LANE_WIDTH);
+
+    size_t numAmps = batch.numAmpsPerInstance * batch.numLanes;
+    batch.stateVec.real = allocOrExit(numAmps * sizeof *batch.stateVec.real);
+    batch.stateVec.imag = allocOrExit(numAmps * sizeof *batch.stateVec.imag);
+    batch.isActive = allocOrExit(batch.numLanes * sizeof *batch.isActive);
+    batch.laneCoeffs = allocOrExit(BATCH_NUM_COEFF_ARRAYS * batch.numLanes * sizeof *batch.laneCoeffs);
+
+    setBatchActiveInstances(batch, NULL);
+
+    initBatchZeroState(batch);
+    return batch;
+}
+
+void destroyQuregBatch(QuregBatch batch, QuESTEnv env) {
+    free(batch.stateVec.real);
+    free(batch.stateVec.imag);
+    free(batch.isActive);
+    free(batch.laneCoeffs);
+}
+
+void setBatchActiveInstances(QuregBatch batch, int* isActive) {
+    for (int b=0; b < batch.numLanes; b++)
+        batch.isActive[b] = (b >= batch.numInstances)? 0 : (isActive == NULL)? 1 : (isActive[b] != 0);
+}
+
+
+/*
+ * state initialisation and access
+ */
+
+/* Sets every amplitude of every instance to the given real value, leaving the padding lanes zero */
+static void setAllAmps(QuregBatch batch, qreal value) {
+    for (long long int i=0; i < batch.numAmpsPerInstance; i++) {
+        for (int b=0; b < batch.numLanes; b++) {
+            batch.stateVec.real[i*batch.numLanes + b] = (b < batch.numInstances)? value : 0;
+            batch.stateVec.imag[i*batch.numLanes + b] = 0;
+        }
+    }
+}
+
+void initBatchZeroState(QuregBatch batch) {
+    setAllAmps(batch, 0);
+    for (int b=0; b < batch.numInstances; b++)
+        batch.stateVec.real[b] = 1;
+}
+
+void initBatchPlusState(QuregBatch batch) {
+    setAllAmps(batch, 1.0 / sqrt((qreal) batch.numAmpsPerInstance));
+}
+
+void initBatchClassicalStates(QuregBatch batch, long long int* stateInds) {
+    Qureg shape = getValidationShape(batch);
+    for (int b=0; b < batch.numInstances; b++)
+        validateStateIndex(shape, stateInds[b], __func__);
+
+    setAllAmps(batch, 0);
+    for (int b=0; b < batch.numInstances; b++)
+        batch.stateVec.real[stateInds[b]*batch.numLanes + b] = 1;
+}
+
+void setBatchInstance(QuregBatch batch, int instance, Qureg qureg) {
+    validateStateVecQureg(qureg, __func__);
+    validateMatchingQuregDims(getValidationShape(batch), qureg, __func__);
+    validateInstanceIndex(instance, batch.numInstances, __func__);
+
+    for (long long int i=0; i < batch.numAmpsPerInstance; i++) {
+        batch.stateVec.real[i*batch.numLanes + instance] = statevec_getRealAmp(qureg, i);
+        batch.stateVec.imag[i*batch.numLanes + instance] = statevec_getImagAmp(qureg, i);
+    }
+}
+
+void copyBatchInstance(QuregBatch batch, int instance, Qureg qureg) {
+    validateStateVecQureg(qureg, __func__);
+    validateMatchingQuregDims(getValidationShape(batch), qureg, __func__);
+    validateInstanceIndex(instance, batch.numInstances, __func__);
+
+    long long int numAmps = batch.numAmpsPerInstance;
+    qreal* reals = allocOrExit(numAmps * sizeof *reals);
+    qreal* imags = allocOrExit(numAmps * sizeof *imags);
+    for (long long int i=0; i < numAmps; i++) {
+        reals[i] = batch.stateVec.real[i*batch.numLanes + instance];
+        imags[i] = batch.stateVec.imag[i*batch.numLanes + instance];
+    }
+    statevec_setAmps(qureg, 0, reals, imags, numAmps);
+    free(reals);
+    free(imags);
+}
+
+Complex getBatchAmp(QuregBatch batch, int instance, long long int index) {
+    validateInstanceIndex(instance, batch.numInstances, __func__);
+    validateStateIndex(getValidationShape(batch), index, __func__);
+
+    Complex amp;
+    amp.real = batch.stateVec.real[index*batch.numLanes + instance];
+    amp.imag = batch.stateVec.imag[index*batch.numLanes + instance];
+    return amp;
+}
+
+
+/*
+ * calculations
+ */
+
+/* Writes to probs[b] the sum of the squared norms of the amplitudes of instance b whose
+ * index has every bit of bitMask equal to the corresponding bit of bitValues. The lane sums
+ * are accumulated in the coefficient workspace, which spans whole groups of lanes.
+ */
+static void sumProbs(QuregBatch batch, long long int bitMask, long long int bitValues, qreal* probs) {
+    long long int numLanes = batch.numLanes;
+    qreal* sums = batch.laneCoeffs;
+
+    for (long long int lane=0; lane < numLanes; lane++)
+        sums[lane] = 0;
+
+    for (long long int index=0; index < batch.numAmpsPerInstance; index++) {
+        if ((index & bitMask) != bitValues)
+            continue;
+
+        for (long long int lane=0; lane < numLanes; lane+=BATCH_LANE_WIDTH)
+            addProbsOfLanes(sums + lane,
+                batch.stateVec.real + index*numLanes + lane,
+                batch.stateVec.imag + index*numLanes + lane);
+    }
+
+    for (int b=0; b < batch.numInstances; b++)
+        probs[b] = sums[b];
+}
+
+void batchCalcTotalProb(QuregBatch batch, qreal* probs) {
+    sumProbs(batch, 0, 0, probs);
+}
+
+void batchCalcProbOfOutcome(QuregBatch batch, const int measureQubit, int outcome, qreal* probs) {
+    validateTarget(getValidationShape(batch), measureQubit, __func__);
+    validateOutcome(outcome, __func__);
+
+    sumProbs(batch, 1LL << measureQubit, ((long long int) outcome) << measureQubit, probs);
+}
+
+
+/*
+ * gates
+ */
+
+void batchHadamard(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    qreal f = 1/sqrt(2);
+    applyUniformMatrix(batch, targetQubit, 0, getRealMatrix(f, f, f, -f));
+}
+
+void batchPauliX(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    applyUniformMatrix(batch, targetQubit, 0, getRealMatrix(0, 1, 1, 0));
+}
+
+void batchPauliY(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    ComplexMatrix2 u = getRealMatrix(0, 0, 0, 0);
+    u.r0c1.imag = -1;
+    u.r1c0.imag = 1;
+    applyUniformMatrix(batch, targetQubit, 0, u);
+}
+
+void batchPauliZ(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    applyUniformPhase(batch, 1LL << targetQubit, -1, 0);
+}
+
+void batchSGate(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    applyUniformPhase(batch, 1LL << targetQubit, 0, 1);
+}
+
+void batchTGate(QuregBatch batch, const int targetQubit) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    applyUniformPhase(batch, 1LL << targetQubit, cos(M_PI/4), sin(M_PI/4));
+}
+
+void batchPhaseShift(QuregBatch batch, const int targetQubit, qreal* angles) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+
+    applyPhaseShifts(batch, 1LL << targetQubit, angles);
+}
+
+void batchRotateX(QuregBatch batch, const int rotQubit, qreal* angles) {
+    validateTarget(getValidationShape(batch), rotQubit, __func__);
+
+    Vector unitAxis = {1, 0, 0};
+    applyRotations(batch, rotQubit, 0, angles, unitAxis);
+}
+
+void batchRotateY(QuregBatch batch, const int rotQubit, qreal* angles) {
+    validateTarget(getValidationShape(batch), rotQubit, __func__);
+
+    Vector unitAxis = {0, 1, 0};
+    applyRotations(batch, rotQubit, 0, angles, unitAxis);
+}
+
+void batchRotateZ(QuregBatch batch, const int rotQubit, qreal* angles) {
+    validateTarget(getValidationShape(batch), rotQubit, __func__);
+
+    Vector unitAxis = {0, 0, 1};
+    applyRotations(batch, rotQubit, 0, angles, unitAxis);
+}
+
+void batchUnitary(QuregBatch batch, const int targetQubit, ComplexMatrix2 u) {
+    validateTarget(getValidationShape(batch), targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyUniformMatrix(batch, targetQubit, 0, u);
+}
+
+void batchControlledNot(QuregBatch batch, const int controlQubit, const int targetQubit) {
+    validateControlTarget(getValidationShape(batch), controlQubit, targetQubit, __func__);
+
+    applyUniformMatrix(batch, targetQubit, 1LL << controlQubit, getRealMatrix(0, 1, 1, 0));
+}
+
+void batchControlledPhaseFlip(QuregBatch batch, const int idQubit1, const int idQubit2) {
+    validateControlTarget(getValidationShape(batch), idQubit1, idQubit2, __func__);
+
+    applyUniformPhase(batch, (1LL << idQubit1) | (1LL << idQubit2), -1, 0);
+}
+
+void batchControlledPhaseShift(QuregBatch batch, const int idQubit1, const int idQubit2, qreal* angles) {
+    validateControlTarget(getValidationShape(batch), idQubit1, idQubit2, __func__);
+
+    applyPhaseShifts(batch, (1LL << idQubit1) | (1LL << idQubit2), angles);
+}
+
+void batchControlledRotateX(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles) {
+    validateControlTarget(getValidationShape(batch), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {1, 0, 0};
+    applyRotations(batch, targetQubit, 1LL << controlQubit, angles, unitAxis);
+}
+
+void batchControlledRotateY(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles) {
+    validateControlTarget(getValidationShape(batch), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {0, 1, 0};
+    applyRotations(batch, targetQubit, 1LL << controlQubit, angles, unitAxis);
+}
+
+void batchControlledRotateZ(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles) {
+    validateControlTarget(getValidationShape(batch), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {0, 0, 1};
+    applyRotations(batch, targetQubit, 1LL << controlQubit, angles, unitAxis);
+}
+
+void batchControlledUnitary(QuregBatch batch, const int controlQubit, const int targetQubit, ComplexMatrix2 u) {
+    validateControlTarget(getValidationShape(batch), controlQubit, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyUniformMatrix(batch, targetQubit, 1LL << controlQubit, u);
+}
+
+void batchMultiControlledUnitary(QuregBatch batch, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u) {
+    validateMultiControlsTarget(getValidationShape(batch), controlQubits, numControlQubits, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyUniformMatrix(batch, targetQubit, getControlMask(controlQubits, numControlQubits), u);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
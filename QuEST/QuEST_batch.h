@@ -0,0 +1,158 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * The batched register API.
+ * A QuregBatch holds many independent pure states of the same small number of qubits, and
+ * applies each gate to every instance in a single pass. Amplitude i of every instance is
+ * stored contiguously, so the innermost loop of every kernel runs across instances with
+ * unit stride and is vectorised by the compiler, rather than running the same short loop
+ * over 2^numQubits amplitudes once per register. This suits parameter sweeps, variational
+ * optimisers and noise-trajectory ensembles of registers too small to fill a core alone.
+ *
+ * Rotations and phases take an array of one angle per instance, and gates may be restricted
+ * to a subset of the instances with setBatchActiveInstances. Batches are never distributed;
+ * in the MPI build every rank holds an identical copy. Gates are not recorded to QASM.
+ */
+
+# ifndef QUEST_BATCH_H
+# define QUEST_BATCH_H
+
+# include "QuEST.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Represents a batch of pure states, each of the same number of qubits.
+ * Qubits are zero-based, and qubit q is the q-th least significant bit of a basis state index.
+ */
+typedef struct QuregBatch
+{
+    //! The number of qubits in each instance
+    int numQubits;
+    //! The number of independent instances in the batch
+    int numInstances;
+    //! The number of amplitudes in each instance, 2^numQubits
+    long long int numAmpsPerInstance;
+    //! numInstances rounded up to a whole number of vectors; the extra lanes are zero and never active
+    int numLanes;
+    //! Amplitude i of instance b is at index i*numLanes + b
+    ComplexArray stateVec;
+    //! Whether each lane is affected by gates (1) or left unchanged (0)
+    int* isActive;
+    //! Workspace for the per-instance coefficients of the current gate
+    qreal* laneCoeffs;
+} QuregBatch;
+
+/** Create a batch of \p numInstances registers of \p numQubits qubits, each initialised to
+ * the zero state, with every instance active.
+ *
+ * @returns an object representing the batch
+ * @param[in] numQubits number of qubits in each instance
+ * @param[in] numInstances number of independent instances
+ * @param[in] env object representing the execution environment
+ * @throws exitWithError if \p numQubits <= 0 or \p numInstances <= 0
+ */
+QuregBatch createQuregBatch(int numQubits, int numInstances, QuESTEnv env);
+
+/** Deallocate a QuregBatch, freeing its amplitudes and workspace.
+ *
+ * @param[in,out] batch the batch to destroy
+ * @param[in] env object representing the execution environment
+ */
+void destroyQuregBatch(QuregBatch batch, QuESTEnv env);
+
+/** Choose which instances subsequent gates act upon.
+ * Instance b is affected only if \p isActive[b] is non-zero; if \p isActive is NULL,
+ * every instance is made active. Initialisation functions ignore this mask.
+ *
+ * @param[in,out] batch the batch
+ * @param[in] isActive array of numInstances flags, or NULL
+ */
+void setBatchActiveInstances(QuregBatch batch, int* isActive);
+
+/** Initialise every instance to the zero state |0...0> */
+void initBatchZeroState(QuregBatch batch);
+
+/** Initialise every instance to the equal superposition of all basis states */
+void initBatchPlusState(QuregBatch batch);
+
+/** Initialise instance b to the classical basis state with index \p stateInds[b]
+ *
+ * @throws exitWithError if any index is outside [0, 2^numQubits)
+ */
+void initBatchClassicalStates(QuregBatch batch, long long int* stateInds);
+
+/** Overwrite instance \p instance with the state of the state-vector \p qureg
+ *
+ * @throws exitWithError if \p qureg is a density matrix, its dimensions differ from the
+ *  batch's, or \p instance is outside [0, numInstances)
+ */
+void setBatchInstance(QuregBatch batch, int instance, Qureg qureg);
+
+/** Overwrite the state-vector \p qureg with the state of instance \p instance
+ *
+ * @throws exitWithError if \p qureg is a density matrix, its dimensions differ from the
+ *  batch's, or \p instance is outside [0, numInstances)
+ */
+void copyBatchInstance(QuregBatch batch, int instance, Qureg qureg);
+
+/** Get the complex amplitude of basis state \p index of instance \p instance */
+Complex getBatchAmp(QuregBatch batch, int instance, long long int index);
+
+/** Write the total probability (squared norm) of instance b to \p probs[b], for every instance */
+void batchCalcTotalProb(QuregBatch batch, qreal* probs);
+
+/** Write the probability of qubit \p measureQubit being in state \p outcome in instance b
+ * to \p probs[b], for every instance
+ */
+void batchCalcProbOfOutcome(QuregBatch batch, const int measureQubit, int outcome, qreal* probs);
+
+/*
+ * gates, mirroring those of QuEST.h and applied to every active instance.
+ * Where an angle is taken, \p angles holds one angle per instance.
+ */
+
+void batchHadamard(QuregBatch batch, const int targetQubit);
+
+void batchPauliX(QuregBatch batch, const int targetQubit);
+
+void batchPauliY(QuregBatch batch, const int targetQubit);
+
+void batchPauliZ(QuregBatch batch, const int targetQubit);
+
+void batchSGate(QuregBatch batch, const int targetQubit);
+
+void batchTGate(QuregBatch batch, const int targetQubit);
+
+void batchPhaseShift(QuregBatch batch, const int targetQubit, qreal* angles);
+
+void batchRotateX(QuregBatch batch, const int rotQubit, qreal* angles);
+
+void batchRotateY(QuregBatch batch, const int rotQubit, qreal* angles);
+
+void batchRotateZ(QuregBatch batch, const int rotQubit, qreal* angles);
+
+void batchUnitary(QuregBatch batch, const int targetQubit, ComplexMatrix2 u);
+
+void batchControlledNot(QuregBatch batch, const int controlQubit, const int targetQubit);
+
+void batchControlledPhaseFlip(QuregBatch batch, const int idQubit1, const int idQubit2);
+
+void batchControlledPhaseShift(QuregBatch batch, const int idQubit1, const int idQubit2, qreal* angles);
+
+void batchControlledRotateX(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles);
+
+void batchControlledRotateY(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles);
+
+void batchControlledRotateZ(QuregBatch batch, const int controlQubit, const int targetQubit, qreal* angles);
+
+void batchControlledUnitary(QuregBatch batch, const int controlQubit, const int targetQubit, ComplexMatrix2 u);
+
+void batchMultiControlledUnitary(QuregBatch batch, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u);
+
+#ifdef __cplusplus
+}
+#endif
+
+# endif // QUEST_BATCH_H
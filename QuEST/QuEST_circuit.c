@@ -0,0 +1,984 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * Recorded circuits and their adjoint differentiation, implementing QuEST_circuit.h.
+ *
+ * Gates are stored as the struct of arrays in QuEST_circuit_internal.h. Each gate is validated
+ * (and any matrix or axis copied) when recorded, so running a circuit only checks that the
+ * register has the right size before calling the backend directly, and one recording serves
+ * any number of runs. Runs go through a compiled plan (see QuEST_circuit_cache.c), in which
+ * consecutive diagonal gates are multiplied into one table over the qubits they act upon, and
+ * applied in a single pass over the amplitudes.
+ *
+ * For the gradient of <psi|U^dagger H U|psi> with U = U_P ... U_1, each rotation
+ * U_i = exp(-i theta sigma / 2) contributes Im <lambda_i| sigma |phi_i>, where
+ * |phi_i> = U_i ... U_1 |psi> and <lambda_i| = <psi|U^dagger H U_P ... U_{i+1}. Both are
+ * obtained from the outputs |phi_P> and H|phi_P> by un-applying one gate at a time, so the
+ * sweep needs only the register itself and one workspace.
+ */
+
+# include "QuEST.h"
+# include "QuEST_circuit.h"
+# include "QuEST_circuit_internal.h"
+# include "QuEST_internal.h"
+# include "QuEST_precision.h"
+# include "QuEST_validation.h"
+# include "QuEST_qasm.h"
+
+# include <math.h>
+# include <stdio.h>
+# include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+# define CIRCUIT_INIT_CAPACITY 64
+
+# ifndef M_PI
+# define M_PI 3.14159265358979323846
+# endif
+
+
+/*
+ * recording
+ */
+
+static void* reallocOrExit(void* mem, size_t numBytes) {
+    mem = realloc(mem, numBytes);
+    if (mem == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+/** grows a pool of capacity *capacity so that it can hold numNeeded elements */
+static void* reservePool(void* pool, int* capacity, int numNeeded, size_t elemSize) {
+    if (numNeeded <= *capacity)
+        return pool;
+    while (*capacity < numNeeded)
+        *capacity *= 2;
+    return reallocOrExit(pool, *capacity * elemSize);
+}
+
+static Qureg getValidationShape(Circuit circuit) {
+    Qureg shape = {
+        .isDensityMatrix = 0,
+        .numQubitsRepresented = circuit.numQubits,
+        .numQubitsInStateVec = circuit.numQubits,
+        .numAmpsTotal = 1LL << circuit.numQubits};
+    return shape;
+}
+
+int circuit_addGate(struct CircuitData* data, TargetGate gate, int* controlQubits, int numControlQubits, int targetQubit,
+    qreal angle, int paramIndex, int operandIndex
+) {
+    if (data->numGates == data->gateCapacity) {
+        int cap = 2*data->gateCapacity;
+        data->gates = reallocOrExit(data->gates, cap * sizeof *data->gates);
+        data->targets = reallocOrExit(data->targets, cap * sizeof *data->targets);
+        data->numControls = reallocOrExit(data->numControls, cap * sizeof *data->numControls);
+        data->qubitOffsets = reallocOrExit(data->qubitOffsets, cap * sizeof *data->qubitOffsets);
+        data->flipMasks = reallocOrExit(data->flipMasks, cap * sizeof *data->flipMasks);
+        data->angles = reallocOrExit(data->angles, cap * sizeof *data->angles);
+        data->paramInds = reallocOrExit(data->paramInds, cap * sizeof *data->paramInds);
+        data->operandInds = reallocOrExit(data->operandInds, cap * sizeof *data->operandInds);
+        data->gateCapacity = cap;
+    }
+
+    int offset = data->numQubitEntries;
+    data->qubits = reservePool(data->qubits, &data->qubitCapacity, offset + numControlQubits + 1, sizeof *data->qubits);
+    for (int c=0; c < numControlQubits; c++)
+        data->qubits[offset + c] = controlQubits[c];
+    data->qubits[offset + numControlQubits] = targetQubit;
+    data->numQubitEntries += numControlQubits + 1;
+
+    int g = data->numGates++;
+    data->gates[g] = gate;
+    data->targets[g] = targetQubit;
+    data->numControls[g] = numControlQubits;
+    data->qubitOffsets[g] = offset;
+    data->flipMasks[g] = 0;
+    data->angles[g] = angle;
+    data->paramInds[g] = paramIndex;
+    data->operandInds[g] = operandIndex;
+    data->isHashValid = 0;
+    return g;
+}
+
+int circuit_addMatrix(struct CircuitData* data, ComplexMatrix2 u) {
+    data->matrices = reservePool(data->matrices, &data->matrixCapacity, data->numMatrices + 1, sizeof *data->matrices);
+    data->matrices[data->numMatrices] = u;
+    return data->numMatrices++;
+}
+
+int circuit_addAxis(struct CircuitData* data, Vector axis) {
+    data->axes = reservePool(data->axes, &data->axisCapacity, data->numAxes + 1, sizeof *data->axes);
+    data->axes[data->numAxes] = axis;
+    return data->numAxes++;
+}
+
+static ComplexMatrix2 getCompactUnitaryMatrix(Complex alpha, Complex beta) {
+    ComplexMatrix2 u;
+    u.r0c0 = alpha;
+    u.r0c1.real = -beta.real; u.r0c1.imag = beta.imag;
+    u.r1c0 = beta;
+    u.r1c1.real = alpha.real; u.r1c1.imag = -alpha.imag;
+    return u;
+}
+
+ComplexMatrix2 circuit_getConjugateTranspose(ComplexMatrix2 u) {
+    ComplexMatrix2 d;
+    d.r0c0.real = u.r0c0.real; d.r0c0.imag = -u.r0c0.imag;
+    d.r0c1.real = u.r1c0.real; d.r0c1.imag = -u.r1c0.imag;
+    d.r1c0.real = u.r0c1.real; d.r1c0.imag = -u.r0c1.imag;
+    d.r1c1.real = u.r1c1.real; d.r1c1.imag = -u.r1c1.imag;
+    return d;
+}
+
+
+int circuit_copyGate(struct CircuitData* dest, struct CircuitData* src, int g) {
+    int operand = src->operandInds[g];
+    if (src->gates[g] == GATE_UNITARY)
+        operand = circuit_addMatrix(dest, src->matrices[operand]);
+    else if (src->gates[g] == GATE_ROTATE_AROUND_AXIS)
+        operand = circuit_addAxis(dest, src->axes[operand]);
+
+    int h = circuit_addGate(dest, src->gates[g], &src->qubits[src->qubitOffsets[g]], src->numControls[g],
+        src->targets[g], src->angles[g], src->paramInds[g], operand);
+    dest->flipMasks[h] = src->flipMasks[g];
+    return h;
+}
+
+struct CircuitData* circuit_createData(void) {
+    struct CircuitData* data = reallocOrExit(NULL, sizeof *data);
+    data->numGates = 0;
+    data->gateCapacity = CIRCUIT_INIT_CAPACITY;
+    data->gates = reallocOrExit(NULL, data->gateCapacity * sizeof *data->gates);
+    data->targets = reallocOrExit(NULL, data->gateCapacity * sizeof *data->targets);
+    data->numControls = reallocOrExit(NULL, data->gateCapacity * sizeof *data->numControls);
+    data->qubitOffsets = reallocOrExit(NULL, data->gateCapacity * sizeof *data->qubitOffsets);
+    data->flipMasks = reallocOrExit(NULL, data->gateCapacity * sizeof *data->flipMasks);
+    data->angles = reallocOrExit(NULL, data->gateCapacity * sizeof *data->angles);
+    data->paramInds = reallocOrExit(NULL, data->gateCapacity * sizeof *data->paramInds);
+    data->operandInds = reallocOrExit(NULL, data->gateCapacity * sizeof *data->operandInds);
+
+    data->numQubitEntries = 0;
+    data->qubitCapacity = 2*CIRCUIT_INIT_CAPACITY;
+    data->qubits = reallocOrExit(NULL, data->qubitCapacity * sizeof *data->qubits);
+
+    data->numMatrices = 0;
+    data->matrixCapacity = 1;
+    data->matrices = reallocOrExit(NULL, data->matrixCapacity * sizeof *data->matrices);
+
+    data->numAxes = 0;
+    data->axisCapacity = 1;
+    data->axes = reallocOrExit(NULL, data->axisCapacity * sizeof *data->axes);
+
+    data->isHashValid = 0;
+    data->hash = 0;
+
+    data->numParams = 0;
+    data->paramCapacity = CIRCUIT_INIT_CAPACITY;
+    data->params = reallocOrExit(NULL, data->paramCapacity * sizeof *data->params);
+    return data;
+}
+
+static void freeGates(struct CircuitData* data) {
+    free(data->gates);
+    free(data->targets);
+    free(data->numControls);
+    free(data->qubitOffsets);
+    free(data->flipMasks);
+    free(data->angles);
+    free(data->paramInds);
+    free(data->operandInds);
+    free(data->qubits);
+    free(data->matrices);
+    free(data->axes);
+}
+
+void circuit_destroyData(struct CircuitData* data) {
+    freeGates(data);
+    free(data->params);
+    free(data);
+}
+
+void circuit_replaceGates(struct CircuitData* data, struct CircuitData* newGates) {
+    freeGates(data);
+    free(newGates->params);
+    newGates->numParams = data->numParams;
+    newGates->paramCapacity = data->paramCapacity;
+    newGates->params = data->params;
+    *data = *newGates;
+    free(newGates);
+}
+
+
+/*
+ * applying gates
+ */
+
+qreal circuit_getAngle(struct CircuitData* data, int g) {
+    return (data->paramInds[g] >= 0)? data->params[data->paramInds[g]] : data->angles[g];
+}
+
+long long int circuit_getGateMask(struct CircuitData* data, int g) {
+    long long int mask = 0;
+    int* qubits = &data->qubits[data->qubitOffsets[g]];
+    for (int k=0; k <= data->numControls[g]; k++)
+        mask |= 1LL << qubits[k];
+    return mask;
+}
+
+int circuit_isPhaseGate(TargetGate gate) {
+    return gate == GATE_SIGMA_Z || gate == GATE_S || gate == GATE_T || gate == GATE_PHASE_SHIFT;
+}
+
+int circuit_isDiagonalGate(struct CircuitData* data, int g) {
+    TargetGate gate = data->gates[g];
+    if (circuit_isPhaseGate(gate) || gate == GATE_ROTATE_Z)
+        return 1;
+    if (gate == GATE_UNITARY) {
+        ComplexMatrix2 u = data->matrices[data->operandInds[g]];
+        return u.r0c1.real == 0 && u.r0c1.imag == 0 && u.r1c0.real == 0 && u.r1c0.imag == 0;
+    }
+    return 0;
+}
+
+Complex circuit_getDiagonalFactor(struct CircuitData* data, int g, long long int basisState, int isInverse) {
+    int numQubits = data->numControls[g] + 1;
+    int* qubits = &data->qubits[data->qubitOffsets[g]];
+    long long int flips = data->flipMasks[g];
+    TargetGate gate = data->gates[g];
+    Complex fac = {.real=1, .imag=0};
+
+    // a phase gate conditions on its target as on its controls
+    int numConditions = circuit_isPhaseGate(gate)? numQubits : numQubits - 1;
+    for (int k=0; k < numConditions; k++)
+        if (((basisState >> qubits[k]) & 1) == ((flips >> k) & 1))
+            return fac;
+
+    int targetBit = (basisState >> qubits[numQubits-1]) & 1;
+    qreal sign = (isInverse)? -1 : 1;
+    if (gate == GATE_SIGMA_Z) {
+        fac.real = -1;
+    } else if (gate == GATE_S) {
+        fac.real = 0;
+        fac.imag = sign;
+    } else if (gate == GATE_T) {
+        fac.real = 1/sqrt(2);
+        fac.imag = sign/sqrt(2);
+    } else if (gate == GATE_PHASE_SHIFT) {
+        qreal angle = circuit_getAngle(data, g);
+        fac.real = cos(angle);
+        fac.imag = sign*sin(angle);
+    } else if (gate == GATE_ROTATE_Z) {
+        qreal angle = (targetBit? 1 : -1) * circuit_getAngle(data, g)/2;
+        fac.real = cos(angle);
+        fac.imag = sign*sin(angle);
+    } else if (gate == GATE_UNITARY) {
+        ComplexMatrix2 u = data->matrices[data->operandInds[g]];
+        fac = (targetBit)? u.r1c1 : u.r0c0;
+        fac.imag *= sign;
+    }
+    return fac;
+}
+
+int circuit_getDiagonalRunEnd(struct CircuitData* data, int start, int maxRunQubits) {
+    if (!circuit_isDiagonalGate(data, start))
+        return start+1;
+
+    long long int mask = circuit_getGateMask(data, start);
+    int end = start+1;
+    while (end < data->numGates && circuit_isDiagonalGate(data, end)) {
+        long long int runMask = mask | circuit_getGateMask(data, end);
+        if (__builtin_popcountll(runMask) > maxRunQubits)
+            break;
+        mask = runMask;
+        end++;
+    }
+    return end;
+}
+
+int circuit_countSweeps(struct CircuitData* data) {
+    int numSweeps = 0;
+    for (int g=0; g < data->numGates; g = circuit_getDiagonalRunEnd(data, g, CIRCUIT_MAX_DIAGONAL_QUBITS))
+        numSweeps++;
+    return numSweeps;
+}
+
+void circuit_getDiagonalTable(struct CircuitData* data, int start, int end, int isInverse, Qureg qureg,
+    long long int* qubitMask, qreal** factorsRe, qreal** factorsIm
+) {
+    long long int mask = 0;
+    for (int g=start; g < end; g++)
+        mask |= circuit_getGateMask(data, g);
+
+    int numRunQubits = 0;
+    int runQubits[64];
+    for (int q=0; q < 64; q++)
+        if ((mask >> q) & 1)
+            runQubits[numRunQubits++] = q;
+
+    long long int numFactors = 1LL << numRunQubits;
+    Complex* diag = reallocOrExit(NULL, numFactors * sizeof *diag);
+    for (long long int i=0; i < numFactors; i++) {
+        long long int basisState = 0;
+        for (int k=0; k < numRunQubits; k++)
+            basisState |= ((i >> k) & 1) << runQubits[k];
+
+        Complex prod = {.real=1, .imag=0};
+        for (int g=start; g < end; g++) {
+            Complex fac = circuit_getDiagonalFactor(data, g, basisState, isInverse);
+            qreal re = prod.real*fac.real - prod.imag*fac.imag;
+            prod.imag = prod.real*fac.imag + prod.imag*fac.real;
+            prod.real = re;
+        }
+        diag[i] = prod;
+    }
+
+    long long int numEntries = (qureg.isDensityMatrix)? numFactors*numFactors : numFactors;
+    qreal* re = reallocOrExit(NULL, numEntries * sizeof *re);
+    qreal* im = reallocOrExit(NULL, numEntries * sizeof *im);
+    if (qureg.isDensityMatrix) {
+        for (long long int c=0; c < numFactors; c++) {
+            for (long long int r=0; r < numFactors; r++) {
+                long long int i = r + c*numFactors;
+                re[i] = diag[r].real*diag[c].real + diag[r].imag*diag[c].imag;
+                im[i] = diag[r].imag*diag[c].real - diag[r].real*diag[c].imag;
+            }
+        }
+        mask |= mask << qureg.numQubitsRepresented;
+    } else {
+        for (long long int i=0; i < numFactors; i++) {
+            re[i] = diag[i].real;
+            im[i] = diag[i].imag;
+        }
+    }
+    free(diag);
+
+    *qubitMask = mask;
+    *factorsRe = re;
+    *factorsIm = im;
+}
+
+void circuit_applyDiagonalRun(Qureg qureg, struct CircuitData* data, int start, int end, int isInverse) {
+    long long int mask;
+    qreal *factorsRe, *factorsIm;
+    circuit_getDiagonalTable(data, start, end, isInverse, qureg, &mask, &factorsRe, &factorsIm);
+    statevec_applyDiagonalTable(qureg, mask, factorsRe, factorsIm);
+    free(factorsRe);
+    free(factorsIm);
+}
+
+/** applies gate g as though it conditioned on every control being 1, ignoring its flip mask */
+static void applyUnflippedGate(Qureg qureg, struct CircuitData* data, int g, int isInverse) {
+    int target = data->targets[g];
+    int numControls = data->numControls[g];
+    int* qubits = &data->qubits[data->qubitOffsets[g]];
+    int control = qubits[0];
+    int isDensity = qureg.isDensityMatrix;
+
+    qreal angle = circuit_getAngle(data, g);
+    if (isInverse)
+        angle = -angle;
+
+    switch (data->gates[g]) {
+        case GATE_HADAMARD:
+            if (isDensity) densmatr_hadamard(qureg, target);
+            else statevec_hadamard(qureg, target);
+            break;
+        case GATE_SIGMA_X:
+            if (numControls == 0) {
+                if (isDensity) densmatr_pauliX(qureg, target);
+                else statevec_pauliX(qureg, target);
+            } else {
+                if (isDensity) densmatr_controlledNot(qureg, control, target);
+                else statevec_controlledNot(qureg, control, target);
+            }
+            break;
+        case GATE_SIGMA_Y:
+            if (numControls == 0) {
+                if (isDensity) densmatr_pauliY(qureg, target);
+                else statevec_pauliY(qureg, target);
+            } else {
+                if (isDensity) densmatr_controlledPauliY(qureg, control, target);
+                else statevec_controlledPauliY(qureg, control, target);
+            }
+            break;
+        case GATE_SIGMA_Z:
+            if (numControls == 0) {
+                if (isDensity) densmatr_pauliZ(qureg, target);
+                else statevec_pauliZ(qureg, target);
+            } else if (numControls == 1) {
+                if (isDensity) densmatr_controlledPhaseFlip(qureg, control, target);
+                else statevec_controlledPhaseFlip(qureg, control, target);
+            } else {
+                if (isDensity) densmatr_multiControlledPhaseFlip(qureg, qubits, numControls+1);
+                else statevec_multiControlledPhaseFlip(qureg, qubits, numControls+1);
+            }
+            break;
+        case GATE_S:
+            if (isDensity) {
+                if (isInverse) densmatr_phaseShift(qureg, target, -M_PI/2);
+                else densmatr_sGate(qureg, target);
+            } else {
+                if (isInverse) statevec_sGateConj(qureg, target);
+                else statevec_sGate(qureg, target);
+            }
+            break;
+        case GATE_T:
+            if (isDensity) {
+                if (isInverse) densmatr_phaseShift(qureg, target, -M_PI/4);
+                else densmatr_tGate(qureg, target);
+            } else {
+                if (isInverse) statevec_tGateConj(qureg, target);
+                else statevec_tGate(qureg, target);
+            }
+            break;
+        case GATE_PHASE_SHIFT:
+            if (numControls == 0) {
+                if (isDensity) densmatr_phaseShift(qureg, target, angle);
+                else statevec_phaseShift(qureg, target, angle);
+            } else if (numControls == 1) {
+                if (isDensity) densmatr_controlledPhaseShift(qureg, control, target, angle);
+                else statevec_controlledPhaseShift(qureg, control, target, angle);
+            } else {
+                if (isDensity) densmatr_multiControlledPhaseShift(qureg, qubits, numControls+1, angle);
+                else statevec_multiControlledPhaseShift(qureg, qubits, numControls+1, angle);
+            }
+            break;
+        case GATE_ROTATE_X:
+            if (numControls == 0) {
+                if (isDensity) densmatr_rotateX(qureg, target, angle);
+                else statevec_rotateX(qureg, target, angle);
+            } else {
+                if (isDensity) densmatr_controlledRotateX(qureg, control, target, angle);
+                else statevec_controlledRotateX(qureg, control, target, angle);
+            }
+            break;
+        case GATE_ROTATE_Y:
+            if (numControls == 0) {
+                if (isDensity) densmatr_rotateY(qureg, target, angle);
+                else statevec_rotateY(qureg, target, angle);
+            } else {
+                if (isDensity) densmatr_controlledRotateY(qureg, control, target, angle);
+                else statevec_controlledRotateY(qureg, control, target, angle);
+            }
+            break;
+        case GATE_ROTATE_Z:
+            if (numControls == 0) {
+                if (isDensity) densmatr_rotateZ(qureg, target, angle);
+                else statevec_rotateZ(qureg, target, angle);
+            } else {
+                if (isDensity) densmatr_controlledRotateZ(qureg, control, target, angle);
+                else statevec_controlledRotateZ(qureg, control, target, angle);
+            }
+            break;
+        case GATE_ROTATE_AROUND_AXIS: {
+            Vector axis = data->axes[data->operandInds[g]];
+            if (numControls == 0) {
+                if (isDensity) densmatr_rotateAroundAxis(qureg, target, angle, axis);
+                else statevec_rotateAroundAxis(qureg, target, angle, axis);
+            } else {
+                if (isDensity) densmatr_controlledRotateAroundAxis(qureg, control, target, angle, axis);
+                else statevec_controlledRotateAroundAxis(qureg, control, target, angle, axis);
+            }
+            break;
+        }
+        case GATE_UNITARY: {
+            ComplexMatrix2 u = data->matrices[data->operandInds[g]];
+            if (isInverse)
+                u = circuit_getConjugateTranspose(u);
+            if (numControls == 0) {
+                if (isDensity) densmatr_unitary(qureg, target, u);
+                else statevec_unitary(qureg, target, u);
+            } else if (numControls == 1) {
+                if (isDensity) densmatr_controlledUnitary(qureg, control, target, u);
+                else statevec_controlledUnitary(qureg, control, target, u);
+            } else {
+                if (isDensity) densmatr_multiControlledUnitary(qureg, qubits, numControls, target, u);
+                else statevec_multiControlledUnitary(qureg, qubits, numControls, target, u);
+            }
+            break;
+        }
+    }
+}
+
+/** applies a diagonal gate which conditions on some qubits being 0: in one pass if it is small
+ * enough to tabulate, else between X gates on those qubits */
+static void applyFlippedGate(Qureg qureg, struct CircuitData* data, int g, int isInverse) {
+    int maxRunQubits = (qureg.isDensityMatrix)? CIRCUIT_MAX_DENSITY_DIAGONAL_QUBITS : CIRCUIT_MAX_DIAGONAL_QUBITS;
+    if (data->numControls[g] + 1 <= maxRunQubits) {
+        circuit_applyDiagonalRun(qureg, data, g, g+1, isInverse);
+        return;
+    }
+
+    // data is left untouched, since a cached plan's gates may be run by several threads at once
+    int* qubits = &data->qubits[data->qubitOffsets[g]];
+    long long int flips = data->flipMasks[g];
+    for (int pass=0; pass < 2; pass++) {
+        for (int k=0; k <= data->numControls[g]; k++) {
+            if ((flips >> k) & 1) {
+                if (qureg.isDensityMatrix) densmatr_pauliX(qureg, qubits[k]);
+                else statevec_pauliX(qureg, qubits[k]);
+            }
+        }
+        if (pass == 0)
+            applyUnflippedGate(qureg, data, g, isInverse);
+    }
+}
+
+void circuit_applyGate(Qureg qureg, struct CircuitData* data, int g, int isInverse) {
+    if (data->flipMasks[g])
+        applyFlippedGate(qureg, data, g, isInverse);
+    else
+        applyUnflippedGate(qureg, data, g, isInverse);
+}
+
+void circuit_recordGateToQASM(Qureg qureg, struct CircuitData* data, int g) {
+    if (!qureg.qasmLog->isLogging)
+        return;
+
+    TargetGate gate = data->gates[g];
+    int target = data->targets[g];
+    int numControls = data->numControls[g];
+    int* controls = &data->qubits[data->qubitOffsets[g]];
+    qreal angle = circuit_getAngle(data, g);
+
+    // a qubit conditioned upon being 0 is logged between X gates
+    long long int flips = data->flipMasks[g];
+    for (int k=0; k <= numControls; k++)
+        if ((flips >> k) & 1)
+            qasm_recordGate(qureg, GATE_SIGMA_X, controls[k]);
+
+    if (gate == GATE_UNITARY) {
+        ComplexMatrix2 u = data->matrices[data->operandInds[g]];
+        if (numControls == 0) qasm_recordUnitary(qureg, u, target);
+        else if (numControls == 1) qasm_recordControlledUnitary(qureg, u, controls[0], target);
+        else qasm_recordMultiControlledUnitary(qureg, u, controls, numControls, target);
+    }
+    else if (gate == GATE_ROTATE_AROUND_AXIS) {
+        Vector axis = data->axes[data->operandInds[g]];
+        if (numControls == 0) qasm_recordAxisRotation(qureg, angle, axis, target);
+        else qasm_recordControlledAxisRotation(qureg, angle, axis, controls[0], target);
+    }
+    else if (gate == GATE_PHASE_SHIFT || gate == GATE_ROTATE_X || gate == GATE_ROTATE_Y || gate == GATE_ROTATE_Z) {
+        if (numControls == 0) qasm_recordParamGate(qureg, gate, target, angle);
+        else if (numControls == 1) qasm_recordControlledParamGate(qureg, gate, controls[0], target, angle);
+        else qasm_recordMultiControlledParamGate(qureg, gate, controls, numControls, target, angle);
+    }
+    else {
+        if (numControls == 0) qasm_recordGate(qureg, gate, target);
+        else if (numControls == 1) qasm_recordControlledGate(qureg, gate, controls[0], target);
+        else qasm_recordMultiControlledGate(qureg, gate, controls, numControls, target);
+    }
+
+    for (int k=0; k <= numControls; k++)
+        if ((flips >> k) & 1)
+            qasm_recordGate(qureg, GATE_SIGMA_X, controls[k]);
+}
+
+/** applies a Pauli operator, exactly, so that applying it twice restores the state bit-for-bit */
+static void applyPauli(Qureg qureg, int target, enum pauliOpType code) {
+    if (code == PAULI_X)
+        statevec_pauliX(qureg, target);
+    else if (code == PAULI_Y)
+        statevec_pauliY(qureg, target);
+    else if (code == PAULI_Z)
+        statevec_pauliZ(qureg, target);
+}
+
+static void applyControlledPauli(Qureg qureg, int control, int target, enum pauliOpType code) {
+    if (code == PAULI_X)
+        statevec_controlledNot(qureg, control, target);
+    else if (code == PAULI_Y)
+        statevec_controlledPauliY(qureg, control, target);
+    else if (code == PAULI_Z)
+        statevec_controlledPhaseFlip(qureg, control, target);
+}
+
+static enum pauliOpType getRotationAxis(TargetGate gate) {
+    if (gate == GATE_ROTATE_X)
+        return PAULI_X;
+    if (gate == GATE_ROTATE_Y)
+        return PAULI_Y;
+    return PAULI_Z;
+}
+
+/** Sets workspace to H|qureg>, leaving qureg unchanged. Each term's Paulis are applied to qureg
+ * in place, changing only the qubits whose code differs from the previous term's, and its
+ * weighted copy is added to workspace.
+ */
+static void setPauliSumOnState(Qureg qureg, Qureg workspace,
+    enum pauliOpType* allPauliCodes, qreal* termCoeffs, int numSumTerms
+) {
+    int numQubits = qureg.numQubitsRepresented;
+    enum pauliOpType* appliedCodes = reallocOrExit(NULL, numQubits * sizeof *appliedCodes);
+    for (int q=0; q < numQubits; q++)
+        appliedCodes[q] = PAULI_I;
+
+    Complex zero = {.real=0, .imag=0};
+    Complex one = {.real=1, .imag=0};
+
+    for (int t=0; t < numSumTerms; t++) {
+        for (int q=0; q < numQubits; q++) {
+            enum pauliOpType code = allPauliCodes[t*numQubits + q];
+            if (code != appliedCodes[q]) {
+                applyPauli(qureg, q, appliedCodes[q]);
+                applyPauli(qureg, q, code);
+                appliedCodes[q] = code;
+            }
+        }
+        Complex coeff = {.real=termCoeffs[t], .imag=0};
+        statevec_setWeightedQureg(coeff, qureg, zero, qureg, (t==0)? zero : one, workspace);
+    }
+
+    for (int q=0; q < numQubits; q++)
+        applyPauli(qureg, q, appliedCodes[q]);
+    free(appliedCodes);
+}
+
+
+/*
+ * circuit management
+ */
+
+Circuit createCircuit(int numQubits) {
+    validateCreateNumQubits(numQubits, __func__);
+
+    Circuit circuit;
+    circuit.numQubits = numQubits;
+    circuit.data = circuit_createData();
+    return circuit;
+}
+
+void destroyCircuit(Circuit circuit) {
+    circuit_destroyData(circuit.data);
+}
+
+int getNumCircuitGates(Circuit circuit) {
+    return circuit.data->numGates;
+}
+
+int getNumCircuitParams(Circuit circuit) {
+    return circuit.data->numParams;
+}
+
+int createCircuitParam(Circuit circuit, qreal value) {
+    struct CircuitData* data = circuit.data;
+    data->params = reservePool(data->params, &data->paramCapacity, data->numParams + 1, sizeof *data->params);
+    data->params[data->numParams] = value;
+    return data->numParams++;
+}
+
+void setCircuitParam(Circuit circuit, int paramIndex, qreal value) {
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit.data->params[paramIndex] = value;
+}
+
+qreal getCircuitParam(Circuit circuit, int paramIndex) {
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    return circuit.data->params[paramIndex];
+}
+
+
+/*
+ * gates
+ */
+
+void circuitHadamard(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_HADAMARD, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitPauliX(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_X, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitPauliY(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_Y, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitPauliZ(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_Z, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitSGate(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_S, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitTGate(Circuit circuit, const int targetQubit) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_T, NULL, 0, targetQubit, 0, -1, -1);
+}
+
+void circuitPhaseShift(Circuit circuit, const int targetQubit, qreal angle) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_PHASE_SHIFT, NULL, 0, targetQubit, angle, -1, -1);
+}
+
+void circuitRotateX(Circuit circuit, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_X, NULL, 0, rotQubit, angle, -1, -1);
+}
+
+void circuitRotateY(Circuit circuit, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Y, NULL, 0, rotQubit, angle, -1, -1);
+}
+
+void circuitRotateZ(Circuit circuit, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Z, NULL, 0, rotQubit, angle, -1, -1);
+}
+
+void circuitControlledNot(Circuit circuit, const int controlQubit, const int targetQubit) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_X, (int[]) {controlQubit}, 1, targetQubit, 0, -1, -1);
+}
+
+void circuitControlledPauliY(Circuit circuit, const int controlQubit, const int targetQubit) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_Y, (int[]) {controlQubit}, 1, targetQubit, 0, -1, -1);
+}
+
+void circuitControlledPhaseShift(Circuit circuit, const int idQubit1, const int idQubit2, qreal angle) {
+    validateControlTarget(getValidationShape(circuit), idQubit1, idQubit2, __func__);
+
+    circuit_addGate(circuit.data, GATE_PHASE_SHIFT, (int[]) {idQubit1}, 1, idQubit2, angle, -1, -1);
+}
+
+void circuitControlledPhaseFlip(Circuit circuit, const int idQubit1, const int idQubit2) {
+    validateControlTarget(getValidationShape(circuit), idQubit1, idQubit2, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_Z, (int[]) {idQubit1}, 1, idQubit2, 0, -1, -1);
+}
+
+void circuitControlledRotateX(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_X, (int[]) {controlQubit}, 1, targetQubit, angle, -1, -1);
+}
+
+void circuitControlledRotateY(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Y, (int[]) {controlQubit}, 1, targetQubit, angle, -1, -1);
+}
+
+void circuitControlledRotateZ(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Z, (int[]) {controlQubit}, 1, targetQubit, angle, -1, -1);
+}
+
+void circuitRotateAroundAxis(Circuit circuit, const int rotQubit, qreal angle, Vector axis) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+    validateVector(axis, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_AROUND_AXIS, NULL, 0, rotQubit, angle, -1, circuit_addAxis(circuit.data, axis));
+}
+
+void circuitControlledRotateAroundAxis(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle, Vector axis) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateVector(axis, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_AROUND_AXIS, (int[]) {controlQubit}, 1, targetQubit, angle, -1, circuit_addAxis(circuit.data, axis));
+}
+
+void circuitCompactUnitary(Circuit circuit, const int targetQubit, Complex alpha, Complex beta) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+    validateUnitaryComplexPair(alpha, beta, __func__);
+
+    int m = circuit_addMatrix(circuit.data, getCompactUnitaryMatrix(alpha, beta));
+    circuit_addGate(circuit.data, GATE_UNITARY, NULL, 0, targetQubit, 0, -1, m);
+}
+
+void circuitControlledCompactUnitary(Circuit circuit, const int controlQubit, const int targetQubit, Complex alpha, Complex beta) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateUnitaryComplexPair(alpha, beta, __func__);
+
+    int m = circuit_addMatrix(circuit.data, getCompactUnitaryMatrix(alpha, beta));
+    circuit_addGate(circuit.data, GATE_UNITARY, (int[]) {controlQubit}, 1, targetQubit, 0, -1, m);
+}
+
+void circuitUnitary(Circuit circuit, const int targetQubit, ComplexMatrix2 u) {
+    validateTarget(getValidationShape(circuit), targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    circuit_addGate(circuit.data, GATE_UNITARY, NULL, 0, targetQubit, 0, -1, circuit_addMatrix(circuit.data, u));
+}
+
+void circuitControlledUnitary(Circuit circuit, const int controlQubit, const int targetQubit, ComplexMatrix2 u) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    circuit_addGate(circuit.data, GATE_UNITARY, (int[]) {controlQubit}, 1, targetQubit, 0, -1, circuit_addMatrix(circuit.data, u));
+}
+
+void circuitMultiControlledUnitary(Circuit circuit, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u) {
+    validateMultiControlsTarget(getValidationShape(circuit), controlQubits, numControlQubits, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    circuit_addGate(circuit.data, GATE_UNITARY, controlQubits, numControlQubits, targetQubit, 0, -1, circuit_addMatrix(circuit.data, u));
+}
+
+void circuitMultiControlledPhaseShift(Circuit circuit, int *controlQubits, int numControlQubits, qreal angle) {
+    validateMultiControls(getValidationShape(circuit), controlQubits, numControlQubits, __func__);
+
+    circuit_addGate(circuit.data, GATE_PHASE_SHIFT, controlQubits, numControlQubits-1, controlQubits[numControlQubits-1], angle, -1, -1);
+}
+
+void circuitMultiControlledPhaseFlip(Circuit circuit, int *controlQubits, int numControlQubits) {
+    validateMultiControls(getValidationShape(circuit), controlQubits, numControlQubits, __func__);
+
+    circuit_addGate(circuit.data, GATE_SIGMA_Z, controlQubits, numControlQubits-1, controlQubits[numControlQubits-1], 0, -1, -1);
+}
+
+void circuitParamRotateX(Circuit circuit, const int rotQubit, int paramIndex) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_X, NULL, 0, rotQubit, 0, paramIndex, -1);
+}
+
+void circuitParamRotateY(Circuit circuit, const int rotQubit, int paramIndex) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Y, NULL, 0, rotQubit, 0, paramIndex, -1);
+}
+
+void circuitParamRotateZ(Circuit circuit, const int rotQubit, int paramIndex) {
+    validateTarget(getValidationShape(circuit), rotQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Z, NULL, 0, rotQubit, 0, paramIndex, -1);
+}
+
+void circuitParamControlledRotateX(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_X, (int[]) {controlQubit}, 1, targetQubit, 0, paramIndex, -1);
+}
+
+void circuitParamControlledRotateY(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Y, (int[]) {controlQubit}, 1, targetQubit, 0, paramIndex, -1);
+}
+
+void circuitParamControlledRotateZ(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex) {
+    validateControlTarget(getValidationShape(circuit), controlQubit, targetQubit, __func__);
+    validateCircuitParam(paramIndex, circuit.data->numParams, __func__);
+
+    circuit_addGate(circuit.data, GATE_ROTATE_Z, (int[]) {controlQubit}, 1, targetQubit, 0, paramIndex, -1);
+}
+
+
+/*
+ * execution
+ */
+
+void runCircuit(Circuit circuit, Qureg qureg) {
+    validateMatchingQuregDims(getValidationShape(circuit), qureg, __func__);
+
+    struct CircuitData* data = circuit.data;
+    struct CircuitPlan* plan = circuit_getPlan(data, qureg);
+    circuit_runPlan(plan, data, qureg);
+    circuit_releasePlan(plan);
+
+    for (int g=0; g < data->numGates; g++)
+        circuit_recordGateToQASM(qureg, data, g);
+}
+
+
+/*
+ * differentiation
+ */
+
+qreal calcExpecPauliSumGradient(Circuit circuit, Qureg qureg, Qureg workspace,
+    enum pauliOpType* allPauliCodes, qreal* termCoeffs, int numSumTerms, qreal* gradients
+) {
+    validateStateVecQureg(qureg, __func__);
+    validateStateVecQureg(workspace, __func__);
+    validateMatchingQuregDims(getValidationShape(circuit), qureg, __func__);
+    validateMatchingQuregDims(qureg, workspace, __func__);
+    validateNumSumTerms(numSumTerms, __func__);
+    validatePauliCodes(allPauliCodes, numSumTerms*qureg.numQubitsRepresented, __func__);
+
+    struct CircuitData* data = circuit.data;
+
+    // forward pass, then |lambda> = H|phi_P>
+    for (int g=0; g < data->numGates; g++)
+        circuit_applyGate(qureg, data, g, 0);
+    setPauliSumOnState(qureg, workspace, allPauliCodes, termCoeffs, numSumTerms);
+    qreal expec = statevec_calcInnerProduct(qureg, workspace).real;
+
+    for (int p=0; p < data->numParams; p++)
+        gradients[p] = 0;
+
+    // lambda needn't be un-applied past the earliest parameterised gate
+    int firstParamGate = data->numGates;
+    for (int g=data->numGates-1; g >= 0; g--)
+        if (data->paramInds[g] >= 0)
+            firstParamGate = g;
+
+    for (int g=data->numGates-1; g >= 0; g--) {
+        int p = data->paramInds[g];
+        if (p >= 0) {
+            int target = data->targets[g];
+            int control = data->qubits[data->qubitOffsets[g]];
+            enum pauliOpType axis = getRotationAxis(data->gates[g]);
+
+            if (data->numControls[g] == 0) {
+                // Im <lambda| sigma |phi>, with sigma applied to phi in place then undone
+                applyPauli(qureg, target, axis);
+                gradients[p] += statevec_calcInnerProduct(workspace, qureg).imag;
+                applyPauli(qureg, target, axis);
+            } else {
+                // the generator is |1><1| (x) sigma, which is half of C-sigma minus (Z (x) 1) C-sigma
+                applyControlledPauli(qureg, control, target, axis);
+                qreal withPlus = statevec_calcInnerProduct(workspace, qureg).imag;
+                statevec_pauliZ(qureg, control);
+                qreal withMinus = statevec_calcInnerProduct(workspace, qureg).imag;
+                statevec_pauliZ(qureg, control);
+                applyControlledPauli(qureg, control, target, axis);
+                gradients[p] += (withPlus - withMinus)/2;
+            }
+        }
+
+        circuit_applyGate(qureg, data, g, 1);
+        if (g > firstParamGate)
+            circuit_applyGate(workspace, data, g, 1);
+    }
+
+    return expec;
+}
+
+#ifdef __cplusplus
+}
+#endif
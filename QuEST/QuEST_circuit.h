@@ -0,0 +1,346 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * The recorded circuit API.
+ * A Circuit is a list of gates recorded once, with the same arguments as their QuEST.h
+ * counterparts (prefixed with "circuit"), and replayed later with runCircuit upon any Qureg of
+ * the same size, whether state-vector or density matrix. Gates are validated when recorded,
+ * so a circuit can be run thousands of times from different initial states without
+ * re-validating or re-copying its gates.
+ * Rotation angles may be bound to parameter slots of the circuit, which can be changed
+ * between runs, and the gradient of a Pauli-sum expectation value with respect to every
+ * slot is found by adjoint differentiation in about three executions of the circuit.
+ * Recorded circuits can be shortened in place by optimisation passes before they are run.
+ * Each run goes through a compiled plan, cached per structure, so repeated runs of the same
+ * gates (with any slot values) derive no gate matrices.
+ */
+
+# ifndef QUEST_CIRCUIT_H
+# define QUEST_CIRCUIT_H
+
+# include "QuEST.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// \cond HIDDEN_SYMBOLS
+struct CircuitData;
+/// \endcond
+
+/** Represents a recorded sequence of gates upon a fixed number of qubits.
+ * Qubits are zero-based, as they are for a Qureg.
+ */
+typedef struct Circuit
+{
+    //! The number of qubits the gates act upon
+    int numQubits;
+    //! The recorded gates and parameter slots
+    struct CircuitData* data;
+} Circuit;
+
+/** The effect of an optimisation pass upon a circuit. A sweep is one pass over the amplitudes
+ * of a state-vector: runCircuit applies each non-diagonal gate in its own sweep, and each run
+ * of consecutive diagonal gates upon at most 10 qubits in one.
+ */
+typedef struct CircuitPassStats
+{
+    int numGatesBefore;
+    int numGatesAfter;
+    int numSweepsBefore;
+    int numSweepsAfter;
+} CircuitPassStats;
+
+/** Counts of the lookups made of the compiled plan cache by runCircuit, since the cache was
+ * last cleared.
+ */
+typedef struct CircuitCacheStats
+{
+    //! Runs which found their plan in the in-process cache
+    long long int numHits;
+    //! Runs which did not, and so read or compiled a plan
+    long long int numMisses;
+    //! Of those misses, the plans read from the cache directory
+    long long int numDiskLoads;
+    //! The number of plans currently held
+    int numPlans;
+} CircuitCacheStats;
+
+/** Create an empty circuit upon \p numQubits qubits, with no parameter slots.
+ *
+ * @returns an object to which gates can be recorded
+ * @param[in] numQubits number of qubits the circuit acts upon
+ * @throws exitWithError if \p numQubits <= 0
+ */
+Circuit createCircuit(int numQubits);
+
+/** Deallocate a Circuit, freeing its gates and parameters.
+ *
+ * @param[in,out] circuit the circuit to destroy
+ */
+void destroyCircuit(Circuit circuit);
+
+/** Returns the number of gates recorded in \p circuit */
+int getNumCircuitGates(Circuit circuit);
+
+/** Returns the number of parameter slots created in \p circuit */
+int getNumCircuitParams(Circuit circuit);
+
+/** Add a parameter slot to \p circuit, holding \p value, to which rotation angles can be bound
+ * with the circuitParam* gates.
+ *
+ * @returns the index of the new slot; slots are numbered from 0 in order of creation
+ */
+int createCircuitParam(Circuit circuit, qreal value);
+
+/** Change the value held by parameter slot \p paramIndex. Every gate bound to the slot uses
+ * the new value when the circuit is next run.
+ *
+ * @throws exitWithError if \p paramIndex is not a slot of \p circuit
+ */
+void setCircuitParam(Circuit circuit, int paramIndex, qreal value);
+
+/** Get the value held by parameter slot \p paramIndex.
+ *
+ * @throws exitWithError if \p paramIndex is not a slot of \p circuit
+ */
+qreal getCircuitParam(Circuit circuit, int paramIndex);
+
+/*
+ * gates, recorded with the arguments of their QuEST.h counterparts
+ */
+
+void circuitHadamard(Circuit circuit, const int targetQubit);
+
+void circuitPauliX(Circuit circuit, const int targetQubit);
+
+void circuitPauliY(Circuit circuit, const int targetQubit);
+
+void circuitPauliZ(Circuit circuit, const int targetQubit);
+
+void circuitSGate(Circuit circuit, const int targetQubit);
+
+void circuitTGate(Circuit circuit, const int targetQubit);
+
+void circuitPhaseShift(Circuit circuit, const int targetQubit, qreal angle);
+
+void circuitRotateX(Circuit circuit, const int rotQubit, qreal angle);
+
+void circuitRotateY(Circuit circuit, const int rotQubit, qreal angle);
+
+void circuitRotateZ(Circuit circuit, const int rotQubit, qreal angle);
+
+void circuitControlledNot(Circuit circuit, const int controlQubit, const int targetQubit);
+
+void circuitControlledPauliY(Circuit circuit, const int controlQubit, const int targetQubit);
+
+void circuitControlledPhaseShift(Circuit circuit, const int idQubit1, const int idQubit2, qreal angle);
+
+void circuitControlledPhaseFlip(Circuit circuit, const int idQubit1, const int idQubit2);
+
+void circuitControlledRotateX(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle);
+
+void circuitControlledRotateY(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle);
+
+void circuitControlledRotateZ(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle);
+
+void circuitRotateAroundAxis(Circuit circuit, const int rotQubit, qreal angle, Vector axis);
+
+void circuitControlledRotateAroundAxis(Circuit circuit, const int controlQubit, const int targetQubit, qreal angle, Vector axis);
+
+void circuitCompactUnitary(Circuit circuit, const int targetQubit, Complex alpha, Complex beta);
+
+void circuitControlledCompactUnitary(Circuit circuit, const int controlQubit, const int targetQubit, Complex alpha, Complex beta);
+
+void circuitUnitary(Circuit circuit, const int targetQubit, ComplexMatrix2 u);
+
+void circuitControlledUnitary(Circuit circuit, const int controlQubit, const int targetQubit, ComplexMatrix2 u);
+
+void circuitMultiControlledUnitary(Circuit circuit, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u);
+
+void circuitMultiControlledPhaseShift(Circuit circuit, int *controlQubits, int numControlQubits, qreal angle);
+
+void circuitMultiControlledPhaseFlip(Circuit circuit, int *controlQubits, int numControlQubits);
+
+/*
+ * rotations whose angle is the current value of a parameter slot
+ */
+
+/** Record rotateX(qureg, rotQubit, angle) where angle is the value of slot \p paramIndex
+ * when the circuit is run.
+ *
+ * @throws exitWithError if \p paramIndex is not a slot of \p circuit
+ */
+void circuitParamRotateX(Circuit circuit, const int rotQubit, int paramIndex);
+
+/** As circuitParamRotateX, but about the y axis */
+void circuitParamRotateY(Circuit circuit, const int rotQubit, int paramIndex);
+
+/** As circuitParamRotateX, but about the z axis */
+void circuitParamRotateZ(Circuit circuit, const int rotQubit, int paramIndex);
+
+/** Record controlledRotateX(qureg, controlQubit, targetQubit, angle) where angle is the value
+ * of slot \p paramIndex when the circuit is run.
+ *
+ * @throws exitWithError if \p paramIndex is not a slot of \p circuit
+ */
+void circuitParamControlledRotateX(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex);
+
+/** As circuitParamControlledRotateX, but about the y axis */
+void circuitParamControlledRotateY(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex);
+
+/** As circuitParamControlledRotateX, but about the z axis */
+void circuitParamControlledRotateZ(Circuit circuit, const int controlQubit, const int targetQubit, int paramIndex);
+
+/** Apply every gate of \p circuit, in the order recorded, to \p qureg, using the current values
+ * of its parameter slots. The gates are first compiled for the type and size of \p qureg into
+ * a plan, in which runs of diagonal gates are fused into one pass and fixed rotations are
+ * replaced by their matrices; the plan is cached (see setCircuitCacheCapacity) so that later
+ * runs of a circuit with the same gates skip compilation, whatever its slot values. The
+ * register is not initialised first, so the circuit acts upon whatever state \p qureg holds.
+ * If \p qureg is recording QASM, the gates are logged as if they had been called directly,
+ * with compact unitaries logged as general unitaries.
+ *
+ * Upon a state-vector distributed over several processes, a gate targeting a qubit beyond each
+ * process's chunk exchanges whole chunks. When several such gates lie close ahead, their target
+ * qubits are first swapped with qubits within the chunk in one all-to-all exchange, and the gates
+ * relabelled to match; the original order of the qubits is restored before runCircuit returns.
+ *
+ * @param[in] circuit the circuit to run
+ * @param[in,out] qureg a state-vector or density matrix of circuit.numQubits qubits
+ * @throws exitWithError if \p qureg does not have circuit.numQubits qubits
+ */
+void runCircuit(Circuit circuit, Qureg qureg);
+
+/** Returns the structural hash by which compiled plans of \p circuit are cached: a 64-bit
+ * FNV-1a hash of its number of qubits and of each gate's type, qubits, fixed angle, matrix or
+ * axis, and parameter slot index. Changing slot values does not change the hash, and
+ * separately recorded circuits with the same gates have the same hash. A cached plan is used
+ * only by circuits whose gates also match those it was compiled from, so circuits whose hashes
+ * happen to collide each compile their own.
+ */
+unsigned long long int getCircuitHash(Circuit circuit);
+
+/** Set the most compiled plans the in-process cache holds (16 by default), evicting the least
+ * recently used plans beyond it. A capacity of 0 disables caching, so each run compiles its
+ * plan afresh. The cache is shared by all circuits and threads, and circuits may be run upon
+ * different registers concurrently.
+ *
+ * @throws exitWithError if \p numPlans < 0
+ */
+void setCircuitCacheCapacity(int numPlans);
+
+/** Set a directory in which compiled plans persist between processes, or disable this if
+ * \p path is NULL (the default). A plan missing from the in-process cache is read from
+ * path/circuit_<hash>_<statevec|densmatr>.plan, where hash is getCircuitHash as 16 hexadecimal
+ * digits, if such a file exists and was written for the same gates, precision and register size;
+ * otherwise it is compiled and written there, by the process holding the register's first
+ * chunk. Files which cannot be read or written are ignored.
+ *
+ * @param[in] path the directory, which must already exist, or NULL
+ */
+void setCircuitCacheDirectory(char* path);
+
+/** Free every plan in the in-process cache, and reset the counts of getCircuitCacheStats.
+ * Call this before finishing, to release the cache's memory.
+ */
+void clearCircuitCache(void);
+
+/** Returns the cache counts since clearCircuitCache was last called */
+CircuitCacheStats getCircuitCacheStats(void);
+
+/** Computes the expected value of the Pauli sum H (given as in calcExpecPauliSum) after
+ * \p circuit acts upon state-vector \p qureg, and the derivative of that value with respect to
+ * every parameter slot, by adjoint differentiation.
+ *
+ * The circuit is run forward once upon \p qureg, \p workspace is set to H|psi>, and the gates
+ * are then un-applied from both registers in reverse order, each parameterised gate
+ * contributing to its slot's derivative from one inner product (two, if controlled). The cost
+ * is about that of three circuit runs however many slots there are, where finite differences
+ * or the parameter-shift rule need two runs per slot. The derivative of a slot bound to
+ * several gates is the sum of their contributions.
+ *
+ * On return, \p qureg has been returned to its input state (up to numerical error), ready
+ * for a run with new parameter values, and \p workspace is overwritten.
+ *
+ * @param[in] circuit the circuit to differentiate
+ * @param[in,out] qureg the input state-vector, returned to its input state
+ * @param[out] workspace a state-vector of the same size as \p qureg, overwritten
+ * @param[in] allPauliCodes numSumTerms * numQubits Pauli codes, as in calcExpecPauliSum
+ * @param[in] termCoeffs the real coefficient of each term
+ * @param[in] numSumTerms the number of terms in the sum
+ * @param[out] gradients the derivative with respect to each of the getNumCircuitParams(circuit) slots
+ * @returns the expected value of H in the output state of the circuit
+ * @throws exitWithError if \p qureg or \p workspace are density matrices, if their sizes
+ *      differ from that of \p circuit, if \p numSumTerms <= 0 or if any code is invalid
+ */
+qreal calcExpecPauliSumGradient(Circuit circuit, Qureg qureg, Qureg workspace,
+    enum pauliOpType* allPauliCodes, qreal* termCoeffs, int numSumTerms, qreal* gradients);
+
+/*
+ * optimisation passes, which rewrite the gates of a circuit in place. Gates bound to a parameter
+ * slot are never merged, cancelled or inverted, so an optimised circuit remains correct for
+ * every value of its slots, and its gradients are unchanged.
+ */
+
+/** Removes pairs of gates which are each other's inverse, such as two Hadamards or a phase
+ * shift followed by its negation, including pairs separated by gates which commute with them.
+ * Nested pairs, like a sub-circuit followed by its inverse, are removed in one pass.
+ *
+ * @returns the gate and sweep counts before and after the pass
+ */
+CircuitPassStats cancelCircuitInversePairs(Circuit circuit);
+
+/** Merges rotations about the same axis upon the same qubits (and controls) into one rotation,
+ * including those separated by gates which commute with them. Phase gates (pauliZ, sGate,
+ * tGate and the phase shifts) merge into one phase shift, and unitaries into their product.
+ * A merged gate which is the identity is removed.
+ *
+ * @returns the gate and sweep counts before and after the pass
+ */
+CircuitPassStats mergeCircuitRotations(Circuit circuit);
+
+/** Moves diagonal gates earlier, past gates which commute with them, to join other diagonal
+ * gates, so that runCircuit applies more of them together. The gates are kept in their
+ * recorded order if this would not reduce the number of sweeps.
+ *
+ * @returns the gate and sweep counts before and after the pass
+ */
+CircuitPassStats commuteCircuitDiagonals(Circuit circuit);
+
+/** Removes pairs of pauliX gates upon a qubit which is used, between them, only as a control
+ * or by diagonal gates, by making those gates condition on the qubit being 0. As in Grover's
+ * search, a multiControlledPhaseFlip between two layers of pauliX becomes a single gate. A
+ * single non-diagonal gate so controlled is rewritten as two gates: its operator upon the
+ * other controls, then its inverse upon all of them.
+ *
+ * @returns the gate and sweep counts before and after the pass
+ */
+CircuitPassStats rewriteCircuitConjugatedControls(Circuit circuit);
+
+/** Specialises \p circuit to input basis state \p inputStateInd, after which it acts upon that
+ * state as before, but not necessarily upon any other. Gates with a control known to be
+ * unsatisfied are removed, controls known to be satisfied are dropped, and pauliX gates upon
+ * qubits whose value no earlier gate uses are folded into \p inputStateInd, which is updated,
+ * so that the circuit should then be run from initClassicalState(qureg, *inputStateInd).
+ *
+ * @param[in,out] circuit the circuit to specialise
+ * @param[in,out] inputStateInd the index of the input basis state, updated with folded gates
+ * @returns the gate and sweep counts before and after the pass
+ * @throws exitWithError if \p inputStateInd is not a basis state of circuit.numQubits qubits
+ */
+CircuitPassStats propagateCircuitConstants(Circuit circuit, long long int* inputStateInd);
+
+/** Applies rewriteCircuitConjugatedControls, cancelCircuitInversePairs, mergeCircuitRotations
+ * and commuteCircuitDiagonals repeatedly, until they reduce neither the number of gates nor
+ * of sweeps.
+ *
+ * @returns the gate and sweep counts before and after all passes
+ */
+CircuitPassStats optimiseCircuit(Circuit circuit);
+
+#ifdef __cplusplus
+}
+#endif
+
+# endif // QUEST_CIRCUIT_H
@@ -0,0 +1,947 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * Compiled circuit plans and their cache, implementing the cache functions of QuEST_circuit.h.
+ *
+ * A plan is the gate list of a circuit prepared for one register type and size: each run of
+ * fixed diagonal gates becomes one precomputed table, applied in a single pass, and each fixed
+ * rotation becomes the unitary it applies, so running a plan derives no matrix. Gates bound to
+ * parameter slots are kept as gates, and read the slots of the circuit being run, so a plan
+ * serves any slot values.
+ *
+ * Plans are keyed by a 64-bit FNV-1a hash of the circuit's structure (gates, qubits, fixed
+ * angles, matrices, axes and slot indices, but not slot values), so separately recorded but
+ * identical circuits share a plan. Each plan keeps the structure it was compiled from, which a
+ * circuit must match exactly to use it, so that circuits whose hashes collide never share one. The cache is a small array evicted least-recently-used
+ * first. It is shared by every thread, so each access to it is made within a critical section,
+ * and a plan evicted while another thread runs it is destroyed only once that run releases it.
+ * Running a plan never modifies it. If a cache directory is set, compiled plans are also written
+ * there by the process holding the first chunk of the register, and read back by any process
+ * before compiling.
+ */
+
+# include "QuEST.h"
+# include "QuEST_circuit.h"
+# include "QuEST_circuit_internal.h"
+# include "QuEST_internal.h"
+# include "QuEST_precision.h"
+# include "QuEST_validation.h"
+
+# include <math.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+# define CIRCUIT_CACHE_DEFAULT_CAPACITY 16
+# define PLAN_FILE_MAGIC "QuESTPLN"
+# define PLAN_FILE_VERSION 2
+
+/** the most steps ahead which a distributed state-vector's qubits are relabelled for, and the
+ * fewest exchanges upon global qubits within them which a relabelling must save */
+# define CIRCUIT_REMAP_WINDOW 256
+# define CIRCUIT_MIN_REMAPPED_EXCHANGES 2
+
+enum planStepKind {STEP_GATE, STEP_TABLE, STEP_PARAM_TABLE};
+
+struct CircuitPlan
+{
+    unsigned long long int hash;
+    int isDensityMatrix;
+    int numQubits;
+    int isCached;
+    int numUsers;               // the number of runs in progress, which must finish before it is destroyed
+
+    int numSteps;
+    int* stepKinds;
+    int* stepStarts;            // the step's first gate in gates (STEP_GATE, STEP_PARAM_TABLE)
+    int* stepEnds;              // one past its last gate
+    long long int* stepMasks;   // the qubits of a STEP_TABLE, as passed to statevec_applyDiagonalTable
+    long long int* tableOffsets; // where the factors of a STEP_TABLE begin in tablesRe and tablesIm
+
+    long long int numTableEntries;
+    qreal* tablesRe;
+    qreal* tablesIm;
+
+    // the compiled gates, whose parameter slots are borrowed from the circuit being run
+    struct CircuitData* gates;
+
+    // the gates of the circuit compiled, compared with those of every circuit whose hash matches
+    struct CircuitData* source;
+};
+
+static int cacheCapacity = CIRCUIT_CACHE_DEFAULT_CAPACITY;
+static int numCachedPlans = 0;
+static struct CircuitPlan** cachedPlans = NULL;
+static long long int* cacheLastUses = NULL;
+static long long int cacheClock = 0;
+static char* cacheDirectory = NULL;
+static CircuitCacheStats cacheStats = {0};
+
+static void* reallocOrExit(void* mem, size_t numBytes) {
+    mem = realloc(mem, (numBytes > 0)? numBytes : 1);
+    if (mem == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+static void* allocOrExit(size_t numBytes) {
+    return reallocOrExit(NULL, numBytes);
+}
+
+
+/*
+ * hashing
+ */
+
+static unsigned long long int hashBytes(unsigned long long int hash, const void* bytes, size_t numBytes) {
+    const unsigned char* b = bytes;
+    for (size_t i=0; i < numBytes; i++) {
+        hash ^= b[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long int getHash(struct CircuitData* data, int numQubits) {
+    if (data->isHashValid)
+        return data->hash;
+
+    unsigned long long int hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, &numQubits, sizeof numQubits);
+    for (int g=0; g < data->numGates; g++) {
+        int gate = data->gates[g];
+        hash = hashBytes(hash, &gate, sizeof gate);
+        hash = hashBytes(hash, &data->numControls[g], sizeof *data->numControls);
+        hash = hashBytes(hash, &data->qubits[data->qubitOffsets[g]], (data->numControls[g] + 1) * sizeof *data->qubits);
+        hash = hashBytes(hash, &data->flipMasks[g], sizeof *data->flipMasks);
+        hash = hashBytes(hash, &data->paramInds[g], sizeof *data->paramInds);
+        if (data->paramInds[g] < 0)
+            hash = hashBytes(hash, &data->angles[g], sizeof *data->angles);
+        if (gate == GATE_UNITARY)
+            hash = hashBytes(hash, &data->matrices[data->operandInds[g]], sizeof *data->matrices);
+        if (gate == GATE_ROTATE_AROUND_AXIS)
+            hash = hashBytes(hash, &data->axes[data->operandInds[g]], sizeof *data->axes);
+    }
+
+    data->hash = hash;
+    data->isHashValid = 1;
+    return hash;
+}
+
+
+/*
+ * compilation
+ */
+
+static struct CircuitPlan* allocPlan(int numSteps) {
+    struct CircuitPlan* plan = allocOrExit(sizeof *plan);
+    plan->isCached = 0;
+    plan->numUsers = 0;
+    plan->numSteps = 0;
+    plan->stepKinds = allocOrExit(numSteps * sizeof *plan->stepKinds);
+    plan->stepStarts = allocOrExit(numSteps * sizeof *plan->stepStarts);
+    plan->stepEnds = allocOrExit(numSteps * sizeof *plan->stepEnds);
+    plan->stepMasks = allocOrExit(numSteps * sizeof *plan->stepMasks);
+    plan->tableOffsets = allocOrExit(numSteps * sizeof *plan->tableOffsets);
+    plan->numTableEntries = 0;
+    plan->tablesRe = allocOrExit(0);
+    plan->tablesIm = allocOrExit(0);
+
+    plan->gates = circuit_createData();
+    free(plan->gates->params);
+    plan->gates->params = NULL;
+    plan->source = circuit_createData();
+    free(plan->source->params);
+    plan->source->params = NULL;
+    return plan;
+}
+
+static void destroyPlan(struct CircuitPlan* plan) {
+    free(plan->stepKinds);
+    free(plan->stepStarts);
+    free(plan->stepEnds);
+    free(plan->stepMasks);
+    free(plan->tableOffsets);
+    free(plan->tablesRe);
+    free(plan->tablesIm);
+    plan->gates->params = NULL;
+    circuit_destroyData(plan->gates);
+    plan->source->params = NULL;
+    circuit_destroyData(plan->source);
+    free(plan);
+}
+
+/** whether data has exactly the structure compiled into plan, i.e. every field which getHash hashes */
+static int isPlanSource(struct CircuitPlan* plan, struct CircuitData* data) {
+    struct CircuitData* source = plan->source;
+    if (source->numGates != data->numGates)
+        return 0;
+    for (int g=0; g < data->numGates; g++) {
+        TargetGate gate = data->gates[g];
+        int numQubits = data->numControls[g] + 1;
+        if (source->gates[g] != gate || source->numControls[g] != data->numControls[g]
+                || source->flipMasks[g] != data->flipMasks[g] || source->paramInds[g] != data->paramInds[g])
+            return 0;
+        if (memcmp(&source->qubits[source->qubitOffsets[g]], &data->qubits[data->qubitOffsets[g]], numQubits * sizeof *data->qubits))
+            return 0;
+        if (data->paramInds[g] < 0 && memcmp(&source->angles[g], &data->angles[g], sizeof *data->angles))
+            return 0;
+        if (gate == GATE_UNITARY && memcmp(&source->matrices[source->operandInds[g]], 
+                &data->matrices[data->operandInds[g]], sizeof *data->matrices))
+            return 0;
+        if (gate == GATE_ROTATE_AROUND_AXIS && memcmp(&source->axes[source->operandInds[g]], 
+                &data->axes[data->operandInds[g]], sizeof *data->axes))
+            return 0;
+    }
+    return 1;
+}
+
+static int isRotationGate(TargetGate gate) {
+    return gate == GATE_ROTATE_X || gate == GATE_ROTATE_Y || gate == GATE_ROTATE_Z || gate == GATE_ROTATE_AROUND_AXIS;
+}
+
+/** the unitary of rotation gate g of data, by its current angle */
+static ComplexMatrix2 getRotationMatrix(struct CircuitData* data, int g) {
+    TargetGate gate = data->gates[g];
+    Vector axis = {.x=(gate == GATE_ROTATE_X), .y=(gate == GATE_ROTATE_Y), .z=(gate == GATE_ROTATE_Z)};
+    if (gate == GATE_ROTATE_AROUND_AXIS)
+        axis = data->axes[data->operandInds[g]];
+    Complex alpha, beta;
+    getComplexPairFromRotation(circuit_getAngle(data, g), axis, &alpha, &beta);
+    return getMatrixFromComplexPair(alpha, beta);
+}
+
+/** appends gate g of src to dest, as the unitary it applies if it is a fixed rotation */
+static void compileGate(struct CircuitData* dest, struct CircuitData* src, int g) {
+    if (!isRotationGate(src->gates[g]) || src->paramInds[g] >= 0) {
+        circuit_copyGate(dest, src, g);
+        return;
+    }
+
+    int m = circuit_addMatrix(dest, getRotationMatrix(src, g));
+    circuit_addGate(dest, GATE_UNITARY, &src->qubits[src->qubitOffsets[g]], src->numControls[g], src->targets[g], 0, -1, m);
+}
+
+static struct CircuitPlan* compilePlan(struct CircuitData* data, Qureg qureg, unsigned long long int hash) {
+    struct CircuitPlan* plan = allocPlan(data->numGates);
+    plan->hash = hash;
+    plan->isDensityMatrix = qureg.isDensityMatrix;
+    plan->numQubits = qureg.numQubitsRepresented;
+    for (int h=0; h < data->numGates; h++)
+        circuit_copyGate(plan->source, data, h);
+
+    int maxRunQubits = (qureg.isDensityMatrix)? CIRCUIT_MAX_DENSITY_DIAGONAL_QUBITS : CIRCUIT_MAX_DIAGONAL_QUBITS;
+    int g = 0;
+    while (g < data->numGates) {
+        int end = circuit_getDiagonalRunEnd(data, g, maxRunQubits);
+        int isRun = circuit_isDiagonalGate(data, g) && __builtin_popcountll(circuit_getGateMask(data, g)) <= maxRunQubits;
+        int isFixed = 1;
+        for (int h=g; h < end; h++)
+            if (data->paramInds[h] >= 0)
+                isFixed = 0;
+
+        int s = plan->numSteps++;
+        if (isRun && isFixed) {
+            long long int mask;
+            qreal *factorsRe, *factorsIm;
+            circuit_getDiagonalTable(data, g, end, 0, qureg, &mask, &factorsRe, &factorsIm);
+            long long int numFactors = 1LL << __builtin_popcountll(mask);
+            long long int offset = plan->numTableEntries;
+            plan->numTableEntries += numFactors;
+            plan->tablesRe = reallocOrExit(plan->tablesRe, plan->numTableEntries * sizeof *plan->tablesRe);
+            plan->tablesIm = reallocOrExit(plan->tablesIm, plan->numTableEntries * sizeof *plan->tablesIm);
+            memcpy(&plan->tablesRe[offset], factorsRe, numFactors * sizeof *factorsRe);
+            memcpy(&plan->tablesIm[offset], factorsIm, numFactors * sizeof *factorsIm);
+            free(factorsRe);
+            free(factorsIm);
+
+            plan->stepKinds[s] = STEP_TABLE;
+            plan->stepMasks[s] = mask;
+            plan->tableOffsets[s] = offset;
+        }
+        else if (isRun && end - g > 1) {
+            // the table of a run with parameterised gates is rebuilt each run, from the slots
+            plan->stepKinds[s] = STEP_PARAM_TABLE;
+            plan->stepStarts[s] = plan->gates->numGates;
+            for (int h=g; h < end; h++)
+                circuit_copyGate(plan->gates, data, h);
+            plan->stepEnds[s] = plan->gates->numGates;
+        }
+        else {
+            end = g+1;
+            plan->stepKinds[s] = STEP_GATE;
+            plan->stepStarts[s] = plan->gates->numGates;
+            compileGate(plan->gates, data, g);
+            plan->stepEnds[s] = plan->gates->numGates;
+        }
+        g = end;
+    }
+    return plan;
+}
+
+static void applyStep(struct CircuitPlan* plan, struct CircuitData* gates, int s, Qureg qureg) {
+    switch (plan->stepKinds[s]) {
+        case STEP_GATE:
+            circuit_applyGate(qureg, gates, plan->stepStarts[s], 0);
+            break;
+        case STEP_TABLE: {
+            long long int offset = plan->tableOffsets[s];
+            statevec_applyDiagonalTable(qureg, plan->stepMasks[s], &plan->tablesRe[offset], &plan->tablesIm[offset]);
+            break;
+        }
+        case STEP_PARAM_TABLE:
+            circuit_applyDiagonalRun(qureg, gates, plan->stepStarts[s], plan->stepEnds[s], 0);
+            break;
+    }
+}
+
+static ComplexMatrix2 getRealMatrix(qreal r0c0, qreal r0c1, qreal r1c0, qreal r1c1) {
+    ComplexMatrix2 u = {
+        .r0c0={.real=r0c0, .imag=0}, .r0c1={.real=r0c1, .imag=0},
+        .r1c0={.real=r1c0, .imag=0}, .r1c1={.real=r1c1, .imag=0}};
+    return u;
+}
+
+/** writes step s of plan to sequence as the steps of statevec_applyGateSequence, and returns
+ * their number, or 0 if it is not a table or a single-target unitary upon local qubits */
+static int getSequenceSteps(struct CircuitPlan* plan, struct CircuitData* gates, int s, Qureg qureg, GateSequenceStep* sequence) {
+    if (plan->stepKinds[s] == STEP_TABLE) {
+        long long int offset = plan->tableOffsets[s];
+        sequence[0].targetQubit = -1;
+        sequence[0].tableMask = plan->stepMasks[s];
+        sequence[0].factorsRe = &plan->tablesRe[offset];
+        sequence[0].factorsIm = &plan->tablesIm[offset];
+        return 1;
+    }
+    if (plan->stepKinds[s] != STEP_GATE || gates->flipMasks[plan->stepStarts[s]])
+        return 0;
+
+    int g = plan->stepStarts[s];
+    TargetGate gate = gates->gates[g];
+    ComplexMatrix2 u;
+    if (gate == GATE_HADAMARD)
+        u = getRealMatrix(1/sqrt(2), 1/sqrt(2), 1/sqrt(2), -1/sqrt(2));
+    else if (gate == GATE_SIGMA_X)
+        u = getRealMatrix(0, 1, 1, 0);
+    else if (gate == GATE_SIGMA_Y) {
+        u = getRealMatrix(0, 0, 0, 0);
+        u.r0c1.imag = -1;
+        u.r1c0.imag = 1;
+    }
+    else if (isRotationGate(gate))
+        u = getRotationMatrix(gates, g);
+    else if (gate == GATE_UNITARY)
+        u = gates->matrices[gates->operandInds[g]];
+    else
+        return 0;
+
+    // a density matrix applies u to its rows and conj(u) to its columns
+    int target = gates->targets[g];
+    int shift = qureg.numQubitsRepresented;
+    int outerTarget = (qureg.isDensityMatrix)? target + shift : target;
+    if ((2LL << outerTarget) > qureg.numAmpsPerChunk)
+        return 0;
+
+    long long int ctrlMask = circuit_getGateMask(gates, g) & ~(1LL << target);
+    sequence[0].targetQubit = target;
+    sequence[0].ctrlMask = ctrlMask;
+    sequence[0].u = u;
+    if (!qureg.isDensityMatrix)
+        return 1;
+
+    sequence[1].targetQubit = target + shift;
+    sequence[1].ctrlMask = ctrlMask << shift;
+    sequence[1].u = getConjugateMatrix(u);
+    return 2;
+}
+
+/*
+ * qubit layout
+ */
+
+/** The positions of the qubits of a distributed state-vector during one run of a plan. A gate
+ * upon a qubit beyond the chunk (a global qubit) exchanges the whole chunk, so before a window of
+ * such gates, their targets are swapped with qubits within the chunk which the window leaves
+ * alone, in one all-to-all exchange, and the gates are relabelled to act upon the new positions.
+ * Every global position holds either its own qubit or one whose own position is within the chunk,
+ * so the run ends by restoring the original order with at most one more exchange, and no other
+ * function ever sees the layout.
+ */
+struct QubitLayout
+{
+    int numQubits;
+    int numLocalQubits;
+    int positionOf[64];     // where each qubit currently lies
+    int qubitAt[64];        // which qubit lies at each position
+};
+
+/** the qubit which step s must find within the chunk to avoid an exchange, or -1 if none */
+static int getExchangeTarget(struct CircuitPlan* plan, int s) {
+    if (plan->stepKinds[s] != STEP_GATE || circuit_isDiagonalGate(plan->gates, plan->stepStarts[s]))
+        return -1;
+    return plan->gates->targets[plan->stepStarts[s]];
+}
+
+/** rewrites the qubits of runPlan's gates and tables, from those of plan, as their current positions */
+static void relabelPlan(struct QubitLayout* layout, struct CircuitPlan* plan, struct CircuitPlan* runPlan) {
+    struct CircuitData* planGates = plan->gates;
+    struct CircuitData* runGates = runPlan->gates;
+    for (int i=0; i < planGates->numQubitEntries; i++)
+        runGates->qubits[i] = layout->positionOf[planGates->qubits[i]];
+    for (int g=0; g < planGates->numGates; g++)
+        runGates->targets[g] = layout->positionOf[planGates->targets[g]];
+
+    // a table's factors are indexed by its qubits in increasing order, which relabelling may change
+    for (int s=0; s < plan->numSteps; s++) {
+        if (plan->stepKinds[s] != STEP_TABLE)
+            continue;
+        int numTableQubits = 0;
+        int positions[64];
+        long long int mask = 0;
+        for (int q=0; q < layout->numQubits; q++) {
+            if ((plan->stepMasks[s] >> q) & 1) {
+                positions[numTableQubits++] = layout->positionOf[q];
+                mask |= 1LL << layout->positionOf[q];
+            }
+        }
+        int newBits[64];
+        for (int k=0; k < numTableQubits; k++)
+            newBits[k] = __builtin_popcountll(mask & ((1LL << positions[k]) - 1));
+
+        long long int offset = plan->tableOffsets[s];
+        for (long long int i=0; i < (1LL << numTableQubits); i++) {
+            long long int j = 0;
+            for (int k=0; k < numTableQubits; k++)
+                j |= ((i >> k) & 1) << newBits[k];
+            runPlan->tablesRe[offset + j] = plan->tablesRe[offset + i];
+            runPlan->tablesIm[offset + j] = plan->tablesIm[offset + i];
+        }
+        runPlan->stepMasks[s] = mask;
+    }
+}
+
+static void swapGlobalQubits(struct QubitLayout* layout, Qureg qureg, int* globalPositions, int* localPositions, int numPairs) {
+    statevec_swapGlobalQubits(qureg, globalPositions, localPositions, numPairs);
+    for (int k=0; k < numPairs; k++) {
+        int q1 = layout->qubitAt[globalPositions[k]];
+        int q2 = layout->qubitAt[localPositions[k]];
+        layout->qubitAt[globalPositions[k]] = q2;
+        layout->qubitAt[localPositions[k]] = q1;
+        layout->positionOf[q1] = localPositions[k];
+        layout->positionOf[q2] = globalPositions[k];
+    }
+}
+
+/** If step s must exchange, and the steps which follow it (up to CIRCUIT_REMAP_WINDOW) would
+ * make at least CIRCUIT_MIN_REMAPPED_EXCHANGES exchanges upon the global qubits they target,
+ * swaps those qubits into the chunk and returns 1, else returns 0 */
+static int remapForWindow(struct QubitLayout* layout, struct CircuitPlan* plan, int s, Qureg qureg) {
+    int numLocal = layout->numLocalQubits;
+    int target = getExchangeTarget(plan, s);
+    if (target < 0 || layout->positionOf[target] < numLocal)
+        return 0;
+
+    // the window ends where its targets could no longer all lie within the chunk, since some
+    // positions there must hold the qubits which are displaced
+    int maxInWindow = numLocal - (layout->numQubits - numLocal);
+    if (maxInWindow < 1)
+        return 0;
+    int inWindow[64] = {0};
+    int numInWindow = 0;
+    int numExchanges = 0;
+    int end = s + CIRCUIT_REMAP_WINDOW;
+    if (end > plan->numSteps)
+        end = plan->numSteps;
+    for (int t=s; t < end; t++) {
+        int q = getExchangeTarget(plan, t);
+        if (q < 0)
+            continue;
+        if (!inWindow[q]) {
+            if (numInWindow == maxInWindow)
+                break;
+            inWindow[q] = 1;
+            numInWindow++;
+        }
+        if (layout->positionOf[q] >= numLocal)
+            numExchanges++;
+    }
+    if (numExchanges < CIRCUIT_MIN_REMAPPED_EXCHANGES)
+        return 0;
+
+    // the displaced qubits are those used furthest ahead
+    int nextUse[64];
+    for (int q=0; q < layout->numQubits; q++)
+        nextUse[q] = end;
+    for (int t=end-1; t >= s; t--) {
+        int q = getExchangeTarget(plan, t);
+        if (q >= 0)
+            nextUse[q] = t;
+    }
+
+    // each window qubit beyond the chunk takes the position of the qubit which belongs where it
+    // lies, if that is within the chunk, else of a qubit which belongs within the chunk
+    int globalPositions[64], localPositions[64];
+    int isTaken[64] = {0};
+    int numPairs = 0;
+    for (int p=numLocal; p < layout->numQubits; p++) {
+        if (!inWindow[layout->qubitAt[p]])
+            continue;
+        int choice = -1;
+        int home = layout->positionOf[p];
+        if (home < numLocal && !inWindow[p] && !isTaken[home])
+            choice = home;
+        for (int l=0; choice != home && l < numLocal; l++) {
+            int q = layout->qubitAt[l];
+            if (!isTaken[l] && !inWindow[q] && q < numLocal && (choice < 0 || nextUse[q] > nextUse[layout->qubitAt[choice]]))
+                choice = l;
+        }
+        if (choice < 0)
+            continue;
+        isTaken[choice] = 1;
+        globalPositions[numPairs] = p;
+        localPositions[numPairs] = choice;
+        numPairs++;
+    }
+    if (numPairs == 0)
+        return 0;
+
+    swapGlobalQubits(layout, qureg, globalPositions, localPositions, numPairs);
+    return 1;
+}
+
+/** returns every qubit to its own position */
+static void restoreLayout(struct QubitLayout* layout, Qureg qureg) {
+    int globalPositions[64], localPositions[64];
+    int numPairs = 0;
+    for (int p=layout->numLocalQubits; p < layout->numQubits; p++) {
+        if (layout->qubitAt[p] != p) {
+            globalPositions[numPairs] = p;
+            localPositions[numPairs] = layout->positionOf[p];
+            numPairs++;
+        }
+    }
+    if (numPairs > 0)
+        swapGlobalQubits(layout, qureg, globalPositions, localPositions, numPairs);
+
+    int isPermuted = 0;
+    int newPositions[64];
+    for (int l=0; l < layout->numLocalQubits; l++) {
+        newPositions[l] = layout->qubitAt[l];
+        if (newPositions[l] != l)
+            isPermuted = 1;
+    }
+    if (isPermuted)
+        statevec_permuteLocalQubits(qureg, newPositions);
+}
+
+void circuit_runPlan(struct CircuitPlan* plan, struct CircuitData* data, Qureg qureg) {
+    // the plan may be run concurrently, so its gates borrow the slots through a private copy
+    struct CircuitData planGates = *plan->gates;
+    struct CircuitData* gates = &planGates;
+    gates->params = data->params;
+    gates->numParams = data->numParams;
+
+    // a distributed state-vector may have its qubits relabelled during the run, so the qubits of
+    // the gates and tables are made private too
+    struct CircuitPlan runPlan = *plan;
+    struct QubitLayout layout;
+    int isRemappable = !qureg.isDensityMatrix && qureg.numChunks > 1;
+    if (isRemappable) {
+        layout.numQubits = qureg.numQubitsInStateVec;
+        layout.numLocalQubits = 0;
+        while ((1LL << layout.numLocalQubits) < qureg.numAmpsPerChunk)
+            layout.numLocalQubits++;
+        for (int q=0; q < layout.numQubits; q++)
+            layout.positionOf[q] = layout.qubitAt[q] = q;
+
+        runPlan.gates = gates;
+        gates->qubits = allocOrExit(plan->gates->numQubitEntries * sizeof *gates->qubits);
+        gates->targets = allocOrExit(plan->gates->numGates * sizeof *gates->targets);
+        runPlan.stepMasks = allocOrExit(plan->numSteps * sizeof *runPlan.stepMasks);
+        runPlan.tablesRe = allocOrExit(plan->numTableEntries * sizeof *runPlan.tablesRe);
+        runPlan.tablesIm = allocOrExit(plan->numTableEntries * sizeof *runPlan.tablesIm);
+        relabelPlan(&layout, plan, &runPlan);
+    }
+
+    // consecutive steps which need no communication are applied as one sequence, which the
+    // CPU backend runs within a single parallel region
+    GateSequenceStep* sequence = allocOrExit(2 * (size_t) plan->numSteps * sizeof *sequence);
+    int s = 0;
+    while (s < plan->numSteps) {
+        if (isRemappable && remapForWindow(&layout, plan, s, qureg))
+            relabelPlan(&layout, plan, &runPlan);
+
+        int numSequenced = 0;
+        int end = s;
+        int num;
+        while (end < plan->numSteps && (num = getSequenceSteps(&runPlan, gates, end, qureg, &sequence[numSequenced])) > 0) {
+            numSequenced += num;
+            end++;
+        }
+        if (end - s >= 2) {
+            statevec_applyGateSequence(qureg, sequence, numSequenced);
+            s = end;
+        } else {
+            applyStep(&runPlan, gates, s, qureg);
+            s++;
+        }
+    }
+    free(sequence);
+
+    if (isRemappable) {
+        restoreLayout(&layout, qureg);
+        free(gates->qubits);
+        free(gates->targets);
+        free(runPlan.stepMasks);
+        free(runPlan.tablesRe);
+        free(runPlan.tablesIm);
+    }
+}
+
+
+/*
+ * plan files
+ */
+
+static void getPlanFileName(char* fileName, size_t maxLen, unsigned long long int hash, int isDensityMatrix) {
+    snprintf(fileName, maxLen, "%s/circuit_%016llx_%s.plan",
+        cacheDirectory, hash, (isDensityMatrix)? "densmatr" : "statevec");
+}
+
+static int writeItems(FILE* file, const void* items, size_t itemSize, long long int numItems) {
+    return numItems == 0 || fwrite(items, itemSize, numItems, file) == (size_t) numItems;
+}
+
+static int readItems(FILE* file, void* items, size_t itemSize, long long int numItems) {
+    return numItems == 0 || fread(items, itemSize, numItems, file) == (size_t) numItems;
+}
+
+/** writes the gates of data one by one, with their matrix or axis, to be re-recorded by readGates */
+static int writeGates(FILE* file, struct CircuitData* data) {
+    int ok = writeItems(file, &data->numGates, sizeof data->numGates, 1);
+    for (int g=0; ok && g < data->numGates; g++) {
+        int gate = data->gates[g];
+        ok = writeItems(file, &gate, sizeof gate, 1)
+            && writeItems(file, &data->numControls[g], sizeof *data->numControls, 1)
+            && writeItems(file, &data->qubits[data->qubitOffsets[g]], sizeof *data->qubits, data->numControls[g] + 1)
+            && writeItems(file, &data->flipMasks[g], sizeof *data->flipMasks, 1)
+            && writeItems(file, &data->angles[g], sizeof *data->angles, 1)
+            && writeItems(file, &data->paramInds[g], sizeof *data->paramInds, 1);
+        if (ok && gate == GATE_UNITARY)
+            ok = writeItems(file, &data->matrices[data->operandInds[g]], sizeof *data->matrices, 1);
+        if (ok && gate == GATE_ROTATE_AROUND_AXIS)
+            ok = writeItems(file, &data->axes[data->operandInds[g]], sizeof *data->axes, 1);
+    }
+    return ok;
+}
+
+/** records into data the gates written by writeGates, returning 0 if they are malformed */
+static int readGates(FILE* file, struct CircuitData* data, int numQubits) {
+    int numGates;
+    int ok = readItems(file, &numGates, sizeof numGates, 1) && numGates >= 0;
+    int* qubits = allocOrExit(numQubits * sizeof *qubits);
+    for (int g=0; ok && g < numGates; g++) {
+        int gate, numControls, paramIndex;
+        long long int flipMask;
+        qreal angle;
+        ok = readItems(file, &gate, sizeof gate, 1)
+            && readItems(file, &numControls, sizeof numControls, 1)
+            && numControls >= 0 && numControls < numQubits
+            && readItems(file, qubits, sizeof *qubits, numControls + 1)
+            && readItems(file, &flipMask, sizeof flipMask, 1)
+            && readItems(file, &angle, sizeof angle, 1)
+            && readItems(file, &paramIndex, sizeof paramIndex, 1);
+        for (int k=0; ok && k <= numControls; k++)
+            ok = qubits[k] >= 0 && qubits[k] < numQubits;
+        if (!ok)
+            break;
+
+        int operand = -1;
+        if (gate == GATE_UNITARY) {
+            ComplexMatrix2 u;
+            ok = readItems(file, &u, sizeof u, 1);
+            operand = circuit_addMatrix(data, u);
+        }
+        if (gate == GATE_ROTATE_AROUND_AXIS) {
+            Vector axis;
+            ok = readItems(file, &axis, sizeof axis, 1);
+            operand = circuit_addAxis(data, axis);
+        }
+        int h = circuit_addGate(data, (TargetGate) gate, qubits, numControls, qubits[numControls], angle, paramIndex, operand);
+        data->flipMasks[h] = flipMask;
+    }
+    free(qubits);
+    return ok;
+}
+
+/** writes plan to a temporary file which is then renamed, so that no process reads a partial plan */
+static void savePlan(struct CircuitPlan* plan, const char* fileName) {
+    char tempName[1024];
+    snprintf(tempName, sizeof tempName, "%s.tmp", fileName);
+    FILE* file = fopen(tempName, "wb");
+    if (file == NULL)
+        return;
+
+    int version = PLAN_FILE_VERSION;
+    int realSize = sizeof(qreal);
+    int ok = writeItems(file, PLAN_FILE_MAGIC, 1, 8)
+        && writeItems(file, &version, sizeof version, 1)
+        && writeItems(file, &realSize, sizeof realSize, 1)
+        && writeItems(file, &plan->hash, sizeof plan->hash, 1)
+        && writeItems(file, &plan->isDensityMatrix, sizeof plan->isDensityMatrix, 1)
+        && writeItems(file, &plan->numQubits, sizeof plan->numQubits, 1)
+        && writeItems(file, &plan->numSteps, sizeof plan->numSteps, 1)
+        && writeItems(file, plan->stepKinds, sizeof *plan->stepKinds, plan->numSteps)
+        && writeItems(file, plan->stepStarts, sizeof *plan->stepStarts, plan->numSteps)
+        && writeItems(file, plan->stepEnds, sizeof *plan->stepEnds, plan->numSteps)
+        && writeItems(file, plan->stepMasks, sizeof *plan->stepMasks, plan->numSteps)
+        && writeItems(file, plan->tableOffsets, sizeof *plan->tableOffsets, plan->numSteps)
+        && writeItems(file, &plan->numTableEntries, sizeof plan->numTableEntries, 1)
+        && writeItems(file, plan->tablesRe, sizeof *plan->tablesRe, plan->numTableEntries)
+        && writeItems(file, plan->tablesIm, sizeof *plan->tablesIm, plan->numTableEntries);
+
+    // the compiled gates, then those of the circuit compiled, so that a plan read back is checked too
+    ok = ok && writeGates(file, plan->gates) && writeGates(file, plan->source);
+
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tempName, fileName) != 0)
+        remove(tempName);
+}
+
+/** reads the plan in fileName if it exists and is a plan of data for qureg, else returns NULL */
+static struct CircuitPlan* loadPlan(const char* fileName, unsigned long long int hash, struct CircuitData* data, Qureg qureg) {
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL)
+        return NULL;
+
+    char magic[8];
+    int version, realSize, isDensityMatrix, numQubits, numSteps;
+    unsigned long long int fileHash;
+    int ok = readItems(file, magic, 1, 8)
+        && readItems(file, &version, sizeof version, 1)
+        && readItems(file, &realSize, sizeof realSize, 1)
+        && readItems(file, &fileHash, sizeof fileHash, 1)
+        && readItems(file, &isDensityMatrix, sizeof isDensityMatrix, 1)
+        && readItems(file, &numQubits, sizeof numQubits, 1)
+        && readItems(file, &numSteps, sizeof numSteps, 1);
+    ok = ok && memcmp(magic, PLAN_FILE_MAGIC, 8) == 0 && version == PLAN_FILE_VERSION
+        && realSize == (int) sizeof(qreal) && fileHash == hash && numSteps >= 0
+        && isDensityMatrix == qureg.isDensityMatrix && numQubits == qureg.numQubitsRepresented;
+    if (!ok) {
+        fclose(file);
+        return NULL;
+    }
+
+    struct CircuitPlan* plan = allocPlan(numSteps);
+    plan->hash = hash;
+    plan->isDensityMatrix = isDensityMatrix;
+    plan->numQubits = numQubits;
+    plan->numSteps = numSteps;
+    long long int numTableEntries;
+    ok = readItems(file, plan->stepKinds, sizeof *plan->stepKinds, numSteps)
+        && readItems(file, plan->stepStarts, sizeof *plan->stepStarts, numSteps)
+        && readItems(file, plan->stepEnds, sizeof *plan->stepEnds, numSteps)
+        && readItems(file, plan->stepMasks, sizeof *plan->stepMasks, numSteps)
+        && readItems(file, plan->tableOffsets, sizeof *plan->tableOffsets, numSteps)
+        && readItems(file, &numTableEntries, sizeof numTableEntries, 1)
+        && numTableEntries >= 0;
+    if (ok) {
+        plan->numTableEntries = numTableEntries;
+        plan->tablesRe = reallocOrExit(plan->tablesRe, numTableEntries * sizeof *plan->tablesRe);
+        plan->tablesIm = reallocOrExit(plan->tablesIm, numTableEntries * sizeof *plan->tablesIm);
+        ok = readItems(file, plan->tablesRe, sizeof *plan->tablesRe, numTableEntries)
+            && readItems(file, plan->tablesIm, sizeof *plan->tablesIm, numTableEntries);
+    }
+
+    ok = ok && readGates(file, plan->gates, numQubits) && readGates(file, plan->source, numQubits);
+    fclose(file);
+
+    // a plan of another circuit whose hash collides with this one's is not used
+    ok = ok && isPlanSource(plan, data);
+
+    // steps must index the gates and tables read
+    for (int s=0; ok && s < numSteps; s++) {
+        if (plan->stepKinds[s] == STEP_TABLE)
+            ok = plan->tableOffsets[s] >= 0
+                && plan->tableOffsets[s] + (1LL << __builtin_popcountll(plan->stepMasks[s])) <= plan->numTableEntries;
+        else
+            ok = (plan->stepKinds[s] == STEP_GATE || plan->stepKinds[s] == STEP_PARAM_TABLE)
+                && plan->stepStarts[s] >= 0 && plan->stepStarts[s] < plan->stepEnds[s]
+                && plan->stepEnds[s] <= plan->gates->numGates;
+    }
+    if (!ok) {
+        destroyPlan(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+
+/*
+ * the cache
+ */
+
+static void evictLeastRecentlyUsed(void) {
+    int oldest = 0;
+    for (int i=1; i < numCachedPlans; i++)
+        if (cacheLastUses[i] < cacheLastUses[oldest])
+            oldest = i;
+
+    cachedPlans[oldest]->isCached = 0;
+    if (cachedPlans[oldest]->numUsers == 0)
+        destroyPlan(cachedPlans[oldest]);
+    numCachedPlans--;
+    cachedPlans[oldest] = cachedPlans[numCachedPlans];
+    cacheLastUses[oldest] = cacheLastUses[numCachedPlans];
+}
+
+static void addToCache(struct CircuitPlan* plan) {
+    if (cacheCapacity == 0)
+        return;
+    if (cachedPlans == NULL) {
+        cachedPlans = allocOrExit(cacheCapacity * sizeof *cachedPlans);
+        cacheLastUses = allocOrExit(cacheCapacity * sizeof *cacheLastUses);
+    }
+    if (numCachedPlans == cacheCapacity)
+        evictLeastRecentlyUsed();
+
+    plan->isCached = 1;
+    cachedPlans[numCachedPlans] = plan;
+    cacheLastUses[numCachedPlans] = ++cacheClock;
+    numCachedPlans++;
+}
+
+static struct CircuitPlan* findOrCompilePlan(struct CircuitData* data, Qureg qureg) {
+    unsigned long long int hash = getHash(data, qureg.numQubitsRepresented);
+    for (int i=0; i < numCachedPlans; i++) {
+        struct CircuitPlan* plan = cachedPlans[i];
+        if (plan->hash == hash && plan->isDensityMatrix == qureg.isDensityMatrix && plan->numQubits == qureg.numQubitsRepresented
+                && isPlanSource(plan, data)) {
+            cacheLastUses[i] = ++cacheClock;
+            cacheStats.numHits++;
+            return plan;
+        }
+    }
+    cacheStats.numMisses++;
+
+    char fileName[1024] = "";
+    struct CircuitPlan* plan = NULL;
+    if (cacheDirectory != NULL) {
+        getPlanFileName(fileName, sizeof fileName, hash, qureg.isDensityMatrix);
+        plan = loadPlan(fileName, hash, data, qureg);
+        if (plan != NULL)
+            cacheStats.numDiskLoads++;
+    }
+    if (plan == NULL) {
+        plan = compilePlan(data, qureg, hash);
+        if (cacheDirectory != NULL && qureg.chunkId == 0)
+            savePlan(plan, fileName);
+    }
+
+    addToCache(plan);
+    return plan;
+}
+
+struct CircuitPlan* circuit_getPlan(struct CircuitData* data, Qureg qureg) {
+    struct CircuitPlan* plan;
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    {
+        plan = findOrCompilePlan(data, qureg);
+        plan->numUsers++;
+    }
+    return plan;
+}
+
+void circuit_releasePlan(struct CircuitPlan* plan) {
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    {
+        plan->numUsers--;
+        if (!plan->isCached && plan->numUsers == 0)
+            destroyPlan(plan);
+    }
+}
+
+unsigned long long int getCircuitHash(Circuit circuit) {
+    unsigned long long int hash;
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    hash = getHash(circuit.data, circuit.numQubits);
+    return hash;
+}
+
+static void setCapacity(int numPlans) {
+    while (numCachedPlans > numPlans)
+        evictLeastRecentlyUsed();
+    if (cachedPlans != NULL && numPlans > 0) {
+        cachedPlans = reallocOrExit(cachedPlans, numPlans * sizeof *cachedPlans);
+        cacheLastUses = reallocOrExit(cacheLastUses, numPlans * sizeof *cacheLastUses);
+    } else {
+        free(cachedPlans);
+        free(cacheLastUses);
+        cachedPlans = NULL;
+        cacheLastUses = NULL;
+    }
+    cacheCapacity = numPlans;
+}
+
+void setCircuitCacheCapacity(int numPlans) {
+    validateCacheCapacity(numPlans, __func__);
+
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    setCapacity(numPlans);
+}
+
+void setCircuitCacheDirectory(char* path) {
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    {
+        free(cacheDirectory);
+        cacheDirectory = NULL;
+        if (path != NULL) {
+            cacheDirectory = allocOrExit(strlen(path) + 1);
+            strcpy(cacheDirectory, path);
+        }
+    }
+}
+
+void clearCircuitCache(void) {
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    {
+        while (numCachedPlans > 0)
+            evictLeastRecentlyUsed();
+        CircuitCacheStats noStats = {0};
+        cacheStats = noStats;
+    }
+}
+
+CircuitCacheStats getCircuitCacheStats(void) {
+    CircuitCacheStats stats;
+# ifdef _OPENMP
+# pragma omp critical (QuEST_circuitCache)
+# endif
+    {
+        stats = cacheStats;
+        stats.numPlans = numCachedPlans;
+    }
+    return stats;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * The recorded form of a Circuit, shared by the functions which build, transform and run it.
+ * Not exposed to users.
+ */
+
+# ifndef QUEST_CIRCUIT_INTERNAL_H
+# define QUEST_CIRCUIT_INTERNAL_H
+
+# include "QuEST.h"
+# include "QuEST_precision.h"
+# include "QuEST_qasm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/** The gate list of a Circuit, as parallel arrays of length numGates, and the pools they index.
+ *
+ * A gate is identified by its TargetGate and number of controls, exactly as the QASM logger
+ * identifies it, so e.g. controlledNot is GATE_SIGMA_X with one control, and
+ * multiControlledPhaseFlip is GATE_SIGMA_Z with its last qubit as the target. A gate's
+ * controls, followed by its target, are stored contiguously in qubits from qubitOffsets[g],
+ * so that the multi-qubit phase gates can be passed their qubits directly.
+ *
+ * A diagonal gate may instead condition on some of its qubits being 0, as flagged by
+ * flipMasks[g]; this is how the optimiser absorbs X gates which bracket a control. Only the
+ * target of a phase gate (GATE_SIGMA_Z, GATE_S, GATE_T, GATE_PHASE_SHIFT) may be flipped, since
+ * it conditions on its target exactly as on its controls.
+ */
+struct CircuitData
+{
+    int numGates;
+    int gateCapacity;
+    TargetGate* gates;
+    int* targets;
+    int* numControls;
+    int* qubitOffsets;  // where the gate's controls, then target, begin in qubits
+    long long int* flipMasks; // bit k set if the gate's k-th qubit must be 0 rather than 1
+    qreal* angles;      // the angle of a parameterless rotation or phase gate
+    int* paramInds;     // the slot supplying the angle, or -1 if fixed
+    int* operandInds;   // the gate's entry in matrices (GATE_UNITARY) or axes (GATE_ROTATE_AROUND_AXIS), else -1
+
+    int numQubitEntries;
+    int qubitCapacity;
+    int* qubits;
+
+    int numMatrices;
+    int matrixCapacity;
+    ComplexMatrix2* matrices;
+
+    int numAxes;
+    int axisCapacity;
+    Vector* axes;
+
+    // the structural hash of the gates, valid until a gate is added
+    int isHashValid;
+    unsigned long long int hash;
+
+    // the current values of the parameter slots
+    int numParams;
+    int paramCapacity;
+    qreal* params;
+};
+
+/** the most qubits upon which consecutive diagonal gates are fused into one pass over a
+ * state-vector; a density matrix's table is the square of a state-vector's, so its runs span
+ * half as many */
+# define CIRCUIT_MAX_DIAGONAL_QUBITS 10
+# define CIRCUIT_MAX_DENSITY_DIAGONAL_QUBITS 5
+
+/** an empty gate list with no parameter slots */
+struct CircuitData* circuit_createData(void);
+
+void circuit_destroyData(struct CircuitData* data);
+
+/** replaces the gates of data with those of newGates, keeping the parameter slots of data,
+ * and frees newGates */
+void circuit_replaceGates(struct CircuitData* data, struct CircuitData* newGates);
+
+/** appends a gate, returning its index. Controls are copied, and operandIndex must already
+ * index the matrix or axis pool of data */
+int circuit_addGate(struct CircuitData* data, TargetGate gate, int* controlQubits, int numControlQubits, int targetQubit,
+    qreal angle, int paramIndex, int operandIndex);
+
+int circuit_addMatrix(struct CircuitData* data, ComplexMatrix2 u);
+
+int circuit_addAxis(struct CircuitData* data, Vector axis);
+
+/** appends a copy of gate g of src, with its matrix or axis, to dest */
+int circuit_copyGate(struct CircuitData* dest, struct CircuitData* src, int g);
+
+ComplexMatrix2 circuit_getConjugateTranspose(ComplexMatrix2 u);
+
+/** the angle gate g currently applies, from its slot if it has one */
+qreal circuit_getAngle(struct CircuitData* data, int g);
+
+/** applies gate g, or its inverse, to a state-vector or density matrix, without validation */
+void circuit_applyGate(Qureg qureg, struct CircuitData* data, int g, int isInverse);
+
+/** the bit mask of the qubits gate g acts upon */
+long long int circuit_getGateMask(struct CircuitData* data, int g);
+
+/** whether a gate of type gate conditions on its target as on its controls, applying a phase
+ * only when all of its qubits are 1 (or 0, where flipped) */
+int circuit_isPhaseGate(TargetGate gate);
+
+/** whether gate g is diagonal in the computational basis, whatever its angle */
+int circuit_isDiagonalGate(struct CircuitData* data, int g);
+
+/** the factor by which diagonal gate g, or its inverse, multiplies basis state basisState */
+Complex circuit_getDiagonalFactor(struct CircuitData* data, int g, long long int basisState, int isInverse);
+
+/** the end of the run of gates from start which are applied in one pass: one past the last
+ * consecutive diagonal gate whose qubits, together, number at most maxRunQubits, or start+1 */
+int circuit_getDiagonalRunEnd(struct CircuitData* data, int start, int maxRunQubits);
+
+/** the number of passes over a state-vector which running the circuit makes */
+int circuit_countSweeps(struct CircuitData* data);
+
+/** Tabulates the product of diagonal gates start to end-1, or of their inverses, over the basis
+ * states of the qubits they act upon, in the form statevec_applyDiagonalTable takes for qureg.
+ * For a density matrix, the table holds D[row] conj(D[col]) upon the row qubits followed by the
+ * column qubits. The tables are allocated, to be freed by the caller.
+ */
+void circuit_getDiagonalTable(struct CircuitData* data, int start, int end, int isInverse, Qureg qureg,
+    long long int* qubitMask, qreal** factorsRe, qreal** factorsIm);
+
+/** applies diagonal gates start to end-1, or their inverses, in one pass */
+void circuit_applyDiagonalRun(Qureg qureg, struct CircuitData* data, int start, int end, int isInverse);
+
+/// \cond HIDDEN_SYMBOLS
+struct CircuitPlan;
+/// \endcond
+
+/** The plan for running the gates of data upon registers of the type and size of qureg: from
+ * the in-process cache if it holds one of the same structural hash, else from the cache
+ * directory if set, else compiled and added to both.
+ */
+struct CircuitPlan* circuit_getPlan(struct CircuitData* data, Qureg qureg);
+
+/** runs plan upon qureg, binding its parameterised gates to the current slots of data */
+void circuit_runPlan(struct CircuitPlan* plan, struct CircuitData* data, Qureg qureg);
+
+/** frees plan if the cache did not keep it */
+void circuit_releasePlan(struct CircuitPlan* plan);
+
+/** adds gate g to the QASM log of qureg, if it is recording */
+void circuit_recordGateToQASM(Qureg qureg, struct CircuitData* data, int g);
+
+# ifdef __cplusplus
+}
+# endif
+
+# endif // QUEST_CIRCUIT_INTERNAL_H
@@ -0,0 +1,556 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * Optimisation passes over recorded circuits, implementing the pass functions of QuEST_circuit.h.
+ *
+ * Passes decide which gates may be moved past one another per qubit: a gate acts upon each of
+ * its qubits as Z (a control, or the target of a diagonal gate), as X (the target of pauliX or
+ * rotateX), as Y, or generally, and two gates commute if upon every qubit they share they act
+ * as the same one of Z, X or Y. Each pass marks or rewrites gates in place, then rebuilds the
+ * gate list without those removed, leaving the parameter slots untouched.
+ */
+
+# include "QuEST.h"
+# include "QuEST_circuit.h"
+# include "QuEST_circuit_internal.h"
+# include "QuEST_precision.h"
+# include "QuEST_validation.h"
+
+# include <math.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+# ifndef M_PI
+# define M_PI 3.14159265358979323846
+# endif
+
+enum qubitRole {ROLE_NONE, ROLE_Z, ROLE_X, ROLE_Y, ROLE_GENERAL};
+
+static void* allocOrExit(size_t numBytes) {
+    void* mem = calloc(numBytes, 1);
+    if (mem == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+static Qureg getValidationShape(Circuit circuit) {
+    Qureg shape = {
+        .isDensityMatrix = 0,
+        .numQubitsRepresented = circuit.numQubits,
+        .numQubitsInStateVec = circuit.numQubits,
+        .numAmpsTotal = 1LL << circuit.numQubits};
+    return shape;
+}
+
+
+/*
+ * gate properties
+ */
+
+static int* getQubits(struct CircuitData* data, int g) {
+    return &data->qubits[data->qubitOffsets[g]];
+}
+
+/** the position of qubit q among the controls then target of gate g, or -1 */
+static int findQubit(struct CircuitData* data, int g, int q) {
+    int* qubits = getQubits(data, g);
+    for (int k=0; k <= data->numControls[g]; k++)
+        if (qubits[k] == q)
+            return k;
+    return -1;
+}
+
+/** the value the k-th qubit of gate g must hold for the gate to act */
+static int getRequiredValue(struct CircuitData* data, int g, int k) {
+    return !((data->flipMasks[g] >> k) & 1);
+}
+
+static int isFixedGate(struct CircuitData* data, int g) {
+    return data->paramInds[g] < 0;
+}
+
+static int isUncontrolledX(struct CircuitData* data, int g) {
+    return data->gates[g] == GATE_SIGMA_X && data->numControls[g] == 0;
+}
+
+static enum qubitRole getRole(struct CircuitData* data, int g, int q) {
+    int k = findQubit(data, g, q);
+    if (k < 0)
+        return ROLE_NONE;
+    if (k < data->numControls[g] || circuit_isDiagonalGate(data, g))
+        return ROLE_Z;
+
+    TargetGate gate = data->gates[g];
+    if (gate == GATE_SIGMA_X || gate == GATE_ROTATE_X)
+        return ROLE_X;
+    if (gate == GATE_SIGMA_Y || gate == GATE_ROTATE_Y)
+        return ROLE_Y;
+    return ROLE_GENERAL;
+}
+
+static int gatesCommute(struct CircuitData* data, int g, int h) {
+    int* qubits = getQubits(data, g);
+    for (int k=0; k <= data->numControls[g]; k++) {
+        enum qubitRole roleH = getRole(data, h, qubits[k]);
+        if (roleH == ROLE_NONE)
+            continue;
+        enum qubitRole roleG = getRole(data, g, qubits[k]);
+        if (roleG != roleH || roleG == ROLE_GENERAL)
+            return 0;
+    }
+    return 1;
+}
+
+/** whether gates g and h condition upon and target the same qubits in the same way, so that
+ * their operators may be combined. A phase gate has no distinguished target. */
+static int haveSameSupport(struct CircuitData* data, int g, int h) {
+    int numControls = data->numControls[g];
+    int isPhase = circuit_isPhaseGate(data->gates[g]);
+    if (numControls != data->numControls[h] || isPhase != circuit_isPhaseGate(data->gates[h]))
+        return 0;
+    if (!isPhase && data->targets[g] != data->targets[h])
+        return 0;
+
+    int* qubits = getQubits(data, g);
+    for (int k=0; k <= numControls; k++) {
+        if (!isPhase && k == numControls)
+            continue;
+        int j = findQubit(data, h, qubits[k]);
+        if (j < 0 || (!isPhase && j == numControls))
+            return 0;
+        if (getRequiredValue(data, g, k) != getRequiredValue(data, h, j))
+            return 0;
+    }
+    return 1;
+}
+
+/** the phase a fixed phase gate applies */
+static qreal getPhase(struct CircuitData* data, int g) {
+    switch (data->gates[g]) {
+        case GATE_SIGMA_Z: return M_PI;
+        case GATE_S: return M_PI/2;
+        case GATE_T: return M_PI/4;
+        default: return data->angles[g];
+    }
+}
+
+static int isMultipleOf(qreal angle, qreal period) {
+    qreal rem = fmod(fabs(angle), period);
+    return rem < REAL_EPS || period - rem < REAL_EPS;
+}
+
+static int areEqualVectors(Vector a, Vector b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+/** the matrix of u then v, i.e. v u */
+static ComplexMatrix2 getProduct(ComplexMatrix2 v, ComplexMatrix2 u) {
+    Complex* vRows[2][2] = {{&v.r0c0, &v.r0c1}, {&v.r1c0, &v.r1c1}};
+    Complex* uRows[2][2] = {{&u.r0c0, &u.r0c1}, {&u.r1c0, &u.r1c1}};
+    ComplexMatrix2 prod;
+    Complex* prodRows[2][2] = {{&prod.r0c0, &prod.r0c1}, {&prod.r1c0, &prod.r1c1}};
+    for (int r=0; r < 2; r++) {
+        for (int c=0; c < 2; c++) {
+            Complex* a0 = vRows[r][0]; Complex* b0 = uRows[0][c];
+            Complex* a1 = vRows[r][1]; Complex* b1 = uRows[1][c];
+            prodRows[r][c]->real = a0->real*b0->real - a0->imag*b0->imag + a1->real*b1->real - a1->imag*b1->imag;
+            prodRows[r][c]->imag = a0->real*b0->imag + a0->imag*b0->real + a1->real*b1->imag + a1->imag*b1->real;
+        }
+    }
+    return prod;
+}
+
+static int isIdentity(ComplexMatrix2 u) {
+    return fabs(u.r0c0.real - 1) < REAL_EPS && fabs(u.r0c0.imag) < REAL_EPS
+        && fabs(u.r0c1.real) < REAL_EPS && fabs(u.r0c1.imag) < REAL_EPS
+        && fabs(u.r1c0.real) < REAL_EPS && fabs(u.r1c0.imag) < REAL_EPS
+        && fabs(u.r1c1.real - 1) < REAL_EPS && fabs(u.r1c1.imag) < REAL_EPS;
+}
+
+/** whether fixed gates g then h, with the same support, combine to the identity */
+static int areInverses(struct CircuitData* data, int g, int h) {
+    if (!isFixedGate(data, g) || !isFixedGate(data, h) || !haveSameSupport(data, g, h))
+        return 0;
+
+    TargetGate gate = data->gates[g];
+    if (circuit_isPhaseGate(gate))
+        return isMultipleOf(getPhase(data, g) + getPhase(data, h), 2*M_PI);
+    if (gate != data->gates[h])
+        return 0;
+    if (gate == GATE_HADAMARD || gate == GATE_SIGMA_X || gate == GATE_SIGMA_Y)
+        return 1;
+    if (gate == GATE_ROTATE_X || gate == GATE_ROTATE_Y || gate == GATE_ROTATE_Z)
+        return isMultipleOf(data->angles[g] + data->angles[h], 4*M_PI);
+    if (gate == GATE_ROTATE_AROUND_AXIS)
+        return areEqualVectors(data->axes[data->operandInds[g]], data->axes[data->operandInds[h]])
+            && isMultipleOf(data->angles[g] + data->angles[h], 4*M_PI);
+    if (gate == GATE_UNITARY)
+        return isIdentity(getProduct(data->matrices[data->operandInds[h]], data->matrices[data->operandInds[g]]));
+    return 0;
+}
+
+/** whether fixed gates g then h, with the same support, combine into one gate of g's kind */
+static int areMergeable(struct CircuitData* data, int g, int h) {
+    if (!isFixedGate(data, g) || !isFixedGate(data, h) || !haveSameSupport(data, g, h))
+        return 0;
+
+    TargetGate gate = data->gates[g];
+    if (circuit_isPhaseGate(gate))
+        return 1;
+    if (gate != data->gates[h])
+        return 0;
+    if (gate == GATE_ROTATE_AROUND_AXIS)
+        return areEqualVectors(data->axes[data->operandInds[g]], data->axes[data->operandInds[h]]);
+    return gate == GATE_ROTATE_X || gate == GATE_ROTATE_Y || gate == GATE_ROTATE_Z || gate == GATE_UNITARY;
+}
+
+/** The latest gate before h, not yet removed, for which isPartner(data, gate, h) holds and
+ * which h can be moved back to by commutation, or -1 */
+static int findEarlierPartner(struct CircuitData* data, int* isRemoved, int h,
+    int (*isPartner)(struct CircuitData*, int, int)
+) {
+    long long int mask = circuit_getGateMask(data, h);
+    for (int g=h-1; g >= 0; g--) {
+        if (isRemoved[g] || !(mask & circuit_getGateMask(data, g)))
+            continue;
+        if (isPartner(data, g, h))
+            return g;
+        if (!gatesCommute(data, g, h))
+            return -1;
+    }
+    return -1;
+}
+
+
+/*
+ * rewriting gates
+ */
+
+/** removes the k-th qubit from gate g; if it was the target of a phase gate, the last remaining
+ * qubit becomes the target */
+static void removeQubit(struct CircuitData* data, int g, int k) {
+    int* qubits = getQubits(data, g);
+    int numQubits = data->numControls[g] + 1;
+    for (int j=k; j < numQubits-1; j++)
+        qubits[j] = qubits[j+1];
+
+    long long int flips = data->flipMasks[g];
+    data->flipMasks[g] = (flips & ((1LL << k) - 1)) | ((flips >> (k+1)) << k);
+    data->numControls[g]--;
+    data->targets[g] = qubits[numQubits-2];
+}
+
+/** replaces fixed gate g with its inverse */
+static void invertGate(struct CircuitData* data, int g) {
+    switch (data->gates[g]) {
+        case GATE_S:
+        case GATE_T:
+            data->angles[g] = -getPhase(data, g);
+            data->gates[g] = GATE_PHASE_SHIFT;
+            break;
+        case GATE_PHASE_SHIFT:
+        case GATE_ROTATE_X:
+        case GATE_ROTATE_Y:
+        case GATE_ROTATE_Z:
+        case GATE_ROTATE_AROUND_AXIS:
+            data->angles[g] = -data->angles[g];
+            break;
+        case GATE_UNITARY:
+            data->operandInds[g] = circuit_addMatrix(data,
+                circuit_getConjugateTranspose(data->matrices[data->operandInds[g]]));
+            break;
+        default:
+            break;
+    }
+}
+
+/** replaces diagonal gate g, acting upon qubit q as Z, with X_q g X_q */
+static void conjugateByX(struct CircuitData* data, int g, int q) {
+    int k = findQubit(data, g, q);
+    if (k < data->numControls[g] || circuit_isPhaseGate(data->gates[g])) {
+        data->flipMasks[g] ^= 1LL << k;
+    }
+    else if (data->gates[g] == GATE_ROTATE_Z) {
+        data->angles[g] = -data->angles[g];
+    }
+    else {
+        ComplexMatrix2 u = data->matrices[data->operandInds[g]];
+        Complex diag = u.r0c0;
+        u.r0c0 = u.r1c1;
+        u.r1c1 = diag;
+        data->operandInds[g] = circuit_addMatrix(data, u);
+    }
+}
+
+/** replaces the gates of data with those not flagged in isRemoved, in their current order */
+static void removeFlaggedGates(struct CircuitData* data, int* isRemoved) {
+    struct CircuitData* newData = circuit_createData();
+    for (int g=0; g < data->numGates; g++)
+        if (!isRemoved[g])
+            circuit_copyGate(newData, data, g);
+    circuit_replaceGates(data, newData);
+}
+
+static CircuitPassStats beginPass(struct CircuitData* data) {
+    CircuitPassStats stats;
+    stats.numGatesBefore = data->numGates;
+    stats.numSweepsBefore = circuit_countSweeps(data);
+    return stats;
+}
+
+static CircuitPassStats endPass(struct CircuitData* data, CircuitPassStats stats) {
+    stats.numGatesAfter = data->numGates;
+    stats.numSweepsAfter = circuit_countSweeps(data);
+    return stats;
+}
+
+
+/*
+ * passes
+ */
+
+CircuitPassStats cancelCircuitInversePairs(Circuit circuit) {
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    // each gate is matched against the surviving gates before it, so nested pairs cancel inwards-out
+    int* isRemoved = allocOrExit(data->numGates * sizeof *isRemoved);
+    for (int h=0; h < data->numGates; h++) {
+        int g = findEarlierPartner(data, isRemoved, h, areInverses);
+        if (g >= 0)
+            isRemoved[g] = isRemoved[h] = 1;
+    }
+
+    removeFlaggedGates(data, isRemoved);
+    free(isRemoved);
+    return endPass(data, stats);
+}
+
+CircuitPassStats mergeCircuitRotations(Circuit circuit) {
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    // h is absorbed into the earlier gate g, since h commutes with every gate between them
+    int* isRemoved = allocOrExit(data->numGates * sizeof *isRemoved);
+    for (int h=0; h < data->numGates; h++) {
+        int g = findEarlierPartner(data, isRemoved, h, areMergeable);
+        if (g < 0)
+            continue;
+        isRemoved[h] = 1;
+
+        int isIdentityGate;
+        if (circuit_isPhaseGate(data->gates[g])) {
+            data->angles[g] = getPhase(data, g) + getPhase(data, h);
+            data->gates[g] = GATE_PHASE_SHIFT;
+            isIdentityGate = isMultipleOf(data->angles[g], 2*M_PI);
+        }
+        else if (data->gates[g] == GATE_UNITARY) {
+            ComplexMatrix2 prod = getProduct(data->matrices[data->operandInds[h]], data->matrices[data->operandInds[g]]);
+            data->operandInds[g] = circuit_addMatrix(data, prod);
+            isIdentityGate = isIdentity(prod);
+        }
+        else {
+            data->angles[g] += data->angles[h];
+            isIdentityGate = isMultipleOf(data->angles[g], 4*M_PI);
+        }
+        if (isIdentityGate)
+            isRemoved[g] = 1;
+    }
+
+    removeFlaggedGates(data, isRemoved);
+    free(isRemoved);
+    return endPass(data, stats);
+}
+
+CircuitPassStats commuteCircuitDiagonals(Circuit circuit) {
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    int numGates = data->numGates;
+    int* order = allocOrExit(numGates * sizeof *order);
+    for (int i=0; i < numGates; i++)
+        order[i] = i;
+
+    // each diagonal gate moves back to just after the nearest earlier diagonal gate, if every
+    // gate between them commutes with it
+    for (int p=1; p < numGates; p++) {
+        int g = order[p];
+        if (!circuit_isDiagonalGate(data, g))
+            continue;
+
+        int dest = -1;
+        for (int i=p-1; i >= 0; i--) {
+            if (circuit_isDiagonalGate(data, order[i])) {
+                dest = i+1;
+                break;
+            }
+            if (!gatesCommute(data, g, order[i]))
+                break;
+        }
+        if (dest >= 0 && dest < p) {
+            memmove(&order[dest+1], &order[dest], (p - dest) * sizeof *order);
+            order[dest] = g;
+        }
+    }
+
+    struct CircuitData* newData = circuit_createData();
+    for (int i=0; i < numGates; i++)
+        circuit_copyGate(newData, data, order[i]);
+    if (circuit_countSweeps(newData) < stats.numSweepsBefore)
+        circuit_replaceGates(data, newData);
+    else
+        circuit_destroyData(newData);
+
+    free(order);
+    return endPass(data, stats);
+}
+
+CircuitPassStats rewriteCircuitConjugatedControls(Circuit circuit) {
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    int numGates = data->numGates;
+    int* isRemoved = allocOrExit(numGates * sizeof *isRemoved);
+    int* bracketed = allocOrExit(numGates * sizeof *bracketed);
+    int* splitQubits = allocOrExit(numGates * sizeof *splitQubits);
+    for (int g=0; g < numGates; g++)
+        splitQubits[g] = -1;
+
+    for (int g=0; g < numGates; g++) {
+        if (isRemoved[g] || !isUncontrolledX(data, g))
+            continue;
+
+        // find the closing X, through gates which use the qubit only as Z, at most one non-diagonally
+        int q = data->targets[g];
+        int end = -1;
+        int numBracketed = 0;
+        int numSplit = 0;
+        for (int h=g+1; h < numGates; h++) {
+            if (isRemoved[h] || !((circuit_getGateMask(data, h) >> q) & 1))
+                continue;
+            if (isUncontrolledX(data, h)) {
+                end = h;
+                break;
+            }
+            if (!isFixedGate(data, h) || splitQubits[h] >= 0 || getRole(data, h, q) != ROLE_Z)
+                break;
+            if (!circuit_isDiagonalGate(data, h) && numSplit++ > 0)
+                break;
+            bracketed[numBracketed++] = h;
+        }
+        if (end < 0)
+            continue;
+
+        isRemoved[g] = isRemoved[end] = 1;
+        for (int i=0; i < numBracketed; i++) {
+            int h = bracketed[i];
+            if (circuit_isDiagonalGate(data, h))
+                conjugateByX(data, h, q);
+            else
+                splitQubits[h] = q;
+        }
+    }
+
+    // U conditioned upon qubit q being 0 is U upon the other controls, then U^dagger upon all
+    struct CircuitData* newData = circuit_createData();
+    for (int g=0; g < numGates; g++) {
+        if (isRemoved[g])
+            continue;
+        int h = circuit_copyGate(newData, data, g);
+        if (splitQubits[g] < 0)
+            continue;
+        removeQubit(newData, h, findQubit(newData, h, splitQubits[g]));
+        h = circuit_copyGate(newData, data, g);
+        invertGate(newData, h);
+    }
+    circuit_replaceGates(data, newData);
+
+    free(isRemoved);
+    free(bracketed);
+    free(splitQubits);
+    return endPass(data, stats);
+}
+
+CircuitPassStats propagateCircuitConstants(Circuit circuit, long long int* inputStateInd) {
+    validateStateIndex(getValidationShape(circuit), *inputStateInd, __func__);
+
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    // the values of the qubits still in a basis state, and whether any kept gate has used them
+    long long int values = *inputStateInd;
+    int* isKnown = allocOrExit(circuit.numQubits * sizeof *isKnown);
+    int* isUsed = allocOrExit(circuit.numQubits * sizeof *isUsed);
+    int* isRemoved = allocOrExit(data->numGates * sizeof *isRemoved);
+    for (int q=0; q < circuit.numQubits; q++)
+        isKnown[q] = 1;
+
+    for (int g=0; g < data->numGates; g++) {
+        int* qubits = getQubits(data, g);
+        int numConditions = data->numControls[g] + circuit_isPhaseGate(data->gates[g]);
+
+        // a condition known to fail makes the gate the identity
+        for (int k=0; k < numConditions; k++)
+            if (isKnown[qubits[k]] && ((values >> qubits[k]) & 1) != getRequiredValue(data, g, k))
+                isRemoved[g] = 1;
+        if (isRemoved[g])
+            continue;
+
+        // conditions known to hold are dropped, though a phase gate keeps one qubit
+        for (int k=numConditions-1; k >= 0; k--)
+            if (isKnown[qubits[k]] && data->numControls[g] > 0)
+                removeQubit(data, g, k);
+
+        int target = data->targets[g];
+        if (isUncontrolledX(data, g) && isKnown[target] && !isUsed[target]) {
+            *inputStateInd ^= 1LL << target;
+            values ^= 1LL << target;
+            isRemoved[g] = 1;
+            continue;
+        }
+
+        if (!circuit_isDiagonalGate(data, g)) {
+            TargetGate gate = data->gates[g];
+            if ((gate == GATE_SIGMA_X || gate == GATE_SIGMA_Y) && data->numControls[g] == 0 && isKnown[target])
+                values ^= 1LL << target;
+            else
+                isKnown[target] = 0;
+        }
+        for (int k=0; k <= data->numControls[g]; k++)
+            isUsed[qubits[k]] = 1;
+    }
+
+    removeFlaggedGates(data, isRemoved);
+    free(isKnown);
+    free(isUsed);
+    free(isRemoved);
+    return endPass(data, stats);
+}
+
+CircuitPassStats optimiseCircuit(Circuit circuit) {
+    struct CircuitData* data = circuit.data;
+    CircuitPassStats stats = beginPass(data);
+
+    int numGates, numSweeps;
+    do {
+        numGates = data->numGates;
+        numSweeps = circuit_countSweeps(data);
+        rewriteCircuitConjugatedControls(circuit);
+        cancelCircuitInversePairs(circuit);
+        mergeCircuitRotations(circuit);
+        commuteCircuitDiagonals(circuit);
+    } while (data->numGates < numGates || circuit_countSweeps(data) < numSweeps);
+
+    return endPass(data, stats);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -102,7 +102,26 @@ void shiftIndices(int* indices, int numIndices, int shift) {
         indices[j] += shift;
 }
 
-int generateMeasurementOutcome(qreal zeroProb, qreal *outcomeProb) {
+/** Draws a random number in [0, 1] from the given generator, which belongs to a single register */
+static qreal getRandomReal(struct MTState* rng) {
+    return genrand_real1(rng);
+}
+
+struct MTState* createRandomGenerator(QuESTEnv env) {
+    struct MTState* rng = malloc(sizeof *rng);
+    if (rng == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    init_by_array(rng, env.seeds, env.numSeeds);
+    return rng;
+}
+
+void destroyRandomGenerator(struct MTState* rng) {
+    free(rng);
+}
+
+int generateMeasurementOutcome(struct MTState* rng, qreal zeroProb, qreal *outcomeProb) {
     
     // randomly choose outcome
     int outcome;
@@ -111,7 +130,7 @@ int generateMeasurementOutcome(qreal zeroProb, qreal *outcomeProb) {
     else if (1-zeroProb < REAL_EPS) 
         outcome = 0;
     else
-        outcome = (genrand_real1() > zeroProb);
+        outcome = (getRandomReal(rng) > zeroProb);
     
     // set probability of outcome
     if (outcome == 0)
@@ -152,14 +171,14 @@ void getQuESTDefaultSeedKey(unsigned long int *key){
     key[0] = msecs; key[1] = pid; key[2] = hostNameInt;
 }
 
-/** 
- * numSeeds <= 64
- */
-void seedQuEST(unsigned long int *seedArray, int numSeeds){
-    // init MT random number generator with user defined list of seeds
-    // for the MPI version, it is ok that all procs will get the same seed as random numbers will only be 
-    // used by the master process
-    init_by_array(seedArray, numSeeds); 
+void seedQuEST(QuESTEnv *env, unsigned long int *seedArray, int numSeeds){
+    validateNumSeeds(numSeeds, __func__);
+    
+    // record the keys with which every subsequently created register's generator is seeded
+    // for the MPI version, all procs must be given the same keys so that they draw the same numbers
+    for (int i=0; i < numSeeds; i++)
+        env->seeds[i] = seedArray[i];
+    env->numSeeds = numSeeds;
 }
 
 qreal statevec_getProbAmp(Qureg qureg, long long int index){
@@ -186,6 +205,107 @@ void reportState(Qureg qureg){
     fclose(state);
 }
 
+/** The longest file name of a checkpoint, including its prefix */
+# define MAX_CHECKPOINT_FILENAME_LEN 1024
+
+/** Writes this rank's chunk to its own file of the checkpoint, as its real then its imaginary 
+ * amplitudes in binary, so that every rank writes concurrently. Returns 0 if the file could not 
+ * be wholly written.
+ */
+int writeCheckpointChunk(Qureg qureg, char* prefix) {
+    char filename[MAX_CHECKPOINT_FILENAME_LEN];
+    snprintf(filename, sizeof filename, "%s_chunk_%d.bin", prefix, qureg.chunkId);
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+        return 0;
+    
+    size_t numAmps = qureg.numAmpsPerChunk;
+    int success = fwrite(qureg.stateVec.real, sizeof(qreal), numAmps, file) == numAmps
+        && fwrite(qureg.stateVec.imag, sizeof(qreal), numAmps, file) == numAmps;
+    return (fclose(file) == 0) && success;
+}
+
+/** Writes the manifest of a checkpoint, describing the register and how it was divided into files. 
+ * It is written to a temporary file which is then renamed, so that no partial manifest ever exists */
+int writeCheckpointManifest(Qureg qureg, char* prefix) {
+    char filename[MAX_CHECKPOINT_FILENAME_LEN];
+    char tempName[MAX_CHECKPOINT_FILENAME_LEN];
+    snprintf(filename, sizeof filename, "%s.manifest", prefix);
+    snprintf(tempName, sizeof tempName, "%s.manifest.tmp", prefix);
+    FILE* file = fopen(tempName, "w");
+    if (file == NULL)
+        return 0;
+    
+    fprintf(file, "QuEST checkpoint\n");
+    fprintf(file, "numQubitsRepresented %d\n", qureg.numQubitsRepresented);
+    fprintf(file, "isDensityMatrix %d\n", qureg.isDensityMatrix);
+    fprintf(file, "numChunks %d\n", qureg.numChunks);
+    fprintf(file, "qrealBytes %d\n", (int) sizeof(qreal));
+    if (fclose(file) != 0 || rename(tempName, filename) != 0) {
+        remove(tempName);
+        return 0;
+    }
+    return 1;
+}
+
+/** Removes the manifest of any earlier checkpoint of the same prefix, so that its chunks can be 
+ * overwritten without a manifest vouching for them */
+void removeCheckpointManifest(char* prefix) {
+    char filename[MAX_CHECKPOINT_FILENAME_LEN];
+    snprintf(filename, sizeof filename, "%s.manifest", prefix);
+    remove(filename);
+}
+
+/** Reads the manifest of a checkpoint, returning 0 if it is absent or malformed */
+int readCheckpointManifest(char* prefix, CheckpointManifest* manifest) {
+    char filename[MAX_CHECKPOINT_FILENAME_LEN];
+    snprintf(filename, sizeof filename, "%s.manifest", prefix);
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+        return 0;
+    
+    int numRead = fscanf(file, "QuEST checkpoint numQubitsRepresented %d isDensityMatrix %d numChunks %d qrealBytes %d",
+        &manifest->numQubitsRepresented, &manifest->isDensityMatrix, &manifest->numChunks, &manifest->qrealBytes);
+    fclose(file);
+    return (numRead == 4);
+}
+
+/** Reads this rank's chunk from a checkpoint divided into numSavedChunks files, which need not be 
+ * the number of ranks: each rank seeks to and reads only the part of each file overlapping its chunk, 
+ * so that the amplitudes are redistributed without any communication. Returns 0 if a file could not 
+ * be wholly read.
+ */
+int readCheckpointChunk(Qureg qureg, char* prefix, int numSavedChunks) {
+    long long int savedChunkSize = qureg.numAmpsTotal / numSavedChunks;
+    long long int chunkStart = qureg.chunkId * qureg.numAmpsPerChunk;
+    long long int chunkEnd = chunkStart + qureg.numAmpsPerChunk;
+    char filename[MAX_CHECKPOINT_FILENAME_LEN];
+    
+    for (long long int start=chunkStart; start < chunkEnd; ) {
+        int savedChunkId = (int) (start / savedChunkSize);
+        long long int savedStart = savedChunkId * savedChunkSize;
+        long long int end = (savedStart + savedChunkSize < chunkEnd)? savedStart + savedChunkSize : chunkEnd;
+        size_t numAmps = end - start;
+        
+        snprintf(filename, sizeof filename, "%s_chunk_%d.bin", prefix, savedChunkId);
+        FILE* file = fopen(filename, "rb");
+        if (file == NULL)
+            return 0;
+        
+        long realOffset = (start - savedStart) * sizeof(qreal);
+        long imagOffset = realOffset + savedChunkSize * sizeof(qreal);
+        int success = fseek(file, realOffset, SEEK_SET) == 0
+            && fread(&qureg.stateVec.real[start - chunkStart], sizeof(qreal), numAmps, file) == numAmps
+            && fseek(file, imagOffset, SEEK_SET) == 0
+            && fread(&qureg.stateVec.imag[start - chunkStart], sizeof(qreal), numAmps, file) == numAmps;
+        fclose(file);
+        if (!success)
+            return 0;
+        start = end;
+    }
+    return 1;
+}
+
 void reportQuregParams(Qureg qureg){
     long long int numAmps = 1L << qureg.numQubitsInStateVec;
     long long int numAmpsPerRank = numAmps/qureg.numChunks;
@@ -307,10 +427,253 @@ void statevec_controlledRotateZ(Qureg qureg, const int controlQubit, const int t
     statevec_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, unitAxis);
 }
 
+/** Applies the Kraus map by building its superoperator sum_i conj(K_i) (x) K_i once, then handing it to
+ * the backend to apply in a single pass. Element (out, in) of the superoperator is at out*dim^2 + in, 
+ * where the index of amplitude (row, col) of the targets' block is row + col*dim, as the column qubits
+ * are the more significant in the flattened density matrix.
+ */
+void densmatr_applyKrausMap(Qureg qureg, int* targets, const int numTargets, Complex* ops, const int numOps) {
+    
+    int dim = 1 << numTargets;
+    int superDim = dim*dim;
+    qreal superRe[16*16], superIm[16*16];
+    
+    for (int rowOut=0; rowOut < dim; rowOut++) {
+        for (int colOut=0; colOut < dim; colOut++) {
+            for (int rowIn=0; rowIn < dim; rowIn++) {
+                for (int colIn=0; colIn < dim; colIn++) {
+                    
+                    // sum_i K_i[rowOut][rowIn] conj(K_i[colOut][colIn])
+                    qreal re=0, im=0;
+                    for (int i=0; i < numOps; i++) {
+                        Complex a = ops[i*superDim + rowOut*dim + rowIn];
+                        Complex b = ops[i*superDim + colOut*dim + colIn];
+                        re += a.real*b.real + a.imag*b.imag;
+                        im += a.imag*b.real - a.real*b.imag;
+                    }
+                    int ind = (rowOut + colOut*dim)*superDim + (rowIn + colIn*dim);
+                    superRe[ind] = re;
+                    superIm[ind] = im;
+                }
+            }
+        }
+    }
+    
+    densmatr_applyKrausSuperoperator(qureg, targets, numTargets, superRe, superIm);
+}
+
+ComplexMatrix2 getMatrixFromComplexPair(Complex alpha, Complex beta) {
+    
+    ComplexMatrix2 u;
+    u.r0c0 = alpha;
+    u.r0c1.real = - beta.real;
+    u.r0c1.imag =   beta.imag;
+    u.r1c0 = beta;
+    u.r1c1.real =   alpha.real;
+    u.r1c1.imag = - alpha.imag;
+    return u;
+}
+
+/* 
+ * single-target gates upon density matrices, which all reduce to a multi-controlled unitary 
+ * applied as U (x) conj(U) in a single pass by the backend 
+ */
+
+void densmatr_unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u) {
+    
+    densmatr_multiControlledUnitary(qureg, NULL, 0, targetQubit, u);
+}
+
+void densmatr_controlledUnitary(Qureg qureg, const int controlQubit, const int targetQubit, ComplexMatrix2 u) {
+    
+    int controlQubits[1] = {controlQubit};
+    densmatr_multiControlledUnitary(qureg, controlQubits, 1, targetQubit, u);
+}
+
+void densmatr_compactUnitary(Qureg qureg, const int targetQubit, Complex alpha, Complex beta) {
+    
+    densmatr_unitary(qureg, targetQubit, getMatrixFromComplexPair(alpha, beta));
+}
+
+void densmatr_controlledCompactUnitary(Qureg qureg, const int controlQubit, const int targetQubit, Complex alpha, Complex beta) {
+    
+    densmatr_controlledUnitary(qureg, controlQubit, targetQubit, getMatrixFromComplexPair(alpha, beta));
+}
+
+static ComplexMatrix2 getPauliXMatrix(void) {
+    
+    ComplexMatrix2 u = {{0}};
+    u.r0c1.real = 1;
+    u.r1c0.real = 1;
+    return u;
+}
+
+static ComplexMatrix2 getPauliYMatrix(void) {
+    
+    ComplexMatrix2 u = {{0}};
+    u.r0c1.imag = -1;
+    u.r1c0.imag =  1;
+    return u;
+}
+
+static ComplexMatrix2 getPhaseMatrix(Complex term) {
+    
+    ComplexMatrix2 u = {{0}};
+    u.r0c0.real = 1;
+    u.r1c1 = term;
+    return u;
+}
+
+void densmatr_hadamard(Qureg qureg, const int targetQubit) {
+    
+    qreal fac = 1/sqrt(2);
+    ComplexMatrix2 u = {{0}};
+    u.r0c0.real = fac;
+    u.r0c1.real = fac;
+    u.r1c0.real = fac;
+    u.r1c1.real = -fac;
+    densmatr_unitary(qureg, targetQubit, u);
+}
+
+void densmatr_pauliX(Qureg qureg, const int targetQubit) {
+    
+    densmatr_unitary(qureg, targetQubit, getPauliXMatrix());
+}
+
+void densmatr_pauliY(Qureg qureg, const int targetQubit) {
+    
+    densmatr_unitary(qureg, targetQubit, getPauliYMatrix());
+}
+
+void densmatr_phaseShiftByTerm(Qureg qureg, const int targetQubit, Complex term) {
+    
+    densmatr_unitary(qureg, targetQubit, getPhaseMatrix(term));
+}
+
+void densmatr_phaseShift(Qureg qureg, const int targetQubit, qreal angle) {
+    Complex term; 
+    term.real = cos(angle); 
+    term.imag = sin(angle);
+    densmatr_phaseShiftByTerm(qureg, targetQubit, term);
+}
+
+void densmatr_pauliZ(Qureg qureg, const int targetQubit) {
+    Complex term; 
+    term.real = -1;
+    term.imag =  0;
+    densmatr_phaseShiftByTerm(qureg, targetQubit, term);
+}
+
+void densmatr_sGate(Qureg qureg, const int targetQubit) {
+    Complex term; 
+    term.real = 0;
+    term.imag = 1;
+    densmatr_phaseShiftByTerm(qureg, targetQubit, term);
+}
+
+void densmatr_tGate(Qureg qureg, const int targetQubit) {
+    Complex term; 
+    term.real = 1/sqrt(2);
+    term.imag = 1/sqrt(2);
+    densmatr_phaseShiftByTerm(qureg, targetQubit, term);
+}
+
+void densmatr_controlledNot(Qureg qureg, const int controlQubit, const int targetQubit) {
+    
+    densmatr_controlledUnitary(qureg, controlQubit, targetQubit, getPauliXMatrix());
+}
+
+void densmatr_controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit) {
+    
+    densmatr_controlledUnitary(qureg, controlQubit, targetQubit, getPauliYMatrix());
+}
+
+void densmatr_controlledPhaseShift(Qureg qureg, const int idQubit1, const int idQubit2, qreal angle) {
+    Complex term; 
+    term.real = cos(angle); 
+    term.imag = sin(angle);
+    densmatr_controlledUnitary(qureg, idQubit1, idQubit2, getPhaseMatrix(term));
+}
+
+void densmatr_multiControlledPhaseShift(Qureg qureg, int *controlQubits, int numControlQubits, qreal angle) {
+    Complex term; 
+    term.real = cos(angle); 
+    term.imag = sin(angle);
+    
+    // the gate is diagonal, so any one of the qubits can be treated as the target
+    densmatr_multiControlledUnitary(qureg, 
+        controlQubits, numControlQubits-1, controlQubits[numControlQubits-1], getPhaseMatrix(term));
+}
+
+void densmatr_controlledPhaseFlip(Qureg qureg, const int idQubit1, const int idQubit2) {
+    Complex term; 
+    term.real = -1;
+    term.imag =  0;
+    densmatr_controlledUnitary(qureg, idQubit1, idQubit2, getPhaseMatrix(term));
+}
+
+void densmatr_multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numControlQubits) {
+    Complex term; 
+    term.real = -1;
+    term.imag =  0;
+    densmatr_multiControlledUnitary(qureg, 
+        controlQubits, numControlQubits-1, controlQubits[numControlQubits-1], getPhaseMatrix(term));
+}
+
+void densmatr_rotateX(Qureg qureg, const int rotQubit, qreal angle) {
+    
+    Vector unitAxis = {1, 0, 0};
+    densmatr_rotateAroundAxis(qureg, rotQubit, angle, unitAxis);
+}
+
+void densmatr_rotateY(Qureg qureg, const int rotQubit, qreal angle) {
+    
+    Vector unitAxis = {0, 1, 0};
+    densmatr_rotateAroundAxis(qureg, rotQubit, angle, unitAxis);
+}
+
+void densmatr_rotateZ(Qureg qureg, const int rotQubit, qreal angle) {
+    
+    Vector unitAxis = {0, 0, 1};
+    densmatr_rotateAroundAxis(qureg, rotQubit, angle, unitAxis);
+}
+
+void densmatr_rotateAroundAxis(Qureg qureg, const int rotQubit, qreal angle, Vector axis) {
+    
+    Complex alpha, beta;
+    getComplexPairFromRotation(angle, axis, &alpha, &beta);
+    densmatr_compactUnitary(qureg, rotQubit, alpha, beta);
+}
+
+void densmatr_controlledRotateX(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    
+    Vector unitAxis = {1, 0, 0};
+    densmatr_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, unitAxis);
+}
+
+void densmatr_controlledRotateY(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    
+    Vector unitAxis = {0, 1, 0};
+    densmatr_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, unitAxis);
+}
+
+void densmatr_controlledRotateZ(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    
+    Vector unitAxis = {0, 0, 1};
+    densmatr_controlledRotateAroundAxis(qureg, controlQubit, targetQubit, angle, unitAxis);
+}
+
+void densmatr_controlledRotateAroundAxis(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle, Vector axis) {
+    
+    Complex alpha, beta;
+    getComplexPairFromRotation(angle, axis, &alpha, &beta);
+    densmatr_controlledCompactUnitary(qureg, controlQubit, targetQubit, alpha, beta);
+}
+
 int statevec_measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb) {
     
     qreal zeroProb = statevec_calcProbOfOutcome(qureg, measureQubit, 0);
-    int outcome = generateMeasurementOutcome(zeroProb, outcomeProb);
+    int outcome = generateMeasurementOutcome(qureg.rng, zeroProb, outcomeProb);
     statevec_collapseToKnownProbOutcome(qureg, measureQubit, outcome, *outcomeProb);
     return outcome;
 }
@@ -318,11 +681,227 @@ int statevec_measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb)
 int densmatr_measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb) {
     
     qreal zeroProb = densmatr_calcProbOfOutcome(qureg, measureQubit, 0);
-    int outcome = generateMeasurementOutcome(zeroProb, outcomeProb);
+    int outcome = generateMeasurementOutcome(qureg.rng, zeroProb, outcomeProb);
     densmatr_collapseToKnownProbOutcome(qureg, measureQubit, outcome, *outcomeProb);
     return outcome;
 }
 
+/*
+ * noise channels upon state-vectors, each of which samples a single quantum trajectory.
+ * Every rank draws the same random numbers, so distributed registers choose the same branch.
+ */
+
+/** Returns which of numBranches equally likely errors occurs, or -1 if none does (with probability 1-prob) */
+static int chooseErrorBranch(Qureg qureg, qreal prob, int numBranches) {
+    qreal r = getRandomReal(qureg.rng);
+    if (r >= prob)
+        return -1;
+    
+    // r/prob is uniform in [0, 1)
+    int branch = (int) (numBranches * r / prob);
+    return (branch < numBranches)? branch : numBranches-1;
+}
+
+/** Applies Pauli 1=X, 2=Y or 3=Z to targetQubit, or nothing for 0 */
+static void applyPauli(Qureg qureg, const int targetQubit, int pauli) {
+    if (pauli == 1)
+        statevec_pauliX(qureg, targetQubit);
+    else if (pauli == 2)
+        statevec_pauliY(qureg, targetQubit);
+    else if (pauli == 3)
+        statevec_pauliZ(qureg, targetQubit);
+}
+
+void statevec_oneQubitDephaseTrajectory(Qureg qureg, const int targetQubit, qreal prob) {
+    
+    if (chooseErrorBranch(qureg, prob, 1) == 0)
+        statevec_pauliZ(qureg, targetQubit);
+}
+
+void statevec_twoQubitDephaseTrajectory(Qureg qureg, const int qubit1, const int qubit2, qreal prob) {
+    
+    // branches 0, 1, 2 are Z1, Z2 and Z1 Z2
+    int branch = chooseErrorBranch(qureg, prob, 3);
+    if (branch == 0 || branch == 2)
+        statevec_pauliZ(qureg, qubit1);
+    if (branch == 1 || branch == 2)
+        statevec_pauliZ(qureg, qubit2);
+}
+
+void statevec_oneQubitDepolariseTrajectory(Qureg qureg, const int targetQubit, qreal prob) {
+    
+    int branch = chooseErrorBranch(qureg, prob, 3);
+    applyPauli(qureg, targetQubit, branch + 1);
+}
+
+void statevec_twoQubitDepolariseTrajectory(Qureg qureg, const int qubit1, const int qubit2, qreal prob) {
+    
+    // branch+1 in [1, 15] encodes the Paulis upon qubit1 and qubit2 in base 4, excluding II
+    int branch = chooseErrorBranch(qureg, prob, 15);
+    if (branch == -1)
+        return;
+    applyPauli(qureg, qubit1, (branch + 1) % 4);
+    applyPauli(qureg, qubit2, (branch + 1) / 4);
+}
+
+/** Simulates trajectories firstTrajectory to firstTrajectory+numTrajectories-1 in turn upon a single 
+ * register, adding their observables to sums. Trajectory t is seeded with the keys of env followed 
+ * by t, so its outcomes do not depend upon which thread or in what order it is simulated.
+ */
+void sumTrajectories(QuESTEnv env, int numQubits, int firstTrajectory, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* sums) 
+{
+    for (int o=0; o < numObservables; o++)
+        sums[o] = 0;
+    if (numTrajectories == 0)
+        return;
+    
+    qreal* values = malloc(numObservables * sizeof *values);
+    Qureg qureg = createQureg(numQubits, env);
+    
+    unsigned long int keys[MAX_NUM_SEEDS+1];
+    for (int i=0; i < env.numSeeds; i++)
+        keys[i] = env.seeds[i];
+    
+    for (int t=firstTrajectory; t < firstTrajectory + numTrajectories; t++) {
+        keys[env.numSeeds] = (unsigned long int) t;
+        init_by_array(qureg.rng, keys, env.numSeeds + 1);
+        initZeroState(qureg);
+        circuit(qureg, args);
+        observe(qureg, args, values);
+        for (int o=0; o < numObservables; o++)
+            sums[o] += values[o];
+    }
+    
+    destroyQureg(qureg, env);
+    free(values);
+}
+
+/*
+ * Pauli expectation values, computed by the backends from bit masks without modifying the register.
+ * Since Y = i X Z, a Pauli product maps basis state |j> to i^numY (-1)^|j & phaseMask| |j ^ flipMask>,
+ * where flipMask holds the X and Y qubits, and phaseMask the Y and Z qubits.
+ */
+
+/** A Pauli product encoded as bit masks, with its coefficient times i^numY, and the index of the sum it belongs to */
+typedef struct {
+    long long int flipMask;
+    long long int phaseMask;
+    qreal factorRe, factorIm;
+    int sumInd;
+} PauliMasks;
+
+static PauliMasks getPauliMasks(int* targetQubits, enum pauliOpType* pauliCodes, int numTargets, qreal coeff) {
+    
+    PauliMasks term = {0, 0, 0, 0, 0};
+    int numY = 0;
+    for (int i=0; i < numTargets; i++) {
+        long long int bit = 1LL << targetQubits[i];
+        if (pauliCodes[i] == PAULI_X || pauliCodes[i] == PAULI_Y)
+            term.flipMask |= bit;
+        if (pauliCodes[i] == PAULI_Y || pauliCodes[i] == PAULI_Z)
+            term.phaseMask |= bit;
+        if (pauliCodes[i] == PAULI_Y)
+            numY++;
+    }
+    
+    // coeff * i^numY
+    qreal phaseRe[4] = {1, 0, -1, 0};
+    qreal phaseIm[4] = {0, 1, 0, -1};
+    term.factorRe = coeff * phaseRe[numY % 4];
+    term.factorIm = coeff * phaseIm[numY % 4];
+    return term;
+}
+
+static int comparePauliFlipMasks(const void* a, const void* b) {
+    long long int maskA = ((const PauliMasks*) a)->flipMask;
+    long long int maskB = ((const PauliMasks*) b)->flipMask;
+    return (maskA > maskB) - (maskA < maskB);
+}
+
+/** Encodes every term of every sum, ordered so that terms with equal flip masks are adjacent and
+ * can be evaluated together, even when they belong to different sums, then hands them to the 
+ * state-vector or density matrix backend.
+ */
+static void calcExpecPauliSumsFromCodes(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs) 
+{
+    int numQubits = qureg.numQubitsRepresented;
+    int* qubits = malloc(numQubits * sizeof *qubits);
+    for (int q=0; q < numQubits; q++)
+        qubits[q] = q;
+    
+    int numTerms = 0;
+    for (int s=0; s < numSums; s++)
+        numTerms += numSumTerms[s];
+    
+    PauliMasks* terms = malloc(numTerms * sizeof *terms);
+    int t = 0;
+    for (int s=0; s < numSums; s++)
+        for (int i=0; i < numSumTerms[s]; i++, t++) {
+            terms[t] = getPauliMasks(qubits, &allPauliCodes[t*numQubits], numQubits, termCoeffs[t]);
+            terms[t].sumInd = s;
+        }
+    qsort(terms, numTerms, sizeof *terms, comparePauliFlipMasks);
+    
+    long long int* flipMasks = malloc(numTerms * sizeof *flipMasks);
+    long long int* phaseMasks = malloc(numTerms * sizeof *phaseMasks);
+    qreal* factorsRe = malloc(numTerms * sizeof *factorsRe);
+    qreal* factorsIm = malloc(numTerms * sizeof *factorsIm);
+    int* sumInds = malloc(numTerms * sizeof *sumInds);
+    for (t=0; t < numTerms; t++) {
+        flipMasks[t] = terms[t].flipMask;
+        phaseMasks[t] = terms[t].phaseMask;
+        factorsRe[t] = terms[t].factorRe;
+        factorsIm[t] = terms[t].factorIm;
+        sumInds[t] = terms[t].sumInd;
+    }
+    
+    if (qureg.isDensityMatrix)
+        densmatr_calcExpecPauliMasks(qureg, flipMasks, phaseMasks, factorsRe, factorsIm, sumInds, numTerms, expecs, numSums);
+    else
+        statevec_calcExpecPauliMasks(qureg, flipMasks, phaseMasks, factorsRe, factorsIm, sumInds, numTerms, expecs, numSums);
+    
+    free(qubits);
+    free(terms);
+    free(flipMasks);
+    free(phaseMasks);
+    free(factorsRe);
+    free(factorsIm);
+    free(sumInds);
+}
+
+qreal statevec_calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets) {
+    
+    PauliMasks term = getPauliMasks(targetQubits, pauliCodes, numTargets, 1);
+    qreal expec;
+    statevec_calcExpecPauliMasks(qureg, &term.flipMask, &term.phaseMask, &term.factorRe, &term.factorIm, 
+        &term.sumInd, 1, &expec, 1);
+    return expec;
+}
+
+qreal densmatr_calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets) {
+    
+    PauliMasks term = getPauliMasks(targetQubits, pauliCodes, numTargets, 1);
+    qreal expec;
+    densmatr_calcExpecPauliMasks(qureg, &term.flipMask, &term.phaseMask, &term.factorRe, &term.factorIm, 
+        &term.sumInd, 1, &expec, 1);
+    return expec;
+}
+
+void statevec_calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs) 
+{
+    calcExpecPauliSumsFromCodes(qureg, allPauliCodes, termCoeffs, numSumTerms, numSums, expecs);
+}
+
+void densmatr_calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs) 
+{
+    calcExpecPauliSumsFromCodes(qureg, allPauliCodes, termCoeffs, numSumTerms, numSums, expecs);
+}
+
 qreal statevec_calcFidelity(Qureg qureg, Qureg pureState) {
     
     Complex innerProd = statevec_calcInnerProduct(qureg, pureState);
@@ -0,0 +1,1043 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * A decision-diagram (QMDD) backend for pure states, implementing QuEST_dd.h.
+ *
+ * A state of N qubits is a quasi-reduced, edge-weighted binary diagram: every non-zero path
+ * from the root visits one node per qubit, from qubit N-1 at the root down to qubit 0, and
+ * ends at the single terminal node. The amplitude of basis state i is the product of the edge
+ * weights along the path selected by the bits of i. Zero sub-vectors are represented by an
+ * edge of weight 0 to the terminal, at any level.
+ *
+ * Nodes are normalised so that the larger-magnitude child weight is exactly 1, and are made
+ * unique through a hash table (with a tolerance on weights), so identical sub-vectors are
+ * stored once. Gates are applied directly to the state diagram by recursive descent to the
+ * target level, memoised per gate in a compute table, and vector addition is memoised
+ * across gates. Nodes are reference counted from the root and unreferenced nodes are
+ * reclaimed by a mark-free sweep of the unique table once their number passes a threshold.
+ */
+
+# include "QuEST.h"
+# include "QuEST_dd.h"
+# include "QuEST_internal.h"
+# include "QuEST_precision.h"
+# include "QuEST_validation.h"
+# include "mt19937ar.h"
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// weights closer than this are treated as equal (and as zero, if this close to zero)
+# if QuEST_PREC==1
+    # define DD_TOLERANCE 1e-6
+# else
+    # define DD_TOLERANCE 1e-12
+# endif
+// weights are rounded to this granularity when hashed
+# define DD_HASH_QUANTUM (DD_TOLERANCE*1e4)
+
+# define DD_NODES_PER_BLOCK 4096
+# define DD_INIT_NUM_BUCKETS (1LL<<12)
+# define DD_COMPUTE_TABLE_SIZE (1LL<<16)
+# define DD_INIT_GC_THRESHOLD (1LL<<17)
+
+
+/*
+ * structures
+ */
+
+typedef struct DDNode
+{
+    struct DDNode* next;        // next node in the same unique-table bucket, or in the free list
+    struct DDNode* child[2];    // sub-diagrams for this qubit being 0 or 1
+    Complex weight[2];
+    int var;                    // the qubit of this node, or -1 for the terminal
+    unsigned int refCount;
+    qreal normSq;               // squared norm of the unweighted sub-vector, or <0 if not yet known
+    qreal scratch;              // per-query memo, valid when stamp matches the query id
+    unsigned long long int stamp;
+} DDNode;
+
+typedef struct DDEdge
+{
+    DDNode* node;
+    Complex weight;
+} DDEdge;
+
+typedef struct DDAddEntry
+{
+    DDNode* a;
+    DDNode* b;
+    Complex ratio;
+    DDEdge result;
+} DDAddEntry;
+
+typedef struct DDOpEntry
+{
+    DDNode* node;
+    unsigned long long int opId;
+    DDEdge result;
+} DDOpEntry;
+
+typedef struct DDNodeBlock
+{
+    struct DDNodeBlock* next;
+    DDNode nodes[DD_NODES_PER_BLOCK];
+} DDNodeBlock;
+
+struct DDPackage
+{
+    int rank;
+    DDNode terminal;
+    DDEdge root;
+
+    // unique table
+    DDNode** buckets;
+    long long int numBuckets;
+    long long int numNodes;
+    long long int peakNodes;
+
+    // node pool
+    DDNodeBlock* blocks;
+    int blockFill;
+    DDNode* freeList;
+
+    // garbage collection
+    long long int gcThreshold;
+    int numGCRuns;
+
+    // compute tables
+    DDAddEntry* addTable;
+    DDOpEntry* applyTable;
+    DDOpEntry* projectTable;
+    long long int numLookups;
+    long long int numHits;
+
+    // identifies the gate or query in progress, for the per-operation memos
+    unsigned long long int opCounter;
+
+    // the gate in progress
+    int target;
+    long long int ctrlMask;
+    long long int lowerCtrlMask;
+    ComplexMatrix2 u;
+
+    // this register's own random number generator, for measurement
+    MTState rng;
+};
+
+
+/*
+ * complex arithmetic
+ */
+
+static Complex cmplx(qreal real, qreal imag) {
+    Complex c;
+    c.real = real;
+    c.imag = imag;
+    return c;
+}
+
+static Complex cAdd(Complex a, Complex b) {
+    return cmplx(a.real + b.real, a.imag + b.imag);
+}
+
+static Complex cMul(Complex a, Complex b) {
+    return cmplx(a.real*b.real - a.imag*b.imag, a.real*b.imag + a.imag*b.real);
+}
+
+static Complex cDiv(Complex a, Complex b) {
+    qreal den = b.real*b.real + b.imag*b.imag;
+    return cmplx((a.real*b.real + a.imag*b.imag)/den, (a.imag*b.real - a.real*b.imag)/den);
+}
+
+static qreal cAbsSq(Complex a) {
+    return a.real*a.real + a.imag*a.imag;
+}
+
+static int cIsZero(Complex a) {
+    return absReal(a.real) < DD_TOLERANCE && absReal(a.imag) < DD_TOLERANCE;
+}
+
+static int cIsApproxEqual(Complex a, Complex b) {
+    return absReal(a.real - b.real) < DD_TOLERANCE && absReal(a.imag - b.imag) < DD_TOLERANCE;
+}
+
+
+/*
+ * hashing
+ */
+
+static unsigned long long int mixHash(unsigned long long int hash, unsigned long long int val) {
+    hash ^= val + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static unsigned long long int hashComplex(unsigned long long int hash, Complex c) {
+    hash = mixHash(hash, (unsigned long long int) (long long int) floor(c.real/DD_HASH_QUANTUM + 0.5));
+    hash = mixHash(hash, (unsigned long long int) (long long int) floor(c.imag/DD_HASH_QUANTUM + 0.5));
+    return hash;
+}
+
+static unsigned long long int hashNode(int var, DDNode* child0, DDNode* child1, Complex w0, Complex w1) {
+    unsigned long long int hash = (unsigned long long int) var;
+    hash = mixHash(hash, (unsigned long long int) (uintptr_t) child0);
+    hash = mixHash(hash, (unsigned long long int) (uintptr_t) child1);
+    hash = hashComplex(hash, w0);
+    hash = hashComplex(hash, w1);
+    return hash;
+}
+
+static unsigned long long int hashOp(DDNode* node, unsigned long long int opId) {
+    return mixHash(mixHash(0, (unsigned long long int) (uintptr_t) node), opId);
+}
+
+
+/*
+ * memory management
+ */
+
+static void* allocOrExit(size_t numBytes) {
+    void* mem = malloc(numBytes);
+    if (mem == NULL) {
+        printf("Could not allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+static DDNode* allocNode(struct DDPackage* pkg) {
+    DDNode* node;
+    if (pkg->freeList != NULL) {
+        node = pkg->freeList;
+        pkg->freeList = node->next;
+        return node;
+    }
+    if (pkg->blocks == NULL || pkg->blockFill == DD_NODES_PER_BLOCK) {
+        DDNodeBlock* block = allocOrExit(sizeof *block);
+        block->next = pkg->blocks;
+        pkg->blocks = block;
+        pkg->blockFill = 0;
+    }
+    return &pkg->blocks->nodes[pkg->blockFill++];
+}
+
+static void clearComputeTables(struct DDPackage* pkg) {
+    memset(pkg->addTable, 0, DD_COMPUTE_TABLE_SIZE * sizeof *pkg->addTable);
+    memset(pkg->applyTable, 0, DD_COMPUTE_TABLE_SIZE * sizeof *pkg->applyTable);
+    memset(pkg->projectTable, 0, DD_COMPUTE_TABLE_SIZE * sizeof *pkg->projectTable);
+}
+
+static void growUniqueTable(struct DDPackage* pkg) {
+    long long int newNumBuckets = 2*pkg->numBuckets;
+    DDNode** newBuckets = allocOrExit(newNumBuckets * sizeof *newBuckets);
+    for (long long int b=0; b < newNumBuckets; b++)
+        newBuckets[b] = NULL;
+
+    for (long long int b=0; b < pkg->numBuckets; b++) {
+        DDNode* node = pkg->buckets[b];
+        while (node != NULL) {
+            DDNode* next = node->next;
+            long long int ind = hashNode(node->var, node->child[0], node->child[1],
+                node->weight[0], node->weight[1]) & (newNumBuckets-1);
+            node->next = newBuckets[ind];
+            newBuckets[ind] = node;
+            node = next;
+        }
+    }
+    free(pkg->buckets);
+    pkg->buckets = newBuckets;
+    pkg->numBuckets = newNumBuckets;
+}
+
+static void incRef(struct DDPackage* pkg, DDNode* node) {
+    if (node == &pkg->terminal)
+        return;
+    if (node->refCount++ == 0) {
+        incRef(pkg, node->child[0]);
+        incRef(pkg, node->child[1]);
+    }
+}
+
+static void decRef(struct DDPackage* pkg, DDNode* node) {
+    if (node == &pkg->terminal)
+        return;
+    if (--node->refCount == 0) {
+        decRef(pkg, node->child[0]);
+        decRef(pkg, node->child[1]);
+    }
+}
+
+static void collectGarbage(struct DDPackage* pkg) {
+    for (long long int b=0; b < pkg->numBuckets; b++) {
+        DDNode** link = &pkg->buckets[b];
+        while (*link != NULL) {
+            DDNode* node = *link;
+            if (node->refCount == 0) {
+                *link = node->next;
+                node->next = pkg->freeList;
+                pkg->freeList = node;
+                pkg->numNodes--;
+            } else
+                link = &node->next;
+        }
+    }
+    // cached results may refer to the freed nodes
+    clearComputeTables(pkg);
+    pkg->numGCRuns++;
+}
+
+static void setRoot(struct DDPackage* pkg, DDEdge root) {
+    incRef(pkg, root.node);
+    decRef(pkg, pkg->root.node);
+    pkg->root = root;
+
+    // collect only between operations, when every live node is referenced from the root
+    if (pkg->numNodes > pkg->gcThreshold) {
+        collectGarbage(pkg);
+        if (pkg->numNodes > pkg->gcThreshold/2)
+            pkg->gcThreshold *= 2;
+    }
+}
+
+
+/*
+ * edges and nodes
+ */
+
+static DDEdge zeroEdge(struct DDPackage* pkg) {
+    DDEdge edge;
+    edge.node = &pkg->terminal;
+    edge.weight = cmplx(0, 0);
+    return edge;
+}
+
+static DDEdge oneEdge(struct DDPackage* pkg) {
+    DDEdge edge;
+    edge.node = &pkg->terminal;
+    edge.weight = cmplx(1, 0);
+    return edge;
+}
+
+static DDEdge getChildEdge(DDNode* node, int bit) {
+    DDEdge edge;
+    edge.node = node->child[bit];
+    edge.weight = node->weight[bit];
+    return edge;
+}
+
+static DDEdge scaleEdge(struct DDPackage* pkg, DDEdge edge, Complex factor) {
+    edge.weight = cMul(edge.weight, factor);
+    if (cIsZero(edge.weight))
+        return zeroEdge(pkg);
+    return edge;
+}
+
+/** returns the edge to the unique node with the given children, normalised so that its
+ * larger child weight is 1 */
+static DDEdge makeNode(struct DDPackage* pkg, int var, DDEdge e0, DDEdge e1) {
+    if (cIsZero(e0.weight))
+        e0 = zeroEdge(pkg);
+    if (cIsZero(e1.weight))
+        e1 = zeroEdge(pkg);
+    if (e0.node == &pkg->terminal && e1.node == &pkg->terminal &&
+        cIsZero(e0.weight) && cIsZero(e1.weight))
+        return zeroEdge(pkg);
+
+    // normalise by the larger weight (preferring the zero child on ties)
+    Complex norm = (cAbsSq(e1.weight) > cAbsSq(e0.weight) + DD_TOLERANCE)? e1.weight : e0.weight;
+    Complex w0 = cDiv(e0.weight, norm);
+    Complex w1 = cDiv(e1.weight, norm);
+    if (norm.real == e0.weight.real && norm.imag == e0.weight.imag)
+        w0 = cmplx(1, 0);
+    else
+        w1 = cmplx(1, 0);
+
+    DDEdge result;
+    result.weight = norm;
+
+    // find an existing node
+    long long int ind = hashNode(var, e0.node, e1.node, w0, w1) & (pkg->numBuckets-1);
+    for (DDNode* node = pkg->buckets[ind]; node != NULL; node = node->next) {
+        if (node->var == var && node->child[0] == e0.node && node->child[1] == e1.node &&
+            cIsApproxEqual(node->weight[0], w0) && cIsApproxEqual(node->weight[1], w1)) {
+            result.node = node;
+            return result;
+        }
+    }
+
+    // otherwise create one
+    DDNode* node = allocNode(pkg);
+    node->var = var;
+    node->child[0] = e0.node;
+    node->child[1] = e1.node;
+    node->weight[0] = w0;
+    node->weight[1] = w1;
+    node->refCount = 0;
+    node->normSq = -1;
+    node->stamp = 0;
+    node->next = pkg->buckets[ind];
+    pkg->buckets[ind] = node;
+
+    if (++pkg->numNodes > pkg->peakNodes)
+        pkg->peakNodes = pkg->numNodes;
+    if (pkg->numNodes > 2*pkg->numBuckets)
+        growUniqueTable(pkg);
+
+    result.node = node;
+    return result;
+}
+
+
+/*
+ * diagram operations
+ */
+
+/** returns x + y, where both represent vectors over the same qubits */
+static DDEdge addEdges(struct DDPackage* pkg, DDEdge x, DDEdge y) {
+    if (cIsZero(x.weight))
+        return y;
+    if (cIsZero(y.weight))
+        return x;
+    if (x.node == y.node) {
+        x.weight = cAdd(x.weight, y.weight);
+        return (cIsZero(x.weight))? zeroEdge(pkg) : x;
+    }
+
+    // x + y = w_x (X + r Y) with |r| <= 1, so only X + r Y need be cached
+    if (cAbsSq(y.weight) > cAbsSq(x.weight)) {
+        DDEdge tmp = x;
+        x = y;
+        y = tmp;
+    }
+    Complex ratio = cDiv(y.weight, x.weight);
+
+    DDAddEntry* entry = &pkg->addTable[
+        hashComplex(mixHash((uintptr_t) x.node, (uintptr_t) y.node), ratio) & (DD_COMPUTE_TABLE_SIZE-1)];
+    pkg->numLookups++;
+    if (entry->a == x.node && entry->b == y.node && cIsApproxEqual(entry->ratio, ratio)) {
+        pkg->numHits++;
+        return scaleEdge(pkg, entry->result, x.weight);
+    }
+
+    DDNode* a = x.node;
+    DDNode* b = y.node;
+    DDEdge sum0 = addEdges(pkg, getChildEdge(a, 0), scaleEdge(pkg, getChildEdge(b, 0), ratio));
+    DDEdge sum1 = addEdges(pkg, getChildEdge(a, 1), scaleEdge(pkg, getChildEdge(b, 1), ratio));
+    DDEdge result = makeNode(pkg, a->var, sum0, sum1);
+
+    entry->a = a;
+    entry->b = b;
+    entry->ratio = ratio;
+    entry->result = result;
+    return scaleEdge(pkg, result, x.weight);
+}
+
+/** zeroes every amplitude for which a control qubit below the target of the current gate is 0 */
+static DDEdge projectOntoLowerControls(struct DDPackage* pkg, DDEdge edge) {
+    if (cIsZero(edge.weight))
+        return zeroEdge(pkg);
+    DDNode* node = edge.node;
+    if (node == &pkg->terminal || (pkg->lowerCtrlMask & ((2LL << node->var) - 1)) == 0)
+        return edge;
+
+    DDOpEntry* entry = &pkg->projectTable[hashOp(node, pkg->opCounter) & (DD_COMPUTE_TABLE_SIZE-1)];
+    pkg->numLookups++;
+    if (entry->node == node && entry->opId == pkg->opCounter) {
+        pkg->numHits++;
+        return scaleEdge(pkg, entry->result, edge.weight);
+    }
+
+    DDEdge proj0 = zeroEdge(pkg);
+    if (! ((pkg->lowerCtrlMask >> node->var) & 1))
+        proj0 = projectOntoLowerControls(pkg, getChildEdge(node, 0));
+    DDEdge proj1 = projectOntoLowerControls(pkg, getChildEdge(node, 1));
+    DDEdge result = makeNode(pkg, node->var, proj0, proj1);
+
+    entry->node = node;
+    entry->opId = pkg->opCounter;
+    entry->result = result;
+    return scaleEdge(pkg, result, edge.weight);
+}
+
+/** applies the current (multi-controlled, single-target) gate to the sub-diagram */
+static DDEdge applyToEdge(struct DDPackage* pkg, DDEdge edge) {
+    if (cIsZero(edge.weight))
+        return zeroEdge(pkg);
+    DDNode* node = edge.node;
+
+    DDOpEntry* entry = &pkg->applyTable[hashOp(node, pkg->opCounter) & (DD_COMPUTE_TABLE_SIZE-1)];
+    pkg->numLookups++;
+    if (entry->node == node && entry->opId == pkg->opCounter) {
+        pkg->numHits++;
+        return scaleEdge(pkg, entry->result, edge.weight);
+    }
+
+    DDEdge lo = getChildEdge(node, 0);
+    DDEdge hi = getChildEdge(node, 1);
+    DDEdge newLo, newHi;
+    ComplexMatrix2 u = pkg->u;
+
+    // above the target, descend (only into the 1 branch of controls)
+    if (node->var > pkg->target) {
+        newLo = ((pkg->ctrlMask >> node->var) & 1)? lo : applyToEdge(pkg, lo);
+        newHi = applyToEdge(pkg, hi);
+    }
+    // at the target, without lower controls, mix the branches
+    else if (pkg->lowerCtrlMask == 0) {
+        newLo = addEdges(pkg, scaleEdge(pkg, lo, u.r0c0), scaleEdge(pkg, hi, u.r0c1));
+        newHi = addEdges(pkg, scaleEdge(pkg, lo, u.r1c0), scaleEdge(pkg, hi, u.r1c1));
+    }
+    // with lower controls, mix only the projections P onto satisfied controls:
+    // lo' = lo + (u00 - 1) P lo + u01 P hi, hi' = hi + u10 P lo + (u11 - 1) P hi
+    else {
+        DDEdge projLo = projectOntoLowerControls(pkg, lo);
+        DDEdge projHi = projectOntoLowerControls(pkg, hi);
+        Complex u00m1 = cmplx(u.r0c0.real - 1, u.r0c0.imag);
+        Complex u11m1 = cmplx(u.r1c1.real - 1, u.r1c1.imag);
+        newLo = addEdges(pkg, lo, addEdges(pkg,
+            scaleEdge(pkg, projLo, u00m1), scaleEdge(pkg, projHi, u.r0c1)));
+        newHi = addEdges(pkg, hi, addEdges(pkg,
+            scaleEdge(pkg, projLo, u.r1c0), scaleEdge(pkg, projHi, u11m1)));
+    }
+    DDEdge result = makeNode(pkg, node->var, newLo, newHi);
+
+    entry->node = node;
+    entry->opId = pkg->opCounter;
+    entry->result = result;
+    return scaleEdge(pkg, result, edge.weight);
+}
+
+static long long int getControlMask(int* controlQubits, const int numControlQubits) {
+    long long int mask = 0;
+    for (int i=0; i < numControlQubits; i++)
+        mask |= 1LL << controlQubits[i];
+    return mask;
+}
+
+static void applyGate(DDQureg qureg, const int targetQubit, long long int ctrlMask, ComplexMatrix2 u) {
+    struct DDPackage* pkg = qureg.pkg;
+    pkg->target = targetQubit;
+    pkg->ctrlMask = ctrlMask;
+    pkg->lowerCtrlMask = ctrlMask & ((1LL << targetQubit) - 1);
+    pkg->u = u;
+    pkg->opCounter++;
+
+    setRoot(pkg, applyToEdge(pkg, pkg->root));
+}
+
+static qreal getNodeNormSq(struct DDPackage* pkg, DDNode* node) {
+    if (node == &pkg->terminal)
+        return 1;
+    if (node->normSq < 0)
+        node->normSq = (
+            cAbsSq(node->weight[0]) * getNodeNormSq(pkg, node->child[0]) +
+            cAbsSq(node->weight[1]) * getNodeNormSq(pkg, node->child[1]));
+    return node->normSq;
+}
+
+static qreal getNodeProbOfZero(struct DDPackage* pkg, DDNode* node, const int measureQubit) {
+    if (node->var == measureQubit)
+        return cAbsSq(node->weight[0]) * getNodeNormSq(pkg, node->child[0]);
+    if (node->stamp == pkg->opCounter)
+        return node->scratch;
+
+    qreal prob = 0;
+    for (int bit=0; bit < 2; bit++)
+        if (! cIsZero(node->weight[bit]))
+            prob += cAbsSq(node->weight[bit]) * getNodeProbOfZero(pkg, node->child[bit], measureQubit);
+
+    node->stamp = pkg->opCounter;
+    node->scratch = prob;
+    return prob;
+}
+
+static long long int countNodes(struct DDPackage* pkg, DDNode* node) {
+    if (node == &pkg->terminal || node->stamp == pkg->opCounter)
+        return 0;
+    node->stamp = pkg->opCounter;
+    return 1 + countNodes(pkg, node->child[0]) + countNodes(pkg, node->child[1]);
+}
+
+static void copyAmpsFromNode(struct DDPackage* pkg, DDEdge edge, long long int offset, qreal* reals, qreal* imags) {
+    if (cIsZero(edge.weight))
+        return;
+    if (edge.node == &pkg->terminal) {
+        reals[offset] = edge.weight.real;
+        imags[offset] = edge.weight.imag;
+        return;
+    }
+    int var = edge.node->var;
+    copyAmpsFromNode(pkg, scaleEdge(pkg, getChildEdge(edge.node, 0), edge.weight), offset, reals, imags);
+    copyAmpsFromNode(pkg, scaleEdge(pkg, getChildEdge(edge.node, 1), edge.weight), offset + (1LL << var), reals, imags);
+}
+
+static Qureg getValidationShape(DDQureg qureg) {
+    Qureg shape = {
+        .isDensityMatrix = 0,
+        .numQubitsRepresented = qureg.numQubits,
+        .numQubitsInStateVec = qureg.numQubits,
+        .numAmpsTotal = 1LL << qureg.numQubits};
+    return shape;
+}
+
+static ComplexMatrix2 getCompactUnitaryMatrix(Complex alpha, Complex beta) {
+    ComplexMatrix2 u;
+    u.r0c0 = alpha;
+    u.r0c1 = cmplx(- beta.real, beta.imag);
+    u.r1c0 = beta;
+    u.r1c1 = cmplx(alpha.real, - alpha.imag);
+    return u;
+}
+
+static ComplexMatrix2 getDiagonalMatrix(Complex d0, Complex d1) {
+    ComplexMatrix2 u;
+    u.r0c0 = d0;
+    u.r0c1 = cmplx(0, 0);
+    u.r1c0 = cmplx(0, 0);
+    u.r1c1 = d1;
+    return u;
+}
+
+static ComplexMatrix2 getRotationMatrix(qreal angle, Vector axis) {
+    Complex alpha, beta;
+    getComplexPairFromRotation(angle, axis, &alpha, &beta);
+    return getCompactUnitaryMatrix(alpha, beta);
+}
+
+static qreal getProbOfOutcome(DDQureg qureg, const int measureQubit, int outcome) {
+    struct DDPackage* pkg = qureg.pkg;
+    pkg->opCounter++;
+
+    qreal total = cAbsSq(pkg->root.weight) * getNodeNormSq(pkg, pkg->root.node);
+    qreal zeroProb = 0;
+    if (! cIsZero(pkg->root.weight))
+        zeroProb = cAbsSq(pkg->root.weight) * getNodeProbOfZero(pkg, pkg->root.node, measureQubit);
+
+    return (outcome == 0)? zeroProb : total - zeroProb;
+}
+
+static void collapseToKnownProbOutcome(DDQureg qureg, const int measureQubit, int outcome, qreal outcomeProb) {
+    Complex one = cmplx(1, 0);
+    Complex zero = cmplx(0, 0);
+    ComplexMatrix2 proj = (outcome == 0)? getDiagonalMatrix(one, zero) : getDiagonalMatrix(zero, one);
+    applyGate(qureg, measureQubit, 0, proj);
+
+    qureg.pkg->root = scaleEdge(qureg.pkg, qureg.pkg->root, cmplx(1/sqrt(outcomeProb), 0));
+}
+
+
+/*
+ * register management
+ */
+
+DDQureg createDDQureg(int numQubits, QuESTEnv env) {
+    validateCreateNumDDQubits(numQubits, __func__);
+
+    struct DDPackage* pkg = allocOrExit(sizeof *pkg);
+    pkg->rank = env.rank;
+    pkg->terminal.var = -1;
+    pkg->terminal.child[0] = pkg->terminal.child[1] = NULL;
+    pkg->terminal.refCount = 1;
+    pkg->terminal.normSq = 1;
+    pkg->terminal.stamp = 0;
+    pkg->root = zeroEdge(pkg);
+
+    pkg->numBuckets = DD_INIT_NUM_BUCKETS;
+    pkg->buckets = allocOrExit(pkg->numBuckets * sizeof *pkg->buckets);
+    for (long long int b=0; b < pkg->numBuckets; b++)
+        pkg->buckets[b] = NULL;
+    pkg->numNodes = 0;
+    pkg->peakNodes = 0;
+
+    pkg->blocks = NULL;
+    pkg->blockFill = 0;
+    pkg->freeList = NULL;
+
+    pkg->gcThreshold = DD_INIT_GC_THRESHOLD;
+    pkg->numGCRuns = 0;
+
+    pkg->addTable = allocOrExit(DD_COMPUTE_TABLE_SIZE * sizeof *pkg->addTable);
+    pkg->applyTable = allocOrExit(DD_COMPUTE_TABLE_SIZE * sizeof *pkg->applyTable);
+    pkg->projectTable = allocOrExit(DD_COMPUTE_TABLE_SIZE * sizeof *pkg->projectTable);
+    clearComputeTables(pkg);
+    pkg->numLookups = 0;
+    pkg->numHits = 0;
+    pkg->opCounter = 0;
+    init_by_array(&pkg->rng, env.seeds, env.numSeeds);
+
+    DDQureg qureg;
+    qureg.numQubits = numQubits;
+    qureg.pkg = pkg;
+
+    ddInitZeroState(qureg);
+    return qureg;
+}
+
+void destroyDDQureg(DDQureg qureg, QuESTEnv env) {
+    struct DDPackage* pkg = qureg.pkg;
+    while (pkg->blocks != NULL) {
+        DDNodeBlock* next = pkg->blocks->next;
+        free(pkg->blocks);
+        pkg->blocks = next;
+    }
+    free(pkg->buckets);
+    free(pkg->addTable);
+    free(pkg->applyTable);
+    free(pkg->projectTable);
+    free(pkg);
+}
+
+void reportDDQuregParams(DDQureg qureg) {
+    struct DDPackage* pkg = qureg.pkg;
+    if (pkg->rank == 0) {
+        printf("DECISION DIAGRAM:\n");
+        printf("Number of qubits is %d.\n", qureg.numQubits);
+        printf("Number of reachable nodes is %lld.\n", getNumDDNodes(qureg));
+        printf("Number of allocated nodes is %lld (peak %lld).\n", pkg->numNodes, pkg->peakNodes);
+        printf("Number of garbage collections is %d.\n", pkg->numGCRuns);
+        printf("Compute table hit rate is %.1f%%.\n",
+            (pkg->numLookups > 0)? 100.0*pkg->numHits/(double) pkg->numLookups : 0.0);
+    }
+}
+
+long long int getNumDDNodes(DDQureg qureg) {
+    struct DDPackage* pkg = qureg.pkg;
+    pkg->opCounter++;
+    return countNodes(pkg, pkg->root.node);
+}
+
+void collectDDGarbage(DDQureg qureg) {
+    collectGarbage(qureg.pkg);
+}
+
+
+/*
+ * state initialisation
+ */
+
+void ddInitZeroState(DDQureg qureg) {
+    ddInitClassicalState(qureg, 0);
+}
+
+void ddInitPlusState(DDQureg qureg) {
+    struct DDPackage* pkg = qureg.pkg;
+    Complex factor = cmplx(1/sqrt(2), 0);
+
+    DDEdge edge = oneEdge(pkg);
+    for (int q=0; q < qureg.numQubits; q++) {
+        DDEdge half = scaleEdge(pkg, edge, factor);
+        edge = makeNode(pkg, q, half, half);
+    }
+    setRoot(pkg, edge);
+}
+
+void ddInitClassicalState(DDQureg qureg, long long int stateInd) {
+    validateStateIndex(getValidationShape(qureg), stateInd, __func__);
+
+    struct DDPackage* pkg = qureg.pkg;
+    DDEdge edge = oneEdge(pkg);
+    for (int q=0; q < qureg.numQubits; q++) {
+        if ((stateInd >> q) & 1)
+            edge = makeNode(pkg, q, zeroEdge(pkg), edge);
+        else
+            edge = makeNode(pkg, q, edge, zeroEdge(pkg));
+    }
+    setRoot(pkg, edge);
+}
+
+void copyDDQuregToQureg(DDQureg ddQureg, Qureg qureg) {
+    validateStateVecQureg(qureg, __func__);
+    validateMatchingQuregDims(getValidationShape(ddQureg), qureg, __func__);
+
+    long long int numAmps = 1LL << ddQureg.numQubits;
+    qreal* reals = allocOrExit(numAmps * sizeof *reals);
+    qreal* imags = allocOrExit(numAmps * sizeof *imags);
+    for (long long int i=0; i < numAmps; i++)
+        reals[i] = imags[i] = 0;
+
+    copyAmpsFromNode(ddQureg.pkg, ddQureg.pkg->root, 0, reals, imags);
+    initStateFromAmps(qureg, reals, imags);
+
+    free(reals);
+    free(imags);
+}
+
+
+/*
+ * calculations
+ */
+
+Complex ddGetAmp(DDQureg qureg, long long int index) {
+    validateStateIndex(getValidationShape(qureg), index, __func__);
+
+    struct DDPackage* pkg = qureg.pkg;
+    Complex amp = pkg->root.weight;
+    DDNode* node = pkg->root.node;
+    while (node != &pkg->terminal && ! cIsZero(amp)) {
+        int bit = (index >> node->var) & 1;
+        amp = cMul(amp, node->weight[bit]);
+        node = node->child[bit];
+    }
+    return amp;
+}
+
+qreal ddGetRealAmp(DDQureg qureg, long long int index) {
+    return ddGetAmp(qureg, index).real;
+}
+
+qreal ddGetImagAmp(DDQureg qureg, long long int index) {
+    return ddGetAmp(qureg, index).imag;
+}
+
+qreal ddGetProbAmp(DDQureg qureg, long long int index) {
+    return cAbsSq(ddGetAmp(qureg, index));
+}
+
+qreal ddCalcTotalProb(DDQureg qureg) {
+    struct DDPackage* pkg = qureg.pkg;
+    return cAbsSq(pkg->root.weight) * getNodeNormSq(pkg, pkg->root.node);
+}
+
+qreal ddCalcProbOfOutcome(DDQureg qureg, const int measureQubit, int outcome) {
+    validateTarget(getValidationShape(qureg), measureQubit, __func__);
+    validateOutcome(outcome, __func__);
+
+    return getProbOfOutcome(qureg, measureQubit, outcome);
+}
+
+qreal ddCollapseToOutcome(DDQureg qureg, const int measureQubit, int outcome) {
+    validateTarget(getValidationShape(qureg), measureQubit, __func__);
+    validateOutcome(outcome, __func__);
+
+    qreal outcomeProb = getProbOfOutcome(qureg, measureQubit, outcome);
+    validateMeasurementProb(outcomeProb, __func__);
+    collapseToKnownProbOutcome(qureg, measureQubit, outcome, outcomeProb);
+    return outcomeProb;
+}
+
+int ddMeasureWithStats(DDQureg qureg, int measureQubit, qreal *outcomeProb) {
+    validateTarget(getValidationShape(qureg), measureQubit, __func__);
+
+    qreal zeroProb = getProbOfOutcome(qureg, measureQubit, 0);
+    int outcome = generateMeasurementOutcome(&qureg.pkg->rng, zeroProb, outcomeProb);
+    collapseToKnownProbOutcome(qureg, measureQubit, outcome, *outcomeProb);
+    return outcome;
+}
+
+int ddMeasure(DDQureg qureg, int measureQubit) {
+    validateTarget(getValidationShape(qureg), measureQubit, __func__);
+
+    qreal discardedProb;
+    return ddMeasureWithStats(qureg, measureQubit, &discardedProb);
+}
+
+
+/*
+ * gates
+ */
+
+void ddHadamard(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    qreal fac = 1/sqrt(2);
+    ComplexMatrix2 u;
+    u.r0c0 = cmplx(fac, 0);
+    u.r0c1 = cmplx(fac, 0);
+    u.r1c0 = cmplx(fac, 0);
+    u.r1c1 = cmplx(-fac, 0);
+    applyGate(qureg, targetQubit, 0, u);
+}
+
+void ddPauliX(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(0, 0), cmplx(0, 0));
+    u.r0c1 = cmplx(1, 0);
+    u.r1c0 = cmplx(1, 0);
+    applyGate(qureg, targetQubit, 0, u);
+}
+
+void ddPauliY(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(0, 0), cmplx(0, 0));
+    u.r0c1 = cmplx(0, -1);
+    u.r1c0 = cmplx(0, 1);
+    applyGate(qureg, targetQubit, 0, u);
+}
+
+void ddPauliZ(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    applyGate(qureg, targetQubit, 0, getDiagonalMatrix(cmplx(1, 0), cmplx(-1, 0)));
+}
+
+void ddSGate(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    applyGate(qureg, targetQubit, 0, getDiagonalMatrix(cmplx(1, 0), cmplx(0, 1)));
+}
+
+void ddTGate(DDQureg qureg, const int targetQubit) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    qreal fac = 1/sqrt(2);
+    applyGate(qureg, targetQubit, 0, getDiagonalMatrix(cmplx(1, 0), cmplx(fac, fac)));
+}
+
+void ddPhaseShift(DDQureg qureg, const int targetQubit, qreal angle) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+
+    applyGate(qureg, targetQubit, 0, getDiagonalMatrix(cmplx(1, 0), cmplx(cos(angle), sin(angle))));
+}
+
+void ddRotateX(DDQureg qureg, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(qureg), rotQubit, __func__);
+
+    Vector unitAxis = {1, 0, 0};
+    applyGate(qureg, rotQubit, 0, getRotationMatrix(angle, unitAxis));
+}
+
+void ddRotateY(DDQureg qureg, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(qureg), rotQubit, __func__);
+
+    Vector unitAxis = {0, 1, 0};
+    applyGate(qureg, rotQubit, 0, getRotationMatrix(angle, unitAxis));
+}
+
+void ddRotateZ(DDQureg qureg, const int rotQubit, qreal angle) {
+    validateTarget(getValidationShape(qureg), rotQubit, __func__);
+
+    Vector unitAxis = {0, 0, 1};
+    applyGate(qureg, rotQubit, 0, getRotationMatrix(angle, unitAxis));
+}
+
+void ddRotateAroundAxis(DDQureg qureg, const int rotQubit, qreal angle, Vector axis) {
+    validateTarget(getValidationShape(qureg), rotQubit, __func__);
+    validateVector(axis, __func__);
+
+    applyGate(qureg, rotQubit, 0, getRotationMatrix(angle, axis));
+}
+
+void ddCompactUnitary(DDQureg qureg, const int targetQubit, Complex alpha, Complex beta) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+    validateUnitaryComplexPair(alpha, beta, __func__);
+
+    applyGate(qureg, targetQubit, 0, getCompactUnitaryMatrix(alpha, beta));
+}
+
+void ddUnitary(DDQureg qureg, const int targetQubit, ComplexMatrix2 u) {
+    validateTarget(getValidationShape(qureg), targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyGate(qureg, targetQubit, 0, u);
+}
+
+void ddControlledNot(DDQureg qureg, const int controlQubit, const int targetQubit) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(0, 0), cmplx(0, 0));
+    u.r0c1 = cmplx(1, 0);
+    u.r1c0 = cmplx(1, 0);
+    applyGate(qureg, targetQubit, 1LL << controlQubit, u);
+}
+
+void ddControlledPauliY(DDQureg qureg, const int controlQubit, const int targetQubit) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(0, 0), cmplx(0, 0));
+    u.r0c1 = cmplx(0, -1);
+    u.r1c0 = cmplx(0, 1);
+    applyGate(qureg, targetQubit, 1LL << controlQubit, u);
+}
+
+void ddControlledPhaseShift(DDQureg qureg, const int idQubit1, const int idQubit2, qreal angle) {
+    validateControlTarget(getValidationShape(qureg), idQubit1, idQubit2, __func__);
+
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(1, 0), cmplx(cos(angle), sin(angle)));
+    applyGate(qureg, idQubit2, 1LL << idQubit1, u);
+}
+
+void ddMultiControlledPhaseShift(DDQureg qureg, int *controlQubits, int numControlQubits, qreal angle) {
+    validateMultiControls(getValidationShape(qureg), controlQubits, numControlQubits, __func__);
+
+    // a diagonal gate, so any one of the qubits can act as the target
+    ComplexMatrix2 u = getDiagonalMatrix(cmplx(1, 0), cmplx(cos(angle), sin(angle)));
+    int targetQubit = controlQubits[numControlQubits-1];
+    applyGate(qureg, targetQubit, getControlMask(controlQubits, numControlQubits-1), u);
+}
+
+void ddControlledPhaseFlip(DDQureg qureg, const int idQubit1, const int idQubit2) {
+    validateControlTarget(getValidationShape(qureg), idQubit1, idQubit2, __func__);
+
+    applyGate(qureg, idQubit2, 1LL << idQubit1, getDiagonalMatrix(cmplx(1, 0), cmplx(-1, 0)));
+}
+
+void ddMultiControlledPhaseFlip(DDQureg qureg, int *controlQubits, int numControlQubits) {
+    validateMultiControls(getValidationShape(qureg), controlQubits, numControlQubits, __func__);
+
+    int targetQubit = controlQubits[numControlQubits-1];
+    applyGate(qureg, targetQubit, getControlMask(controlQubits, numControlQubits-1),
+        getDiagonalMatrix(cmplx(1, 0), cmplx(-1, 0)));
+}
+
+void ddControlledRotateX(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {1, 0, 0};
+    applyGate(qureg, targetQubit, 1LL << controlQubit, getRotationMatrix(angle, unitAxis));
+}
+
+void ddControlledRotateY(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {0, 1, 0};
+    applyGate(qureg, targetQubit, 1LL << controlQubit, getRotationMatrix(angle, unitAxis));
+}
+
+void ddControlledRotateZ(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+
+    Vector unitAxis = {0, 0, 1};
+    applyGate(qureg, targetQubit, 1LL << controlQubit, getRotationMatrix(angle, unitAxis));
+}
+
+void ddControlledRotateAroundAxis(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle, Vector axis) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+    validateVector(axis, __func__);
+
+    applyGate(qureg, targetQubit, 1LL << controlQubit, getRotationMatrix(angle, axis));
+}
+
+void ddControlledCompactUnitary(DDQureg qureg, const int controlQubit, const int targetQubit, Complex alpha, Complex beta) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+    validateUnitaryComplexPair(alpha, beta, __func__);
+
+    applyGate(qureg, targetQubit, 1LL << controlQubit, getCompactUnitaryMatrix(alpha, beta));
+}
+
+void ddControlledUnitary(DDQureg qureg, const int controlQubit, const int targetQubit, ComplexMatrix2 u) {
+    validateControlTarget(getValidationShape(qureg), controlQubit, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyGate(qureg, targetQubit, 1LL << controlQubit, u);
+}
+
+void ddMultiControlledUnitary(DDQureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u) {
+    validateMultiControlsTarget(getValidationShape(qureg), controlQubits, numControlQubits, targetQubit, __func__);
+    validateUnitaryMatrix(u, __func__);
+
+    applyGate(qureg, targetQubit, getControlMask(controlQubits, numControlQubits), u);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
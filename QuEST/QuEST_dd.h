@@ -0,0 +1,182 @@
+// Distributed under MIT licence. See https://github.com/aniabrown/QuEST/blob/master/LICENCE.txt for details
+
+/** @file
+ * The decision-diagram (QMDD) register API.
+ * A DDQureg stores a pure state as a quasi-reduced edge-weighted decision diagram rather
+ * than as a dense array of 2^numQubits amplitudes. States with repeated structure (basis
+ * states, GHZ states, QFTs of basis states, Deutsch-Jozsa and Grover oracles) are stored
+ * in O(numQubits) nodes, so registers of 40+ qubits can be simulated when the circuit
+ * keeps the diagram small. Gates mirror those of QuEST.h, prefixed with "dd".
+ *
+ * Each DDQureg owns its own node package (unique table, compute tables and node pool) and
+ * random number generator, so independent registers share no mutable state. Registers are never distributed; in
+ * the MPI build every rank holds an identical copy.
+ */
+
+# ifndef QUEST_DD_H
+# define QUEST_DD_H
+
+# include "QuEST.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// \cond HIDDEN_SYMBOLS
+struct DDPackage;
+/// \endcond
+
+/** Represents a pure state of qubits as a decision diagram.
+ * Qubits are zero-based, and qubit q is the q-th least significant bit of a basis state index.
+ */
+typedef struct DDQureg
+{
+    //! The number of qubits represented
+    int numQubits;
+    //! The nodes, tables and root edge of the diagram
+    struct DDPackage* pkg;
+} DDQureg;
+
+/** Create a decision-diagram register of \p numQubits qubits, initialised to the zero state.
+ *
+ * @returns an object representing the set of qubits
+ * @param[in] numQubits number of qubits in the system
+ * @param[in] env object representing the execution environment
+ * @throws exitWithError if \p numQubits <= 0 or \p numQubits > 62
+ */
+DDQureg createDDQureg(int numQubits, QuESTEnv env);
+
+/** Deallocate a DDQureg, freeing all of its nodes and tables.
+ *
+ * @param[in,out] qureg the register to destroy
+ * @param[in] env object representing the execution environment
+ */
+void destroyDDQureg(DDQureg qureg, QuESTEnv env);
+
+/** Report the size of a DDQureg's diagram, its peak size, and its garbage-collection
+ * and compute-table statistics.
+ */
+void reportDDQuregParams(DDQureg qureg);
+
+/** Returns the number of nodes currently reachable from the register's root edge
+ * (excluding the terminal).
+ */
+long long int getNumDDNodes(DDQureg qureg);
+
+/** Frees every node no longer reachable from the register and clears the compute tables.
+ * This otherwise happens automatically whenever the number of allocated nodes passes a
+ * growing threshold.
+ */
+void collectDDGarbage(DDQureg qureg);
+
+/** Initialise to the zero state |0...0> */
+void ddInitZeroState(DDQureg qureg);
+
+/** Initialise to the equal superposition of all basis states */
+void ddInitPlusState(DDQureg qureg);
+
+/** Initialise to the classical basis state with index \p stateInd
+ *
+ * @throws exitWithError if \p stateInd is outside [0, 2^numQubits)
+ */
+void ddInitClassicalState(DDQureg qureg, long long int stateInd);
+
+/** Overwrite the dense state-vector \p qureg with the state of \p ddQureg.
+ * This materialises all 2^numQubits amplitudes, so is only sensible for small registers.
+ *
+ * @throws exitWithError if \p qureg is a density matrix or its dimensions differ from \p ddQureg
+ */
+void copyDDQuregToQureg(DDQureg ddQureg, Qureg qureg);
+
+/** Get the complex amplitude of basis state \p index */
+Complex ddGetAmp(DDQureg qureg, long long int index);
+
+/** Get the real component of the amplitude of basis state \p index */
+qreal ddGetRealAmp(DDQureg qureg, long long int index);
+
+/** Get the imaginary component of the amplitude of basis state \p index */
+qreal ddGetImagAmp(DDQureg qureg, long long int index);
+
+/** Get the probability of basis state \p index */
+qreal ddGetProbAmp(DDQureg qureg, long long int index);
+
+/** Get the total probability (squared norm) of the state */
+qreal ddCalcTotalProb(DDQureg qureg);
+
+/** Get the probability of qubit \p measureQubit being in state \p outcome */
+qreal ddCalcProbOfOutcome(DDQureg qureg, const int measureQubit, int outcome);
+
+/** Collapse qubit \p measureQubit to state \p outcome, renormalising the state.
+ *
+ * @returns the probability of the outcome before collapse
+ * @throws exitWithError if the outcome has zero probability
+ */
+qreal ddCollapseToOutcome(DDQureg qureg, const int measureQubit, int outcome);
+
+/** Measure qubit \p measureQubit, collapsing it randomly to 0 or 1 */
+int ddMeasure(DDQureg qureg, int measureQubit);
+
+/** Measure qubit \p measureQubit and report the probability of the outcome in \p outcomeProb */
+int ddMeasureWithStats(DDQureg qureg, int measureQubit, qreal *outcomeProb);
+
+/*
+ * gates, mirroring those of QuEST.h
+ */
+
+void ddHadamard(DDQureg qureg, const int targetQubit);
+
+void ddPauliX(DDQureg qureg, const int targetQubit);
+
+void ddPauliY(DDQureg qureg, const int targetQubit);
+
+void ddPauliZ(DDQureg qureg, const int targetQubit);
+
+void ddSGate(DDQureg qureg, const int targetQubit);
+
+void ddTGate(DDQureg qureg, const int targetQubit);
+
+void ddPhaseShift(DDQureg qureg, const int targetQubit, qreal angle);
+
+void ddRotateX(DDQureg qureg, const int rotQubit, qreal angle);
+
+void ddRotateY(DDQureg qureg, const int rotQubit, qreal angle);
+
+void ddRotateZ(DDQureg qureg, const int rotQubit, qreal angle);
+
+void ddRotateAroundAxis(DDQureg qureg, const int rotQubit, qreal angle, Vector axis);
+
+void ddCompactUnitary(DDQureg qureg, const int targetQubit, Complex alpha, Complex beta);
+
+void ddUnitary(DDQureg qureg, const int targetQubit, ComplexMatrix2 u);
+
+void ddControlledNot(DDQureg qureg, const int controlQubit, const int targetQubit);
+
+void ddControlledPauliY(DDQureg qureg, const int controlQubit, const int targetQubit);
+
+void ddControlledPhaseShift(DDQureg qureg, const int idQubit1, const int idQubit2, qreal angle);
+
+void ddMultiControlledPhaseShift(DDQureg qureg, int *controlQubits, int numControlQubits, qreal angle);
+
+void ddControlledPhaseFlip(DDQureg qureg, const int idQubit1, const int idQubit2);
+
+void ddMultiControlledPhaseFlip(DDQureg qureg, int *controlQubits, int numControlQubits);
+
+void ddControlledRotateX(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void ddControlledRotateY(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void ddControlledRotateZ(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void ddControlledRotateAroundAxis(DDQureg qureg, const int controlQubit, const int targetQubit, qreal angle, Vector axis);
+
+void ddControlledCompactUnitary(DDQureg qureg, const int controlQubit, const int targetQubit, Complex alpha, Complex beta);
+
+void ddControlledUnitary(DDQureg qureg, const int controlQubit, const int targetQubit, ComplexMatrix2 u);
+
+void ddMultiControlledUnitary(DDQureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u);
+
+#ifdef __cplusplus
+}
+#endif
+
+# endif // QUEST_DD_H
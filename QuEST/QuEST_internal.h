@@ -33,12 +33,45 @@ void getComplexPairFromRotation(qreal angle, Vector axis, Complex* alpha, Comple
 
 void getZYZRotAnglesFromComplexPair(Complex alpha, Complex beta, qreal* rz2, qreal* ry, qreal* rz1);
 
+ComplexMatrix2 getMatrixFromComplexPair(Complex alpha, Complex beta);
+
 void getComplexPairAndPhaseFromUnitary(ComplexMatrix2 u, Complex* alpha, Complex* beta, qreal* globalPhase);
 
 void shiftIndices(int* indices, int numIndices, int shift);
 
 void getQuESTDefaultSeedKey(unsigned long int *key);
 
+struct MTState* createRandomGenerator(QuESTEnv env);
+
+void destroyRandomGenerator(struct MTState* rng);
+
+int generateMeasurementOutcome(struct MTState* rng, qreal zeroProb, qreal *outcomeProb);
+
+void sumTrajectories(QuESTEnv env, int numQubits, int firstTrajectory, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* sums);
+
+/** The description of a checkpoint, written once every chunk has been, so that its presence 
+ * marks a complete checkpoint */
+typedef struct CheckpointManifest
+{
+    int numQubitsRepresented;
+    int isDensityMatrix;
+    //! the number of chunk files, which may differ from the number of ranks reading them
+    int numChunks;
+    int qrealBytes;
+} CheckpointManifest;
+
+int writeCheckpointChunk(Qureg qureg, char* prefix);
+
+int writeCheckpointManifest(Qureg qureg, char* prefix);
+
+void removeCheckpointManifest(char* prefix);
+
+int readCheckpointManifest(char* prefix, CheckpointManifest* manifest);
+
+int readCheckpointChunk(Qureg qureg, char* prefix, int numSavedChunks);
+
 
 /*
  * operations upon density matrices 
@@ -58,6 +91,16 @@ qreal densmatr_calcFidelity(Qureg qureg, Qureg pureState);
 
 qreal densmatr_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome);
 
+void densmatr_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs);
+
+qreal densmatr_calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets);
+
+void densmatr_calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs);
+
+void densmatr_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums);
+
 void densmatr_collapseToKnownProbOutcome(Qureg qureg, const int measureQubit, int outcome, qreal outcomeProb);
     
 int densmatr_measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb);
@@ -71,6 +114,64 @@ void densmatr_oneQubitDepolarise(Qureg qureg, const int targetQubit, qreal depol
 void densmatr_twoQubitDepolarise(Qureg qureg, int qubit1, int qubit2, qreal depolLevel);
 
 void densmatr_addDensityMatrix(Qureg combineQureg, qreal otherProb, Qureg otherQureg);
+
+void densmatr_applyKrausMap(Qureg qureg, int* targets, const int numTargets, Complex* ops, const int numOps);
+
+void densmatr_applyKrausSuperoperator(Qureg qureg, int* targets, const int numTargets, qreal* superRe, qreal* superIm);
+
+void densmatr_multiControlledUnitary(Qureg qureg, int* controlQubits, const int numControlQubits, const int targetQubit, ComplexMatrix2 u);
+
+void densmatr_unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u);
+
+void densmatr_controlledUnitary(Qureg qureg, const int controlQubit, const int targetQubit, ComplexMatrix2 u);
+
+void densmatr_compactUnitary(Qureg qureg, const int targetQubit, Complex alpha, Complex beta);
+
+void densmatr_controlledCompactUnitary(Qureg qureg, const int controlQubit, const int targetQubit, Complex alpha, Complex beta);
+
+void densmatr_hadamard(Qureg qureg, const int targetQubit);
+
+void densmatr_pauliX(Qureg qureg, const int targetQubit);
+
+void densmatr_pauliY(Qureg qureg, const int targetQubit);
+
+void densmatr_pauliZ(Qureg qureg, const int targetQubit);
+
+void densmatr_sGate(Qureg qureg, const int targetQubit);
+
+void densmatr_tGate(Qureg qureg, const int targetQubit);
+
+void densmatr_phaseShift(Qureg qureg, const int targetQubit, qreal angle);
+
+void densmatr_phaseShiftByTerm(Qureg qureg, const int targetQubit, Complex term);
+
+void densmatr_controlledNot(Qureg qureg, const int controlQubit, const int targetQubit);
+
+void densmatr_controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit);
+
+void densmatr_controlledPhaseShift(Qureg qureg, const int idQubit1, const int idQubit2, qreal angle);
+
+void densmatr_multiControlledPhaseShift(Qureg qureg, int *controlQubits, int numControlQubits, qreal angle);
+
+void densmatr_controlledPhaseFlip(Qureg qureg, const int idQubit1, const int idQubit2);
+
+void densmatr_multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numControlQubits);
+
+void densmatr_rotateX(Qureg qureg, const int rotQubit, qreal angle);
+
+void densmatr_rotateY(Qureg qureg, const int rotQubit, qreal angle);
+
+void densmatr_rotateZ(Qureg qureg, const int rotQubit, qreal angle);
+
+void densmatr_rotateAroundAxis(Qureg qureg, const int rotQubit, qreal angle, Vector axis);
+
+void densmatr_controlledRotateX(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void densmatr_controlledRotateY(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void densmatr_controlledRotateZ(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle);
+
+void densmatr_controlledRotateAroundAxis(Qureg qureg, const int controlQubit, const int targetQubit, qreal angle, Vector axis);
     
     
 /* 
@@ -83,6 +184,10 @@ int statevec_compareStates(Qureg mq1, Qureg mq2, qreal precision);
 
 int statevec_initStateFromSingleFile(Qureg *qureg, char filename[200], QuESTEnv env);
 
+int statevec_writeCheckpoint(Qureg qureg, char* prefix);
+
+int statevec_initStateFromCheckpoint(Qureg qureg, char* prefix, int numSavedChunks);
+
 void statevec_initStateOfSingleQubit(Qureg *qureg, int qubitId, int outcome);
 
 void statevec_createQureg(Qureg *qureg, int numQubits, QuESTEnv env);
@@ -101,6 +206,35 @@ void statevec_setAmps(Qureg qureg, long long int startInd, qreal* reals, qreal*
 
 void statevec_cloneQureg(Qureg targetQureg, Qureg copyQureg);
 
+void statevec_setWeightedQureg(Complex fac1, Qureg qureg1, Complex fac2, Qureg qureg2, Complex facOut, Qureg out);
+
+void statevec_applyDiagonalTable(Qureg qureg, long long int qubitMask, qreal* factorsRe, qreal* factorsIm);
+
+/** One step of a gate sequence: the unitary u upon targetQubit, applied where every qubit of
+ * ctrlMask is 1, or if targetQubit < 0, the diagonal table of the qubits of tableMask, as
+ * applied by statevec_applyDiagonalTable */
+typedef struct GateSequenceStep
+{
+    int targetQubit;
+    long long int ctrlMask;
+    ComplexMatrix2 u;
+    long long int tableMask;
+    qreal *factorsRe, *factorsIm;
+} GateSequenceStep;
+
+/** applies the steps in order, within a single parallel region on the CPU. Every target must
+ * lie within one chunk, so that no step communicates */
+void statevec_applyGateSequence(Qureg qureg, GateSequenceStep* steps, int numSteps);
+
+/** swaps qubit globalQubits[k], which lies beyond the chunk, with qubit localQubits[k], which
+ * lies within it, for every k, in one all-to-all exchange among the chunks which differ only in
+ * those global qubits. Only called upon registers distributed over several chunks */
+void statevec_swapGlobalQubits(Qureg qureg, int* globalQubits, int* localQubits, int numPairs);
+
+/** moves each qubit q within the chunk to qubit newPositions[q], without communicating. Only
+ * called upon registers distributed over several chunks */
+void statevec_permuteLocalQubits(Qureg qureg, int* newPositions);
+
 void statevec_multiControlledPhaseFlip(Qureg qureg, int *controlQubits, int numControlQubits);
 
 void statevec_controlledPhaseFlip(Qureg qureg, const int idQubit1, const int idQubit2);
@@ -129,6 +263,18 @@ void statevec_pauliYConj(Qureg qureg, const int targetQubit);
 
 void statevec_pauliZ(Qureg qureg, const int targetQubit);
 
+void statevec_oneQubitDephaseTrajectory(Qureg qureg, const int targetQubit, qreal prob);
+
+void statevec_twoQubitDephaseTrajectory(Qureg qureg, const int qubit1, const int qubit2, qreal prob);
+
+void statevec_oneQubitDepolariseTrajectory(Qureg qureg, const int targetQubit, qreal prob);
+
+void statevec_twoQubitDepolariseTrajectory(Qureg qureg, const int qubit1, const int qubit2, qreal prob);
+
+void statevec_calcTrajectoryAverages(QuESTEnv env, int numQubits, int numTrajectories, 
+    void (*circuit)(Qureg, void*), void (*observe)(Qureg, void*, qreal*), void* args, 
+    int numObservables, qreal* averages);
+
 void statevec_controlledPauliY(Qureg qureg, const int controlQubit, const int targetQubit);
 
 void statevec_controlledPauliYConj(Qureg qureg, const int controlQubit, const int targetQubit);
@@ -145,6 +291,16 @@ qreal statevec_calcFidelity(Qureg qureg, Qureg pureState);
 
 Complex statevec_calcInnerProduct(Qureg bra, Qureg ket);
 
+void statevec_calcInnerProducts(Qureg bra, Qureg* kets, int numKets, Complex* innerProds);
+
+qreal statevec_calcExpecPauliProd(Qureg qureg, int* targetQubits, enum pauliOpType* pauliCodes, int numTargets);
+
+void statevec_calcExpecPauliSums(Qureg qureg, enum pauliOpType* allPauliCodes, qreal* termCoeffs, 
+    int* numSumTerms, int numSums, qreal* expecs);
+
+void statevec_calcExpecPauliMasks(Qureg qureg, long long int* flipMasks, long long int* phaseMasks, 
+    qreal* factorsRe, qreal* factorsIm, int* sumInds, int numTerms, qreal* expecs, int numSums);
+
 void statevec_compactUnitary(Qureg qureg, const int targetQubit, Complex alpha, Complex beta);
 
 void statevec_unitary(Qureg qureg, const int targetQubit, ComplexMatrix2 u);
@@ -181,6 +337,8 @@ void statevec_controlledNot(Qureg qureg, const int controlQubit, const int targe
 
 qreal statevec_calcProbOfOutcome(Qureg qureg, const int measureQubit, int outcome);
 
+void statevec_calcProbsOfOutcomes(Qureg qureg, int* measureQubits, int* outcomes, int numMeasures, qreal* outcomeProbs);
+
 void statevec_collapseToKnownProbOutcome(Qureg qureg, const int measureQubit, int outcome, qreal outcomeProb);
 
 int statevec_measureWithStats(Qureg qureg, int measureQubit, qreal *outcomeProb);
@@ -45,7 +45,26 @@ typedef enum {
     E_INVALID_ONE_QUBIT_DEPHASE_PROB,
     E_INVALID_TWO_QUBIT_DEPHASE_PROB,
     E_INVALID_ONE_QUBIT_DEPOL_PROB,
-    E_INVALID_TWO_QUBIT_DEPOL_PROB
+    E_INVALID_TWO_QUBIT_DEPOL_PROB,
+    E_INVALID_NUM_DD_QUBITS,
+    E_INVALID_NUM_KRAUS_TARGETS,
+    E_INVALID_NUM_KRAUS_OPS,
+    E_NON_TRACE_PRESERVING_KRAUS_MAP,
+    E_KRAUS_MAP_TOO_BIG_FOR_NODE,
+    E_INVALID_NUM_TRAJECTORIES,
+    E_INVALID_NUM_OBSERVABLES,
+    E_INVALID_NUM_QUREGS,
+    E_INVALID_NUM_TARGETS,
+    E_INVALID_PAULI_CODE,
+    E_INVALID_NUM_SUM_TERMS,
+    E_INVALID_CIRCUIT_PARAM,
+    E_INVALID_CACHE_CAPACITY,
+    E_INVALID_NUM_INSTANCES,
+    E_INVALID_INSTANCE_INDEX,
+    E_INVALID_NUM_SEEDS,
+    E_INVALID_EXEC_POLICY,
+    E_INVALID_NUM_MEASUREMENTS,
+    E_MISMATCHING_CHECKPOINT
 } ErrorCode;
 
 static const char* errorMessages[] = {
@@ -57,7 +76,7 @@ static const char* errorMessages[] = {
     [E_INVALID_OFFSET_NUM_AMPS] = "More amplitudes given than exist in the statevector from the given starting index.",
     [E_TARGET_IS_CONTROL] = "Control qubit cannot equal target qubit.",
     [E_TARGET_IN_CONTROLS] = "Control qubits cannot include target qubit.",
-    [E_TARGETS_NOT_UNIQUE] = "The two target qubits must be unique.",
+    [E_TARGETS_NOT_UNIQUE] = "The target qubits must be unique.",
     [E_INVALID_NUM_CONTROLS] = "Invalid number of control qubits. Must be >0 and <numQubits.",
     [E_NON_UNITARY_MATRIX] = "Matrix is not unitary.",
     [E_NON_UNITARY_COMPLEX_PAIR] = "Compact matrix formed by given complex numbers is not unitary.",
@@ -76,7 +95,26 @@ static const char* errorMessages[] = {
     [E_INVALID_ONE_QUBIT_DEPHASE_PROB] = "The probability of a single qubit dephase error cannot exceed 1/2, which maximally mixes.",
     [E_INVALID_TWO_QUBIT_DEPHASE_PROB] = "The probability of a two-qubit qubit dephase error cannot exceed 3/4, which maximally mixes.",
     [E_INVALID_ONE_QUBIT_DEPOL_PROB] = "The probability of a single qubit depolarising error cannot exceed 3/4, which maximally mixes.",
-    [E_INVALID_TWO_QUBIT_DEPOL_PROB] = "The probability of a two-qubit depolarising error cannot exceed 15/16, which maximally mixes."
+    [E_INVALID_TWO_QUBIT_DEPOL_PROB] = "The probability of a two-qubit depolarising error cannot exceed 15/16, which maximally mixes.",
+    [E_INVALID_NUM_DD_QUBITS] = "Invalid number of qubits. Decision-diagram registers must have >0 and <=62 qubits.",
+    [E_INVALID_NUM_KRAUS_TARGETS] = "Invalid number of target qubits. Kraus maps must act upon 1 or 2 qubits.",
+    [E_INVALID_NUM_KRAUS_OPS] = "Invalid number of Kraus operators. Must be >0 and <=4 for one target, or <=16 for two targets.",
+    [E_NON_TRACE_PRESERVING_KRAUS_MAP] = "The Kraus operators must satisfy sum_i K_i^dagger K_i = I, to preserve the trace.",
+    [E_KRAUS_MAP_TOO_BIG_FOR_NODE] = "Each node must contain at least 4^numTargets amplitudes of the density matrix. Use fewer nodes.",
+    [E_INVALID_NUM_TRAJECTORIES] = "Invalid number of trajectories. Must be >0.",
+    [E_INVALID_NUM_OBSERVABLES] = "Invalid number of observables. Must be >0.",
+    [E_INVALID_NUM_QUREGS] = "Invalid number of registers. Must be >0.",
+    [E_INVALID_NUM_TARGETS] = "Invalid number of target qubits. Must be >0 and <=numQubits.",
+    [E_INVALID_PAULI_CODE] = "Invalid Pauli code. Codes must be 0 (PAULI_I), 1 (PAULI_X), 2 (PAULI_Y) or 3 (PAULI_Z).",
+    [E_INVALID_NUM_SUM_TERMS] = "Invalid number of terms in the Pauli sum. Must be >0.",
+    [E_INVALID_CIRCUIT_PARAM] = "Invalid parameter index. Must be >=0 and less than the number of parameters created in the circuit.",
+    [E_INVALID_CACHE_CAPACITY] = "Invalid circuit cache capacity. Must be >=0.",
+    [E_INVALID_NUM_INSTANCES] = "Invalid number of instances in the batch. Must be >0.",
+    [E_INVALID_INSTANCE_INDEX] = "Invalid instance index. Must be >=0 and less than the number of instances in the batch.",
+    [E_INVALID_NUM_SEEDS] = "Invalid number of seeds. Must be >0 and <=MAX_NUM_SEEDS (64).",
+    [E_INVALID_EXEC_POLICY] = "Invalid execution policy. The thread cap and the fewest amplitudes per thread must be >=0.",
+    [E_INVALID_NUM_MEASUREMENTS] = "Invalid number of measured qubits. Must be >0.",
+    [E_MISMATCHING_CHECKPOINT] = "The checkpoint was written from a register of a different number of qubits, type or precision, or is corrupt."
 };
 
 void exitWithError(ErrorCode code, const char* func){
@@ -91,6 +129,28 @@ void QuESTAssert(int isValid, ErrorCode code, const char* func){
     if (!isValid) exitWithError(code, func);
 }
 
+/** Whether the Kraus operators (flat row-major matrices of dim x dim) satisfy sum_i K_i^dagger K_i = I */
+int isKrausMapTracePreserving(int dim, Complex* ops, int numOps) {
+    for (int r=0; r < dim; r++) {
+        for (int c=0; c < dim; c++) {
+            
+            // (sum_i K_i^dagger K_i)[r][c] = sum_i sum_k conj(K_i[k][r]) K_i[k][c]
+            qreal re=0, im=0;
+            for (int i=0; i < numOps; i++) {
+                for (int k=0; k < dim; k++) {
+                    Complex a = ops[i*dim*dim + k*dim + r];
+                    Complex b = ops[i*dim*dim + k*dim + c];
+                    re += a.real*b.real + a.imag*b.imag;
+                    im += a.real*b.imag - a.imag*b.real;
+                }
+            }
+            if (absReal(re - (r==c)) > REAL_EPS || absReal(im) > REAL_EPS)
+                return 0;
+        }
+    }
+    return 1;
+}
+
 int isComplexUnit(Complex alpha) {
     return (absReal(1 - sqrt(alpha.real*alpha.real + alpha.imag*alpha.imag)) < REAL_EPS); 
 }
@@ -131,6 +191,10 @@ void validateCreateNumQubits(int numQubits, const char* caller) {
     QuESTAssert(numQubits>0, E_INVALID_NUM_QUBITS, caller);
 }
 
+void validateCreateNumDDQubits(int numQubits, const char* caller) {
+    QuESTAssert(numQubits>0 && numQubits<=62, E_INVALID_NUM_DD_QUBITS, caller);
+}
+
 void validateStateIndex(Qureg qureg, long long int stateInd, const char* caller) {
     long long int stateMax = 1LL << qureg.numQubitsRepresented;
     QuESTAssert(stateInd>=0 && stateInd<stateMax, E_INVALID_STATE_INDEX, caller);
@@ -257,6 +321,90 @@ void validateTwoQubitDepolProb(qreal prob, const char* caller) {
     QuESTAssert(prob <= 15/16.0, E_INVALID_TWO_QUBIT_DEPOL_PROB, caller);
 }
 
+void validateKrausTargets(Qureg qureg, int* targets, const int numTargets, const char* caller) {
+    QuESTAssert(numTargets==1 || numTargets==2, E_INVALID_NUM_KRAUS_TARGETS, caller);
+    if (numTargets == 1)
+        validateTarget(qureg, targets[0], caller);
+    else
+        validateUniqueTargets(qureg, targets[0], targets[1], caller);
+    
+    // the distributed backend must fit every row and column bit of the targets within a node
+    QuESTAssert(qureg.numAmpsPerChunk >= (1LL << (2*numTargets)), E_KRAUS_MAP_TOO_BIG_FOR_NODE, caller);
+}
+
+void validateKrausOps(const int numTargets, Complex* ops, const int numOps, const char* caller) {
+    int dim = 1 << numTargets;
+    QuESTAssert(numOps>0 && numOps<=dim*dim, E_INVALID_NUM_KRAUS_OPS, caller);
+    QuESTAssert(isKrausMapTracePreserving(dim, ops, numOps), E_NON_TRACE_PRESERVING_KRAUS_MAP, caller);
+}
+
+void validateNumTrajectories(int numTrajectories, const char* caller) {
+    QuESTAssert(numTrajectories>0, E_INVALID_NUM_TRAJECTORIES, caller);
+}
+
+void validateNumObservables(int numObservables, const char* caller) {
+    QuESTAssert(numObservables>0, E_INVALID_NUM_OBSERVABLES, caller);
+}
+
+void validateNumMeasurements(int numMeasures, const char* caller) {
+    QuESTAssert(numMeasures>0, E_INVALID_NUM_MEASUREMENTS, caller);
+}
+
+void validateCheckpointManifest(Qureg qureg, int numQubits, int isDensityMatrix, int numChunks, int qrealBytes, const char* caller) {
+    int isMatching = (numQubits == qureg.numQubitsRepresented && isDensityMatrix == qureg.isDensityMatrix 
+        && qrealBytes == (int) sizeof(qreal));
+    int isPowerOf2 = (numChunks > 0 && (numChunks & (numChunks-1)) == 0);
+    QuESTAssert(isMatching && isPowerOf2 && numChunks <= qureg.numAmpsTotal, E_MISMATCHING_CHECKPOINT, caller);
+}
+
+void validateNumQuregs(int numQuregs, const char* caller) {
+    QuESTAssert(numQuregs>0, E_INVALID_NUM_QUREGS, caller);
+}
+
+void validateMultiTargets(Qureg qureg, int* targetQubits, const int numTargets, const char* caller) {
+    QuESTAssert(numTargets>0 && numTargets<=qureg.numQubitsRepresented, E_INVALID_NUM_TARGETS, caller);
+    for (int i=0; i < numTargets; i++) {
+        validateTarget(qureg, targetQubits[i], caller);
+        for (int j=0; j < i; j++)
+            QuESTAssert(targetQubits[i] != targetQubits[j], E_TARGETS_NOT_UNIQUE, caller);
+    }
+}
+
+void validatePauliCodes(enum pauliOpType* pauliCodes, const int numPauliCodes, const char* caller) {
+    for (int i=0; i < numPauliCodes; i++) {
+        int code = pauliCodes[i];
+        QuESTAssert(code==PAULI_I || code==PAULI_X || code==PAULI_Y || code==PAULI_Z, E_INVALID_PAULI_CODE, caller);
+    }
+}
+
+void validateNumSumTerms(int numTerms, const char* caller) {
+    QuESTAssert(numTerms>0, E_INVALID_NUM_SUM_TERMS, caller);
+}
+
+void validateCircuitParam(int paramIndex, int numParams, const char* caller) {
+    QuESTAssert(paramIndex>=0 && paramIndex<numParams, E_INVALID_CIRCUIT_PARAM, caller);
+}
+
+void validateCacheCapacity(int numPlans, const char* caller) {
+    QuESTAssert(numPlans>=0, E_INVALID_CACHE_CAPACITY, caller);
+}
+
+void validateNumInstances(int numInstances, const char* caller) {
+    QuESTAssert(numInstances>0, E_INVALID_NUM_INSTANCES, caller);
+}
+
+void validateInstanceIndex(int instance, int numInstances, const char* caller) {
+    QuESTAssert(instance>=0 && instance<numInstances, E_INVALID_INSTANCE_INDEX, caller);
+}
+
+void validateNumSeeds(int numSeeds, const char* caller) {
+    QuESTAssert(numSeeds>0 && numSeeds<=MAX_NUM_SEEDS, E_INVALID_NUM_SEEDS, caller);
+}
+
+void validateExecPolicy(ExecPolicy policy, const char* caller) {
+    QuESTAssert(policy.maxThreads>=0 && policy.minAmpsPerThread>=0, E_INVALID_EXEC_POLICY, caller);
+}
+
 
 
 
@@ -1,7 +1,7 @@
 // Distributed under MIT licence. See https://github.com/aniabrown/QuEST_GPU/blob/master/LICENCE.txt for details
 
 /** @file
- * Provides validation defined in QuEST_validation.c which is used exclusively by QuEST.c
+ * Provides validation defined in QuEST_validation.c which is used exclusively by QuEST.c, QuEST_dd.c, QuEST_batch.c and the QuEST_circuit*.c files
  */
  
 # ifndef QUEST_VALIDATION_H
@@ -15,6 +15,8 @@ extern "C" {
 
 void validateCreateNumQubits(int numQubits, const char* caller);
 
+void validateCreateNumDDQubits(int numQubits, const char* caller);
+
 void validateStateIndex(Qureg qureg, long long int stateInd, const char* caller);
 
 void validateTarget(Qureg qureg, int targetQubit, const char* caller);
@@ -63,6 +65,38 @@ void validateOneQubitDepolProb(qreal prob, const char* caller);
 
 void validateTwoQubitDepolProb(qreal prob, const char* caller);
 
+void validateKrausTargets(Qureg qureg, int* targets, const int numTargets, const char* caller);
+
+void validateKrausOps(const int numTargets, Complex* ops, const int numOps, const char* caller);
+
+void validateNumTrajectories(int numTrajectories, const char* caller);
+
+void validateNumObservables(int numObservables, const char* caller);
+
+void validateNumMeasurements(int numMeasures, const char* caller);
+
+void validateCheckpointManifest(Qureg qureg, int numQubits, int isDensityMatrix, int numChunks, int qrealBytes, const char* caller);
+
+void validateNumQuregs(int numQuregs, const char* caller);
+
+void validateMultiTargets(Qureg qureg, int* targetQubits, const int numTargets, const char* caller);
+
+void validatePauliCodes(enum pauliOpType* pauliCodes, const int numPauliCodes, const char* caller);
+
+void validateNumSumTerms(int numTerms, const char* caller);
+
+void validateCircuitParam(int paramIndex, int numParams, const char* caller);
+
+void validateCacheCapacity(int numPlans, const char* caller);
+
+void validateNumInstances(int numInstances, const char* caller);
+
+void validateInstanceIndex(int instance, int numInstances, const char* caller);
+
+void validateNumSeeds(int numSeeds, const char* caller);
+
+void validateExecPolicy(ExecPolicy policy, const char* caller);
+
 # ifdef __cplusplus
 }
 # endif
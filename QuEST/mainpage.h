@@ -26,6 +26,8 @@ This page is currently a mere grouping of the full API doc available at QuEST.h
 - \ref destroyQureg
 - \ref seedQuEST
 - \ref seedQuESTDefault
+- \ref seedQureg
+- \ref setQuregExecPolicy
 
 \section sec_init Initialisation
 
@@ -109,9 +111,15 @@ This page is currently a mere grouping of the full API doc available at QuEST.h
 - \ref printRecordedQASM
 - \ref writeRecordedQASMToFile
 
+\section sec_checkpoint Checkpointing
+
+- \ref writeQuregCheckpoint
+- \ref initStateFromCheckpoint
+
 \section sec_debug Debugging
 
 - \ref reportQuESTEnv
+- \ref reportMemoryBandwidth
 - \ref reportQuregParams
 - \ref reportState
 - \ref reportStateToScreen
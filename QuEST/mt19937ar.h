@@ -5,28 +5,36 @@
 extern "C" {
 #endif
 
-void init_by_array(unsigned long init_key[], int key_length);
+#define MT_STATE_SIZE 624
 
-void init_genrand(unsigned long s);
+/* the state of one generator; every function below reads and advances only the state it is given */
+typedef struct MTState
+{
+    unsigned long mt[MT_STATE_SIZE];
+    int mti;
+} MTState;
+
+void init_by_array(MTState* state, unsigned long init_key[], int key_length);
+
+void init_genrand(MTState* state, unsigned long s);
+
+/* generates a random number on [0,0xffffffff]-interval */
+unsigned long genrand_int32(MTState* state);
 
 /* generates a random number on [0,1]-real-interval */
-double genrand_real1(void);
+double genrand_real1(MTState* state);
 
 /* generates a random number on [0,1)-real-interval */
-double genrand_real2(void);
+double genrand_real2(MTState* state);
 
 /* generates a random number on (0,1)-real-interval */
-double genrand_real3(void);
-
-/* generates a random number on (0,1)-real-interval */
-double genrand_real3(void);
+double genrand_real3(MTState* state);
 
 /* generates a random number on [0,1) with 53-bit resolution*/
-double genrand_res53(void);
+double genrand_res53(MTState* state);
 
 #ifdef __cplusplus
 }
 #endif
 
 #endif // MT_RAND_H
-
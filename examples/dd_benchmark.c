@@ -0,0 +1,201 @@
+/** @file
+ * Benchmarks the decision-diagram registers of QuEST_dd.h against the dense state-vector
+ * backend, on the algorithms of qSimMain.c scaled up in qubit number.
+ *
+ * Build from the root directory with: make EXE=ddBenchmark SOURCES=dd_benchmark
+ * (after copying this file there), and run as: ./ddBenchmark [maxDenseQubits] [maxQubits]
+ * Dense registers are skipped above maxDenseQubits (default 24), since they need 2^n amplitudes.
+ */
+
+// for the wall clock of clock_gettime
+# define _POSIX_C_SOURCE 199309L
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <math.h>
+# include <time.h>
+
+# include "QuEST.h"
+# include "QuEST_dd.h"
+
+# ifndef M_PI
+# define M_PI 3.14159265358979323846
+# endif
+
+
+/*
+ * a register of either backend, so each algorithm is written once
+ */
+
+typedef struct {
+    int isDD;
+    int numQubits;
+    Qureg dense;
+    DDQureg dd;
+} Register;
+
+static void H(Register r, int q) {
+    if (r.isDD) ddHadamard(r.dd, q); else hadamard(r.dense, q);
+}
+
+static void X(Register r, int q) {
+    if (r.isDD) ddPauliX(r.dd, q); else pauliX(r.dense, q);
+}
+
+static void Z(Register r, int q) {
+    if (r.isDD) ddPauliZ(r.dd, q); else pauliZ(r.dense, q);
+}
+
+static void CNOT(Register r, int c, int t) {
+    if (r.isDD) ddControlledNot(r.dd, c, t); else controlledNot(r.dense, c, t);
+}
+
+static void CZ(Register r, int c, int t) {
+    if (r.isDD) ddControlledPhaseFlip(r.dd, c, t); else controlledPhaseFlip(r.dense, c, t);
+}
+
+static void CPhase(Register r, int c, int t, qreal angle) {
+    if (r.isDD) ddControlledPhaseShift(r.dd, c, t, angle); else controlledPhaseShift(r.dense, c, t, angle);
+}
+
+static void MCZ(Register r, int* qubits, int numQubits) {
+    if (r.isDD) ddMultiControlledPhaseFlip(r.dd, qubits, numQubits); else multiControlledPhaseFlip(r.dense, qubits, numQubits);
+}
+
+static int M(Register r, int q) {
+    return (r.isDD)? ddMeasure(r.dd, q) : measure(r.dense, q);
+}
+
+static void initClassical(Register r, long long int ind) {
+    if (r.isDD) ddInitClassicalState(r.dd, ind); else initClassicalState(r.dense, ind);
+}
+
+
+/*
+ * the algorithms of qSimMain.c, for any number of qubits
+ */
+
+/** randomNumberGenerator(): Hadamard every qubit then measure them all */
+static void randomNumber(Register r) {
+    initClassical(r, 0);
+    for (int q=0; q < r.numQubits; q++)
+        H(r, q);
+    for (int q=0; q < r.numQubits; q++)
+        M(r, q);
+}
+
+/** deutschJozsa(), with the oracle extended over every neighbouring pair of qubits */
+static void deutschJozsa(Register r) {
+    initClassical(r, 0);
+    X(r, 0);
+    for (int q=0; q < r.numQubits; q++)
+        H(r, q);
+    Z(r, r.numQubits-1);
+    for (int q=1; q < r.numQubits; q++)
+        CZ(r, q, q-1);
+    for (int q=1; q < r.numQubits; q++)
+        H(r, q);
+    M(r, 0);
+}
+
+/** qGateTest() / QFT(): the quantum Fourier transform of a basis state, then its swaps */
+static void fourierOfBasisState(Register r) {
+    initClassical(r, 7);
+    for (int i = r.numQubits-1; i >= 0; i--) {
+        H(r, i);
+        for (int j = i-1, k = 2; j >= 0; j--, k++)
+            CPhase(r, j, i, 2.0 * M_PI / pow(2.0, k));
+    }
+    for (int i=0; i < r.numQubits/2; i++) {
+        CNOT(r, i, r.numQubits-1-i);
+        CNOT(r, r.numQubits-1-i, i);
+        CNOT(r, i, r.numQubits-1-i);
+    }
+}
+
+/** grover(): one oracle and diffusion round marking the all-ones state */
+static void grover(Register r) {
+    int* all = malloc(r.numQubits * sizeof *all);
+    for (int q=0; q < r.numQubits; q++)
+        all[q] = q;
+
+    initClassical(r, 0);
+    for (int q=0; q < r.numQubits; q++)
+        H(r, q);
+    MCZ(r, all, r.numQubits);
+    for (int q=0; q < r.numQubits; q++) {
+        H(r, q);
+        X(r, q);
+    }
+    MCZ(r, all, r.numQubits);
+    for (int q=0; q < r.numQubits; q++) {
+        X(r, q);
+        H(r, q);
+    }
+    free(all);
+}
+
+
+/*
+ * benchmarking
+ */
+
+/** the elapsed wall-clock time in milliseconds, unlike clock() which counts the CPU time of every thread */
+static double getWallMillis(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return 1000.0 * time.tv_sec + time.tv_nsec / 1e6;
+}
+
+static void benchmark(QuESTEnv env, const char* name, void (*algorithm)(Register), int numQubits, int isDD) {
+    Register r;
+    r.isDD = isDD;
+    r.numQubits = numQubits;
+    if (isDD)
+        r.dd = createDDQureg(numQubits, env);
+    else
+        r.dense = createQureg(numQubits, env);
+
+    double start = getWallMillis();
+    algorithm(r);
+    double millis = getWallMillis() - start;
+
+    if (env.rank == 0) {
+        if (isDD)
+            printf("%-22s %6d %8s %12.3f %12lld\n", name, numQubits, "dd", millis, getNumDDNodes(r.dd));
+        else
+            printf("%-22s %6d %8s %12.3f %12lld\n", name, numQubits, "dense", millis, (long long int) getNumAmps(r.dense));
+    }
+
+    if (isDD)
+        destroyDDQureg(r.dd, env);
+    else
+        destroyQureg(r.dense, env);
+}
+
+int main (int narg, char** varg) {
+
+    int maxDenseQubits = (narg > 1)? atoi(varg[1]) : 24;
+    int maxQubits = (narg > 2)? atoi(varg[2]) : 48;
+
+    QuESTEnv env = createQuESTEnv();
+    reportQuESTEnv(env);
+
+    const char* names[] = {"randomNumberGenerator", "deutschJozsa", "QFT of basis state", "grover"};
+    void (*algorithms[])(Register) = {randomNumber, deutschJozsa, fourierOfBasisState, grover};
+    int numAlgorithms = 4;
+
+    if (env.rank == 0)
+        printf("\n%-22s %6s %8s %12s %12s\n", "algorithm", "qubits", "backend", "time (ms)", "nodes/amps");
+
+    for (int a=0; a < numAlgorithms; a++) {
+        for (int n=8; n <= maxQubits; n += 8) {
+            if (n <= maxDenseQubits)
+                benchmark(env, names[a], algorithms[a], n, 0);
+            benchmark(env, names[a], algorithms[a], n, 1);
+        }
+    }
+
+    destroyQuESTEnv(env);
+    return 0;
+}
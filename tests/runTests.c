@@ -7,11 +7,18 @@
 
 # include "QuEST.h"
 # include "QuEST_debug.h"
+# include "QuEST_dd.h"
+# include "QuEST_circuit.h"
+# include "QuEST_batch.h"
 
-# define NUM_TESTS 38
+# define NUM_TESTS 58
 # define PATH_TO_TESTS "unit/"
 # define VERBOSE 0
 
+# ifndef M_PI
+# define M_PI 3.14159265358979323846
+# endif
+
 // quad precision unit testing is no more stringent than double
 # if QuEST_PREC==1
 # define COMPARE_PRECISION 10e-5
@@ -187,7 +194,6 @@ int test_initPureState(char testName[200]) {
     initPlusState(vec);
     initZeroState(dens);
     
-    // @TODO this is causing error on 1-process MPI, due to call to copyVecIntoMatrixPairState
     // set dens = |+><+|
     initPureState(dens, vec);
         
@@ -200,6 +206,33 @@ int test_initPureState(char testName[200]) {
     destroyQureg(vec, env);
     destroyQureg(dens, env);
     
+    // a state with distinct amplitudes, whose distributed chunks all pass around the ring of ranks
+    numQubits = 8;
+    vec = createQureg(numQubits, env);
+    dens = createDensityQureg(numQubits, env);
+    initPlusState(vec);
+    for (int q=0; q < numQubits; q++) {
+        rotateY(vec, q, .2*q - .3);
+        rotateZ(vec, q, .1*q + .4);
+    }
+    controlledNot(vec, 7, 1);
+    initPureState(dens, vec);
+    
+    if (passed) passed = compareReals(calcPurity(dens), 1, COMPARE_PRECISION);
+    if (passed) passed = compareReals(calcFidelity(dens, vec), 1, COMPARE_PRECISION);
+    for (int q=0; q < numQubits; q++)
+        if (passed) passed = compareReals(calcProbOfOutcome(dens, q, 0), calcProbOfOutcome(vec, q, 0), COMPARE_PRECISION);
+    
+    // an off-diagonal element, whose row and column lie in different chunks of vec
+    Complex amp2 = {getRealAmp(vec, 2), getImagAmp(vec, 2)};
+    Complex amp200 = {getRealAmp(vec, 200), getImagAmp(vec, 200)};
+    Complex elem = getDensityAmp(dens, 2, 200);
+    if (passed) passed = compareReals(elem.real, amp2.real*amp200.real + amp2.imag*amp200.imag, COMPARE_PRECISION);
+    if (passed) passed = compareReals(elem.imag, amp2.imag*amp200.real - amp2.real*amp200.imag, COMPARE_PRECISION);
+    
+    destroyQureg(vec, env);
+    destroyQureg(dens, env);
+    
     return passed;
 }
 
@@ -1019,6 +1052,46 @@ int test_calcProbOfOutcome(char testName[200]){
     return passed;
 }
 
+int test_calcProbsOfOutcomes(char testName[200]){
+    int passed=1;
+    int numQubits=6;
+    
+    Qureg vec = createQureg(numQubits, env);
+    Qureg mixed = createDensityQureg(numQubits, env);
+    
+    initPlusState(vec);
+    for (int q=0; q < numQubits; q++)
+        rotateY(vec, q, .3*q - .5);
+    controlledNot(vec, 5, 0);
+    initPureState(mixed, vec);
+    applyOneQubitDepolariseError(mixed, 4, .1);
+    
+    // every qubit in both outcomes, including those beyond a distributed chunk and a repeated qubit
+    int qubits[2*6 + 1];
+    int outcomes[2*6 + 1];
+    qreal probs[2*6 + 1];
+    int numMeasures = 2*numQubits + 1;
+    for (int m=0; m < 2*numQubits; m++) {
+        qubits[m] = m / 2;
+        outcomes[m] = m % 2;
+    }
+    qubits[2*numQubits] = 3;
+    outcomes[2*numQubits] = 1;
+    
+    Qureg quregs[2] = {vec, mixed};
+    for (int r=0; r < 2; r++) {
+        calcProbsOfOutcomes(quregs[r], qubits, outcomes, numMeasures, probs);
+        for (int m=0; m < numMeasures; m++)
+            if (passed) passed = compareReals(probs[m], calcProbOfOutcome(quregs[r], qubits[m], outcomes[m]), COMPARE_PRECISION);
+        for (int q=0; q < numQubits; q++)
+            if (passed) passed = compareReals(probs[2*q] + probs[2*q + 1], 1, COMPARE_PRECISION);
+    }
+    
+    destroyQureg(vec, env);
+    destroyQureg(mixed, env);
+    return passed;
+}
+
 int test_collapseToOutcome(char testName[200]){
     int passed=1;
 
@@ -1185,7 +1258,7 @@ int test_measure(char testName[200]){
     int nTrials=10;
     unsigned long int seedArray[] = {18239, 12391};
     int numSeeds = 2;
-    seedQuEST(seedArray, numSeeds);
+    seedQureg(mq, seedArray, numSeeds);
     for (qubit=0; qubit<numQubits; qubit++){
         if (env.rank==0) printf("  %d trials: measure qubit %d when in state |+>:\n", nTrials, qubit);
         if (env.rank==0) printf("    value of qubit = [");
@@ -1367,6 +1440,131 @@ int test_calcInnerProduct(char testName[200]) {
     return passed;
 }
 
+int test_calcInnerProducts(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+    int numKets=4;
+    
+    Qureg bra = createQureg(numQubits, env);
+    Qureg kets[4];
+    Complex prods[4];
+    
+    initPlusState(bra);
+    for (int q=0; q < numQubits; q++)
+        rotateY(bra, q, .3*q - .2);
+    tGate(bra, 2);
+    
+    // kets with differing real and imaginary overlaps, including the bra itself
+    for (int k=0; k < numKets; k++) {
+        kets[k] = createQureg(numQubits, env);
+        initClassicalState(kets[k], 3*k);
+        for (int q=0; q < numQubits; q++)
+            rotateX(kets[k], q, .4*k + .1*q);
+    }
+    initPlusState(kets[3]);
+    for (int q=0; q < numQubits; q++)
+        rotateY(kets[3], q, .3*q - .2);
+    tGate(kets[3], 2);
+    
+    calcInnerProducts(bra, kets, numKets, prods);
+    for (int k=0; k < numKets; k++) {
+        Complex prod = calcInnerProduct(bra, kets[k]);
+        if (passed) passed = compareReals(prods[k].real, prod.real, COMPARE_PRECISION);
+        if (passed) passed = compareReals(prods[k].imag, prod.imag, COMPARE_PRECISION);
+    }
+    if (passed) passed = compareReals(prods[3].real, 1, COMPARE_PRECISION);
+    
+    for (int k=0; k < numKets; k++)
+        destroyQureg(kets[k], env);
+    destroyQureg(bra, env);
+    return passed;
+}
+
+int test_calcExpecPauli(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+    
+    Qureg vec, work, mixed;
+    vec = createQureg(numQubits, env);
+    work = createQureg(numQubits, env);
+    mixed = createDensityQureg(numQubits, env);
+    
+    initPlusState(vec);
+    for (int q=0; q < numQubits; q++) {
+        rotateY(vec, q, .4*q - .7);
+        rotateZ(vec, q, .3*q + .2);
+    }
+    controlledNot(vec, 0, 4);
+    controlledNot(vec, 3, 1);
+    initPureState(mixed, vec);
+    
+    // products including each Pauli upon low and high qubits, checked by applying them to a clone
+    int targets[][3] = {{0, 4, 2}, {4, 1, 3}, {2, 3, 0}, {1, 0, 4}};
+    enum pauliOpType codes[][3] = {
+        {PAULI_X, PAULI_Y, PAULI_Z}, {PAULI_Y, PAULI_Y, PAULI_I}, {PAULI_Z, PAULI_X, PAULI_Z}, {PAULI_X, PAULI_X, PAULI_Y}};
+    enum pauliOpType allCodes[4*5];
+    qreal coeffs[4] = {.5, -1.5, 2, .25};
+    qreal sum = 0;
+    
+    for (int p=0; p < 4; p++) {
+        cloneQureg(work, vec);
+        for (int i=0; i < 3; i++) {
+            if (codes[p][i] == PAULI_X) pauliX(work, targets[p][i]);
+            if (codes[p][i] == PAULI_Y) pauliY(work, targets[p][i]);
+            if (codes[p][i] == PAULI_Z) pauliZ(work, targets[p][i]);
+        }
+        Complex prod = calcInnerProduct(vec, work);
+        qreal expec = calcExpecPauliProd(vec, targets[p], codes[p], 3);
+        if (passed) passed = compareReals(expec, prod.real, COMPARE_PRECISION);
+        if (passed) passed = compareReals(calcExpecPauliProd(mixed, targets[p], codes[p], 3), prod.real, COMPARE_PRECISION);
+        
+        for (int q=0; q < numQubits; q++)
+            allCodes[p*numQubits + q] = PAULI_I;
+        for (int i=0; i < 3; i++)
+            allCodes[p*numQubits + targets[p][i]] = codes[p][i];
+        sum += coeffs[p] * prod.real;
+    }
+    
+    // sums, including terms which share a flip mask
+    allCodes[3*numQubits + 2] = PAULI_Z;
+    sum += coeffs[3] * calcExpecPauliProd(vec, (int[]) {1, 0, 4, 2}, (enum pauliOpType[]) {PAULI_X, PAULI_X, PAULI_Y, PAULI_Z}, 4)
+         - coeffs[3] * calcExpecPauliProd(vec, targets[3], codes[3], 3);
+    if (passed) passed = compareReals(calcExpecPauliSum(vec, allCodes, coeffs, 4), sum, COMPARE_PRECISION);
+    if (passed) passed = compareReals(calcExpecPauliSum(mixed, allCodes, coeffs, 4), sum, COMPARE_PRECISION);
+    
+    // several sums at once, whose terms share flip masks across sums: the full sum, its last two terms, 
+    // and its first term alone
+    int numSumTerms[3] = {4, 2, 1};
+    enum pauliOpType sumsCodes[7*5];
+    qreal sumsCoeffs[7];
+    int termInds[7] = {0, 1, 2, 3, 2, 3, 0};
+    for (int t=0; t < 7; t++) {
+        sumsCoeffs[t] = coeffs[termInds[t]];
+        for (int q=0; q < numQubits; q++)
+            sumsCodes[t*numQubits + q] = allCodes[termInds[t]*numQubits + q];
+    }
+    qreal expecs[3];
+    for (int r=0; r < 2; r++) {
+        Qureg qureg = (r == 0)? vec : mixed;
+        calcExpecPauliSums(qureg, sumsCodes, sumsCoeffs, numSumTerms, 3, expecs);
+        if (passed) passed = compareReals(expecs[0], sum, COMPARE_PRECISION);
+        if (passed) passed = compareReals(expecs[1], calcExpecPauliSum(qureg, &allCodes[2*numQubits], &coeffs[2], 2), COMPARE_PRECISION);
+        if (passed) passed = compareReals(expecs[2], calcExpecPauliSum(qureg, allCodes, coeffs, 1), COMPARE_PRECISION);
+    }
+    
+    // dephasing scales <X> by 1 - 2 prob
+    int target = 3;
+    enum pauliOpType code = PAULI_X;
+    qreal before = calcExpecPauliProd(mixed, &target, &code, 1);
+    applyOneQubitDephaseError(mixed, target, .2);
+    if (passed) passed = compareReals(calcExpecPauliProd(mixed, &target, &code, 1), .6*before, COMPARE_PRECISION);
+    
+    destroyQureg(vec, env);
+    destroyQureg(work, env);
+    destroyQureg(mixed, env);
+    return passed;
+}
+
 int test_calcFidelity(char testName[200]) {
     int passed=1;
     int numQubits=5;
@@ -1700,7 +1898,1414 @@ int test_applyTwoQubitDephaseError(char testName[200]) {
     return passed;
 }
 
+int test_applyKrausMap(char testName[200]) {
+    int passed=1;
+    int numQubits=3;
+    
+    Qureg qureg, quregVerif;
+    qureg = createDensityQureg(numQubits, env);
+    quregVerif = createDensityQureg(numQubits, env);
+    
+    // row-major I, X, Y, Z
+    Complex paulis[4][4] = {
+        {{1,0}, {0,0}, {0,0}, {1,0}},
+        {{0,0}, {1,0}, {1,0}, {0,0}},
+        {{0,0}, {0,-1}, {0,1}, {0,0}},
+        {{1,0}, {0,0}, {0,0}, {-1,0}}};
+    Complex ops[16*16];
+    
+    // amplitude damping of |1> leaves it excited with probability 1-gamma
+    qreal gamma = .3;
+    int target = 2;
+    Complex damping[8] = {
+        {1,0}, {0,0}, {0,0}, {sqrt(1-gamma),0},
+        {0,0}, {sqrt(gamma),0}, {0,0}, {0,0}};
+    initClassicalState(qureg, 1<<target);
+    applyKrausMap(qureg, &target, 1, damping, 2);
+    if (passed) passed = compareReals(calcProbOfOutcome(qureg, target, 1), 1-gamma, COMPARE_PRECISION);
+    if (passed) passed = compareReals(calcTotalProb(qureg), 1, COMPARE_PRECISION);
+    
+    // depolarising as weighted Paulis, upon every qubit and ordered pair of qubits
+    qreal prob = .375;
+    for (int q=0; q < numQubits; q++) {
+        for (int i=0; i < 4; i++)
+            for (int j=0; j < 4; j++) {
+                qreal fac = sqrt((i == 0)? 1-prob : prob/3);
+                ops[i*4 + j] = (Complex) {.real=fac*paulis[i][j].real, .imag=fac*paulis[i][j].imag};
+            }
+        initStateDebug(qureg);
+        initStateDebug(quregVerif);
+        applyKrausMap(qureg, &q, 1, ops, 4);
+        applyOneQubitDepolariseError(quregVerif, q, prob);
+        if (passed) passed = compareStates(qureg, quregVerif, COMPARE_PRECISION);
+    }
+    prob = .5;
+    int pairs[][2] = {{0,1}, {2,0}, {1,2}};
+    for (int p=0; p < 3; p++) {
+        for (int a=0; a < 4; a++)
+            for (int b=0; b < 4; b++) {
+                qreal fac = sqrt((a == 0 && b == 0)? 1-prob : prob/15);
+                for (int r=0; r < 4; r++)
+                    for (int c=0; c < 4; c++) {
+                        // targets[0] is the least significant bit of r and c
+                        Complex pa = paulis[a][(r&1)*2 + (c&1)];
+                        Complex pb = paulis[b][(r>>1)*2 + (c>>1)];
+                        ops[(a*4+b)*16 + r*4 + c] = (Complex) {
+                            .real=fac*(pa.real*pb.real - pa.imag*pb.imag),
+                            .imag=fac*(pa.real*pb.imag + pa.imag*pb.real)};
+                    }
+            }
+        initStateDebug(qureg);
+        initStateDebug(quregVerif);
+        applyKrausMap(qureg, pairs[p], 2, ops, 16);
+        applyTwoQubitDepolariseError(quregVerif, pairs[p][0], pairs[p][1], prob);
+        if (passed) passed = compareStates(qureg, quregVerif, COMPARE_PRECISION);
+    }
+    
+    // a single unitary Kraus operator, controlled on targets[0], with either target order
+    for (int i=0; i < 16; i++)
+        ops[i] = (Complex) {.real=0, .imag=0};
+    ops[0*4 + 0].real = 1;
+    ops[1*4 + 3].real = 1;
+    ops[2*4 + 2].real = 1;
+    ops[3*4 + 1].real = 1;
+    int targetPairs[][2] = {{0,2}, {2,1}, {1,0}};
+    for (int p=0; p < 3; p++) {
+        initStateDebug(qureg);
+        initStateDebug(quregVerif);
+        applyKrausMap(qureg, targetPairs[p], 2, ops, 1);
+        controlledNot(quregVerif, targetPairs[p][0], targetPairs[p][1]);
+        if (passed) passed = compareStates(qureg, quregVerif, COMPARE_PRECISION);
+    }
+    
+    destroyQureg(qureg, env);
+    destroyQureg(quregVerif, env);
+    return passed;
+}
 
+/** a circuit exercising every noise channel, for test_calcTrajectoryAverages */
+void applyNoisyCircuit(Qureg qureg, void* args) {
+    hadamard(qureg, 0);
+    hadamard(qureg, 1);
+    applyOneQubitDephaseError(qureg, 0, .2);
+    applyTwoQubitDephaseError(qureg, 0, 1, .3);
+    hadamard(qureg, 0);
+    hadamard(qureg, 1);
+    pauliX(qureg, 2);
+    applyOneQubitDepolariseError(qureg, 2, .3);
+    controlledNot(qureg, 2, 1);
+    applyTwoQubitDepolariseError(qureg, 1, 2, .4);
+}
+
+void observeNoisyCircuit(Qureg qureg, void* args, qreal* values) {
+    for (int q=0; q < 3; q++)
+        values[q] = calcProbOfOutcome(qureg, q, 1);
+    values[3] = calcTotalProb(qureg);
+}
+
+int test_calcTrajectoryAverages(char testName[200]) {
+    int passed=1;
+    int numQubits=3;
+    int numTrajectories=2000;
+    qreal exact[4], averages[4];
+    
+    Qureg mixed = createDensityQureg(numQubits, env);
+    applyNoisyCircuit(mixed, NULL);
+    observeNoisyCircuit(mixed, NULL, exact);
+    destroyQureg(mixed, env);
+    
+    // trajectories agree with the density matrix to within a generous statistical error
+    unsigned long int seedArray[] = {27182, 81828};
+    seedQuEST(&env, seedArray, 2);
+    calcTrajectoryAverages(env, numQubits, numTrajectories, 
+        applyNoisyCircuit, observeNoisyCircuit, NULL, 4, averages);
+    for (int q=0; q < numQubits; q++)
+        if (passed) passed = compareReals(averages[q], exact[q], .05);
+    
+    // the same keys reproduce the same trajectories, however they are shared between threads
+    qreal repeated[4];
+    calcTrajectoryAverages(env, numQubits, numTrajectories, 
+        applyNoisyCircuit, observeNoisyCircuit, NULL, 4, repeated);
+    for (int o=0; o < 4; o++)
+        if (passed) passed = (averages[o] == repeated[o]);
+    
+    // and each trajectory stays normalised
+    if (passed) passed = compareReals(averages[3], 1, COMPARE_PRECISION);
+    
+    return passed;
+}
+
+int test_densityMatrixGates(char testName[200]) {
+    int passed=1;
+    int numQubits=3;
+    
+    Qureg pure, mixed;
+    pure = createQureg(numQubits, env);
+    mixed = createDensityQureg(numQubits, env);
+    
+    ComplexMatrix2 u;
+    u.r0c0 = (Complex) {.real=.5, .imag=.5};
+    u.r0c1 = (Complex) {.real=.5, .imag=-.5}; 
+    u.r1c0 = (Complex) {.real=.5, .imag=-.5};
+    u.r1c1 = (Complex) {.real=.5, .imag=.5};
+    Complex alpha = {.real=.6, .imag=0}, beta = {.real=0, .imag=.8};
+    Vector axis = {1, -2, 3};
+    int controls[] = {0, 2};
+    
+    // the same circuit on a state-vector and its density matrix, with every target and control 
+    // order, so that the distributed build exercises both the local and exchanging fused kernels
+    initClassicalState(pure, 5);
+    initClassicalState(mixed, 5);
+    Qureg regs[2] = {pure, mixed};
+    for (int r=0; r < 2; r++) {
+        Qureg qureg = regs[r];
+        for (int q=0; q < numQubits; q++) {
+            hadamard(qureg, q);
+            rotateX(qureg, q, .3*q + .1);
+            rotateY(qureg, q, .2*q - .4);
+            rotateZ(qureg, q, .5*q + .3);
+        }
+        pauliX(qureg, 0);           pauliY(qureg, 1);           pauliZ(qureg, 2);
+        sGate(qureg, 1);            tGate(qureg, 2);            phaseShift(qureg, 0, 1.1);
+        unitary(qureg, 2, u);       compactUnitary(qureg, 1, alpha, beta);
+        rotateAroundAxis(qureg, 0, .9, axis);
+        controlledNot(qureg, 2, 0);                     controlledNot(qureg, 0, 1);
+        controlledPauliY(qureg, 1, 2);                  controlledPhaseFlip(qureg, 0, 2);
+        controlledPhaseShift(qureg, 2, 1, .7);          multiControlledPhaseShift(qureg, controls, 2, -.3);
+        multiControlledPhaseFlip(qureg, controls, 2);
+        controlledRotateX(qureg, 1, 0, .4);             controlledRotateY(qureg, 2, 1, -.6);
+        controlledRotateZ(qureg, 0, 2, .8);             controlledRotateAroundAxis(qureg, 2, 0, 1.3, axis);
+        controlledUnitary(qureg, 0, 2, u);              controlledCompactUnitary(qureg, 2, 1, alpha, beta);
+        multiControlledUnitary(qureg, controls, 2, 1, u);
+    }
+    
+    // rho stays pure and equal to |psi><psi|
+    if (passed) passed = compareReals(calcPurity(mixed), 1, COMPARE_PRECISION);
+    if (passed) passed = compareReals(calcFidelity(mixed, pure), 1, COMPARE_PRECISION);
+    if (passed) passed = compareReals(calcTotalProb(mixed), 1, COMPARE_PRECISION);
+    for (int q=0; q < numQubits; q++)
+        if (passed) passed = compareReals(calcProbOfOutcome(mixed, q, 1), calcProbOfOutcome(pure, q, 1), COMPARE_PRECISION);
+    
+    destroyQureg(pure, env);
+    destroyQureg(mixed, env);
+    return passed;
+}
+
+int test_ddQureg(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+    
+    Qureg mq, mqVerif;
+    mq = createQureg(numQubits, env);
+    mqVerif = createQureg(numQubits, env);
+    DDQureg dd = createDDQureg(numQubits, env);
+    
+    ComplexMatrix2 u;
+    u.r0c0 = (Complex) {.real=.5, .imag=.5};
+    u.r0c1 = (Complex) {.real=.5, .imag=-.5}; 
+    u.r1c0 = (Complex) {.real=.5, .imag=-.5};
+    u.r1c1 = (Complex) {.real=.5, .imag=.5};
+    Vector axis = {1, -2, 3};
+    int controls[] = {0, 3};
+    int phaseQubits[] = {1, 2, 4};
+    
+    // the same circuit, including controls above and below the target, on both backends
+    initClassicalState(mq, 6);
+    ddInitClassicalState(dd, 6);
+    for (int q=0; q < numQubits; q++) {
+        hadamard(mq, q);
+        ddHadamard(dd, q);
+        rotateY(mq, q, .3*q);
+        ddRotateY(dd, q, .3*q);
+    }
+    controlledNot(mq, 4, 1);                        ddControlledNot(dd, 4, 1);
+    controlledNot(mq, 0, 2);                        ddControlledNot(dd, 0, 2);
+    pauliY(mq, 3);                                  ddPauliY(dd, 3);
+    tGate(mq, 0);                                   ddTGate(dd, 0);
+    controlledPauliY(mq, 2, 4);                     ddControlledPauliY(dd, 2, 4);
+    rotateAroundAxis(mq, 1, 1.2, axis);             ddRotateAroundAxis(dd, 1, 1.2, axis);
+    controlledRotateX(mq, 3, 0, .7);                ddControlledRotateX(dd, 3, 0, .7);
+    controlledPhaseShift(mq, 1, 3, .4);             ddControlledPhaseShift(dd, 1, 3, .4);
+    multiControlledPhaseShift(mq, phaseQubits, 3, -.9);
+    ddMultiControlledPhaseShift(dd, phaseQubits, 3, -.9);
+    multiControlledPhaseFlip(mq, phaseQubits, 3);   ddMultiControlledPhaseFlip(dd, phaseQubits, 3);
+    controlledUnitary(mq, 0, 4, u);                 ddControlledUnitary(dd, 0, 4, u);
+    multiControlledUnitary(mq, controls, 2, 2, u);  ddMultiControlledUnitary(dd, controls, 2, 2, u);
+    
+    copyDDQuregToQureg(dd, mqVerif);
+    if (passed) passed = compareStates(mq, mqVerif, COMPARE_PRECISION);
+    if (passed) passed = compareReals(ddCalcTotalProb(dd), 1, COMPARE_PRECISION);
+    for (int q=0; q < numQubits; q++)
+        if (passed) passed = compareReals(ddCalcProbOfOutcome(dd, q, 1), calcProbOfOutcome(mq, q, 1), COMPARE_PRECISION);
+    
+    // collapse agrees
+    collapseToOutcome(mq, 2, 1);
+    ddCollapseToOutcome(dd, 2, 1);
+    copyDDQuregToQureg(dd, mqVerif);
+    if (passed) passed = compareStates(mq, mqVerif, COMPARE_PRECISION);
+    destroyDDQureg(dd, env);
+    
+    // structured states stay linear in size far beyond dense capacity
+    dd = createDDQureg(48, env);
+    ddHadamard(dd, 0);
+    for (int q=1; q < 48; q++)
+        ddControlledNot(dd, 0, q);                  // (|0...0> + |1...1>)/sqrt(2)
+    if (passed) passed = (getNumDDNodes(dd) <= 2*48);
+    if (passed) passed = compareReals(ddGetProbAmp(dd, 0), .5, COMPARE_PRECISION);
+    for (int q=0; q < 48; q++)
+        ddHadamard(dd, q);                          // uniform over even-parity states
+    // these probabilities are far below COMPARE_PRECISION, so are compared relative to 2^-47
+    if (passed) passed = compareReals(ddGetProbAmp(dd, 3) * pow(2, 47), 1, COMPARE_PRECISION);
+    if (passed) passed = compareReals(ddGetProbAmp(dd, 1) * pow(2, 47), 0, COMPARE_PRECISION);
+    if (passed) passed = compareReals(ddCalcTotalProb(dd), 1, COMPARE_PRECISION);
+    if (passed) passed = compareReals(ddCalcProbOfOutcome(dd, 47, 0), .5, COMPARE_PRECISION);
+    destroyDDQureg(dd, env);
+    
+    destroyQureg(mq, env);
+    destroyQureg(mqVerif, env);
+    return passed;
+}
+
+
+
+/** a unitary with no special structure */
+ComplexMatrix2 getGateTestMatrix(void) {
+    ComplexMatrix2 u;
+    u.r0c0 = (Complex) {.real=.5, .imag=.5};
+    u.r0c1 = (Complex) {.real=.7, .imag=.1};
+    u.r1c0 = (Complex) {.real=.5, .imag=-.5};
+    u.r1c1 = (Complex) {.real=-.1, .imag=.7};
+    return u;
+}
+
+int test_runCircuit(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+    
+    Circuit circuit = createCircuit(numQubits);
+    int slot = createCircuitParam(circuit, .5);
+    circuitHadamard(circuit, 0);
+    circuitPauliX(circuit, 4);
+    circuitPauliY(circuit, 1);
+    circuitPauliZ(circuit, 2);
+    circuitSGate(circuit, 3);
+    circuitTGate(circuit, 0);
+    circuitPhaseShift(circuit, 1, .3);
+    circuitRotateX(circuit, 2, .4);
+    circuitRotateY(circuit, 3, -.8);
+    circuitRotateZ(circuit, 4, 1.2);
+    circuitRotateAroundAxis(circuit, 0, .7, (Vector) {.x=.2, .y=1, .z=-1});
+    circuitCompactUnitary(circuit, 1, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+    circuitUnitary(circuit, 2, getGateTestMatrix());
+    circuitControlledNot(circuit, 4, 0);
+    circuitControlledPauliY(circuit, 0, 3);
+    circuitControlledPhaseShift(circuit, 2, 4, .9);
+    circuitControlledPhaseFlip(circuit, 3, 1);
+    circuitControlledRotateX(circuit, 1, 2, .2);
+    circuitControlledRotateY(circuit, 2, 3, .3);
+    circuitControlledRotateZ(circuit, 3, 4, .4);
+    circuitControlledRotateAroundAxis(circuit, 4, 0, 1.1, (Vector) {.x=-1, .y=0, .z=2});
+    circuitControlledCompactUnitary(circuit, 0, 2, (Complex) {.real=0, .imag=.6}, (Complex) {.real=.8, .imag=0});
+    circuitControlledUnitary(circuit, 1, 4, getGateTestMatrix());
+    circuitMultiControlledUnitary(circuit, (int[]) {0, 3, 4}, 3, 2, getGateTestMatrix());
+    circuitMultiControlledPhaseShift(circuit, (int[]) {1, 2, 4}, 3, -.6);
+    circuitMultiControlledPhaseFlip(circuit, (int[]) {0, 1, 3}, 3);
+    circuitParamRotateY(circuit, 1, slot);
+    circuitParamControlledRotateX(circuit, 3, 0, slot);
+    if (passed) passed = (getNumCircuitGates(circuit) == 28);
+    
+    Qureg vec, vecDirect, mat, matDirect;
+    vec = createQureg(numQubits, env);
+    vecDirect = createQureg(numQubits, env);
+    mat = createDensityQureg(numQubits, env);
+    matDirect = createDensityQureg(numQubits, env);
+    
+    // one recording serves runs from several initial states, with the slot changed between them
+    for (int run=0; run < 3; run++) {
+        qreal angle = .5 + run;
+        setCircuitParam(circuit, slot, angle);
+        
+        initClassicalState(vec, 5*run + 3);
+        rotateY(vec, run, .4);
+        cloneQureg(vecDirect, vec);
+        initPureState(mat, vec);
+        applyOneQubitDepolariseError(mat, 2, .1);
+        cloneQureg(matDirect, mat);
+        
+        runCircuit(circuit, vec);
+        runCircuit(circuit, mat);
+        Qureg direct[2] = {vecDirect, matDirect};
+        for (int i=0; i < 2; i++) {
+            Qureg q = direct[i];
+            hadamard(q, 0);
+            pauliX(q, 4);
+            pauliY(q, 1);
+            pauliZ(q, 2);
+            sGate(q, 3);
+            tGate(q, 0);
+            phaseShift(q, 1, .3);
+            rotateX(q, 2, .4);
+            rotateY(q, 3, -.8);
+            rotateZ(q, 4, 1.2);
+            rotateAroundAxis(q, 0, .7, (Vector) {.x=.2, .y=1, .z=-1});
+            compactUnitary(q, 1, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+            unitary(q, 2, getGateTestMatrix());
+            controlledNot(q, 4, 0);
+            controlledPauliY(q, 0, 3);
+            controlledPhaseShift(q, 2, 4, .9);
+            controlledPhaseFlip(q, 3, 1);
+            controlledRotateX(q, 1, 2, .2);
+            controlledRotateY(q, 2, 3, .3);
+            controlledRotateZ(q, 3, 4, .4);
+            controlledRotateAroundAxis(q, 4, 0, 1.1, (Vector) {.x=-1, .y=0, .z=2});
+            controlledCompactUnitary(q, 0, 2, (Complex) {.real=0, .imag=.6}, (Complex) {.real=.8, .imag=0});
+            controlledUnitary(q, 1, 4, getGateTestMatrix());
+            multiControlledUnitary(q, (int[]) {0, 3, 4}, 3, 2, getGateTestMatrix());
+            multiControlledPhaseShift(q, (int[]) {1, 2, 4}, 3, -.6);
+            multiControlledPhaseFlip(q, (int[]) {0, 1, 3}, 3);
+            rotateY(q, 1, angle);
+            controlledRotateX(q, 3, 0, angle);
+        }
+        if (passed) passed = compareStates(vec, vecDirect, COMPARE_PRECISION);
+        if (passed) passed = compareStates(mat, matDirect, COMPARE_PRECISION);
+    }
+    
+    destroyQureg(vec, env);
+    destroyQureg(vecDirect, env);
+    destroyQureg(mat, env);
+    destroyQureg(matDirect, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+/** the gates of the circuit recorded in test_calcExpecPauliSumGradient, applied directly */
+void applyGradientTestCircuit(Qureg qureg, qreal* params) {
+    for (int q=0; q < 5; q++) {
+        hadamard(qureg, q);
+        rotateY(qureg, q, params[q%4]);
+    }
+    controlledNot(qureg, 0, 1);
+    controlledRotateX(qureg, 1, 3, params[1]);
+    tGate(qureg, 2);
+    sGate(qureg, 3);
+    rotateZ(qureg, 4, .3);
+    rotateZ(qureg, 2, params[2]);
+    controlledRotateZ(qureg, 4, 0, params[3]);
+    controlledRotateY(qureg, 3, 4, params[0]);
+    controlledPhaseShift(qureg, 0, 2, .7);
+    controlledPauliY(qureg, 2, 4);
+    phaseShift(qureg, 1, .4);
+    rotateX(qureg, 0, params[3]);
+    controlledPhaseFlip(qureg, 1, 4);
+    pauliY(qureg, 3);
+    compactUnitary(qureg, 2, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+    multiControlledUnitary(qureg, (int[]) {0, 4}, 2, 1, getGateTestMatrix());
+    rotateAroundAxis(qureg, 3, .9, (Vector) {.x=1, .y=-2, .z=.5});
+    multiControlledPhaseFlip(qureg, (int[]) {1, 2, 3}, 3);
+}
+
+int test_calcExpecPauliSumGradient(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+    int numParams=4;
+    
+    // central differences of step 1e-4 are accurate to ~1e-8 in double precision
+# if QuEST_PREC==1
+    qreal step = 1e-2, precision = 1e-2;
+# else
+    qreal step = 1e-4, precision = 1e-7;
+# endif
+    
+    qreal params[4] = {.3, -1.1, .8, 2.1};
+    Circuit circuit = createCircuit(numQubits);
+    for (int p=0; p < numParams; p++)
+        createCircuitParam(circuit, params[p]);
+    for (int q=0; q < numQubits; q++) {
+        circuitHadamard(circuit, q);
+        circuitParamRotateY(circuit, q, q%4);
+    }
+    circuitControlledNot(circuit, 0, 1);
+    circuitParamControlledRotateX(circuit, 1, 3, 1);
+    circuitTGate(circuit, 2);
+    circuitSGate(circuit, 3);
+    circuitRotateZ(circuit, 4, .3);
+    circuitParamRotateZ(circuit, 2, 2);
+    circuitParamControlledRotateZ(circuit, 4, 0, 3);
+    circuitParamControlledRotateY(circuit, 3, 4, 0);
+    circuitControlledPhaseShift(circuit, 0, 2, .7);
+    circuitControlledPauliY(circuit, 2, 4);
+    circuitPhaseShift(circuit, 1, .4);
+    circuitParamRotateX(circuit, 0, 3);
+    circuitControlledPhaseFlip(circuit, 1, 4);
+    circuitPauliY(circuit, 3);
+    circuitCompactUnitary(circuit, 2, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+    circuitMultiControlledUnitary(circuit, (int[]) {0, 4}, 2, 1, getGateTestMatrix());
+    circuitRotateAroundAxis(circuit, 3, .9, (Vector) {.x=1, .y=-2, .z=.5});
+    circuitMultiControlledPhaseFlip(circuit, (int[]) {1, 2, 3}, 3);
+    
+    enum pauliOpType codes[3*5] = {
+        PAULI_Z, PAULI_Z, PAULI_I, PAULI_I, PAULI_X,
+        PAULI_I, PAULI_Y, PAULI_X, PAULI_Z, PAULI_I,
+        PAULI_X, PAULI_I, PAULI_I, PAULI_Y, PAULI_Y};
+    qreal coeffs[3] = {.7, -1.3, .4};
+    
+    Qureg input, qureg, work;
+    input = createQureg(numQubits, env);
+    qureg = createQureg(numQubits, env);
+    work = createQureg(numQubits, env);
+    initPlusState(input);
+    for (int q=0; q < numQubits; q++)
+        rotateX(input, q, .2*q + .1);
+    cloneQureg(qureg, input);
+    
+    // the expected value matches the circuit applied directly, and the register is restored
+    qreal grads[4];
+    qreal expec = calcExpecPauliSumGradient(circuit, qureg, work, codes, coeffs, 3, grads);
+    if (passed) passed = compareStates(qureg, input, COMPARE_PRECISION);
+    cloneQureg(work, input);
+    applyGradientTestCircuit(work, params);
+    if (passed) passed = compareReals(expec, calcExpecPauliSum(work, codes, coeffs, 3), COMPARE_PRECISION);
+    
+    // each slot's derivative, including those bound to several and to controlled rotations
+    qreal unused[4];
+    for (int p=0; p < numParams; p++) {
+        setCircuitParam(circuit, p, params[p] + step);
+        qreal above = calcExpecPauliSumGradient(circuit, qureg, work, codes, coeffs, 3, unused);
+        setCircuitParam(circuit, p, params[p] - step);
+        qreal below = calcExpecPauliSumGradient(circuit, qureg, work, codes, coeffs, 3, unused);
+        setCircuitParam(circuit, p, params[p]);
+        if (passed) passed = compareReals(grads[p], (above - below)/(2*step), precision);
+    }
+    
+    destroyQureg(input, env);
+    destroyQureg(qureg, env);
+    destroyQureg(work, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+/** the quantum Fourier transform, with its final swaps made of controlled-NOTs, or its inverse */
+void recordQFT(Circuit circuit, int isInverse) {
+    int n = circuit.numQubits;
+    if (!isInverse) {
+        for (int j=0; j < n; j++) {
+            circuitHadamard(circuit, j);
+            for (int k=j+1; k < n; k++)
+                circuitControlledPhaseShift(circuit, j, k, M_PI/(1 << (k-j)));
+        }
+    }
+    for (int j=0; j < n/2; j++) {
+        circuitControlledNot(circuit, j, n-1-j);
+        circuitControlledNot(circuit, n-1-j, j);
+        circuitControlledNot(circuit, j, n-1-j);
+    }
+    if (isInverse) {
+        for (int j=n-1; j >= 0; j--) {
+            for (int k=n-1; k > j; k--)
+                circuitControlledPhaseShift(circuit, j, k, -M_PI/(1 << (k-j)));
+            circuitHadamard(circuit, j);
+        }
+    }
+}
+
+/** 6 rotations, then the QFT and its inverse */
+void recordCancellingCircuit(Circuit circuit) {
+    for (int q=0; q < circuit.numQubits; q++)
+        circuitRotateY(circuit, q, .3*q + .1);
+    recordQFT(circuit, 0);
+    recordQFT(circuit, 1);
+}
+
+/** rotations, phases and unitaries separated by gates which commute with them */
+void recordMergingCircuit(Circuit circuit) {
+    for (int q=0; q < 4; q++)
+        circuitHadamard(circuit, q);
+    circuitRotateZ(circuit, 0, .3);
+    circuitControlledNot(circuit, 0, 1);
+    circuitRotateZ(circuit, 0, .5);
+    circuitTGate(circuit, 2);
+    circuitSGate(circuit, 2);
+    circuitRotateX(circuit, 1, .2);
+    circuitPauliX(circuit, 1);
+    circuitRotateX(circuit, 1, .4);
+    circuitCompactUnitary(circuit, 3, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+    circuitCompactUnitary(circuit, 3, (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=-.8});
+}
+
+/** a Grover-style phase flip of |000000>, then a rotation controlled upon qubit 1 being 0 */
+void recordConjugatedCircuit(Circuit circuit) {
+    int qubits[6] = {0, 1, 2, 3, 4, 5};
+    for (int q=0; q < 6; q++)
+        circuitHadamard(circuit, q);
+    for (int q=0; q < 6; q++)
+        circuitPauliX(circuit, q);
+    circuitMultiControlledPhaseFlip(circuit, qubits, 6);
+    for (int q=0; q < 6; q++)
+        circuitPauliX(circuit, q);
+    for (int q=0; q < 6; q++)
+        circuitHadamard(circuit, q);
+    circuitPauliX(circuit, 1);
+    circuitControlledRotateY(circuit, 1, 3, .4);
+    circuitPauliX(circuit, 1);
+}
+
+/** diagonal gates separated by gates which commute with them */
+void recordDiagonalCircuit(Circuit circuit) {
+    for (int q=0; q < 4; q++)
+        circuitHadamard(circuit, q);
+    circuitRotateZ(circuit, 0, .3);
+    circuitHadamard(circuit, 2);
+    circuitControlledPhaseFlip(circuit, 0, 1);
+    circuitControlledNot(circuit, 1, 3);
+    circuitTGate(circuit, 1);
+}
+
+/** gates which, from |000000>, mostly act upon qubits in known basis states */
+void recordConstantsCircuit(Circuit circuit) {
+    circuitPauliX(circuit, 0);
+    circuitPauliX(circuit, 2);
+    circuitControlledNot(circuit, 0, 1);
+    circuitHadamard(circuit, 3);
+    circuitControlledNot(circuit, 3, 2);
+    circuitControlledPhaseFlip(circuit, 1, 3);
+    circuitControlledRotateY(circuit, 0, 3, .7);
+    circuitPauliX(circuit, 0);
+    circuitControlledUnitary(circuit, 0, 2, getGateTestMatrix());
+}
+
+/** whether two circuits act alike upon a state-vector and a density matrix, from a general
+ * state, or from basis states inputInd and optimisedInd if inputInd >= 0 */
+int compareOptimisedCircuits(Circuit circuit, Circuit optimised, long long int inputInd, long long int optimisedInd) {
+    Qureg vec, vecOpt, mat, matOpt;
+    vec = createQureg(circuit.numQubits, env);
+    vecOpt = createQureg(circuit.numQubits, env);
+    mat = createDensityQureg(circuit.numQubits, env);
+    matOpt = createDensityQureg(circuit.numQubits, env);
+
+    if (inputInd < 0) {
+        initPlusState(vec);
+        for (int q=0; q < circuit.numQubits; q++) {
+            rotateX(vec, q, .2*q + .1);
+            rotateZ(vec, q, .4*q - .3);
+        }
+        cloneQureg(vecOpt, vec);
+        initPureState(mat, vec);
+        applyOneQubitDepolariseError(mat, 1, .1);
+        cloneQureg(matOpt, mat);
+    } else {
+        initClassicalState(vec, inputInd);
+        initClassicalState(mat, inputInd);
+        initClassicalState(vecOpt, optimisedInd);
+        initClassicalState(matOpt, optimisedInd);
+    }
+    runCircuit(circuit, vec);
+    runCircuit(circuit, mat);
+    runCircuit(optimised, vecOpt);
+    runCircuit(optimised, matOpt);
+    int passed = compareStates(vec, vecOpt, COMPARE_PRECISION);
+    if (passed) passed = compareStates(mat, matOpt, COMPARE_PRECISION);
+
+    destroyQureg(vec, env);
+    destroyQureg(vecOpt, env);
+    destroyQureg(mat, env);
+    destroyQureg(matOpt, env);
+    return passed;
+}
+
+int test_optimiseCircuit(char testName[200]) {
+    int passed=1;
+    int numQubits=6;
+
+    // each pass upon a circuit it should shorten: {gates before, after, sweeps before, after}
+    void (*recorders[4])(Circuit) = {
+        recordCancellingCircuit, recordMergingCircuit, recordConjugatedCircuit, recordDiagonalCircuit};
+    CircuitPassStats (*passes[4])(Circuit) = {
+        cancelCircuitInversePairs, mergeCircuitRotations, rewriteCircuitConjugatedControls, commuteCircuitDiagonals};
+    int expected[4][4] = {{66, 6, 46, 6}, {14, 9, 12, 9}, {28, 15, 28, 15}, {9, 9, 9, 7}};
+
+    for (int i=0; i < 4; i++) {
+        Circuit circuit = createCircuit(numQubits);
+        Circuit optimised = createCircuit(numQubits);
+        recorders[i](circuit);
+        recorders[i](optimised);
+        CircuitPassStats stats = passes[i](optimised);
+        if (passed) passed = (stats.numGatesBefore == expected[i][0] && stats.numGatesAfter == expected[i][1]);
+        if (passed) passed = (stats.numSweepsBefore == expected[i][2] && stats.numSweepsAfter == expected[i][3]);
+        if (passed) passed = (getNumCircuitGates(optimised) == expected[i][1]);
+        if (passed) passed = compareOptimisedCircuits(circuit, optimised, -1, -1);
+
+        // the passes together do at least as well as each alone
+        if (passed) passed = (optimiseCircuit(circuit).numGatesAfter <= expected[i][1]);
+        destroyCircuit(circuit);
+        destroyCircuit(optimised);
+    }
+
+    // specialising to an input folds the leading X gates into it, and removes a dead gate
+    Circuit circuit = createCircuit(numQubits);
+    Circuit optimised = createCircuit(numQubits);
+    recordConstantsCircuit(circuit);
+    recordConstantsCircuit(optimised);
+    long long int inputInd = 0;
+    CircuitPassStats stats = propagateCircuitConstants(optimised, &inputInd);
+    if (passed) passed = (stats.numGatesBefore == 9 && stats.numGatesAfter == 4 && inputInd == 6);
+    if (passed) passed = compareOptimisedCircuits(circuit, optimised, 0, inputInd);
+    destroyCircuit(circuit);
+    destroyCircuit(optimised);
+
+    return passed;
+}
+
+/** records a circuit with fixed and parameterised diagonal runs and rotations */
+void recordCacheTestCircuit(Circuit circuit, int slot, qreal angle) {
+    for (int q=0; q < 5; q++)
+        circuitHadamard(circuit, q);
+    circuitTGate(circuit, 1);
+    circuitSGate(circuit, 2);
+    circuitControlledPhaseShift(circuit, 1, 3, .6);
+    circuitRotateZ(circuit, 0, -.7);
+    circuitRotateX(circuit, 2, angle);
+    circuitControlledRotateY(circuit, 0, 4, 1.3);
+    circuitParamRotateZ(circuit, 3, slot);
+    circuitControlledPhaseFlip(circuit, 3, 4);
+    circuitTGate(circuit, 0);
+    circuitRotateAroundAxis(circuit, 1, .8, (Vector) {.x=1, .y=2, .z=-.5});
+    circuitMultiControlledPhaseFlip(circuit, (int[]) {0, 1, 2, 3, 4}, 5);
+    circuitParamRotateX(circuit, 4, slot);
+}
+
+/** the gates of recordCacheTestCircuit, applied directly */
+void applyCacheTestCircuit(Qureg qureg, qreal slotValue, qreal angle) {
+    for (int q=0; q < 5; q++)
+        hadamard(qureg, q);
+    tGate(qureg, 1);
+    sGate(qureg, 2);
+    controlledPhaseShift(qureg, 1, 3, .6);
+    rotateZ(qureg, 0, -.7);
+    rotateX(qureg, 2, angle);
+    controlledRotateY(qureg, 0, 4, 1.3);
+    rotateZ(qureg, 3, slotValue);
+    controlledPhaseFlip(qureg, 3, 4);
+    tGate(qureg, 0);
+    rotateAroundAxis(qureg, 1, .8, (Vector) {.x=1, .y=2, .z=-.5});
+    multiControlledPhaseFlip(qureg, (int[]) {0, 1, 2, 3, 4}, 5);
+    rotateX(qureg, 4, slotValue);
+}
+
+int test_circuitCache(char testName[200]) {
+    int passed=1;
+    int numQubits=5;
+
+    // identically recorded circuits share a hash, which ignores slot values but not fixed angles
+    Circuit circA = createCircuit(numQubits);
+    Circuit circB = createCircuit(numQubits);
+    Circuit circC = createCircuit(numQubits);
+    int slotA = createCircuitParam(circA, .3);
+    int slotB = createCircuitParam(circB, -1.2);
+    int slotC = createCircuitParam(circC, .3);
+    recordCacheTestCircuit(circA, slotA, .4);
+    recordCacheTestCircuit(circB, slotB, .4);
+    recordCacheTestCircuit(circC, slotC, .5);
+    if (passed) passed = (getCircuitHash(circA) == getCircuitHash(circB));
+    if (passed) passed = (getCircuitHash(circA) != getCircuitHash(circC));
+
+    // a plan is shared by circuits of one structure, and the least recently used is evicted
+    Qureg vec, vecDirect, mat, matDirect;
+    vec = createQureg(numQubits, env);
+    vecDirect = createQureg(numQubits, env);
+    mat = createDensityQureg(numQubits, env);
+    matDirect = createDensityQureg(numQubits, env);
+    clearCircuitCache();
+    setCircuitCacheCapacity(1);
+    runCircuit(circA, vec);
+    runCircuit(circB, vec);
+    runCircuit(circC, vec);
+    runCircuit(circA, vec);
+    CircuitCacheStats stats = getCircuitCacheStats();
+    if (passed) passed = (stats.numHits == 1 && stats.numMisses == 3 && stats.numPlans == 1);
+
+    // cached plans bind the current slot values
+    setCircuitCacheCapacity(4);
+    for (int run=0; run < 3; run++) {
+        qreal value = .3 - run;
+        setCircuitParam(circA, slotA, value);
+        initClassicalState(vec, 3*run + 1);
+        rotateY(vec, run, .6);
+        cloneQureg(vecDirect, vec);
+        runCircuit(circA, vec);
+        applyCacheTestCircuit(vecDirect, value, .4);
+        if (passed) passed = compareStates(vec, vecDirect, COMPARE_PRECISION);
+    }
+
+    // plans persist in the cache directory, and are read back once evicted
+    char fileName[200];
+    sprintf(fileName, "./circuit_%016llx_densmatr.plan", getCircuitHash(circC));
+    clearCircuitCache();
+    setCircuitCacheDirectory(".");
+    initPlusState(mat);
+    applyOneQubitDepolariseError(mat, 3, .2);
+    cloneQureg(matDirect, mat);
+    runCircuit(circC, mat);
+    clearCircuitCache();
+    runCircuit(circC, mat);
+    stats = getCircuitCacheStats();
+    if (passed) passed = (stats.numMisses == 1 && stats.numDiskLoads == 1);
+    applyCacheTestCircuit(matDirect, .3, .5);
+    applyCacheTestCircuit(matDirect, .3, .5);
+    if (passed) passed = compareStates(mat, matDirect, COMPARE_PRECISION);
+
+    // a plan compiled from another circuit, but filed and stamped with a circuit's hash (as if their 
+    // hashes collided), is never used; the hash follows the 8-byte magic, version and qreal size
+    char otherFileName[200];
+    unsigned long long int hashA = getCircuitHash(circA);
+    sprintf(otherFileName, "./circuit_%016llx_densmatr.plan", hashA);
+    syncQuESTEnv(env);
+    if (env.rank == 0) {
+        rename(fileName, otherFileName);
+        FILE* planFile = fopen(otherFileName, "r+b");
+        fseek(planFile, 8 + 2*sizeof(int), SEEK_SET);
+        fwrite(&hashA, sizeof hashA, 1, planFile);
+        fclose(planFile);
+    }
+    syncQuESTEnv(env);
+    clearCircuitCache();
+    setCircuitParam(circA, slotA, .3);
+    cloneQureg(matDirect, mat);
+    runCircuit(circA, mat);
+    // (other ranks may find the file already replaced by rank 0's own compiled plan, which they may load)
+    stats = getCircuitCacheStats();
+    if (passed) passed = (stats.numMisses == 1 && (stats.numDiskLoads == 0 || env.rank != 0));
+    applyCacheTestCircuit(matDirect, .3, .4);
+    if (passed) passed = compareStates(mat, matDirect, COMPARE_PRECISION);
+    setCircuitCacheDirectory(NULL);
+    clearCircuitCache();
+    setCircuitCacheCapacity(16);
+    syncQuESTEnv(env);
+    remove(fileName);
+    remove(otherFileName);
+
+    destroyQureg(vec, env);
+    destroyQureg(vecDirect, env);
+    destroyQureg(mat, env);
+    destroyQureg(matDirect, env);
+    destroyCircuit(circA);
+    destroyCircuit(circB);
+    destroyCircuit(circC);
+    return passed;
+}
+
+int test_quregBatch(char testName[200]) {
+    int passed=1;
+    int numQubits=4;
+    int numInstances=11;
+
+    QuregBatch batch = createQuregBatch(numQubits, numInstances, env);
+    Qureg mq = createQureg(numQubits, env);
+    Qureg mqVerif = createQureg(numQubits, env);
+
+    // every instance starts from a distinct state
+    for (int b=0; b < numInstances; b++) {
+        initClassicalState(mq, b % 16);
+        rotateY(mq, b % numQubits, .1*b);
+        setBatchInstance(batch, b, mq);
+    }
+
+    qreal angles[11], moreAngles[11];
+    for (int b=0; b < numInstances; b++) {
+        angles[b] = .3*b - 1;
+        moreAngles[b] = 2 - .17*b;
+    }
+    ComplexMatrix2 u = {
+        .r0c0 = {.real=.5, .imag=.5}, .r0c1 = {.real=.5, .imag=-.5},
+        .r1c0 = {.real=.5, .imag=-.5}, .r1c1 = {.real=.5, .imag=.5}};
+    int controls[2] = {0, 3};
+
+    // the last gate acts only upon every third instance
+    int isActive[11];
+    for (int b=0; b < numInstances; b++)
+        isActive[b] = (b % 3 == 0);
+
+    batchHadamard(batch, 0);
+    batchPauliY(batch, 2);
+    batchTGate(batch, 1);
+    batchRotateX(batch, 3, angles);
+    batchControlledRotateY(batch, 0, 2, moreAngles);
+    batchControlledPhaseShift(batch, 1, 3, angles);
+    batchMultiControlledUnitary(batch, controls, 2, 1, u);
+    batchControlledNot(batch, 3, 0);
+    setBatchActiveInstances(batch, isActive);
+    batchRotateZ(batch, 2, moreAngles);
+    setBatchActiveInstances(batch, NULL);
+
+    qreal probs[11], totals[11];
+    batchCalcProbOfOutcome(batch, 2, 1, probs);
+    batchCalcTotalProb(batch, totals);
+
+    for (int b=0; b < numInstances; b++) {
+        initClassicalState(mqVerif, b % 16);
+        rotateY(mqVerif, b % numQubits, .1*b);
+        hadamard(mqVerif, 0);
+        pauliY(mqVerif, 2);
+        tGate(mqVerif, 1);
+        rotateX(mqVerif, 3, angles[b]);
+        controlledRotateY(mqVerif, 0, 2, moreAngles[b]);
+        controlledPhaseShift(mqVerif, 1, 3, angles[b]);
+        multiControlledUnitary(mqVerif, controls, 2, 1, u);
+        controlledNot(mqVerif, 3, 0);
+        if (isActive[b])
+            rotateZ(mqVerif, 2, moreAngles[b]);
+
+        copyBatchInstance(batch, b, mq);
+        if (passed) passed = compareStates(mq, mqVerif, COMPARE_PRECISION);
+        if (passed) passed = compareReals(probs[b], calcProbOfOutcome(mqVerif, 2, 1), COMPARE_PRECISION);
+        if (passed) passed = compareReals(totals[b], 1, COMPARE_PRECISION);
+    }
+
+    // amplitudes are read back per instance, and classical initialisation is per instance
+    long long int stateInds[11];
+    for (int b=0; b < numInstances; b++)
+        stateInds[b] = (5*b) % 16;
+    initBatchClassicalStates(batch, stateInds);
+    batchPauliX(batch, 1);
+    for (int b=0; b < numInstances; b++) {
+        Complex amp = getBatchAmp(batch, b, stateInds[b] ^ 2);
+        if (passed) passed = compareReals(amp.real, 1, COMPARE_PRECISION);
+    }
+
+    destroyQuregBatch(batch, env);
+    destroyQureg(mq, env);
+    destroyQureg(mqVerif, env);
+    return passed;
+}
+
+/** measures two qubits of a register seeded with keys identifying it, in four rounds of a shared
+ * circuit and noise, packing the outcomes into the returned bits, for test_concurrentQuregs
+ */
+int runSeededRegister(Circuit circuit, int id) {
+    Qureg qureg = createQureg(circuit.numQubits, env);
+    unsigned long int keys[2] = {31415, (unsigned long int) id};
+    seedQureg(qureg, keys, 2);
+
+    int outcomes = 0;
+    for (int round=0; round < 4; round++) {
+        runCircuit(circuit, qureg);
+        applyOneQubitDepolariseError(qureg, round % 3, .3);
+        outcomes |= measure(qureg, round % 3) << (2*round);
+        outcomes |= measure(qureg, 3) << (2*round + 1);
+    }
+    destroyQureg(qureg, env);
+    return outcomes;
+}
+
+int test_concurrentQuregs(char testName[200]) {
+    int passed=1;
+    int numRegisters=256;
+
+    Circuit circuit = createCircuit(4);
+    circuitHadamard(circuit, 0);
+    circuitControlledRotateY(circuit, 0, 3, .8);
+    circuitRotateX(circuit, 1, 1.1);
+    circuitControlledNot(circuit, 1, 2);
+    circuitTGate(circuit, 2);
+    circuitHadamard(circuit, 3);
+
+    // registers run concurrently (in multithreaded, single-node builds) draw only from their own generators
+    int* concurrent = malloc(numRegisters * sizeof *concurrent);
+    int r;
+# ifdef _OPENMP
+# pragma omp parallel for schedule(dynamic) if(env.numRanks == 1)
+# endif
+    for (r=0; r < numRegisters; r++)
+        concurrent[r] = runSeededRegister(circuit, r);
+
+    // so each matches the same register run alone, and differently seeded registers differ
+    int numDistinct = 0;
+    for (r=0; r < numRegisters; r++) {
+        if (passed) passed = (concurrent[r] == runSeededRegister(circuit, r));
+        if (concurrent[r] != concurrent[0])
+            numDistinct++;
+    }
+    if (passed) passed = (numDistinct > 0);
+
+    free(concurrent);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+/** a phase flip conditioned on some of its qubits being 0, which optimiseCircuit absorbs into one gate */
+void recordFlippedPhaseFlip(Circuit circuit) {
+    int qubits[7] = {0, 1, 2, 3, 4, 5, 6};
+    for (int q=0; q < 7; q++)
+        circuitHadamard(circuit, q);
+    for (int q=0; q < 7; q += 2)
+        circuitPauliX(circuit, q);
+    circuitMultiControlledPhaseFlip(circuit, qubits, 7);
+    for (int q=0; q < 7; q += 2)
+        circuitPauliX(circuit, q);
+    circuitRotateY(circuit, 3, .7);
+}
+
+int test_concurrentFlippedGate(char testName[200]) {
+    int passed=1;
+    int numQubits=7;
+    int numRuns=16;
+
+    // the flipped gate has 6 controls, too wide to tabulate, so is run between X gates
+    Circuit circuit = createCircuit(numQubits);
+    recordFlippedPhaseFlip(circuit);
+    optimiseCircuit(circuit);
+    if (passed) passed = (getNumCircuitGates(circuit) == 9);
+
+    Qureg expected = createDensityQureg(numQubits, env);
+    for (int run=0; run < numRuns; run++) {
+        for (int q=0; q < numQubits; q++)
+            hadamard(expected, q);
+        for (int q=0; q < numQubits; q += 2)
+            pauliX(expected, q);
+        multiControlledPhaseFlip(expected, (int[]) {0, 1, 2, 3, 4, 5, 6}, numQubits);
+        for (int q=0; q < numQubits; q += 2)
+            pauliX(expected, q);
+        rotateY(expected, 3, .7);
+    }
+
+    // two threads running the one cached plan each apply every flip (in multithreaded, single-node builds)
+    Qureg quregs[2];
+    for (int t=0; t < 2; t++)
+        quregs[t] = createDensityQureg(numQubits, env);
+    clearCircuitCache();
+    int t;
+# ifdef _OPENMP
+# pragma omp parallel for num_threads(2) schedule(static, 1) if(env.numRanks == 1)
+# endif
+    for (t=0; t < 2; t++)
+        for (int run=0; run < numRuns; run++)
+            runCircuit(circuit, quregs[t]);
+
+    for (t=0; t < 2; t++) {
+        if (passed) passed = compareStates(quregs[t], expected, COMPARE_PRECISION);
+        destroyQureg(quregs[t], env);
+    }
+    destroyQureg(expected, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+int test_setQuregExecPolicy(char testName[200]) {
+    int passed=1;
+    int numQubits=8;
+
+    Circuit circuit = createCircuit(numQubits);
+    for (int q=0; q < numQubits; q++) {
+        circuitHadamard(circuit, q);
+        circuitRotateY(circuit, q, .3*q + .1);
+    }
+    for (int q=0; q < numQubits-1; q++) {
+        circuitControlledNot(circuit, q, q+1);
+        circuitControlledRotateX(circuit, q+1, q, .7 - .2*q);
+    }
+    circuitTGate(circuit, 2);
+
+    // an untuned environment gives every run the same fixed threshold
+    if (passed && getenv("QUEST_TUNE_EXEC_POLICY") == NULL)
+        passed = (env.policy.minAmpsPerThread == DEFAULT_MIN_AMPS_PER_THREAD);
+
+    // a register runs serially, on one thread, or on every thread without a threshold, to the same state
+    ExecPolicy policies[3] = {
+        {.maxThreads=0, .minAmpsPerThread=1LL << 30},
+        {.maxThreads=1, .minAmpsPerThread=0},
+        {.maxThreads=0, .minAmpsPerThread=1}};
+    Qureg reference = createQureg(numQubits, env);
+    if (passed) passed = (reference.policy.maxThreads == env.policy.maxThreads);
+    if (passed) passed = (reference.policy.minAmpsPerThread == env.policy.minAmpsPerThread);
+    runCircuit(circuit, reference);
+
+    for (int p=0; p < 3; p++) {
+        Qureg qureg = createQureg(numQubits, env);
+        setQuregExecPolicy(&qureg, policies[p]);
+        if (passed) passed = (qureg.policy.maxThreads == policies[p].maxThreads);
+        if (passed) passed = (qureg.policy.minAmpsPerThread == policies[p].minAmpsPerThread);
+        runCircuit(circuit, qureg);
+        hadamard(qureg, 0);
+        hadamard(qureg, 0);
+        if (passed) passed = compareStates(qureg, reference, COMPARE_PRECISION);
+        if (passed) passed = compareReals(calcTotalProb(qureg), 1, COMPARE_PRECISION);
+        destroyQureg(qureg, env);
+    }
+
+    destroyQureg(reference, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+/** the index with the lowest numBits bits of index reversed, as test_pipelinedExchange mirrors qubits */
+long long int getMirroredIndex(long long int index, int numBits) {
+    long long int mirrored = 0;
+    for (int b=0; b < numBits; b++)
+        mirrored |= ((index >> b) & 1) << (numBits - 1 - b);
+    return mirrored;
+}
+
+/** applies gates upon the upper qubits, or with mirror, the same gates upon the mirrored (lower) qubits */
+void applyMirroredGates(Qureg qureg, int mirror) {
+    int n = qureg.numQubitsRepresented;
+    int q[4];
+    for (int k=0; k < 4; k++)
+        q[k] = (mirror)? k : n - 1 - k;
+
+    hadamard(qureg, q[0]);
+    pauliX(qureg, q[1]);
+    pauliY(qureg, q[0]);
+    rotateX(qureg, q[1], .3);
+    compactUnitary(qureg, q[0], (Complex) {.real=.6, .imag=0}, (Complex) {.real=0, .imag=.8});
+    unitary(qureg, q[1], getGateTestMatrix());
+    controlledNot(qureg, q[3], q[0]);
+    controlledPauliY(qureg, q[2], q[1]);
+    controlledRotateY(qureg, q[3], q[0], -.7);
+    controlledUnitary(qureg, q[0], q[1], getGateTestMatrix());
+    multiControlledUnitary(qureg, (int[]) {q[2], q[3]}, 2, q[0], getGateTestMatrix());
+    controlledNot(qureg, q[1], q[0]);
+    controlledPauliY(qureg, q[0], q[1]);
+    controlledCompactUnitary(qureg, q[1], q[0], (Complex) {.real=0, .imag=.6}, (Complex) {.real=.8, .imag=0});
+    multiControlledUnitary(qureg, (int[]) {q[1], q[2], q[3]}, 3, q[0], getGateTestMatrix());
+}
+
+/** initialises a state-vector to an arbitrary fixed state, or with mirror, to that state with its qubits mirrored */
+void initMirroredState(Qureg qureg, int mirror) {
+    int n = qureg.numQubitsRepresented;
+    long long int numAmps = 1LL << n;
+    qreal* reals = malloc(2 * numAmps * sizeof *reals);
+    qreal* imags = &reals[numAmps];
+    qreal norm = 0;
+    for (long long int i=0; i < numAmps; i++) {
+        long long int j = (mirror)? getMirroredIndex(i, n) : i;
+        reals[j] = (i%7) + 1;
+        imags[j] = (i%5) - 2;
+        norm += reals[j]*reals[j] + imags[j]*imags[j];
+    }
+    for (long long int i=0; i < numAmps; i++) {
+        reals[i] /= sqrt(norm);
+        imags[i] /= sqrt(norm);
+    }
+    initStateFromAmps(qureg, reals, imags);
+    free(reals);
+}
+
+int test_pipelinedExchange(char testName[200]) {
+    int passed=1;
+    int numQubits=15;
+    int numDensityQubits=8;
+    long long int numAmps = 1LL << numQubits;
+    long long int numPureAmps = 1LL << numDensityQubits;
+
+    // registers large enough that gates on their upper qubits exchange their chunks in several slices,
+    // and their mirror images, which apply the same gates to their lower qubits without exchanging
+    Qureg vecs[2], mats[2], pures[2];
+    for (int m=0; m < 2; m++) {
+        vecs[m] = createQureg(numQubits, env);
+        initMirroredState(vecs[m], m);
+        pures[m] = createQureg(numDensityQubits, env);
+        initMirroredState(pures[m], m);
+        mats[m] = createDensityQureg(numDensityQubits, env);
+        initPureState(mats[m], pures[m]);
+        applyMirroredGates(vecs[m], m);
+        applyMirroredGates(mats[m], m);
+    }
+
+    for (long long int i=0; passed && i < numAmps; i++) {
+        Complex amp = getAmp(vecs[0], i);
+        Complex mirrored = getAmp(vecs[1], getMirroredIndex(i, numQubits));
+        passed = compareReals(amp.real, mirrored.real, COMPARE_PRECISION)
+            && compareReals(amp.imag, mirrored.imag, COMPARE_PRECISION);
+    }
+    for (long long int r=0; passed && r < numPureAmps; r++) {
+        for (long long int c=0; passed && c < numPureAmps; c++) {
+            Complex amp = getDensityAmp(mats[0], r, c);
+            Complex mirrored = getDensityAmp(mats[1], 
+                getMirroredIndex(r, numDensityQubits), getMirroredIndex(c, numDensityQubits));
+            passed = compareReals(amp.real, mirrored.real, COMPARE_PRECISION)
+                && compareReals(amp.imag, mirrored.imag, COMPARE_PRECISION);
+        }
+    }
+
+    for (int m=0; m < 2; m++) {
+        destroyQureg(vecs[m], env);
+        destroyQureg(mats[m], env);
+        destroyQureg(pures[m], env);
+    }
+    return passed;
+}
+
+/** the gates of the circuit recorded in test_remappedCircuit, applied directly */
+void applyRemapTestGates(Qureg qureg, qreal angle) {
+    int n = qureg.numQubitsRepresented;
+    for (int q=0; q < n; q++)
+        hadamard(qureg, q);
+    for (int layer=0; layer < 3; layer++) {
+        rotateX(qureg, n-1, .3 + layer);
+        controlledNot(qureg, 0, n-2);
+        unitary(qureg, n-1, getGateTestMatrix());
+        controlledPhaseShift(qureg, n-1, 1, .7);
+        tGate(qureg, n-2);
+        multiControlledPhaseShift(qureg, (int[]) {0, n-2, n-1}, 3, -.4);
+        rotateY(qureg, n-2, angle);
+        controlledRotateZ(qureg, n-1, 2, .5);
+        hadamard(qureg, 1);
+        controlledUnitary(qureg, n-2, n-1, getGateTestMatrix());
+        pauliY(qureg, n-1);
+    }
+}
+
+int test_remappedCircuit(char testName[200]) {
+    int passed=1;
+    int numQubits=10;
+
+    // a circuit dwelling upon the upper qubits, whose gates on a distributed register are run
+    // after relabelling those qubits to lie within each chunk
+    Circuit circuit = createCircuit(numQubits);
+    int slot = createCircuitParam(circuit, .6);
+    for (int q=0; q < numQubits; q++)
+        circuitHadamard(circuit, q);
+    for (int layer=0; layer < 3; layer++) {
+        circuitRotateX(circuit, numQubits-1, .3 + layer);
+        circuitControlledNot(circuit, 0, numQubits-2);
+        circuitUnitary(circuit, numQubits-1, getGateTestMatrix());
+        circuitControlledPhaseShift(circuit, numQubits-1, 1, .7);
+        circuitTGate(circuit, numQubits-2);
+        circuitMultiControlledPhaseShift(circuit, (int[]) {0, numQubits-2, numQubits-1}, 3, -.4);
+        circuitParamRotateY(circuit, numQubits-2, slot);
+        circuitControlledRotateZ(circuit, numQubits-1, 2, .5);
+        circuitHadamard(circuit, 1);
+        circuitControlledUnitary(circuit, numQubits-2, numQubits-1, getGateTestMatrix());
+        circuitPauliY(circuit, numQubits-1);
+    }
+
+    Qureg vec = createQureg(numQubits, env);
+    Qureg vecDirect = createQureg(numQubits, env);
+    for (int run=0; run < 2; run++) {
+        setCircuitParam(circuit, slot, .6 + run);
+        initZeroState(vec);
+        initZeroState(vecDirect);
+        runCircuit(circuit, vec);
+        applyRemapTestGates(vecDirect, .6 + run);
+
+        // the relabelling is undone by the end of the run, so amplitudes and outcomes are unchanged
+        if (passed) passed = compareStates(vec, vecDirect, COMPARE_PRECISION);
+        for (long long int i=0; passed && i < (1LL << numQubits); i += 37) {
+            Complex amp = getAmp(vec, i);
+            Complex ampDirect = getAmp(vecDirect, i);
+            passed = compareReals(amp.real, ampDirect.real, COMPARE_PRECISION)
+                && compareReals(amp.imag, ampDirect.imag, COMPARE_PRECISION);
+        }
+        for (int q=0; passed && q < numQubits; q++)
+            passed = compareReals(calcProbOfOutcome(vec, q, 1), calcProbOfOutcome(vecDirect, q, 1), COMPARE_PRECISION);
+    }
+
+    destroyQureg(vec, env);
+    destroyQureg(vecDirect, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+int test_boundedExchangeBuffer(char testName[200]) {
+    int passed=1;
+    int numQubits=10;
+
+    // a register whose chunks are exchanged through a buffer of only 64 amplitudes (in many
+    // slices, and when rearranged, in place), and another with the default buffer
+    QuESTEnv smallEnv = env;
+    smallEnv.maxExchangeBufferBytes = 64 * 2 * sizeof(qreal);
+    Qureg small = createQureg(numQubits, smallEnv);
+    Qureg reference = createQureg(numQubits, env);
+    if (passed) passed = (small.numPairAmps <= 64);
+
+    for (int m=0; m < 2; m++) {
+        initMirroredState(small, m);
+        initMirroredState(reference, m);
+        applyMirroredGates(small, m);
+        applyMirroredGates(reference, m);
+        if (passed) passed = compareStates(small, reference, COMPARE_PRECISION);
+    }
+
+    // Pauli products flipping qubits both within and beyond the chunk
+    enum pauliOpType codes[3*10] = {0};
+    qreal coeffs[3] = {.5, -1.5, 2};
+    codes[0*numQubits + numQubits-1] = PAULI_X;
+    codes[0*numQubits + 0] = PAULI_Y;
+    codes[1*numQubits + numQubits-2] = PAULI_Y;
+    codes[1*numQubits + numQubits-1] = PAULI_Z;
+    codes[1*numQubits + 3] = PAULI_X;
+    codes[2*numQubits + numQubits-1] = PAULI_X;
+    codes[2*numQubits + numQubits-2] = PAULI_X;
+    codes[2*numQubits + numQubits-3] = PAULI_X;
+    if (passed) passed = compareReals(calcExpecPauliSum(small, codes, coeffs, 3), 
+        calcExpecPauliSum(reference, codes, coeffs, 3), COMPARE_PRECISION);
+
+    // a circuit upon the upper qubits, run after relabelling them to lie within each chunk
+    Circuit circuit = createCircuit(numQubits);
+    for (int layer=0; layer < 3; layer++) {
+        circuitRotateX(circuit, numQubits-1, .3 + layer);
+        circuitControlledNot(circuit, 0, numQubits-2);
+        circuitUnitary(circuit, numQubits-1, getGateTestMatrix());
+        circuitControlledRotateZ(circuit, numQubits-1, 2, .5);
+        circuitHadamard(circuit, numQubits-3);
+    }
+    runCircuit(circuit, small);
+    runCircuit(circuit, reference);
+    if (passed) passed = compareStates(small, reference, COMPARE_PRECISION);
+
+    destroyQureg(small, smallEnv);
+    destroyQureg(reference, env);
+    destroyCircuit(circuit);
+    return passed;
+}
+
+int test_quregCheckpoint(char testName[200]) {
+    int passed=1;
+    int numQubits=10;
+    int numDensityQubits=5;
+    long long int numAmps = 1LL << numQubits;
+    char fileName[200];
+
+    // a state-vector and density matrix restored from the checkpoints of each rank's chunk
+    Qureg vec = createQureg(numQubits, env);
+    Qureg vecLoaded = createQureg(numQubits, env);
+    Qureg pure = createQureg(numDensityQubits, env);
+    Qureg mat = createDensityQureg(numDensityQubits, env);
+    Qureg matLoaded = createDensityQureg(numDensityQubits, env);
+    initMirroredState(vec, 0);
+    applyMirroredGates(vec, 0);
+    initMirroredState(pure, 1);
+    initPureState(mat, pure);
+    applyOneQubitDepolariseError(mat, numDensityQubits-1, .2);
+
+    writeQuregCheckpoint(vec, "checkpoint_vec");
+    writeQuregCheckpoint(mat, "checkpoint_mat");
+    initStateFromCheckpoint(vecLoaded, "checkpoint_vec");
+    initStateFromCheckpoint(matLoaded, "checkpoint_mat");
+    if (passed) passed = compareStates(vec, vecLoaded, COMPARE_PRECISION);
+    if (passed) passed = compareStates(mat, matLoaded, COMPARE_PRECISION);
+
+    // a checkpoint overwritten in place describes the new chunks, and leaves no temporary manifest
+    pauliX(vecLoaded, 0);
+    writeQuregCheckpoint(vecLoaded, "checkpoint_vec");
+    initStateFromCheckpoint(vec, "checkpoint_vec");
+    if (passed) passed = compareStates(vec, vecLoaded, COMPARE_PRECISION);
+    FILE* tempManifest = fopen("checkpoint_vec.manifest.tmp", "r");
+    if (tempManifest != NULL)
+        fclose(tempManifest);
+    if (passed) passed = (tempManifest == NULL);
+
+    // a checkpoint written as a single chunk, as by one rank, is redistributed among however many read it
+    qreal* reals = malloc(2 * numAmps * sizeof *reals);
+    qreal* imags = &reals[numAmps];
+    for (long long int i=0; i < numAmps; i++) {
+        Complex amp = getAmp(vec, numAmps - 1 - i);
+        reals[i] = amp.real;
+        imags[i] = amp.imag;
+    }
+    syncQuESTEnv(env);
+    if (env.rank == 0) {
+        FILE* file = fopen("checkpoint_single_chunk_0.bin", "wb");
+        fwrite(reals, sizeof *reals, 2*numAmps, file);
+        fclose(file);
+        file = fopen("checkpoint_single.manifest", "w");
+        fprintf(file, "QuEST checkpoint\nnumQubitsRepresented %d\nisDensityMatrix 0\nnumChunks 1\nqrealBytes %d\n",
+            numQubits, (int) sizeof(qreal));
+        fclose(file);
+    }
+    syncQuESTEnv(env);
+    initStateFromCheckpoint(vecLoaded, "checkpoint_single");
+    for (long long int i=0; passed && i < numAmps; i++) {
+        Complex amp = getAmp(vecLoaded, i);
+        passed = compareReals(amp.real, reals[i], COMPARE_PRECISION)
+            && compareReals(amp.imag, imags[i], COMPARE_PRECISION);
+    }
+    free(reals);
+
+    syncQuESTEnv(env);
+    sprintf(fileName, "checkpoint_vec_chunk_%d.bin", env.rank);
+    remove(fileName);
+    sprintf(fileName, "checkpoint_mat_chunk_%d.bin", env.rank);
+    remove(fileName);
+    if (env.rank == 0) {
+        remove("checkpoint_vec.manifest");
+        remove("checkpoint_mat.manifest");
+        remove("checkpoint_single.manifest");
+        remove("checkpoint_single_chunk_0.bin");
+    }
+
+    destroyQureg(vec, env);
+    destroyQureg(vecLoaded, env);
+    destroyQureg(pure, env);
+    destroyQureg(mat, env);
+    destroyQureg(matLoaded, env);
+    return passed;
+}
+
+int test_compressedExchange(char testName[200]) {
+    int passed=1;
+    int numQubits=12;
+    int numDensityQubits=6;
+
+    // registers exchanging only the nonzero amplitudes of their slices, through the default and a
+    // tiny buffer, compared with registers exchanging every amplitude
+    QuESTEnv compressedEnvs[2] = {env, env};
+    for (int e=0; e < 2; e++) {
+        compressedEnvs[e].compressExchanges = 1;
+        compressedEnvs[e].maxExchangeBufferBytes = (e == 0)? env.maxExchangeBufferBytes : 64 * 2 * sizeof(qreal);
+    }
+    QuESTEnv referenceEnv = env;
+    referenceEnv.compressExchanges = 0;
+
+    Qureg vecRef = createQureg(numQubits, referenceEnv);
+    Qureg pureRef = createQureg(numDensityQubits, referenceEnv);
+    Qureg matRef = createDensityQureg(numDensityQubits, referenceEnv);
+    enum pauliOpType codes[2*12] = {0};
+    qreal coeffs[2] = {1, -.5};
+    codes[numQubits-1] = PAULI_X;
+    codes[numQubits + numQubits-2] = PAULI_Y;
+    codes[numQubits + 1] = PAULI_X;
+
+    for (int e=0; passed && e < 2; e++) {
+        Qureg vec = createQureg(numQubits, compressedEnvs[e]);
+        Qureg mat = createDensityQureg(numDensityQubits, compressedEnvs[e]);
+
+        // a sparse state, whose slices are compressed, then a dense one, whose slices are not
+        for (int isDense=0; passed && isDense < 2; isDense++) {
+            if (isDense) {
+                initMirroredState(vec, 0);
+                initMirroredState(vecRef, 0);
+            } else {
+                initClassicalState(vec, 5);
+                initClassicalState(vecRef, 5);
+            }
+            for (int q=numQubits-1; q >= numQubits-3; q--) {
+                hadamard(vec, q);
+                hadamard(vecRef, q);
+            }
+            applyMirroredGates(vec, 0);
+            applyMirroredGates(vecRef, 0);
+            if (passed) passed = compareStates(vec, vecRef, COMPARE_PRECISION);
+            if (passed) passed = compareReals(calcExpecPauliSum(vec, codes, coeffs, 2), 
+                calcExpecPauliSum(vecRef, codes, coeffs, 2), COMPARE_PRECISION);
+        }
+
+        initClassicalState(pureRef, 3);
+        hadamard(pureRef, numDensityQubits-1);
+        initPureState(mat, pureRef);
+        initPureState(matRef, pureRef);
+        applyMirroredGates(mat, 0);
+        applyMirroredGates(matRef, 0);
+        if (passed) passed = compareStates(mat, matRef, COMPARE_PRECISION);
+
+        destroyQureg(vec, compressedEnvs[e]);
+        destroyQureg(mat, compressedEnvs[e]);
+    }
+
+    destroyQureg(vecRef, referenceEnv);
+    destroyQureg(pureRef, referenceEnv);
+    destroyQureg(matRef, referenceEnv);
+    return passed;
+}
 
 int main (int narg, char** varg) {
     env = createQuESTEnv();
@@ -1730,6 +3335,7 @@ int main (int narg, char** varg) {
         test_controlledUnitary,
         test_multiControlledUnitary,
         test_calcProbOfOutcome,
+        test_calcProbsOfOutcomes,
         test_collapseToOutcome,
         test_measure,
         test_measureWithStats,
@@ -1737,6 +3343,8 @@ int main (int narg, char** varg) {
         test_getImagAmp,
         test_getProbAmp,
         test_calcInnerProduct,
+        test_calcInnerProducts,
+        test_calcExpecPauli,
         test_calcFidelity,
         test_addDensityMatrix,
         test_calcPurity,
@@ -1745,6 +3353,23 @@ int main (int narg, char** varg) {
         test_applyOneQubitDepolariseError,
         test_applyTwoQubitDephaseError,
         test_applyTwoQubitDepolariseError,
+        test_applyKrausMap,
+        test_calcTrajectoryAverages,
+        test_densityMatrixGates,
+        test_ddQureg,
+        test_runCircuit,
+        test_calcExpecPauliSumGradient,
+        test_optimiseCircuit,
+        test_circuitCache,
+        test_quregBatch,
+        test_concurrentQuregs,
+        test_concurrentFlippedGate,
+        test_setQuregExecPolicy,
+        test_pipelinedExchange,
+        test_remappedCircuit,
+        test_boundedExchangeBuffer,
+        test_quregCheckpoint,
+        test_compressedExchange,
     };
 
     char testNames[NUM_TESTS][200] = {
@@ -1771,6 +3396,7 @@ int main (int narg, char** varg) {
         "controlledUnitary",
         "multiControlledUnitary",
         "calcProbOfOutcome",
+        "calcProbsOfOutcomes",
         "collapseToOutcome",
         "measure",
         "measureWithStats",
@@ -1778,6 +3404,8 @@ int main (int narg, char** varg) {
         "getImagAmp",
         "getProbAmp",
         "calcInnerProduct",
+        "calcInnerProducts",
+        "calcExpecPauli",
         "calcFidelity",
         "addDensityMatrix",
         "calcPurity",
@@ -1786,6 +3414,23 @@ int main (int narg, char** varg) {
         "applyOneQubitDepolariseError",
         "applyTwoQubitDephaseError",
         "applyTwoQubitDepolariseError",
+        "applyKrausMap",
+        "calcTrajectoryAverages",
+        "densityMatrixGates",
+        "ddQureg",
+        "runCircuit",
+        "calcExpecPauliSumGradient",
+        "optimiseCircuit",
+        "circuitCache",
+        "quregBatch",
+        "concurrentQuregs",
+        "concurrentFlippedGate",
+        "setQuregExecPolicy",
+        "pipelinedExchange",
+        "remappedCircuit",
+        "boundedExchangeBuffer",
+        "quregCheckpoint",
+        "compressedExchange",
     };
     int passed=0;
     if (env.rank==0) printf("\nRunning unit tests\n");
@@ -36,9 +36,13 @@ printf "============================\n\n"
 
 # run the unit tests
 distributed=$(make SUPPRESS_WARNING=1 getvalue-DISTRIBUTED SILENT=1 --silent)
+sharedmemory=$(make SUPPRESS_WARNING=1 getvalue-SHARED_MEMORY SILENT=1 --silent)
 if [ $distributed == 0 ]
 then
     ./runTests
+elif [ $sharedmemory == 1 ]
+then
+    QUEST_SHM_RANKS=$MPI_HOSTS ./runTests
 else
     mpirun -np $MPI_HOSTS ./runTests
 fi